@@ -0,0 +1,1034 @@
+/*
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS HEADER.
+ *
+ * Copyright 2024 Mike Becker - All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Throughput benchmark for all backends.
+ *
+ * Every backend is a build of ec_glob.c (or ec_glob_ref.c) with its own
+ * symbol prefix, so that all of them can be linked into this program and
+ * run against the same generated corpus.
+ */
+
+// for nftw()
+#define _XOPEN_SOURCE 700
+
+#include "ec_glob.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#define BENCH_DECLARE(prefix) \
+    int prefix##ec_glob(const char *pattern, const char *string); \
+    int prefix##ec_glob_compile(ec_glob_t **glob, const char *pattern); \
+    int prefix##ec_glob_exec(const ec_glob_t *glob, const char *string); \
+    void prefix##ec_glob_free(ec_glob_t *glob); \
+    int prefix##ec_glob_match_batch(const char *pattern, const char *blob, \
+            const size_t *offsets, size_t count, unsigned char *matches); \
+    int prefix##ec_glob_set_compile(ec_glob_set_t **set, \
+            const char * const *patterns, unsigned count); \
+    int prefix##ec_glob_set_exec(const ec_glob_set_t *set, \
+            const char *string, unsigned char *matches); \
+    void prefix##ec_glob_set_free(ec_glob_set_t *set); \
+    int prefix##ec_glob_cache_configure(unsigned max_entries, \
+            size_t max_bytes); \
+    void prefix##ec_glob_cache_clear(void);
+
+#define BENCH_BACKEND(prefix, name) { name, \
+    prefix##ec_glob, prefix##ec_glob_compile, prefix##ec_glob_exec, \
+    prefix##ec_glob_free, prefix##ec_glob_match_batch, \
+    prefix##ec_glob_set_compile, \
+    prefix##ec_glob_set_exec, prefix##ec_glob_set_free, \
+    prefix##ec_glob_cache_configure, prefix##ec_glob_cache_clear }
+
+BENCH_DECLARE(posix_)
+BENCH_DECLARE(posix_noshape_)
+BENCH_DECLARE(posix_plain_)
+BENCH_DECLARE(native_)
+BENCH_DECLARE(dfa_)
+BENCH_DECLARE(bitap_)
+BENCH_DECLARE(bitap_scalar_)
+BENCH_DECLARE(pike_)
+BENCH_DECLARE(auto_)
+// the walkers only matter for the default backend
+int posix_ec_glob_set_walk(const char *root, const ec_glob_set_t *set,
+                           ec_glob_walk_fn callback, void *data);
+int posix_ec_glob_set_walk_parallel(const char *root, const ec_glob_set_t *set,
+                                    const struct ec_glob_walk_options *options,
+                                    ec_glob_walk_fn callback, void *data);
+int posix_ec_glob_db_save(const char *path, const ec_glob_t * const *globs,
+                          unsigned glob_count,
+                          const ec_glob_set_t * const *sets,
+                          unsigned set_count);
+int posix_ec_glob_db_open(ec_glob_db_t **db, const char *path);
+int posix_ec_glob_db_set(const ec_glob_db_t *db, unsigned index,
+                         ec_glob_set_t **set);
+void posix_ec_glob_db_close(ec_glob_db_t *db);
+// the path index is compared with the engines chosen per pattern
+int auto_ec_glob_pathindex_create(ec_glob_pathindex_t **index,
+                                  const char * const *paths, size_t count);
+size_t auto_ec_glob_pathindex_size(const ec_glob_pathindex_t *index);
+void auto_ec_glob_pathindex_free(ec_glob_pathindex_t *index);
+int auto_ec_glob_pathindex_match(const ec_glob_pathindex_t *index,
+                                 const ec_glob_t *glob,
+                                 ec_glob_pathindex_fn callback, void *data);
+int auto_ec_glob_pathindex_set_match(const ec_glob_pathindex_t *index,
+                                     const ec_glob_set_t *set,
+                                     ec_glob_pathindex_fn callback,
+                                     void *data);
+// so are the precompiled sets
+int auto_ec_glob_set_precompile(ec_glob_set_t *set, unsigned max_states);
+void auto_ec_glob_set_query(const ec_glob_set_t *set,
+                            struct ec_glob_set_stats *stats);
+// and the patterns with and without the optimizer
+#define BENCH_DECLARE_ENGINES(prefix) \
+    int prefix##ec_glob_compile_using(ec_glob_t **glob, const char *pattern, \
+            const char *engine); \
+    void prefix##ec_glob_query(const ec_glob_t *glob, \
+            struct ec_glob_stats *stats);
+BENCH_DECLARE_ENGINES(auto_)
+BENCH_DECLARE(auto_noopt_)
+BENCH_DECLARE_ENGINES(auto_noopt_)
+#ifdef BENCH_PCRE
+BENCH_DECLARE(pcre_)
+int ref_ec_glob(const char *pattern, const char *string);
+#endif
+#ifdef BENCH_PCRE2
+BENCH_DECLARE(pcre2_)
+#endif
+
+struct bench_backend {
+    const char *name;
+    int (*glob)(const char *, const char *);
+    int (*compile)(ec_glob_t **, const char *);
+    int (*exec)(const ec_glob_t *, const char *);
+    void (*free)(ec_glob_t *);
+    int (*match_batch)(const char *, const char *, const size_t *, size_t,
+                       unsigned char *);
+    int (*set_compile)(ec_glob_set_t **, const char * const *, unsigned);
+    int (*set_exec)(const ec_glob_set_t *, const char *, unsigned char *);
+    void (*set_free)(ec_glob_set_t *);
+    int (*cache_configure)(unsigned, size_t);
+    void (*cache_clear)(void);
+};
+
+static const struct bench_backend backends[] = {
+        BENCH_BACKEND(posix_, "posix"),
+        // show the effect of the specialized shapes and the prefilter
+        BENCH_BACKEND(posix_noshape_, "posix-noshape"),
+        BENCH_BACKEND(posix_plain_, "posix-plain"),
+#ifdef BENCH_PCRE
+        BENCH_BACKEND(pcre_, "pcre"),
+#endif
+#ifdef BENCH_PCRE2
+        // the native API with JIT for compiled and cached patterns
+        BENCH_BACKEND(pcre2_, "pcre2-jit"),
+#endif
+        BENCH_BACKEND(native_, "native"),
+        BENCH_BACKEND(dfa_, "dfa"),
+        BENCH_BACKEND(bitap_, "bitap"),
+        // the lanes of the batches without SIMD instructions
+        BENCH_BACKEND(bitap_scalar_, "bitap-scalar"),
+        BENCH_BACKEND(pike_, "pike"),
+        // the engine chosen for each pattern
+        BENCH_BACKEND(auto_, "auto"),
+#ifdef BENCH_PCRE
+        // the reference implementation only has the one-shot API
+        { .name = "ref", .glob = ref_ec_glob },
+#endif
+};
+static const unsigned backend_count = sizeof(backends) / sizeof(backends[0]);
+
+/*
+ * Typical section headers of .editorconfig files, already in the form in
+ * which an EditorConfig core passes them to ec_glob().
+ */
+static const char *patterns[] = {
+        "**/*",
+        "**/*.{c,h}",
+        "**/*.{cpp,hpp,cc,hh}",
+        "**/*.py",
+        "**/*.{js,ts,json}",
+        "**/*.md",
+        "**/Makefile",
+        "**/{package.json,.travis.yml}",
+        "**/*.{yml,yaml}",
+        "src/**/*.[ch]",
+        "lib/**.js",
+        "docs/**/*.{md,txt}",
+        "**/test_*.py",
+        "**/*.orig.{0..9}",
+        "**/[!.]*.sh",
+};
+#define PATTERN_COUNT (sizeof(patterns) / sizeof(patterns[0]))
+
+/*
+ * Allocation counting.
+ * The allocator of the C library is replaced, so that allocations of the
+ * regex libraries are counted as well.
+ */
+// the walker threads allocate concurrently
+static atomic_ulong bench_allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#endif
+
+/*
+ * The corpus is a generated source tree.
+ * A fixed seed makes it identical for every run.
+ */
+static char **paths;
+static unsigned path_count;
+
+// the same paths packed into one blob for the batch API
+static char *blob;
+static size_t *offsets;
+static unsigned char *bitmap;
+
+static unsigned bench_random(unsigned *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void generate_paths(unsigned count) {
+    static const char *dirs[] = {
+            "src", "lib", "include", "test", "docs", "tools", "build",
+            "vendor", "scripts", "app", "core", "util", "net", "ui", "data",
+            "examples", "third_party", "internal", "test", "src"
+    };
+    static const char *names[] = {
+            "main", "util", "config", "index", "parser", "lexer", "server",
+            "client", "test_io", "test_parser", "README", "CHANGELOG",
+            "helpers", "types", "api", "build", ".hidden", "setup"
+    };
+    static const char *exts[] = {
+            ".c", ".h", ".c", ".h", ".cpp", ".hpp", ".py", ".py", ".js",
+            ".ts", ".json", ".md", ".txt", ".yml", ".yaml", ".go", ".rs",
+            ".java", ".sh", ".html", ".css", ".orig.3", ".orig.12", ""
+    };
+    static const char *specials[] = {
+            "Makefile", "package.json", ".travis.yml", ".editorconfig"
+    };
+#define BENCH_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+    unsigned seed = 4711;
+    paths = malloc(count * sizeof(char *));
+    path_count = count;
+    for (unsigned i = 0 ; i < count ; i++) {
+        char buf[256];
+        size_t len = 0;
+        unsigned depth = bench_random(&seed) % 6;
+        for (unsigned d = 0 ; d < depth ; d++) {
+            len += snprintf(buf + len, sizeof(buf) - len, "%s/",
+                    dirs[bench_random(&seed) % BENCH_SIZE(dirs)]);
+        }
+        if (bench_random(&seed) % 16 == 0) {
+            snprintf(buf + len, sizeof(buf) - len, "%s",
+                    specials[bench_random(&seed) % BENCH_SIZE(specials)]);
+        } else {
+            const char *name = names[bench_random(&seed) % BENCH_SIZE(names)];
+            const char *ext = exts[bench_random(&seed) % BENCH_SIZE(exts)];
+            snprintf(buf + len, sizeof(buf) - len, "%s%u%s",
+                    name, bench_random(&seed) % 100, ext);
+        }
+        paths[i] = strdup(buf);
+    }
+
+    size_t total = 0;
+    for (unsigned i = 0 ; i < count ; i++) {
+        total += strlen(paths[i]);
+    }
+    blob = malloc(total);
+    offsets = malloc((count + 1) * sizeof(size_t));
+    bitmap = malloc((count + 7) / 8);
+    offsets[0] = 0;
+    for (unsigned i = 0 ; i < count ; i++) {
+        size_t len = strlen(paths[i]);
+        memcpy(blob + offsets[i], paths[i], len);
+        offsets[i + 1] = offsets[i] + len;
+    }
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct bench_result {
+    const char *backend;
+    const char *api;
+    const char *pattern;
+    unsigned long calls;
+    unsigned long matches;
+    double ns;
+    unsigned long allocs;
+};
+
+static FILE *json;
+static unsigned result_count;
+
+static void report(const struct bench_result *r) {
+    double ns_per_match = r->ns / r->calls;
+    double allocs_per_call = (double) r->allocs / r->calls;
+    printf("%-13s %-9s %-32s %10.1f %14.0f %10.2f\n",
+           r->backend, r->api, r->pattern, ns_per_match,
+           1e9 / ns_per_match, allocs_per_call);
+    if (json != NULL) {
+        fprintf(json, "%s\n  {\"backend\": \"%s\", \"api\": \"%s\", "
+                "\"pattern\": \"%s\", \"calls\": %lu, \"matches\": %lu, "
+                "\"ns_per_match\": %.1f, \"matches_per_sec\": %.0f, "
+                "\"allocs_per_call\": %.2f}",
+                result_count > 0 ? "," : "", r->backend, r->api, r->pattern,
+                r->calls, r->matches, ns_per_match, 1e9 / ns_per_match,
+                allocs_per_call);
+    }
+    result_count++;
+}
+
+/*
+ * Runs one pattern through one API of a backend.
+ * The one-shot APIs only get every stride-th path, because they are orders
+ * of magnitude slower.
+ */
+static int bench_pattern(const struct bench_backend *b, const char *api,
+                         unsigned p, unsigned stride, unsigned long *matches) {
+    const char *pattern = patterns[p];
+    struct bench_result r = {
+            .backend = b->name, .api = api, .pattern = pattern
+    };
+
+    unsigned long allocs = bench_allocs;
+    double start = now_ns();
+    if (strcmp(api, "compiled") == 0) {
+        // the compilation is part of the measurement
+        ec_glob_t *glob;
+        if (b->compile(&glob, pattern)) {
+            fprintf(stderr, "%s: failed to compile %s\n", b->name, pattern);
+            return 1;
+        }
+        for (unsigned i = 0 ; i < path_count ; i += stride) {
+            r.matches += b->exec(glob, paths[i]) == 0;
+            r.calls++;
+        }
+        b->free(glob);
+    } else if (strcmp(api, "batch") == 0) {
+        if (b->match_batch(pattern, blob, offsets, path_count, bitmap)) {
+            fprintf(stderr, "%s: failed to compile %s\n", b->name, pattern);
+            return 1;
+        }
+        for (unsigned i = 0 ; i < path_count ; i++) {
+            r.matches += (bitmap[i / 8] >> (i % 8)) & 1;
+        }
+        r.calls = path_count;
+    } else {
+        for (unsigned i = 0 ; i < path_count ; i += stride) {
+            r.matches += b->glob(pattern, paths[i]) == 0;
+            r.calls++;
+        }
+    }
+    r.ns = now_ns() - start;
+    r.allocs = bench_allocs - allocs;
+
+    report(&r);
+    *matches = r.matches;
+    return 0;
+}
+
+// evaluates all patterns for every path with a single set
+static int bench_set(const struct bench_backend *b, unsigned long *matches) {
+    struct bench_result r = {
+            .backend = b->name, .api = "set", .pattern = "(all patterns)"
+    };
+
+    unsigned long allocs = bench_allocs;
+    double start = now_ns();
+    ec_glob_set_t *set;
+    if (b->set_compile(&set, patterns, PATTERN_COUNT)) {
+        fprintf(stderr, "%s: failed to compile the set\n", b->name);
+        return 1;
+    }
+    for (unsigned i = 0 ; i < path_count ; i++) {
+        unsigned char bits[(PATTERN_COUNT + 7) / 8];
+        r.matches += b->set_exec(set, paths[i], bits);
+        r.calls++;
+    }
+    b->set_free(set);
+    r.ns = now_ns() - start;
+    r.allocs = bench_allocs - allocs;
+
+    report(&r);
+    *matches = r.matches;
+    return 0;
+}
+
+/*
+ * Writes the corpus as empty files below root.
+ * Returns the number of distinct files.
+ */
+static unsigned write_tree(const char *root) {
+    unsigned files = 0;
+    for (unsigned i = 0 ; i < path_count ; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", root, paths[i]);
+        for (char *slash = strchr(path + strlen(root) + 1, '/') ;
+             slash != NULL ; slash = strchr(slash + 1, '/')) {
+            *slash = '\0';
+            mkdir(path, 0700);
+            *slash = '/';
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            close(fd);
+            files++;
+        }
+    }
+    return files;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+    (void) st;
+    (void) flag;
+    (void) ftw;
+    return remove(path);
+}
+
+static int count_walked(const char *path, const unsigned char *matches,
+                        void *data) {
+    (void) path;
+    (void) matches;
+    ++*(unsigned long *) data;
+    return 0;
+}
+
+/*
+ * Walks the corpus on disk with all patterns, first sequentially and then
+ * with 1 to max_threads threads, doubling the count every time.
+ * Every file counts as one call, so the numbers are per file of the tree.
+ */
+static int bench_walk(unsigned max_threads) {
+    char root[] = "/tmp/ec_glob_bench_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    unsigned files = write_tree(root);
+
+    ec_glob_set_t *set;
+    if (posix_ec_glob_set_compile(&set, patterns, PATTERN_COUNT)) {
+        fprintf(stderr, "posix: failed to compile the set\n");
+        nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+
+    // warm up the directory cache of the kernel
+    unsigned long expected = 0;
+    int status = posix_ec_glob_set_walk(root, set, count_walked, &expected);
+
+    unsigned threads = 0;
+    while (status == 0) {
+        char api[sizeof("pwalk-4294967295")] = "walk";
+        if (threads > 0) snprintf(api, sizeof(api), "pwalk-%u", threads);
+        struct bench_result r = {
+                .backend = "posix", .api = api, .pattern = "(all patterns)"
+        };
+        struct ec_glob_walk_options options = {threads, 0};
+        unsigned long allocs = bench_allocs;
+        double start = now_ns();
+        status = threads == 0
+                ? posix_ec_glob_set_walk(root, set, count_walked, &r.matches)
+                : posix_ec_glob_set_walk_parallel(root, set, &options,
+                                                  count_walked, &r.matches);
+        r.ns = now_ns() - start;
+        r.allocs = bench_allocs - allocs;
+        r.calls = files;
+        if (status != 0) {
+            perror(root);
+        } else if (r.matches != expected) {
+            fprintf(stderr, "posix: result mismatch for %s\n", api);
+            status = 1;
+        } else {
+            report(&r);
+        }
+        if (threads >= max_threads) break;
+        threads = threads == 0 ? 1 : threads * 2;
+        if (threads > max_threads) threads = max_threads;
+    }
+
+    posix_ec_glob_set_free(set);
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return status != 0;
+}
+
+/*
+ * Compares the time to the first match of many sets, like the sections of
+ * the configuration files of many repositories, when they are compiled
+ * from the patterns and when they are loaded from a database.
+ */
+static int bench_db(unsigned set_count) {
+    char path[] = "/tmp/ec_glob_bench_db_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    // every set gets its own directory prefix
+    const unsigned count = PATTERN_COUNT;
+    char **sources = malloc(set_count * count * sizeof(char *));
+    for (unsigned s = 0 ; s < set_count ; s++) {
+        for (unsigned p = 0 ; p < count ; p++) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "repo%u/%s", s, patterns[p]);
+            sources[s * count + p] = strdup(buf);
+        }
+    }
+    ec_glob_set_t **sets = malloc(set_count * sizeof(ec_glob_set_t *));
+
+    struct bench_result r = {
+            .backend = "posix", .api = "source", .pattern = "(sets)"
+    };
+    unsigned long allocs = bench_allocs;
+    double start = now_ns();
+    int status = 0;
+    for (unsigned s = 0 ; s < set_count && status == 0 ; s++) {
+        unsigned char bits[(PATTERN_COUNT + 7) / 8];
+        status = posix_ec_glob_set_compile(&sets[s],
+                (const char * const *) sources + s * count, count);
+        if (status == 0) {
+            r.matches += posix_ec_glob_set_exec(sets[s],
+                                                paths[s % path_count], bits);
+        }
+    }
+    r.ns = now_ns() - start;
+    r.allocs = bench_allocs - allocs;
+    r.calls = set_count;
+    if (status != 0) {
+        fprintf(stderr, "posix: failed to compile the sets\n");
+        set_count = 0;
+    } else {
+        report(&r);
+        status = posix_ec_glob_db_save(path, NULL, 0,
+                (const ec_glob_set_t * const *) sets, set_count);
+        if (status != 0) perror(path);
+    }
+    for (unsigned s = 0 ; s < set_count ; s++) {
+        posix_ec_glob_set_free(sets[s]);
+    }
+
+    if (status == 0) {
+        // the file was just written, so it is in the page cache
+        struct bench_result d = {
+                .backend = "posix", .api = "db", .pattern = "(sets)"
+        };
+        allocs = bench_allocs;
+        start = now_ns();
+        ec_glob_db_t *db;
+        status = posix_ec_glob_db_open(&db, path);
+        for (unsigned s = 0 ; s < set_count && status == 0 ; s++) {
+            unsigned char bits[(PATTERN_COUNT + 7) / 8];
+            status = posix_ec_glob_db_set(db, s, &sets[s]);
+            if (status == 0) {
+                d.matches += posix_ec_glob_set_exec(sets[s],
+                        paths[s % path_count], bits);
+            }
+        }
+        d.ns = now_ns() - start;
+        d.allocs = bench_allocs - allocs;
+        d.calls = set_count;
+        if (status != 0) {
+            perror(path);
+        } else if (d.matches != r.matches) {
+            fprintf(stderr, "posix: result mismatch for the database\n");
+            status = 1;
+        } else {
+            report(&d);
+        }
+        if (db != NULL) {
+            for (unsigned s = 0 ; s < set_count ; s++) {
+                posix_ec_glob_set_free(sets[s]);
+            }
+            posix_ec_glob_db_close(db);
+        }
+    }
+
+    remove(path);
+    for (unsigned i = 0 ; i < set_count * count ; i++) {
+        free(sources[i]);
+    }
+    free(sources);
+    free(sets);
+    return status != 0;
+}
+
+static int count_indexed(size_t id, const unsigned char *matches,
+                         void *data) {
+    (void) id;
+    (void) matches;
+    (*(unsigned long *) data)++;
+    return 0;
+}
+
+/*
+ * Compares matching every path of the corpus one after another with
+ * matching the path index of the corpus, for every pattern on its own and
+ * for the set of all patterns. The times are per path.
+ */
+static int bench_pathindex(void) {
+    struct bench_result r = {
+            .backend = "auto", .api = "index", .pattern = "(build)"
+    };
+    unsigned long allocs = bench_allocs;
+    double start = now_ns();
+    ec_glob_pathindex_t *index;
+    if (auto_ec_glob_pathindex_create(&index, (const char * const *) paths,
+                                      path_count) != 0) {
+        perror("pathindex");
+        return 1;
+    }
+    r.ns = now_ns() - start;
+    r.allocs = bench_allocs - allocs;
+    r.calls = path_count;
+    report(&r);
+    size_t textlen = 0;
+    for (unsigned i = 0 ; i < path_count ; i++) {
+        textlen += strlen(paths[i]) + 1;
+    }
+    printf("index of %zu bytes for %zu bytes of paths\n",
+           auto_ec_glob_pathindex_size(index), textlen);
+
+    int status = 0;
+    for (unsigned p = 0 ; p <= PATTERN_COUNT && status == 0 ; p++) {
+        // the last round matches the set of all patterns
+        const char *name = p < PATTERN_COUNT ? patterns[p] : "(all patterns)";
+        ec_glob_t *glob = NULL;
+        ec_glob_set_t *set = NULL;
+        status = p < PATTERN_COUNT ? auto_ec_glob_compile(&glob, name)
+                : auto_ec_glob_set_compile(&set, patterns, PATTERN_COUNT);
+        if (status != 0) {
+            fprintf(stderr, "auto: failed to compile %s\n", name);
+            break;
+        }
+
+        struct bench_result naive = {
+                .backend = "auto", .api = "naive", .pattern = name
+        };
+        allocs = bench_allocs;
+        start = now_ns();
+        for (unsigned i = 0 ; i < path_count ; i++) {
+            unsigned char bits[(PATTERN_COUNT + 7) / 8];
+            naive.matches += glob != NULL ? auto_ec_glob_exec(glob, paths[i]) == 0
+                    : auto_ec_glob_set_exec(set, paths[i], bits) > 0;
+        }
+        naive.ns = now_ns() - start;
+        naive.allocs = bench_allocs - allocs;
+        naive.calls = path_count;
+        report(&naive);
+
+        struct bench_result indexed = {
+                .backend = "auto", .api = "index", .pattern = name
+        };
+        allocs = bench_allocs;
+        start = now_ns();
+        status = glob != NULL ? auto_ec_glob_pathindex_match(index, glob,
+                count_indexed, &indexed.matches)
+                : auto_ec_glob_pathindex_set_match(index, set,
+                count_indexed, &indexed.matches);
+        indexed.ns = now_ns() - start;
+        indexed.allocs = bench_allocs - allocs;
+        indexed.calls = path_count;
+        if (status != 0) {
+            perror("pathindex");
+        } else if (indexed.matches != naive.matches) {
+            fprintf(stderr, "auto: result mismatch for the index of %s\n",
+                    name);
+            status = 1;
+        } else {
+            report(&indexed);
+        }
+        auto_ec_glob_free(glob);
+        auto_ec_glob_set_free(set);
+    }
+    auto_ec_glob_pathindex_free(index);
+    return status;
+}
+
+/*
+ * Compares sets of growing size, made of the patterns below more and more
+ * directories, when their states are computed lazily and when they are
+ * precompiled into a minimized DFA. The times are per path.
+ */
+static int bench_precompile(unsigned max_states) {
+    static const char *dirs[] = {
+            "src", "lib", "include", "test", "docs", "tools", "app", "core",
+    };
+    const unsigned dir_count = sizeof(dirs) / sizeof(dirs[0]);
+    int status = 0;
+    for (unsigned copies = 1 ; copies <= 16 && status == 0 ; copies *= 4) {
+        unsigned count = copies * PATTERN_COUNT;
+        char **sources = malloc(count * sizeof(char *));
+        for (unsigned c = 0 ; c < copies ; c++) {
+            for (unsigned p = 0 ; p < PATTERN_COUNT ; p++) {
+                char buf[256];
+                if (c == 0) {
+                    snprintf(buf, sizeof(buf), "%s", patterns[p]);
+                } else if (c < dir_count) {
+                    snprintf(buf, sizeof(buf), "%s/%s", dirs[c], patterns[p]);
+                } else {
+                    snprintf(buf, sizeof(buf), "%s%u/%s", dirs[c % dir_count],
+                             c / dir_count, patterns[p]);
+                }
+                sources[c * PATTERN_COUNT + p] = strdup(buf);
+            }
+        }
+        unsigned char *bits = malloc((count + 7) / 8);
+        char name[32];
+        snprintf(name, sizeof(name), "(%u patterns)", count);
+
+        // the lazy set includes its compilation, like the set rows
+        struct bench_result lazy = {
+                .backend = "auto", .api = "set", .pattern = name
+        };
+        unsigned long allocs = bench_allocs;
+        double start = now_ns();
+        ec_glob_set_t *set;
+        status = auto_ec_glob_set_compile(&set,
+                (const char * const *) sources, count);
+        for (unsigned i = 0 ; i < path_count && status == 0 ; i++) {
+            lazy.matches += auto_ec_glob_set_exec(set, paths[i], bits);
+        }
+        lazy.ns = now_ns() - start;
+        lazy.allocs = bench_allocs - allocs;
+        lazy.calls = path_count;
+        if (status == 0) {
+            report(&lazy);
+            auto_ec_glob_set_free(set);
+            start = now_ns();
+            status = auto_ec_glob_set_compile(&set,
+                    (const char * const *) sources, count);
+        }
+        if (status == 0) {
+            status = auto_ec_glob_set_precompile(set, max_states);
+            if (status != 0) auto_ec_glob_set_free(set);
+        }
+        double compile_ns = now_ns() - start;
+        if (status != 0) {
+            fprintf(stderr, "auto: failed to compile %u patterns\n", count);
+        } else {
+            struct ec_glob_set_stats stats;
+            auto_ec_glob_set_query(set, &stats);
+            struct bench_result aot = {
+                    .backend = "auto", .api = "aot", .pattern = name
+            };
+            allocs = bench_allocs;
+            start = now_ns();
+            for (unsigned i = 0 ; i < path_count ; i++) {
+                aot.matches += auto_ec_glob_set_exec(set, paths[i], bits);
+            }
+            aot.ns = now_ns() - start;
+            aot.allocs = bench_allocs - allocs;
+            aot.calls = path_count;
+            if (aot.matches != lazy.matches) {
+                fprintf(stderr, "auto: result mismatch for %u patterns\n",
+                        count);
+                status = 1;
+            } else {
+                report(&aot);
+            }
+            if (stats.states == 0) {
+                printf("%u patterns: over the budget, matched lazily "
+                       "(%.1f ms)\n", count, compile_ns / 1e6);
+            } else {
+                printf("%u patterns: %u states, %u after minimization, "
+                       "%u labels, %u classes, %zu bytes, compiled in "
+                       "%.1f ms\n", count, stats.subset_states, stats.states,
+                       stats.labels, stats.classes, stats.bytes,
+                       compile_ns / 1e6);
+            }
+            auto_ec_glob_set_free(set);
+        }
+
+        for (unsigned i = 0 ; i < count ; i++) {
+            free(sources[i]);
+        }
+        free(sources);
+        free(bits);
+    }
+    return status;
+}
+
+/*
+ * Section headers as they are generated by tools, which list every
+ * alternative in full.
+ */
+static const char *generated_patterns[] = {
+        "{*.yaml,*.yml}",
+        "**/**/*.c",
+        "{a,{b,{c}}}",
+        "{**/*.js,**/*.jsx,**/*.ts,**/*.tsx}",
+        "{src/**/*.c,src/**/*.h,include/**/*.h}",
+        "{**/*.md,**/*.markdown,**/*.md}",
+        "**/{test_*.py,test_*.pyi,conftest.py}",
+        "{lib,lib,src}/**/**/*.{js,js,mjs}",
+};
+#define GENERATED_COUNT \
+    (sizeof(generated_patterns) / sizeof(generated_patterns[0]))
+
+/*
+ * Compares every engine on generated section headers with and without the
+ * optimizer. The times include the compilation and are per path.
+ */
+static int bench_optimizer(void) {
+    static const char *engines[] = {"regex", "native", "dfa", "bitap", "auto"};
+    const unsigned engine_count = sizeof(engines) / sizeof(engines[0]);
+    struct {
+        const char *name;
+        int (*compile_using)(ec_glob_t **, const char *, const char *);
+        void (*query)(const ec_glob_t *, struct ec_glob_stats *);
+        int (*exec)(const ec_glob_t *, const char *);
+        void (*free)(ec_glob_t *);
+    } builds[] = {
+            {"auto-noopt", auto_noopt_ec_glob_compile_using,
+             auto_noopt_ec_glob_query, auto_noopt_ec_glob_exec,
+             auto_noopt_ec_glob_free},
+            {"auto", auto_ec_glob_compile_using, auto_ec_glob_query,
+             auto_ec_glob_exec, auto_ec_glob_free},
+    };
+
+    for (unsigned p = 0 ; p < GENERATED_COUNT ; p++) {
+        const char *pattern = generated_patterns[p];
+        for (unsigned e = 0 ; e < engine_count ; e++) {
+            struct ec_glob_stats stats[2];
+            unsigned long matches[2];
+            for (unsigned b = 0 ; b < 2 ; b++) {
+                struct bench_result r = {
+                        .backend = builds[b].name, .api = engines[e],
+                        .pattern = pattern
+                };
+                unsigned long allocs = bench_allocs;
+                double start = now_ns();
+                ec_glob_t *glob;
+                if (builds[b].compile_using(&glob, pattern, engines[e])) {
+                    fprintf(stderr, "%s: failed to compile %s\n",
+                            builds[b].name, pattern);
+                    return 1;
+                }
+                for (unsigned i = 0 ; i < path_count ; i++) {
+                    r.matches += builds[b].exec(glob, paths[i]) == 0;
+                }
+                builds[b].query(glob, &stats[b]);
+                builds[b].free(glob);
+                r.ns = now_ns() - start;
+                r.allocs = bench_allocs - allocs;
+                r.calls = path_count;
+                report(&r);
+                matches[b] = r.matches;
+            }
+            if (matches[0] != matches[1]) {
+                fprintf(stderr, "auto: result mismatch for %s\n", pattern);
+                return 1;
+            }
+            printf("%s with %s: %u tokens and %zu bytes before, "
+                   "%u tokens and %zu bytes after\n", pattern, engines[e],
+                   stats[0].tokens, stats[0].bytes,
+                   stats[1].tokens, stats[1].bytes);
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n paths] [-s stride] [-o results.json] "
+            "[-w] [-t threads] [-d sets] [-i] [-a states] [-O]\n"
+            "  -n  number of generated paths (default 100000)\n"
+            "  -s  only every n-th path for the one-shot APIs (default 10)\n"
+            "  -o  write the results as JSON to the given file\n"
+            "  -w  benchmark the directory walkers on the corpus written to "
+            "disk instead\n"
+            "  -t  maximum number of walker threads (default: online "
+            "processors)\n"
+            "  -d  benchmark the cold start of the given number of sets "
+            "from a database instead\n"
+            "  -i  benchmark matching a path index of the corpus instead\n"
+            "  -a  benchmark sets precompiled within the given budget of "
+            "states (0 for the default) instead\n"
+            "  -O  benchmark generated patterns with and without the "
+            "optimizer instead\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    unsigned count = 100000;
+    unsigned stride = 10;
+    const char *output = NULL;
+    int walk = 0;
+    int pathindex = 0;
+    int optimizer = 0;
+    unsigned db_sets = 0;
+    long aot_states = -1;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1 ; i < argc ; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            count = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+            stride = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "-o") == 0) {
+            output = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+            db_sets = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            walk = 1;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            pathindex = 1;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimizer = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "-a") == 0) {
+            aot_states = strtol(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "-t") == 0) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (count == 0 || stride == 0 || threads < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (output != NULL) {
+        json = fopen(output, "w");
+        if (json == NULL) {
+            perror(output);
+            return 1;
+        }
+        fprintf(json, "{\"paths\": %u, \"stride\": %u, \"results\": [",
+                count, stride);
+    }
+
+    generate_paths(count);
+
+    printf("%-13s %-9s %-32s %10s %14s %10s\n", "backend", "api", "pattern",
+           "ns/match", "matches/sec", "allocs");
+
+    // all backends must agree on the number of matches
+    static const char *apis[] = {"oneshot", "cached", "compiled", "batch"};
+    const unsigned api_count = sizeof(apis) / sizeof(apis[0]);
+    unsigned long expected[sizeof(apis) / sizeof(apis[0])][PATTERN_COUNT];
+    unsigned long expected_set = 0;
+    int status = walk ? bench_walk(threads)
+            : db_sets > 0 ? bench_db(db_sets)
+            : pathindex ? bench_pathindex()
+            : aot_states >= 0 ? bench_precompile(aot_states)
+            : optimizer ? bench_optimizer() : 0;
+    for (unsigned k = 0 ; k < backend_count && status == 0 && !walk
+                          && db_sets == 0 && !pathindex && aot_states < 0
+                          && !optimizer ; k++) {
+        const struct bench_backend *b = &backends[k];
+        for (unsigned a = 0 ; a < api_count && status == 0 ; a++) {
+            if (a > 0 && b->compile == NULL) break;
+            if (a == 1) {
+                b->cache_configure(PATTERN_COUNT, 16 * 1024 * 1024);
+            }
+            for (unsigned p = 0 ; p < PATTERN_COUNT && status == 0 ; p++) {
+                unsigned long matches;
+                status = bench_pattern(b, apis[a], p,
+                        a >= 2 ? 1 : stride, &matches);
+                if (status != 0) break;
+                if (k == 0) {
+                    expected[a][p] = matches;
+                } else if (matches != expected[a][p]) {
+                    fprintf(stderr, "%s: result mismatch for %s\n",
+                            b->name, patterns[p]);
+                    status = 1;
+                }
+            }
+            if (a == 1) {
+                b->cache_configure(0, 0);
+            }
+        }
+        if (status == 0 && b->set_compile != NULL) {
+            unsigned long matches;
+            status = bench_set(b, &matches);
+            if (status != 0) break;
+            if (k == 0) {
+                expected_set = matches;
+            } else if (matches != expected_set) {
+                fprintf(stderr, "%s: result mismatch for the set\n", b->name);
+                status = 1;
+            }
+        }
+    }
+
+    if (json != NULL) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+    for (unsigned i = 0 ; i < path_count ; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(blob);
+    free(offsets);
+    free(bitmap);
+
+    return status;
+}
@@ -28,11 +28,36 @@
 
 #include "ec_glob.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
-#ifdef EC_GLOB_USE_PCRE
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(EC_GLOB_USE_PCRE2)
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+// only for the status codes
+#include <regex.h>
+#elif defined(EC_GLOB_USE_PCRE)
 #include <pcre2posix.h>
 #else
 #include <regex.h>
@@ -43,61 +68,450 @@ struct numpair_s {
     long max;
 };
 
+enum ec_glob_tok_type {
+    // a literal character
+    EC_GLOB_TOK_CHAR,
+    // ? - any single character
+    EC_GLOB_TOK_ANY,
+    // * - any sequence of characters except slashes
+    EC_GLOB_TOK_STAR,
+    // ** - any sequence of characters
+    EC_GLOB_TOK_GLOBSTAR,
+    // [...] - a character class
+    EC_GLOB_TOK_CLASS,
+    // { - start of alternatives
+    EC_GLOB_TOK_OPEN,
+    // , - separator of alternatives
+    EC_GLOB_TOK_ALT,
+    // } - end of alternatives
+    EC_GLOB_TOK_CLOSE,
+    // {num1..num2} - a number within a range
+    EC_GLOB_TOK_NUMRANGE,
+};
+
+struct ec_glob_tok {
+    unsigned char type;
+    unsigned char chr;
+    // index of the class or the num range,
+    // for OPEN and ALT the index of the next ALT or CLOSE,
+    // and for CLOSE the index of the corresponding OPEN
+    unsigned arg;
+    // for OPEN and ALT the index of the corresponding CLOSE
+    unsigned close;
+};
+
+struct ec_glob_class {
+    unsigned char bits[32];
+};
+
+#define ec_glob_class_test(cls, c) \
+    ((cls)->bits[(unsigned char)(c) >> 3] & (1u << ((unsigned char)(c) & 7)))
+
+#define ec_glob_class_set(cls, c) \
+    (cls)->bits[(unsigned char)(c) >> 3] |= (1u << ((unsigned char)(c) & 7))
+
+/*
+ * The tokenized glob pattern which is shared by all engines.
+ */
+struct ec_glob_prog {
+    struct ec_glob_tok *toks;
+    struct ec_glob_class *classes;
+    struct numpair_s *numranges;
+    unsigned tok_count;
+    unsigned class_count;
+    unsigned numrange_count;
+    // number of tokens where the matching may need to backtrack
+    unsigned backtrack_count;
+};
+
+enum ec_glob_nfa_type {
+    // a character within the range lo to hi
+    EC_GLOB_NFA_RANGE,
+    // a character of the class out1
+    EC_GLOB_NFA_CLASS,
+    // any character
+    EC_GLOB_NFA_ANY,
+    // any character except slashes
+    EC_GLOB_NFA_NOSLASH,
+    // continue with both, out and out1
+    EC_GLOB_NFA_SPLIT,
+    // the string is matched by the pattern out1
+    EC_GLOB_NFA_MATCH,
+    // record the position in the slot out1 and continue with out
+    EC_GLOB_NFA_SAVE,
+};
+
+struct ec_glob_nfa_state {
+    unsigned char type;
+    unsigned char lo;
+    unsigned char hi;
+    unsigned out;
+    unsigned out1;
+};
+
+/*
+ * A Thompson NFA constructed from the tokens of one or more patterns.
+ * The state with index zero is always the MATCH state of the first pattern.
+ */
+struct ec_glob_nfa {
+    struct ec_glob_nfa_state *states;
+    const struct ec_glob_class *classes;
+    unsigned count;
+    unsigned capacity;
+    unsigned start;
+    // offset of the class indices of the pattern under construction
+    unsigned class_base;
+    _Bool oom;
+    // the states belong to a mapped database
+    _Bool mapped;
+    // the num ranges are bracketed by SAVE states for the Pike VM
+    _Bool captures;
+    const struct ec_glob_allocator *allocator;
+};
+
+struct ec_glob_dfa;
+struct ec_glob_bitap;
+
+#ifndef EC_GLOB_USE_PREFILTER
+#define EC_GLOB_USE_PREFILTER 1
+#endif
+
+#ifndef EC_GLOB_USE_OPTIMIZER
+#define EC_GLOB_USE_OPTIMIZER 1
+#endif
+
+#ifndef EC_GLOB_OPT_STACK_SIZE
+#define EC_GLOB_OPT_STACK_SIZE 4096
+#endif
+
+#ifndef EC_GLOB_PREFILTER_COUNT
+#define EC_GLOB_PREFILTER_COUNT 16
+#endif
+
+#ifndef EC_GLOB_PREFILTER_LEN
+#define EC_GLOB_PREFILTER_LEN 16
+#endif
+
+/*
+ * A set of literals where every matching string must start (or end)
+ * with one of them. A set without literals does not filter anything.
+ */
+struct ec_glob_literals {
+    unsigned char count;
+    unsigned char len[EC_GLOB_PREFILTER_COUNT];
+    char str[EC_GLOB_PREFILTER_COUNT][EC_GLOB_PREFILTER_LEN];
+};
+
+struct ec_glob_prefilter {
+    struct ec_glob_literals prefix;
+    struct ec_glob_literals suffix;
+};
+
+#ifndef EC_GLOB_USE_SHAPES
+#define EC_GLOB_USE_SHAPES 1
+#endif
+
+/*
+ * Common shapes of patterns which are matched without an engine.
+ * The literals are taken from the prefilter.
+ */
+enum ec_glob_shape {
+    // the pattern needs an engine
+    ec_glob_shape_none,
+    // L or {L1,L2} - the string is one of the prefix literals
+    ec_glob_shape_literal,
+    // L** - the string starts with one of the prefix literals
+    ec_glob_shape_prefix,
+    // *S - the string has no slash and ends with one of the suffix literals
+    ec_glob_shape_name,
+    // **/*S - the part after the last slash ends with one of the suffix literals
+    ec_glob_shape_basename,
+    // **S - the string ends with one of the suffix literals
+    ec_glob_shape_suffix,
+};
+
+enum ec_glob_engine {
+    ec_glob_engine_regex,
+    ec_glob_engine_native,
+    ec_glob_engine_dfa,
+    // the bit-parallel engine for patterns with few positions
+    ec_glob_engine_bitap,
+    // the Pike VM, which also reports the spans of the num ranges
+    ec_glob_engine_pike,
+    // a specialized matcher for a common shape
+    ec_glob_engine_shape,
+    // not an engine - the engine is chosen for each pattern
+    ec_glob_engine_auto,
+};
+
+// the regex libraries are selected for their own sake, so they stay forced
+#if defined(EC_GLOB_USE_NATIVE)
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_native
+#elif defined(EC_GLOB_USE_DFA)
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_dfa
+#elif defined(EC_GLOB_USE_BITAP)
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_bitap
+#elif defined(EC_GLOB_USE_PIKE)
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_pike
+#elif defined(EC_GLOB_USE_REGEX) || defined(EC_GLOB_USE_PCRE) \
+    || defined(EC_GLOB_USE_PCRE2)
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_regex
+#else
+#define EC_GLOB_DEFAULT_ENGINE ec_glob_engine_auto
+#endif
+
+struct ec_glob_s {
+    struct ec_glob_prog prog;
+    struct ec_glob_prefilter filter;
+    enum ec_glob_shape shape;
+    enum ec_glob_engine engine;
+    struct ec_glob_nfa nfa;
+    struct ec_glob_dfa *dfa;
+    struct ec_glob_bitap *bitap;
+    // the single-word automaton for batches of the other engines, if any
+    struct ec_glob_bitap *lanes;
+#ifdef EC_GLOB_USE_PCRE2
+    pcre2_code *re;
+#else
+    regex_t re;
+#endif
+    // the pattern is matched more than once, which pays off a JIT
+    _Bool reused;
+    // otherwise, the length of the only string it is matched against
+    size_t len;
+    struct ec_glob_allocator allocator;
+    // the size of the allocation holding a compiled pattern
+    size_t size;
+};
+
 struct ec_glob_re {
     char *str;
     unsigned len;
     unsigned capacity;
+    const struct ec_glob_allocator *allocator;
+    _Bool oom;
 };
 
 #ifndef EC_GLOB_STACK_CAPACITY
 #define EC_GLOB_STACK_CAPACITY 64
 #endif
 
-static void ec_glob_pattern_increase_capacity(struct ec_glob_re *re) {
+#ifndef EC_GLOB_STACK_PROG_SIZE
+#define EC_GLOB_STACK_PROG_SIZE 2048
+#endif
+
+#ifndef EC_GLOB_NATIVE_MEMO_SIZE
+#define EC_GLOB_NATIVE_MEMO_SIZE 512
+#endif
+
+#ifndef EC_GLOB_NATIVE_DEPTH
+#define EC_GLOB_NATIVE_DEPTH 64
+#endif
+
+#ifndef EC_GLOB_DFA_CACHE_SIZE
+#define EC_GLOB_DFA_CACHE_SIZE 16384
+#endif
+
+#ifndef EC_GLOB_SET_CACHE_SIZE
+#define EC_GLOB_SET_CACHE_SIZE (1024 * 1024)
+#endif
+
+// the default budget of states for precompiling a set
+#ifndef EC_GLOB_SET_MAX_STATES
+#define EC_GLOB_SET_MAX_STATES 4096
+#endif
+
+// the pattern cache of ec_glob() is disabled unless this is non-zero
+#ifndef EC_GLOB_CACHE_ENTRIES
+#define EC_GLOB_CACHE_ENTRIES 0
+#endif
+
+#ifndef EC_GLOB_CACHE_BYTES
+#define EC_GLOB_CACHE_BYTES (1024 * 1024)
+#endif
+
+#ifndef EC_GLOB_CACHE_SHARDS
+#define EC_GLOB_CACHE_SHARDS 16
+#endif
+
+static void *ec_glob_std_alloc(size_t size, void *ctx) {
+    (void) ctx;
+    return malloc(size);
+}
+
+static void *ec_glob_std_realloc(void *ptr, size_t oldsize, size_t newsize,
+                                 void *ctx) {
+    (void) oldsize;
+    (void) ctx;
+    return realloc(ptr, newsize);
+}
+
+static void ec_glob_std_free(void *ptr, size_t size, void *ctx) {
+    (void) size;
+    (void) ctx;
+    free(ptr);
+}
+
+static const struct ec_glob_allocator ec_glob_std_allocator = {
+        ec_glob_std_alloc, ec_glob_std_realloc, ec_glob_std_free, NULL
+};
+
+#define ec_glob_alloc(a, size) (a)->alloc(size, (a)->ctx)
+#define ec_glob_realloc(a, ptr, oldsize, newsize) \
+    (a)->realloc(ptr, oldsize, newsize, (a)->ctx)
+#define ec_glob_dealloc(a, ptr, size) (a)->free(ptr, size, (a)->ctx)
+
+/*
+ * Doubles the capacity of the regular expression.
+ * When that fails, the expression is marked and all further text is
+ * dropped, so that the error can be reported once at the end.
+ */
+static _Bool ec_glob_pattern_increase_capacity(struct ec_glob_re *re) {
+    if (re->oom) return 0;
     unsigned newcap = re->capacity * 2;
     char *newmem;
     if (re->capacity == EC_GLOB_STACK_CAPACITY) {
-        newmem = malloc(newcap);
-        if (newmem == NULL) abort();
-        memcpy(newmem, re->str, re->len);
+        newmem = ec_glob_alloc(re->allocator, newcap);
+        if (newmem != NULL) memcpy(newmem, re->str, re->len);
     } else {
-        newmem = realloc(re->str, newcap);
-        if (newmem == NULL) abort();
+        newmem = ec_glob_realloc(re->allocator, re->str, re->capacity, newcap);
+    }
+    if (newmem == NULL) {
+        re->oom = 1;
+        return 0;
     }
     re->capacity = newcap;
     re->str = newmem;
+    return 1;
 }
 
 #define ec_glob_pattern_ensure_capacity(re, n) \
-    if (re.len + n > re.capacity) ec_glob_pattern_increase_capacity(&re)
+    ((re).len + n <= (re).capacity || ec_glob_pattern_increase_capacity(&(re)))
 
-#define ec_glob_cats(re, s) \
-    ec_glob_pattern_ensure_capacity(re, sizeof(s) - 1); \
-    memcpy((re).str + (re).len, s, sizeof(s) - 1); (re).len += sizeof(s)-1
+#define ec_glob_cats(re, s) do { \
+    if (ec_glob_pattern_ensure_capacity(re, sizeof(s) - 1)) { \
+        memcpy((re).str + (re).len, s, sizeof(s) - 1); \
+        (re).len += sizeof(s) - 1; \
+    } } while (0)
 
-#define ec_glob_catc(re, c) \
-    ec_glob_pattern_ensure_capacity(re, 1); (re).str[(re).len++] = (c)
+#define ec_glob_catc(re, c) do { \
+    if (ec_glob_pattern_ensure_capacity(re, 1)) \
+        (re).str[(re).len++] = (c); \
+    } while (0)
 
+/*
+ * Computes the memory required to tokenize the pattern.
+ * The number of tokens never exceeds the pattern length, every class
+ * needs an opening bracket and every num range needs an opening brace.
+ */
+static size_t ec_glob_prog_size(const char *pattern, unsigned inputlen,
+                                struct ec_glob_prog *prog) {
+    unsigned brackets = 0, braces = 0;
+    for (unsigned i = 0 ; i < inputlen ; i++) {
+        brackets += pattern[i] == '[';
+        braces += pattern[i] == '{';
+    }
+    prog->tok_count = inputlen;
+    prog->class_count = brackets;
+    prog->numrange_count = braces;
+    return prog->numrange_count * sizeof(struct numpair_s)
+           + prog->tok_count * sizeof(struct ec_glob_tok)
+           + prog->class_count * sizeof(struct ec_glob_class);
+}
 
-int ec_glob(const char *pattern, const char *string) {
-    char stack[EC_GLOB_STACK_CAPACITY];
-    struct ec_glob_re re_pattern = {
-            stack, 1, EC_GLOB_STACK_CAPACITY
-    };
-    re_pattern.str[0] = '^';
+/*
+ * Distributes the memory computed by ec_glob_prog_size().
+ * The memory must be suitably aligned for a long.
+ */
+static void ec_glob_prog_init(struct ec_glob_prog *prog, void *mem) {
+    char *p = mem;
+    prog->numranges = (struct numpair_s *) p;
+    p += prog->numrange_count * sizeof(struct numpair_s);
+    prog->toks = (struct ec_glob_tok *) p;
+    p += prog->tok_count * sizeof(struct ec_glob_tok);
+    prog->classes = (struct ec_glob_class *) p;
+    prog->tok_count = 0;
+    prog->class_count = 0;
+    prog->numrange_count = 0;
+    prog->backtrack_count = 0;
+}
 
-    unsigned scanidx = 0;
-    unsigned inputlen = strlen(pattern);
+static unsigned ec_glob_prog_add(struct ec_glob_prog *prog,
+                                 unsigned char type, unsigned char chr) {
+    unsigned idx = prog->tok_count++;
+    prog->toks[idx].type = type;
+    prog->toks[idx].chr = chr;
+    prog->toks[idx].arg = 0;
+    prog->toks[idx].close = 0;
+    if (type == EC_GLOB_TOK_STAR || type == EC_GLOB_TOK_GLOBSTAR
+        || type == EC_GLOB_TOK_OPEN || type == EC_GLOB_TOK_NUMRANGE) {
+        prog->backtrack_count++;
+    }
+    return idx;
+}
+
+/*
+ * Adds the characters of a bracket expression to a class.
+ * The characters are buffered, so that a-z can be recognized as range.
+ */
+struct ec_glob_class_builder {
+    struct ec_glob_class *cls;
+    unsigned char queue[3];
+    unsigned count;
+};
+
+static void ec_glob_class_feed(struct ec_glob_class_builder *b,
+                               unsigned char c) {
+    b->queue[b->count++] = c;
+    if (b->count == 3) {
+        if (b->queue[1] == '-') {
+            for (unsigned r = b->queue[0] ; r <= b->queue[2] ; r++) {
+                ec_glob_class_set(b->cls, r);
+            }
+            b->count = 0;
+        } else {
+            ec_glob_class_set(b->cls, b->queue[0]);
+            b->queue[0] = b->queue[1];
+            b->queue[1] = b->queue[2];
+            b->count = 2;
+        }
+    }
+}
+
+static void ec_glob_class_flush(struct ec_glob_class_builder *b) {
+    for (unsigned i = 0 ; i < b->count ; i++) {
+        ec_glob_class_set(b->cls, b->queue[i]);
+    }
+    b->count = 0;
+}
+
+/*
+ * Tokenizes an editorconfig glob pattern.
+ * The prog must have been initialized with ec_glob_prog_init().
+ * Returns zero on success or REG_EPAREN when a choice is not closed.
+ */
+static int ec_glob_parse(struct ec_glob_prog *prog,
+                          const char *pattern, size_t inputlen) {
+    size_t scanidx = 0;
     char c;
 
     // maintain information about braces
-    const unsigned brace_stack_size = 32;
-    char brace_stack[brace_stack_size];
-    int depth_brace = 0;
+    // (index of the group's OPEN token or UINT_MAX for literal braces)
+    const size_t brace_stack_size = 32;
+    unsigned brace_stack[brace_stack_size];
+    unsigned brace_last[brace_stack_size];
+    size_t depth_brace = 0;
     _Bool braces_valid = 1;
 
+    // the lookaheads are shared, so that the parser takes linear time:
+    // the next comma or closing brace is the same for all braces in front
+    // of it, and a bracket in front of the position where the last bracket
+    // failed to find its end fails as well
+    size_t brace_next = 0;
+    size_t bracket_fail = 0;
+
     // first, check if braces are syntactically valid
-    for (unsigned i = 0 ; i < inputlen ; i++) {
+    for (size_t i = 0 ; i < inputlen ; i++) {
         // skip potentially escaped braces
         if (pattern[i] == '\\') {
             i++;
@@ -117,35 +531,18 @@ int ec_glob(const char *pattern, const char *string) {
         depth_brace = 0;
     }
 
-    // prepare what we think is more than enough memory for matches
-    const unsigned numrange_max = 32;
-    unsigned numrange_grp_count = 0;
-    unsigned numrange_grp_idx[numrange_max];
-    struct numpair_s numrange_pairs[numrange_max];
-    regmatch_t numrange_matches[numrange_max];
-
-    // initialize first group number with zero
-    // and increment whenever we create a new group
-    numrange_grp_idx[0] = 0;
-
-    // now translate the editorconfig pattern to a POSIX regular expression
+    // now tokenize the editorconfig pattern
     while (scanidx < inputlen) {
         c = pattern[scanidx++];
 
         // escape
         if (c == '\\') {
-            if (strchr("?{}[]*\\-,", pattern[scanidx]) != NULL) {
-                // also escape in regex when required
-                if (strchr("?{}[]*\\", pattern[scanidx]) != NULL) {
-                    ec_glob_catc(re_pattern, '\\');
-                }
+            if (scanidx < inputlen
+                && strchr("?{}[]*\\-,", pattern[scanidx]) != NULL) {
                 c = pattern[scanidx++];
-                ec_glob_catc(re_pattern, c);
             }
             // otherwise, it's just a backslash
-            else {
-                ec_glob_cats(re_pattern, "\\\\");
-            }
+            ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, c);
         }
         // wildcard
         else if (c == '*') {
@@ -158,20 +555,20 @@ int ec_glob(const char *pattern, const char *string) {
                     // the collapsible slash is simply discarded
                     scanidx++;
                 }
-                ec_glob_cats(re_pattern, ".*");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_GLOBSTAR, 0);
             } else {
-                ec_glob_cats(re_pattern, "[^/]*");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_STAR, 0);
             }
         }
         // arbitrary character
         else if (c == '?') {
-            ec_glob_catc(re_pattern, '.');
+            ec_glob_prog_add(prog, EC_GLOB_TOK_ANY, 0);
         }
         // start of alternatives
         else if (c == '{') {
             // if braces are not syntactically valid, treat them as literals
             if (!braces_valid) {
-                ec_glob_cats(re_pattern, "\\{");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, '{');
                 continue;
             }
 
@@ -179,158 +576,165 @@ int ec_glob(const char *pattern, const char *string) {
             depth_brace++;
             if (depth_brace > brace_stack_size) {
                 // treat brace literally when stacked too many of them
-                ec_glob_cats(re_pattern, "\\{");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, '{');
                 continue;
             }
 
             // check if {single} or {num1..num2}
-            _Bool single = 1;
-            _Bool dotdot = strchr("+-0123456789", pattern[scanidx]) != NULL;
-            _Bool dotdot_seen = 0;
-            for (unsigned fw = scanidx; fw < inputlen; fw++) {
-                if (pattern[fw] == ',') {
-                    single = 0;
-                    dotdot = 0;
-                    break;
-                }
-                else if (pattern[fw] == '}') {
-                    // check if this is a {num1..num2} pattern
-                    if (dotdot) {
-                        _Bool ok = 1;
-                        unsigned ngc = numrange_grp_count;
-                        char *chk;
-                        errno = 0;
-                        numrange_pairs[ngc].min = strtol(
-                                &pattern[scanidx], &chk, 10);
-                        ok &= *chk == '.' && 0 == errno;
-                        numrange_pairs[ngc].max = strtol(
-                                strrchr(&pattern[scanidx], '.')+1, &chk, 10);
-                        ok &= *chk == '}' && 0 == errno;
-                        if (ok) {
-                            // a dotdot is not a single
-                            single = 0;
-                            // skip this subpattern later on
-                            scanidx = fw+1;
-                        } else {
-                            // not ok, we could not parse the numbers
-                            dotdot = 0;
-                        }
-                    }
-                    break;
-                } else if (dotdot) {
-                    // check for dotdot separator
-                    if (pattern[fw] == '.') {
-                        if (!dotdot_seen &&
-                            fw + 2 < inputlen && pattern[fw + 1] == '.' &&
-                            strchr("+-0123456789", pattern[fw + 2]) != NULL) {
-                            fw += 2;
-                            dotdot_seen = 1;
-                        } else {
-                            dotdot = 0;
-                        }
-                    }
-                    // everything must be a digit, otherwise
-                    else if (!strchr("0123456789", pattern[fw])) {
+            if (brace_next < scanidx) {
+                brace_next = scanidx;
+                while (brace_next < inputlen && pattern[brace_next] != ','
+                       && pattern[brace_next] != '}') brace_next++;
+            }
+            _Bool single = brace_next == inputlen
+                           || pattern[brace_next] == '}';
+            _Bool dotdot = single
+                           && strchr("+-0123456789", pattern[scanidx]) != NULL;
+            size_t dotdot_pos = 0;
+            struct numpair_s numrange;
+            // stops at the first character which is not part of a num range
+            for (size_t fw = scanidx ; dotdot && fw < brace_next ; fw++) {
+                // check for dotdot separator
+                if (pattern[fw] == '.') {
+                    if (dotdot_pos == 0 &&
+                        fw + 2 < inputlen && pattern[fw + 1] == '.' &&
+                        strchr("+-0123456789", pattern[fw + 2]) != NULL) {
+                        dotdot_pos = fw;
+                        fw += 2;
+                    } else {
                         dotdot = 0;
                     }
                 }
+                // everything must be a digit, otherwise
+                else if (!strchr("0123456789", pattern[fw])) {
+                    dotdot = 0;
+                }
+            }
+            if (brace_next == inputlen || dotdot_pos == 0) {
+                dotdot = 0;
+            } else if (dotdot) {
+                // check if this is a {num1..num2} pattern
+                _Bool ok = 1;
+                char *chk;
+                errno = 0;
+                numrange.min = strtol(&pattern[scanidx], &chk, 10);
+                ok &= *chk == '.' && 0 == errno;
+                numrange.max = strtol(&pattern[dotdot_pos+2], &chk, 10);
+                ok &= *chk == '}' && 0 == errno;
+                if (ok) {
+                    // a dotdot is not a single
+                    single = 0;
+                    // skip this subpattern later on
+                    scanidx = brace_next + 1;
+                } else {
+                    // not ok, we could not parse the numbers
+                    dotdot = 0;
+                }
             }
 
             if (single) {
                 // push literal brace
-                ec_glob_cats(re_pattern, "\\{");
-                brace_stack[depth_brace-1] = '}';
+                ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, '{');
+                brace_stack[depth_brace-1] = (unsigned) -1;
+            } else if (dotdot) {
+                unsigned tok = ec_glob_prog_add(prog, EC_GLOB_TOK_NUMRANGE, 0);
+                prog->toks[tok].arg = prog->numrange_count;
+                prog->numranges[prog->numrange_count++] = numrange;
+                // we already took care of the closing brace
+                depth_brace--;
             } else {
-                // open choice and push parenthesis
-                ec_glob_catc(re_pattern, '(');
-
-                // increase the current group number
-                numrange_grp_idx[numrange_grp_count]++;
-
-                if (dotdot) {
-                    // add the number matching pattern
-                    ec_glob_cats(re_pattern, "[-+]?[0-9]+)");
-                    // increase group counter and initialize
-                    // next index with current group number
-                    numrange_grp_count++;
-                    if (numrange_grp_count < numrange_max) {
-                        numrange_grp_idx[numrange_grp_count] =
-                                numrange_grp_idx[numrange_grp_count - 1];
-                    }
-                    // we already took care of the closing brace
-                    depth_brace--;
-                } else {
-                    // remember that we need to close the choice eventually
-                    brace_stack[depth_brace - 1] = ')';
-                }
+                // open choice and remember that we need to close it
+                unsigned tok = ec_glob_prog_add(prog, EC_GLOB_TOK_OPEN, 0);
+                brace_stack[depth_brace-1] = tok;
+                brace_last[depth_brace-1] = tok;
             }
         }
         // end of alternatives
         else if (depth_brace > 0 && c == '}') {
             depth_brace--;
             if (depth_brace < brace_stack_size
-                && brace_stack[depth_brace] == ')') {
-                ec_glob_catc(re_pattern, ')');
+                && brace_stack[depth_brace] != (unsigned) -1) {
+                unsigned tok = ec_glob_prog_add(prog, EC_GLOB_TOK_CLOSE, 0);
+                prog->toks[brace_last[depth_brace]].arg = tok;
+                // let the OPEN and all ALTs know where the choice ends
+                for (unsigned t = brace_stack[depth_brace] ; t != tok ;
+                     t = prog->toks[t].arg) {
+                    prog->toks[t].close = tok;
+                }
+                // and the CLOSE where the choice starts
+                prog->toks[tok].arg = brace_stack[depth_brace];
             } else {
-                ec_glob_cats(re_pattern, "\\}");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, '}');
             }
         }
         // separator of alternatives
-        else if (depth_brace > 0 && c == ',') {
-            ec_glob_catc(re_pattern, '|');
+        else if (depth_brace > 0 && c == ','
+                 && depth_brace <= brace_stack_size
+                 && brace_stack[depth_brace-1] != (unsigned) -1) {
+            unsigned tok = ec_glob_prog_add(prog, EC_GLOB_TOK_ALT, 0);
+            prog->toks[brace_last[depth_brace-1]].arg = tok;
+            brace_last[depth_brace-1] = tok;
         }
         // brackets
         else if (c == '[') {
             // check if we have a corresponding closing bracket
             _Bool valid = 0;
             _Bool closing_bracket_literal = 0;
-            unsigned newidx;
-            for (unsigned fw = scanidx ; fw < inputlen ; fw++) {
-                if (pattern[fw] == ']') {
-                    // only terminating if it's not the first char
-                    if (fw == scanidx) {
-                        // otherwise, auto-escaped
-                        closing_bracket_literal = 1;
-                    } else {
-                        valid = 1;
-                        newidx = fw+1;
+            size_t newidx;
+            if (scanidx > bracket_fail) {
+                size_t fw;
+                for (fw = scanidx ; fw < inputlen ; fw++) {
+                    if (pattern[fw] == ']') {
+                        // only terminating if it's not the first char
+                        if (fw == scanidx) {
+                            // otherwise, auto-escaped
+                            closing_bracket_literal = 1;
+                        } else {
+                            valid = 1;
+                            newidx = fw+1;
+                            break;
+                        }
+                    } else if (pattern[fw] == '/') {
+                        // special (undocumented) case: slash breaks
+                        // https://github.com/editorconfig/editorconfig/issues/499
                         break;
+                    } else if (pattern[fw] == '\\') {
+                        // skip escaped characters as usual
+                        fw++;
+                        closing_bracket_literal |= pattern[fw] == ']';
                     }
-                } else if (pattern[fw] == '/') {
-                    // special (undocumented) case: slash breaks
-                    // https://github.com/editorconfig/editorconfig/issues/499
-                    break;
-                } else if (pattern[fw] == '\\') {
-                    // skip escaped characters as usual
-                    fw++;
-                    closing_bracket_literal |= pattern[fw] == ']';
                 }
+                if (!valid) bracket_fail = fw;
             }
 
-
             if (valid) {
+                unsigned tok = ec_glob_prog_add(prog, EC_GLOB_TOK_CLASS, 0);
+                struct ec_glob_class_builder cls = {
+                        &prog->classes[prog->class_count], {0}, 0
+                };
+                memset(cls.cls, 0, sizeof(struct ec_glob_class));
+                prog->toks[tok].arg = prog->class_count++;
+
                 // first of all, check, if the sequence is negated
-                if (pattern[scanidx] == '!') {
+                _Bool negated = pattern[scanidx] == '!';
+                if (negated) {
                     scanidx++;
-                    ec_glob_cats(re_pattern, "[^");
-                } else {
-                    ec_glob_catc(re_pattern, '[');
                 }
 
                 // if we have a closing bracket as literal, it must appear first
+                _Bool minus_last = 0;
                 if (closing_bracket_literal) {
-                    ec_glob_catc(re_pattern, ']');
+                    ec_glob_class_feed(&cls, ']');
                     // but if the minus operator wanted to be there
                     // we need to move it to the end
                     if (pattern[scanidx] == '-') {
                         scanidx++;
+                        minus_last = 1;
                     }
                 }
 
                 // everything within brackets is treated as a literal character
-                // we have to parse them one by one, though, because we might
-                // need to escape regex-relevant stuff
-                for (unsigned fw = scanidx ;  ; fw++) {
+                for (size_t fw = scanidx ; fw < inputlen ; fw++) {
                     if (pattern[fw] == '\\') {
                         // skip to next char
                         continue;
@@ -343,80 +747,7204 @@ int ec_glob(const char *pattern, const char *string) {
                     }
                     // include literal character
                     else {
-                        if (strchr(".(){}[]", pattern[fw]) != NULL) {
-                            ec_glob_catc(re_pattern, '\\');
-                        }
-                        ec_glob_catc(re_pattern, pattern[fw]);
+                        ec_glob_class_feed(&cls, pattern[fw]);
                     }
                 }
 
                 // did we promise the minus a seat in the last row?
-                if (pattern[scanidx-1] == '-') {
-                    ec_glob_cats(re_pattern, "-]");
-                } else {
-                    ec_glob_catc(re_pattern, ']');
+                if (minus_last) {
+                    ec_glob_class_feed(&cls, '-');
+                }
+                ec_glob_class_flush(&cls);
+
+                if (negated) {
+                    for (unsigned i = 0 ; i < sizeof(cls.cls->bits) ; i++) {
+                        cls.cls->bits[i] = ~cls.cls->bits[i];
+                    }
                 }
+                // the string terminator is never part of a class
+                cls.cls->bits[0] &= ~1u;
+
                 scanidx = newidx;
             } else {
                 // literal bracket
-                ec_glob_cats(re_pattern, "\\[");
+                ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, '[');
             }
         }
-        // escape special chars
-        else if (strchr(".(){}[]", c) != NULL) {
-            ec_glob_catc(re_pattern, '\\');
-            ec_glob_catc(re_pattern, c);
-        }
         // literal (includes path separators)
         else {
-            ec_glob_catc(re_pattern, c);
+            ec_glob_prog_add(prog, EC_GLOB_TOK_CHAR, c);
         }
     }
 
-    // terminate the regular expression
-    ec_glob_catc(re_pattern, '$');
-    ec_glob_catc(re_pattern, '\0');
+    // a bracket expression might have swallowed the end of a choice
+    while (depth_brace > 0) {
+        depth_brace--;
+        if (depth_brace < brace_stack_size
+            && brace_stack[depth_brace] != (unsigned) -1) {
+            return REG_EPAREN;
+        }
+    }
 
+    return 0;
+}
 
-    // compile pattern and execute matching
-    regex_t re;
-    int status;
-    int flags = REG_EXTENDED;
-
-    // when we don't have a num-pattern, don't capture anything
-    if (numrange_grp_count == 0) {
-        flags |= REG_NOSUB;
-    }
-
-    if ((status = regcomp(&re, re_pattern.str, flags)) == 0) {
-        status = regexec(&re, string, numrange_max, numrange_matches, 0);
-
-        // check num ranges
-        for (unsigned i = 0 ; status == 0 && i < numrange_grp_count ; i++) {
-            regmatch_t nm = numrange_matches[numrange_grp_idx[i]];
-            int nmlen = nm.rm_eo-nm.rm_so;
-            char *nmatch = malloc(nmlen+1);
-            memcpy(nmatch, string+nm.rm_so, nmlen);
-            nmatch[nmlen] = '\0';
-            errno = 0;
-            char *chk;
-            long num = strtol(nmatch, &chk, 10);
-            if (*chk == '\0' && 0 == errno) {
-                // check if the matched number is within the range
-                status |= !(numrange_pairs[i].min <= num
-                        && num <= numrange_pairs[i].max);
-            } else {
-                // number not processable, return error
-                status = 1;
+#if EC_GLOB_USE_OPTIMIZER
+/*
+ * The optimizer rewrites the tokens into a smaller pattern that matches the
+ * same strings. It builds a tree, in which every choice holds a list of
+ * alternatives and every alternative holds a list of nodes, simplifies it
+ * bottom-up and emits the tokens again. Patterns generated by tools tend to
+ * spell out every alternative, like {*.yaml,*.yml}, which becomes *.y{a,}ml.
+ */
+
+// like the parser, choices nest no deeper than that
+#define EC_GLOB_OPT_MAX_DEPTH 32
+
+#define EC_GLOB_OPT_NONE ((unsigned) -1)
+
+struct ec_glob_opt_node {
+    // OPEN for a choice, ALT for an alternative and any other for a token
+    unsigned char type;
+    unsigned char chr;
+    // set when the alternative was moved into a new choice
+    unsigned char moved;
+    unsigned arg;
+    // the next node of the list
+    unsigned next;
+    // the first alternative of a choice or the first node of an alternative
+    unsigned child;
+    // hash of the token, the choice or the nodes of the alternative
+    unsigned hash;
+    // the alternatives of a choice that start with the same token,
+    // and in the first of them the last one
+    unsigned link;
+    unsigned tail;
+    // the slot of the alternative in the table
+    unsigned slot;
+};
+
+struct ec_glob_opt {
+    const struct ec_glob_prog *prog;
+    struct ec_glob_opt_node *nodes;
+    unsigned count;
+    unsigned capacity;
+    // open addressing table of alternatives, all slots are zero between uses
+    unsigned *table;
+    unsigned mask;
+};
+
+static unsigned ec_glob_opt_atom_hash(const struct ec_glob_opt *o, unsigned n) {
+    const struct ec_glob_opt_node *node = &o->nodes[n];
+    unsigned hash = node->type * 0x9e3779b1u;
+    if (node->type == EC_GLOB_TOK_CHAR) {
+        hash ^= node->chr * 0x85ebca6bu;
+    } else if (node->type == EC_GLOB_TOK_CLASS) {
+        const unsigned char *bits = o->prog->classes[node->arg].bits;
+        for (unsigned i = 0 ; i < sizeof(o->prog->classes->bits) ; i++) {
+            hash = (hash ^ bits[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static unsigned ec_glob_opt_seq_hash(const struct ec_glob_opt *o, unsigned n) {
+    unsigned hash = 2166136261u;
+    for (; n != EC_GLOB_OPT_NONE ; n = o->nodes[n].next) {
+        hash = (hash ^ o->nodes[n].hash) * 16777619u;
+    }
+    return hash;
+}
+
+// tokens which can be moved in front of or behind a choice
+#define ec_glob_opt_atom(o, n) ((o)->nodes[n].type != EC_GLOB_TOK_OPEN)
+
+#define ec_glob_opt_star(o, n) \
+    ((o)->nodes[n].type == EC_GLOB_TOK_STAR \
+     || (o)->nodes[n].type == EC_GLOB_TOK_GLOBSTAR)
+
+static _Bool ec_glob_opt_same_seq(const struct ec_glob_opt *o,
+                                  unsigned a, unsigned b);
+
+/*
+ * Compares two nodes, including the alternatives of choices.
+ */
+static _Bool ec_glob_opt_same(const struct ec_glob_opt *o,
+                              unsigned a, unsigned b) {
+    const struct ec_glob_opt_node *x = &o->nodes[a], *y = &o->nodes[b];
+    if (x->type != y->type || x->hash != y->hash) return 0;
+    switch (x->type) {
+        case EC_GLOB_TOK_CHAR:
+            return x->chr == y->chr;
+        case EC_GLOB_TOK_CLASS:
+            return memcmp(&o->prog->classes[x->arg],
+                          &o->prog->classes[y->arg],
+                          sizeof(struct ec_glob_class)) == 0;
+        case EC_GLOB_TOK_OPEN:
+            a = x->child;
+            b = y->child;
+            while (a != EC_GLOB_OPT_NONE && b != EC_GLOB_OPT_NONE) {
+                if (!ec_glob_opt_same_seq(o, o->nodes[a].child,
+                                          o->nodes[b].child)) return 0;
+                a = o->nodes[a].next;
+                b = o->nodes[b].next;
             }
-            free(nmatch);
+            return a == b;
+        default:
+            return 1;
+    }
+}
+
+static _Bool ec_glob_opt_same_seq(const struct ec_glob_opt *o,
+                                  unsigned a, unsigned b) {
+    while (a != EC_GLOB_OPT_NONE && b != EC_GLOB_OPT_NONE) {
+        if (!ec_glob_opt_same(o, a, b)) return 0;
+        a = o->nodes[a].next;
+        b = o->nodes[b].next;
+    }
+    return a == b;
+}
+
+static unsigned ec_glob_opt_node(struct ec_glob_opt *o, unsigned char type) {
+    unsigned n = o->count++;
+    struct ec_glob_opt_node *node = &o->nodes[n];
+    node->type = type;
+    node->chr = 0;
+    node->moved = 0;
+    node->arg = 0;
+    node->next = EC_GLOB_OPT_NONE;
+    node->child = EC_GLOB_OPT_NONE;
+    node->hash = 0;
+    return n;
+}
+
+/*
+ * Builds the nodes for the tokens up to the end of the current alternative.
+ */
+static unsigned ec_glob_opt_build(struct ec_glob_opt *o, unsigned *t) {
+    const struct ec_glob_prog *prog = o->prog;
+    unsigned head = EC_GLOB_OPT_NONE, *tail = &head;
+    while (*t < prog->tok_count) {
+        const struct ec_glob_tok *tok = &prog->toks[*t];
+        if (tok->type == EC_GLOB_TOK_ALT
+            || tok->type == EC_GLOB_TOK_CLOSE) break;
+        unsigned n = ec_glob_opt_node(o, tok->type);
+        (*t)++;
+        if (tok->type == EC_GLOB_TOK_OPEN) {
+            // the parser closes every choice it opens
+            unsigned *alts = &o->nodes[n].child;
+            unsigned char type;
+            do {
+                unsigned a = ec_glob_opt_node(o, EC_GLOB_TOK_ALT);
+                o->nodes[a].child = ec_glob_opt_build(o, t);
+                *alts = a;
+                alts = &o->nodes[a].next;
+                type = prog->toks[(*t)++].type;
+            } while (type == EC_GLOB_TOK_ALT);
+        } else {
+            o->nodes[n].chr = tok->chr;
+            o->nodes[n].arg = tok->arg;
+            o->nodes[n].hash = ec_glob_opt_atom_hash(o, n);
         }
-        regfree(&re);
+        *tail = n;
+        tail = &o->nodes[n].next;
     }
+    return head;
+}
 
-    if (re_pattern.capacity > EC_GLOB_STACK_CAPACITY) {
-        free(re_pattern.str);
+static unsigned ec_glob_opt_reverse(struct ec_glob_opt *o, unsigned n) {
+    unsigned head = EC_GLOB_OPT_NONE;
+    while (n != EC_GLOB_OPT_NONE) {
+        unsigned next = o->nodes[n].next;
+        o->nodes[n].next = head;
+        head = n;
+        n = next;
+    }
+    return head;
+}
+
+/*
+ * Removes the leading tokens that all alternatives of the choice have in
+ * common and returns them as list.
+ */
+static unsigned ec_glob_opt_hoist(struct ec_glob_opt *o, unsigned g) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned head = EC_GLOB_OPT_NONE, *tail = &head;
+    for (;;) {
+        unsigned first = nodes[nodes[g].child].child;
+        if (first == EC_GLOB_OPT_NONE || !ec_glob_opt_atom(o, first)) break;
+        unsigned a = nodes[nodes[g].child].next;
+        while (a != EC_GLOB_OPT_NONE && nodes[a].child != EC_GLOB_OPT_NONE
+               && ec_glob_opt_same(o, nodes[a].child, first)) {
+            a = nodes[a].next;
+        }
+        if (a != EC_GLOB_OPT_NONE) break;
+
+        for (a = nodes[g].child ; a != EC_GLOB_OPT_NONE ; a = nodes[a].next) {
+            nodes[a].child = nodes[nodes[a].child].next;
+        }
+        nodes[first].next = EC_GLOB_OPT_NONE;
+        *tail = first;
+        tail = &nodes[first].next;
+    }
+    return head;
+}
+
+static unsigned ec_glob_opt_seq(struct ec_glob_opt *o, unsigned head,
+                                unsigned depth);
+static unsigned *ec_glob_opt_choice(struct ec_glob_opt *o, unsigned *link,
+                                    unsigned depth);
+
+/*
+ * Moves the alternatives of choices which make up a whole alternative into
+ * the choice, and drops alternatives which are the same as an earlier one.
+ */
+static void ec_glob_opt_flatten(struct ec_glob_opt *o, unsigned g) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned *link = &nodes[g].child;
+    while (*link != EC_GLOB_OPT_NONE) {
+        unsigned a = *link, c = nodes[a].child;
+        if (c != EC_GLOB_OPT_NONE && nodes[c].type == EC_GLOB_TOK_OPEN
+            && nodes[c].next == EC_GLOB_OPT_NONE) {
+            unsigned last = nodes[c].child;
+            while (nodes[last].next != EC_GLOB_OPT_NONE) {
+                last = nodes[last].next;
+            }
+            nodes[last].next = nodes[a].next;
+            *link = nodes[c].child;
+            continue;
+        }
+        link = &nodes[a].next;
+    }
+
+    link = &nodes[g].child;
+    while (*link != EC_GLOB_OPT_NONE) {
+        unsigned a = *link, slot;
+        nodes[a].hash = ec_glob_opt_seq_hash(o, nodes[a].child);
+        for (slot = nodes[a].hash & o->mask ; o->table[slot] != 0 ;
+             slot = (slot + 1) & o->mask) {
+            unsigned b = o->table[slot] - 1;
+            if (nodes[b].hash == nodes[a].hash
+                && ec_glob_opt_same_seq(o, nodes[a].child, nodes[b].child)) {
+                break;
+            }
+        }
+        if (o->table[slot] != 0) {
+            *link = nodes[a].next;
+            continue;
+        }
+        o->table[slot] = a + 1;
+        nodes[a].slot = slot;
+        link = &nodes[a].next;
+    }
+    for (unsigned a = nodes[g].child ; a != EC_GLOB_OPT_NONE ;
+         a = nodes[a].next) {
+        o->table[nodes[a].slot] = 0;
+    }
+}
+
+/*
+ * Moves the common leading tokens of alternatives into a new choice, which
+ * replaces them, so {*.abcd,*.abce,f} becomes {*.abc{d,e},f}. It only does
+ * so when that saves tokens, since the new choice costs two. Choices of
+ * plain strings are left alone, since they are matched as set of literals.
+ */
+static void ec_glob_opt_factor(struct ec_glob_opt *o, unsigned g,
+                               unsigned depth) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned a, slot;
+    _Bool literal = 1;
+    for (a = nodes[g].child ; literal && a != EC_GLOB_OPT_NONE ;
+         a = nodes[a].next) {
+        for (unsigned n = nodes[a].child ; n != EC_GLOB_OPT_NONE ;
+             n = nodes[n].next) {
+            if (nodes[n].type != EC_GLOB_TOK_CHAR) literal = 0;
+        }
+    }
+    if (literal) return;
+
+    for (a = nodes[g].child ; a != EC_GLOB_OPT_NONE ; a = nodes[a].next) {
+        unsigned first = nodes[a].child;
+        nodes[a].link = EC_GLOB_OPT_NONE;
+        nodes[a].tail = a;
+        nodes[a].slot = EC_GLOB_OPT_NONE;
+        if (first == EC_GLOB_OPT_NONE || !ec_glob_opt_atom(o, first)) continue;
+        for (slot = nodes[first].hash & o->mask ; o->table[slot] != 0 ;
+             slot = (slot + 1) & o->mask) {
+            unsigned b = o->table[slot] - 1;
+            if (ec_glob_opt_same(o, nodes[b].child, first)) break;
+        }
+        if (o->table[slot] != 0) {
+            unsigned b = o->table[slot] - 1;
+            nodes[nodes[b].tail].link = a;
+            nodes[b].tail = a;
+        } else {
+            o->table[slot] = a + 1;
+            nodes[a].slot = slot;
+        }
+    }
+
+    unsigned begin = o->count, *link = &nodes[g].child;
+    a = nodes[g].child;
+    for (unsigned next ; a != EC_GLOB_OPT_NONE ; a = next) {
+        next = nodes[a].next;
+        if (nodes[a].slot != EC_GLOB_OPT_NONE) o->table[nodes[a].slot] = 0;
+        if (nodes[a].moved) continue;
+
+        // the length of the common prefix of the alternatives
+        unsigned len = 0, alts = 1;
+        if (nodes[a].link != EC_GLOB_OPT_NONE && depth < EC_GLOB_OPT_MAX_DEPTH
+            && o->count + 2 <= o->capacity) {
+            for (unsigned n = nodes[a].child ; n != EC_GLOB_OPT_NONE
+                 && ec_glob_opt_atom(o, n) ; n = nodes[n].next) len++;
+            for (unsigned b = nodes[a].link ; b != EC_GLOB_OPT_NONE ;
+                 b = nodes[b].link, alts++) {
+                unsigned i = 0;
+                for (unsigned n = nodes[a].child, m = nodes[b].child ; i < len
+                     && m != EC_GLOB_OPT_NONE && ec_glob_opt_same(o, n, m) ;
+                     n = nodes[n].next, m = nodes[m].next) i++;
+                len = i;
+            }
+        }
+        if (len * (alts - 1) <= 2) {
+            *link = a;
+            link = &nodes[a].next;
+            continue;
+        }
+
+        // the new alternative holds the prefix and the choice of the rest
+        unsigned alt = ec_glob_opt_node(o, EC_GLOB_TOK_ALT);
+        unsigned choice = ec_glob_opt_node(o, EC_GLOB_TOK_OPEN);
+        unsigned last = nodes[a].child;
+        for (unsigned i = 1 ; i < len ; i++) last = nodes[last].next;
+        nodes[alt].child = nodes[a].child;
+        nodes[alt].link = a;
+        nodes[alt].tail = last;
+        for (unsigned b = a ; b != EC_GLOB_OPT_NONE ; b = nodes[b].link) {
+            for (unsigned i = 0 ; i < len ; i++) {
+                nodes[b].child = nodes[nodes[b].child].next;
+            }
+            nodes[b].moved = b != a;
+        }
+        nodes[last].next = choice;
+        nodes[choice].child = a;
+        *link = alt;
+        link = &nodes[alt].next;
     }
+    *link = EC_GLOB_OPT_NONE;
 
+    // the moved alternatives are only linked once the choice was walked
+    for (unsigned n = begin, end = o->count ; n < end ; n += 2) {
+        for (unsigned b = nodes[n].link ; b != EC_GLOB_OPT_NONE ;
+             b = nodes[b].link) {
+            nodes[b].moved = 0;
+            nodes[b].next = nodes[b].link;
+        }
+        ec_glob_opt_choice(o, &nodes[nodes[n].tail].next, depth + 1);
+    }
+}
+
+static unsigned ec_glob_opt_group_hash(const struct ec_glob_opt *o,
+                                       unsigned g) {
+    unsigned hash = EC_GLOB_TOK_OPEN * 0x9e3779b1u;
+    for (unsigned a = o->nodes[g].child ; a != EC_GLOB_OPT_NONE ;
+         a = o->nodes[a].next) {
+        hash = (hash ^ ec_glob_opt_seq_hash(o, o->nodes[a].child)) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Simplifies the alternatives of a choice and removes the tokens that
+ * all of them start or end with, which the caller puts around the choice.
+ */
+static void ec_glob_opt_group(struct ec_glob_opt *o, unsigned g,
+                              unsigned depth, unsigned *prefix,
+                              unsigned *suffix) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned a;
+    for (a = nodes[g].child ; a != EC_GLOB_OPT_NONE ; a = nodes[a].next) {
+        nodes[a].child = ec_glob_opt_seq(o, nodes[a].child, depth);
+    }
+    ec_glob_opt_flatten(o, g);
+
+    *prefix = *suffix = EC_GLOB_OPT_NONE;
+    if (nodes[nodes[g].child].next != EC_GLOB_OPT_NONE) {
+        // {*.yaml,*.yml} becomes *.y{a,}ml
+        *prefix = ec_glob_opt_hoist(o, g);
+        for (a = nodes[g].child ; a != EC_GLOB_OPT_NONE ; a = nodes[a].next) {
+            nodes[a].child = ec_glob_opt_reverse(o, nodes[a].child);
+        }
+        *suffix = ec_glob_opt_reverse(o, ec_glob_opt_hoist(o, g));
+        for (a = nodes[g].child ; a != EC_GLOB_OPT_NONE ; a = nodes[a].next) {
+            nodes[a].child = ec_glob_opt_reverse(o, nodes[a].child);
+        }
+
+        // the choice might now be a list of choices, like {a{b,c},a{d,e}}
+        if (*prefix != EC_GLOB_OPT_NONE || *suffix != EC_GLOB_OPT_NONE) {
+            ec_glob_opt_flatten(o, g);
+        }
+        ec_glob_opt_factor(o, g, depth);
+    }
+    nodes[g].hash = ec_glob_opt_group_hash(o, g);
+}
+
+/*
+ * Appends the list to the list ending at the link and returns the new end.
+ */
+static unsigned *ec_glob_opt_append(struct ec_glob_opt *o, unsigned *link,
+                                    unsigned n) {
+    *link = n;
+    for (; n != EC_GLOB_OPT_NONE ; n = o->nodes[n].next) {
+        link = &o->nodes[n].next;
+    }
+    return link;
+}
+
+/*
+ * Simplifies the choice at the link and puts the tokens hoisted from its
+ * alternatives around it, or replaces it by its only alternative.
+ * Returns the link behind the replacement.
+ */
+static unsigned *ec_glob_opt_choice(struct ec_glob_opt *o, unsigned *link,
+                                    unsigned depth) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned g = *link, next = nodes[g].next, prefix, suffix;
+    ec_glob_opt_group(o, g, depth, &prefix, &suffix);
+    unsigned alt = nodes[g].child;
+    if (nodes[alt].next == EC_GLOB_OPT_NONE) {
+        link = ec_glob_opt_append(o, link, nodes[alt].child);
+    } else {
+        link = ec_glob_opt_append(o, link, prefix);
+        *link = g;
+        nodes[g].next = EC_GLOB_OPT_NONE;
+        link = ec_glob_opt_append(o, &nodes[g].next, suffix);
+    }
+    *link = next;
+    return link;
+}
+
+/*
+ * Simplifies the choices of a list of nodes and merges runs of stars.
+ */
+static unsigned ec_glob_opt_seq(struct ec_glob_opt *o, unsigned head,
+                                unsigned depth) {
+    struct ec_glob_opt_node *nodes = o->nodes;
+    unsigned *link = &head;
+    while (*link != EC_GLOB_OPT_NONE) {
+        if (nodes[*link].type == EC_GLOB_TOK_OPEN) {
+            link = ec_glob_opt_choice(o, link, depth + 1);
+        } else {
+            link = &nodes[*link].next;
+        }
+    }
+
+    // a star next to a globstar matches nothing the globstar does not
+    for (unsigned n = head ; n != EC_GLOB_OPT_NONE ; n = nodes[n].next) {
+        while (ec_glob_opt_star(o, n) && nodes[n].next != EC_GLOB_OPT_NONE
+               && ec_glob_opt_star(o, nodes[n].next)) {
+            if (nodes[nodes[n].next].type == EC_GLOB_TOK_GLOBSTAR) {
+                nodes[n].type = EC_GLOB_TOK_GLOBSTAR;
+                nodes[n].hash = ec_glob_opt_atom_hash(o, n);
+            }
+            nodes[n].next = nodes[nodes[n].next].next;
+        }
+    }
+    // the slash behind a globstar lets **/** match anything **/* does
+    for (unsigned n = head ; n != EC_GLOB_OPT_NONE ; n = nodes[n].next) {
+        unsigned slash = nodes[n].next, star;
+        if (nodes[n].type == EC_GLOB_TOK_GLOBSTAR && slash != EC_GLOB_OPT_NONE
+            && nodes[slash].type == EC_GLOB_TOK_CHAR && nodes[slash].chr == '/'
+            && (star = nodes[slash].next) != EC_GLOB_OPT_NONE
+            && nodes[star].type == EC_GLOB_TOK_GLOBSTAR) {
+            nodes[star].type = EC_GLOB_TOK_STAR;
+            nodes[star].hash = ec_glob_opt_atom_hash(o, star);
+        }
+    }
+    return head;
+}
+
+/*
+ * Emits the tokens of the nodes. Returns zero when they do not fit.
+ */
+static _Bool ec_glob_opt_emit(const struct ec_glob_opt *o, unsigned n,
+                              struct ec_glob_prog *out, unsigned capacity) {
+    const struct ec_glob_opt_node *nodes = o->nodes;
+    for (; n != EC_GLOB_OPT_NONE ; n = nodes[n].next) {
+        if (out->tok_count == capacity) return 0;
+        unsigned tok = ec_glob_prog_add(out, nodes[n].type, nodes[n].chr);
+        out->toks[tok].arg = nodes[n].arg;
+        if (nodes[n].type != EC_GLOB_TOK_OPEN) continue;
+
+        unsigned last = tok;
+        for (unsigned a = nodes[n].child ; a != EC_GLOB_OPT_NONE ;
+             a = nodes[a].next) {
+            if (a != nodes[n].child) {
+                if (out->tok_count == capacity) return 0;
+                last = out->toks[last].arg =
+                        ec_glob_prog_add(out, EC_GLOB_TOK_ALT, 0);
+            }
+            if (!ec_glob_opt_emit(o, nodes[a].child, out, capacity)) return 0;
+        }
+        if (out->tok_count == capacity) return 0;
+        unsigned close = ec_glob_prog_add(out, EC_GLOB_TOK_CLOSE, 0);
+        out->toks[last].arg = close;
+        out->toks[close].arg = tok;
+        for (unsigned t = tok ; t != close ; t = out->toks[t].arg) {
+            out->toks[t].close = close;
+        }
+    }
+    return 1;
+}
+#endif
+
+/*
+ * Rewrites the tokens of a parsed pattern into a smaller equivalent one.
+ * The scratch memory is taken from the stack for short patterns, and when
+ * it cannot be allocated the pattern remains unchanged.
+ */
+static void ec_glob_optimize(struct ec_glob_prog *prog,
+                             const struct ec_glob_allocator *allocator) {
+#if EC_GLOB_USE_OPTIMIZER
+    // the spans of num ranges depend on the alternatives that matched them
+    if (prog->numrange_count > 0) return;
+
+    // only choices and adjacent stars can be simplified
+    unsigned t;
+    for (t = 0 ; t + 1 < prog->tok_count ; t++) {
+        unsigned char type = prog->toks[t].type, next = prog->toks[t + 1].type;
+        if (type == EC_GLOB_TOK_OPEN) break;
+        if ((type == EC_GLOB_TOK_STAR || type == EC_GLOB_TOK_GLOBSTAR)
+            && (next == EC_GLOB_TOK_STAR || next == EC_GLOB_TOK_GLOBSTAR)) break;
+        if (type == EC_GLOB_TOK_GLOBSTAR && next == EC_GLOB_TOK_CHAR
+            && prog->toks[t + 1].chr == '/' && t + 2 < prog->tok_count
+            && prog->toks[t + 2].type == EC_GLOB_TOK_GLOBSTAR) break;
+    }
+    if (t + 1 >= prog->tok_count) return;
+
+    // every token needs at most one node, and factoring adds two nodes
+    // for every second alternative at most
+    struct ec_glob_opt o;
+    unsigned slots = 1;
+    while (slots < 2 * prog->tok_count) slots *= 2;
+    o.prog = prog;
+    o.count = 0;
+    o.capacity = 2 * prog->tok_count;
+    o.mask = slots - 1;
+    size_t size = o.capacity * sizeof(struct ec_glob_opt_node)
+                  + slots * sizeof(unsigned)
+                  + prog->tok_count * sizeof(struct ec_glob_tok);
+    long stack[EC_GLOB_OPT_STACK_SIZE / sizeof(long)];
+    void *mem = stack;
+    if (size > sizeof(stack)) {
+        mem = ec_glob_alloc(allocator, size);
+        if (mem == NULL) return;
+    }
+    o.nodes = mem;
+    o.table = (unsigned *) (o.nodes + o.capacity);
+    memset(o.table, 0, slots * sizeof(unsigned));
+
+    t = 0;
+    unsigned head = ec_glob_opt_build(&o, &t);
+    head = ec_glob_opt_seq(&o, head, 0);
+
+    struct ec_glob_prog out = *prog;
+    out.toks = (struct ec_glob_tok *) (o.table + slots);
+    out.tok_count = 0;
+    out.backtrack_count = 0;
+    if (ec_glob_opt_emit(&o, head, &out, prog->tok_count)) {
+        memcpy(prog->toks, out.toks, out.tok_count * sizeof(struct ec_glob_tok));
+        prog->tok_count = out.tok_count;
+        prog->backtrack_count = out.backtrack_count;
+    }
+
+    if (mem != stack) ec_glob_dealloc(allocator, mem, size);
+#else
+    (void) prog;
+    (void) allocator;
+#endif
+}
+
+/*
+ * Combines every literal alternative of the group with every literal in
+ * the set, either in front of them (for suffixes) or behind them (for
+ * prefixes). Returns zero, when the group is not purely literal or the
+ * combinations would not fit, in which case the set remains unchanged.
+ */
+static _Bool ec_glob_literals_combine(struct ec_glob_literals *lits,
+                                      const struct ec_glob_prog *prog,
+                                      unsigned open, _Bool front) {
+    const struct ec_glob_tok *toks = prog->toks;
+    struct ec_glob_literals result;
+    result.count = 0;
+    unsigned begin = open + 1;
+    for (;;) {
+        unsigned end = toks[begin - 1].arg;
+        unsigned altlen = end - begin;
+        for (unsigned t = begin ; t < end ; t++) {
+            if (toks[t].type != EC_GLOB_TOK_CHAR) return 0;
+        }
+        for (unsigned i = 0 ; i < lits->count ; i++) {
+            unsigned len = altlen + lits->len[i];
+            if (len > EC_GLOB_PREFILTER_LEN) return 0;
+            char buf[EC_GLOB_PREFILTER_LEN];
+            char *alt = front ? buf : buf + lits->len[i];
+            memcpy(front ? buf + altlen : buf, lits->str[i], lits->len[i]);
+            for (unsigned t = begin ; t < end ; t++) {
+                *alt++ = (char) toks[t].chr;
+            }
+            // skip duplicates
+            unsigned j = 0;
+            while (j < result.count && (result.len[j] != len
+                    || memcmp(result.str[j], buf, len) != 0)) {
+                j++;
+            }
+            if (j < result.count) continue;
+            if (result.count == EC_GLOB_PREFILTER_COUNT) return 0;
+            memcpy(result.str[j], buf, len);
+            result.len[j] = len;
+            result.count++;
+        }
+        if (toks[end].type == EC_GLOB_TOK_CLOSE) break;
+        begin = end + 1;
+    }
+    *lits = result;
+    return 1;
+}
+
+/*
+ * Extracts the literals every matching string must start or end with.
+ * Literal characters and groups of literal alternatives are combined,
+ * until the first token which can match variable text.
+ * Returns the index of the first token after the prefix literals, or the
+ * number of tokens in front of the suffix literals, respectively.
+ */
+static unsigned ec_glob_literals_extract(struct ec_glob_literals *lits,
+                                         const struct ec_glob_prog *prog,
+                                         _Bool suffix) {
+    const struct ec_glob_tok *toks = prog->toks;
+    lits->count = 1;
+    lits->len[0] = 0;
+    unsigned t = suffix ? prog->tok_count : 0;
+    for (;;) {
+        if (suffix ? t == 0 : t == prog->tok_count) break;
+        const struct ec_glob_tok *tok = &toks[suffix ? t - 1 : t];
+        if (tok->type == EC_GLOB_TOK_CHAR) {
+            for (unsigned i = 0 ; i < lits->count ; i++) {
+                if (lits->len[i] == EC_GLOB_PREFILTER_LEN) return t;
+            }
+            for (unsigned i = 0 ; i < lits->count ; i++) {
+                if (suffix) {
+                    memmove(lits->str[i] + 1, lits->str[i], lits->len[i]);
+                    lits->str[i][0] = (char) tok->chr;
+                } else {
+                    lits->str[i][lits->len[i]] = (char) tok->chr;
+                }
+                lits->len[i]++;
+            }
+            t = suffix ? t - 1 : t + 1;
+        } else if (suffix && tok->type == EC_GLOB_TOK_CLOSE) {
+            if (!ec_glob_literals_combine(lits, prog, tok->arg, 1)) break;
+            t = tok->arg;
+        } else if (!suffix && tok->type == EC_GLOB_TOK_OPEN) {
+            if (!ec_glob_literals_combine(lits, prog, t, 0)) break;
+            t = tok->close + 1;
+        } else {
+            break;
+        }
+    }
+    return t;
+}
+
+static _Bool ec_glob_literals_prefix(const struct ec_glob_literals *lits,
+                                     const char *string, size_t len) {
+    for (unsigned i = 0 ; i < lits->count ; i++) {
+        if (len >= lits->len[i]
+            && memcmp(string, lits->str[i], lits->len[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static _Bool ec_glob_literals_suffix(const struct ec_glob_literals *lits,
+                                     const char *string, size_t len) {
+    for (unsigned i = 0 ; i < lits->count ; i++) {
+        if (len >= lits->len[i] && memcmp(string + len - lits->len[i],
+                lits->str[i], lits->len[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static _Bool ec_glob_literals_equal(const struct ec_glob_literals *lits,
+                                    const char *string, size_t len) {
+    for (unsigned i = 0 ; i < lits->count ; i++) {
+        if (len == lits->len[i]
+            && memcmp(string, lits->str[i], len) == 0) return 1;
+    }
+    return 0;
+}
+
+#if EC_GLOB_USE_SHAPES
+static _Bool ec_glob_literals_have_slash(const struct ec_glob_literals *lits) {
+    for (unsigned i = 0 ; i < lits->count ; i++) {
+        if (memchr(lits->str[i], '/', lits->len[i]) != NULL) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Recognizes the shape of the pattern from the positions where the
+ * extraction of the prefix and suffix literals stopped.
+ */
+static enum ec_glob_shape ec_glob_classify(const struct ec_glob_prog *prog,
+                                           const struct ec_glob_prefilter *filter,
+                                           unsigned prefix_end,
+                                           unsigned suffix_begin) {
+    const struct ec_glob_tok *toks = prog->toks;
+    const unsigned n = prog->tok_count;
+    if (prefix_end == n) {
+        return ec_glob_shape_literal;
+    }
+    if (prefix_end == n - 1 && toks[n - 1].type == EC_GLOB_TOK_GLOBSTAR) {
+        return ec_glob_shape_prefix;
+    }
+    if (suffix_begin == 1 && toks[0].type == EC_GLOB_TOK_GLOBSTAR) {
+        return ec_glob_shape_suffix;
+    }
+    // a single wildcard must not match across a slash of the literal
+    if (ec_glob_literals_have_slash(&filter->suffix)) {
+        return ec_glob_shape_none;
+    }
+    if (suffix_begin == 1 && toks[0].type == EC_GLOB_TOK_STAR) {
+        return ec_glob_shape_name;
+    }
+    if (suffix_begin == 3 && toks[0].type == EC_GLOB_TOK_GLOBSTAR
+        && toks[1].type == EC_GLOB_TOK_CHAR && toks[1].chr == '/'
+        && toks[2].type == EC_GLOB_TOK_STAR) {
+        return ec_glob_shape_basename;
+    }
+    return ec_glob_shape_none;
+}
+#endif
+
+static int ec_glob_shape_match(const struct ec_glob_s *glob,
+                               const char *string, size_t len) {
+    const struct ec_glob_literals *prefix = &glob->filter.prefix;
+    const struct ec_glob_literals *suffix = &glob->filter.suffix;
+    switch (glob->shape) {
+        case ec_glob_shape_literal:
+            return !ec_glob_literals_equal(prefix, string, len);
+        case ec_glob_shape_prefix:
+            return !ec_glob_literals_prefix(prefix, string, len);
+        case ec_glob_shape_name:
+            if (memchr(string, '/', len) != NULL) return 1;
+            return !ec_glob_literals_suffix(suffix, string, len);
+        case ec_glob_shape_basename: {
+            size_t slash = len;
+            while (slash > 0 && string[slash - 1] != '/') {
+                slash--;
+            }
+            if (slash == 0) return 1;
+            return !ec_glob_literals_suffix(suffix, string + slash,
+                                            len - slash);
+        }
+        case ec_glob_shape_suffix:
+            return !ec_glob_literals_suffix(suffix, string, len);
+        default:
+            return 1;
+    }
+}
+
+/*
+ * Extracts the prefilter and recognizes the shape of the pattern.
+ */
+static void ec_glob_analyze(struct ec_glob_s *glob) {
+    struct ec_glob_prefilter *filter = &glob->filter;
+    unsigned prefix_end = ec_glob_literals_extract(&filter->prefix,
+                                                   &glob->prog, 0);
+    unsigned suffix_begin = ec_glob_literals_extract(&filter->suffix,
+                                                     &glob->prog, 1);
+#if EC_GLOB_USE_SHAPES
+    glob->shape = ec_glob_classify(&glob->prog, filter,
+                                   prefix_end, suffix_begin);
+    if (glob->shape != ec_glob_shape_none) return;
+#else
+    (void) prefix_end;
+    (void) suffix_begin;
+    glob->shape = ec_glob_shape_none;
+#endif
+
+#if EC_GLOB_USE_PREFILTER
+    // an empty literal matches every string
+    for (unsigned i = 0 ; i < filter->prefix.count ; i++) {
+        if (filter->prefix.len[i] == 0) filter->prefix.count = 0;
+    }
+    for (unsigned i = 0 ; i < filter->suffix.count ; i++) {
+        if (filter->suffix.len[i] == 0) filter->suffix.count = 0;
+    }
+#else
+    filter->prefix.count = 0;
+    filter->suffix.count = 0;
+#endif
+}
+
+/*
+ * Checks the required literals before running the engine.
+ * Returns zero, when the string cannot match.
+ */
+static _Bool ec_glob_prefilter_test(const struct ec_glob_prefilter *filter,
+                                    const char *string, size_t len) {
+    if (filter->suffix.count > 0
+        && !ec_glob_literals_suffix(&filter->suffix, string, len)) return 0;
+    if (filter->prefix.count > 0
+        && !ec_glob_literals_prefix(&filter->prefix, string, len)) return 0;
+    return 1;
+}
+
+static void ec_glob_regex_cat_escaped(struct ec_glob_re *re, char c) {
+    if (strchr(".[]{}()\\*+?^$|", c) != NULL) {
+        ec_glob_catc(*re, '\\');
+    }
+    ec_glob_catc(*re, c);
+}
+
+/*
+ * Translates a class into a POSIX bracket expression.
+ * The special characters are placed where they are treated literally.
+ */
+static void ec_glob_regex_cat_class(struct ec_glob_re *re,
+                                    const struct ec_glob_class *cls) {
+    unsigned count = 0;
+    unsigned first = 0;
+    for (unsigned c = 1 ; c < 256 ; c++) {
+        if (ec_glob_class_test(cls, c)) {
+            if (count++ == 0) first = c;
+        }
+    }
+
+    if (count == 0) {
+        // "[]" would start a class containing ']', so never match instead
+        ec_glob_cats(*re, "(.^)");
+        return;
+    }
+    if (count == 255) {
+        ec_glob_catc(*re, '.');
+        return;
+    }
+    if (count == 1) {
+        ec_glob_regex_cat_escaped(re, (char) first);
+        return;
+    }
+
+    // use the negated form when it is shorter
+    _Bool negated = count > 127;
+    ec_glob_catc(*re, '[');
+    if (negated) {
+        ec_glob_catc(*re, '^');
+    }
+#define ec_glob_regex_member(c) (c != 0 && !ec_glob_class_test(cls, c) == negated)
+    _Bool empty = 1;
+    if (ec_glob_regex_member(']')) {
+        ec_glob_catc(*re, ']');
+        empty = 0;
+    }
+    for (unsigned c = 1 ; c < 256 ; c++) {
+        if (!ec_glob_regex_member(c) || strchr("]-^[", c) != NULL) continue;
+        // only use ranges for alphanumeric characters
+        unsigned end = c;
+        if (isalnum(c)) {
+            while (end < 255 && isalnum(end + 1)
+                   && ec_glob_regex_member(end + 1)) {
+                end++;
+            }
+        }
+        ec_glob_catc(*re, (char) c);
+        if (end > c + 1) {
+            ec_glob_catc(*re, '-');
+        }
+        if (end > c) {
+            ec_glob_catc(*re, (char) end);
+        }
+        c = end;
+        empty = 0;
+    }
+    if (ec_glob_regex_member('[')) {
+        ec_glob_catc(*re, '[');
+        empty = 0;
+    }
+    _Bool minus = ec_glob_regex_member('-');
+    if (ec_glob_regex_member('^')) {
+        // ^ must not be first, - may be first
+        if (empty && minus) {
+            ec_glob_catc(*re, '-');
+            minus = 0;
+        }
+        ec_glob_catc(*re, '^');
+    }
+    if (minus) {
+        ec_glob_catc(*re, '-');
+    }
+#undef ec_glob_regex_member
+    ec_glob_catc(*re, ']');
+}
+
+struct ec_glob_numrange_seq {
+    void (*emit)(void *ctx, const unsigned char *lo,
+                 const unsigned char *hi, unsigned len);
+    void *ctx;
+    unsigned len;
+    unsigned char lo[24];
+    unsigned char hi[24];
+};
+
+static void ec_glob_numrange_split(struct ec_glob_numrange_seq *seq,
+                                   const unsigned char *a,
+                                   const unsigned char *b, unsigned i) {
+    if (i == seq->len) {
+        seq->emit(seq->ctx, seq->lo, seq->hi, seq->len);
+        return;
+    }
+    if (a[i] == b[i]) {
+        seq->lo[i] = seq->hi[i] = a[i];
+        ec_glob_numrange_split(seq, a, b, i + 1);
+        return;
+    }
+
+    _Bool a_zeros = 1, b_nines = 1;
+    for (unsigned j = i + 1 ; j < seq->len ; j++) {
+        a_zeros &= a[j] == '0';
+        b_nines &= b[j] == '9';
+    }
+    unsigned char mid_lo = a_zeros ? a[i] : a[i] + 1;
+    unsigned char mid_hi = b_nines ? b[i] : b[i] - 1;
+
+    unsigned char bound[24];
+    if (!a_zeros) {
+        // a[i] followed by anything from the rest of a to 99...9
+        memset(bound, '9', seq->len);
+        seq->lo[i] = seq->hi[i] = a[i];
+        ec_glob_numrange_split(seq, a, bound, i + 1);
+    }
+    if (mid_lo <= mid_hi) {
+        seq->lo[i] = mid_lo;
+        seq->hi[i] = mid_hi;
+        for (unsigned j = i + 1 ; j < seq->len ; j++) {
+            seq->lo[j] = '0';
+            seq->hi[j] = '9';
+        }
+        seq->emit(seq->ctx, seq->lo, seq->hi, seq->len);
+    }
+    if (!b_nines) {
+        // b[i] followed by anything from 00...0 to the rest of b
+        memset(bound, '0', seq->len);
+        seq->lo[i] = seq->hi[i] = b[i];
+        ec_glob_numrange_split(seq, bound, b, i + 1);
+    }
+}
+
+static unsigned ec_glob_numrange_digits(unsigned long n, unsigned char *buf) {
+    char tmp[24];
+    unsigned len = 0;
+    do {
+        tmp[len++] = (char) ('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    for (unsigned i = 0 ; i < len ; i++) {
+        buf[i] = tmp[len - 1 - i];
+    }
+    return len;
+}
+
+/*
+ * Calls emit for every sequence of digit ranges that together match
+ * exactly the decimal numbers from lo to hi without leading zeros.
+ */
+static void ec_glob_numrange_expand(unsigned long lo, unsigned long hi,
+        void (*emit)(void *, const unsigned char *,
+                     const unsigned char *, unsigned),
+        void *ctx) {
+    struct ec_glob_numrange_seq seq;
+    seq.emit = emit;
+    seq.ctx = ctx;
+    unsigned char a[24], b[24];
+    while (lo <= hi) {
+        // split the range by the number of digits
+        unsigned len = ec_glob_numrange_digits(lo, a);
+        unsigned long upper = 9;
+        for (unsigned i = 1 ; i < len ; i++) upper = upper * 10 + 9;
+        if (upper > hi) upper = hi;
+        ec_glob_numrange_digits(upper, b);
+        seq.len = len;
+        ec_glob_numrange_split(&seq, a, b, 0);
+        if (upper == hi) break;
+        lo = upper + 1;
+    }
+}
+
+/*
+ * Calls emit for the magnitudes of the numbers within a num range.
+ * The sign is zero when the magnitude is zero (which may have any sign),
+ * one for positive numbers with optional plus and minus one for negative
+ * numbers. The string must start with the sign, followed by an arbitrary
+ * amount of leading zeros and then one of the digit sequences.
+ */
+static void ec_glob_numrange_signed(const struct numpair_s *range,
+        void (*emit)(void *, int, unsigned long, unsigned long),
+        void *ctx) {
+    if (range->min > range->max) return;
+    if (range->min < 0) {
+        unsigned long lo = range->max < 0 ? -(unsigned long) range->max : 1;
+        emit(ctx, -1, lo, -(unsigned long) range->min);
+    }
+    if (range->min <= 0 && range->max >= 0) {
+        emit(ctx, 0, 0, 0);
+    }
+    if (range->max > 0) {
+        unsigned long lo = range->min > 0 ? (unsigned long) range->min : 1;
+        emit(ctx, 1, lo, (unsigned long) range->max);
+    }
+}
+
+struct ec_glob_regex_numrange_ctx {
+    struct ec_glob_re *re;
+    _Bool first;
+};
+
+static void ec_glob_regex_numrange_digits(void *data, const unsigned char *lo,
+                                          const unsigned char *hi,
+                                          unsigned len) {
+    struct ec_glob_regex_numrange_ctx *ctx = data;
+    if (!ctx->first) {
+        ec_glob_catc(*ctx->re, '|');
+    }
+    ctx->first = 0;
+    for (unsigned i = 0 ; i < len ; i++) {
+        if (lo[i] == hi[i]) {
+            ec_glob_catc(*ctx->re, (char) lo[i]);
+        } else {
+            ec_glob_catc(*ctx->re, '[');
+            ec_glob_catc(*ctx->re, (char) lo[i]);
+            ec_glob_catc(*ctx->re, '-');
+            ec_glob_catc(*ctx->re, (char) hi[i]);
+            ec_glob_catc(*ctx->re, ']');
+        }
+    }
+}
+
+static void ec_glob_regex_numrange_sign(void *data, int sign,
+                                        unsigned long lo, unsigned long hi) {
+    struct ec_glob_regex_numrange_ctx *ctx = data;
+    if (!ctx->first) {
+        ec_glob_catc(*ctx->re, '|');
+    }
+    if (sign == 0) {
+        ec_glob_cats(*ctx->re, "[-+]?0+");
+    } else {
+        if (sign < 0) {
+            ec_glob_cats(*ctx->re, "-0*(");
+        } else {
+            ec_glob_cats(*ctx->re, "\\+?0*(");
+        }
+        ctx->first = 1;
+        ec_glob_numrange_expand(lo, hi, ec_glob_regex_numrange_digits, ctx);
+        ec_glob_catc(*ctx->re, ')');
+    }
+    ctx->first = 0;
+}
+
+/*
+ * Appends an expression which matches exactly the numbers within the range,
+ * with the same optional sign and leading zeros the other engines accept.
+ */
+static void ec_glob_regex_cat_numrange(struct ec_glob_re *re,
+                                       const struct numpair_s *range) {
+    struct ec_glob_regex_numrange_ctx ctx = {re, 1};
+    ec_glob_catc(*re, '(');
+    ec_glob_numrange_signed(range, ec_glob_regex_numrange_sign, &ctx);
+    if (ctx.first) {
+        // the range is empty, so the expression must never match
+        ec_glob_cats(*re, ".^");
+    }
+    ec_glob_catc(*re, ')');
+}
+
+#ifdef EC_GLOB_USE_PCRE2
+/*
+ * The PCRE2 backend uses the native API. The match data and the JIT stack
+ * are created once per thread, because the expressions never capture and
+ * the match data only needs room for the whole match.
+ */
+#ifndef EC_GLOB_PCRE2_JIT_STACK_SIZE
+#define EC_GLOB_PCRE2_JIT_STACK_SIZE (512 * 1024)
+#endif
+
+struct ec_glob_pcre2_thread {
+    pcre2_match_data *data;
+    pcre2_match_context *context;
+    pcre2_jit_stack *stack;
+};
+
+static pthread_key_t ec_glob_pcre2_key;
+static pthread_once_t ec_glob_pcre2_once = PTHREAD_ONCE_INIT;
+
+static void ec_glob_pcre2_destroy(void *data) {
+    struct ec_glob_pcre2_thread *thread = data;
+    pcre2_match_data_free(thread->data);
+    pcre2_match_context_free(thread->context);
+    pcre2_jit_stack_free(thread->stack);
+    free(thread);
+}
+
+static void ec_glob_pcre2_init(void) {
+    pthread_key_create(&ec_glob_pcre2_key, ec_glob_pcre2_destroy);
+}
+
+static struct ec_glob_pcre2_thread *ec_glob_pcre2_thread(void) {
+    pthread_once(&ec_glob_pcre2_once, ec_glob_pcre2_init);
+    struct ec_glob_pcre2_thread *thread =
+            pthread_getspecific(ec_glob_pcre2_key);
+    if (thread != NULL) return thread;
+
+    thread = malloc(sizeof(struct ec_glob_pcre2_thread));
+    if (thread == NULL) return NULL;
+    thread->data = pcre2_match_data_create(1, NULL);
+    thread->context = pcre2_match_context_create(NULL);
+    thread->stack = pcre2_jit_stack_create(32 * 1024,
+            EC_GLOB_PCRE2_JIT_STACK_SIZE, NULL);
+    if (thread->data == NULL || thread->context == NULL
+        || thread->stack == NULL
+        || pthread_setspecific(ec_glob_pcre2_key, thread) != 0) {
+        ec_glob_pcre2_destroy(thread);
+        return NULL;
+    }
+    pcre2_jit_stack_assign(thread->context, NULL, thread->stack);
+    return thread;
+}
+
+static int ec_glob_pcre2_compile(struct ec_glob_s *glob, const char *pattern) {
+    int error;
+    PCRE2_SIZE offset;
+    // like a POSIX expression, the dot also matches newlines and the
+    // dollar only matches at the very end
+    glob->re = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+            PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY | PCRE2_NO_AUTO_CAPTURE,
+            &error, &offset, NULL);
+    if (glob->re == NULL) {
+        return error == PCRE2_ERROR_HEAP_FAILED ? REG_ESPACE : REG_BADPAT;
+    }
+    // a pattern which is matched only once is faster without JIT,
+    // and the interpreter takes over when JIT is not available
+    if (glob->reused) {
+        pcre2_jit_compile(glob->re, PCRE2_JIT_COMPLETE);
+    }
+    return 0;
+}
+#endif
+
+static int ec_glob_regex_compile(struct ec_glob_s *glob) {
+    char stack[EC_GLOB_STACK_CAPACITY];
+    struct ec_glob_re re_pattern = {
+            stack, 1, EC_GLOB_STACK_CAPACITY, &glob->allocator, 0
+    };
+    re_pattern.str[0] = '^';
+
+    const struct ec_glob_prog *prog = &glob->prog;
+
+    // translate the tokens to a POSIX regular expression
+    for (unsigned t = 0 ; t < prog->tok_count ; t++) {
+        const struct ec_glob_tok *tok = &prog->toks[t];
+        switch (tok->type) {
+            case EC_GLOB_TOK_CHAR:
+                ec_glob_regex_cat_escaped(&re_pattern, (char) tok->chr);
+                break;
+            case EC_GLOB_TOK_ANY:
+                ec_glob_catc(re_pattern, '.');
+                break;
+            case EC_GLOB_TOK_STAR:
+                ec_glob_cats(re_pattern, "[^/]*");
+                break;
+            case EC_GLOB_TOK_GLOBSTAR:
+                ec_glob_cats(re_pattern, ".*");
+                break;
+            case EC_GLOB_TOK_CLASS:
+                ec_glob_regex_cat_class(&re_pattern,
+                                        &prog->classes[tok->arg]);
+                break;
+            case EC_GLOB_TOK_OPEN:
+                ec_glob_catc(re_pattern, '(');
+                break;
+            case EC_GLOB_TOK_ALT:
+                ec_glob_catc(re_pattern, '|');
+                break;
+            case EC_GLOB_TOK_CLOSE:
+                ec_glob_catc(re_pattern, ')');
+                break;
+            case EC_GLOB_TOK_NUMRANGE:
+                ec_glob_regex_cat_numrange(&re_pattern,
+                                           &prog->numranges[tok->arg]);
+                break;
+        }
+    }
+
+    // terminate the regular expression
+    ec_glob_catc(re_pattern, '$');
+    ec_glob_catc(re_pattern, '\0');
+
+    // compile the pattern - num ranges are exact, so we never need captures
+#ifdef EC_GLOB_USE_PCRE2
+    int status = re_pattern.oom ? REG_ESPACE
+            : ec_glob_pcre2_compile(glob, re_pattern.str);
+#else
+    int status = re_pattern.oom ? REG_ESPACE
+            : regcomp(&glob->re, re_pattern.str, REG_EXTENDED | REG_NOSUB);
+#endif
+
+    if (re_pattern.capacity > EC_GLOB_STACK_CAPACITY) {
+        ec_glob_dealloc(&glob->allocator, re_pattern.str, re_pattern.capacity);
+    }
+
+    return status;
+}
+
+static int ec_glob_regex_match(const struct ec_glob_s *glob,
+                               const char *string, size_t len) {
+#if defined(EC_GLOB_USE_PCRE2)
+    struct ec_glob_pcre2_thread *thread = ec_glob_pcre2_thread();
+    if (thread == NULL) return REG_ESPACE;
+    int rc = pcre2_match(glob->re, (PCRE2_SPTR) string, len, 0, 0,
+                         thread->data, thread->context);
+    return rc >= 0 ? 0 : rc == PCRE2_ERROR_NOMATCH ? REG_NOMATCH : REG_ESPACE;
+#elif defined(REG_STARTEND)
+    // the bounds of the string
+    regmatch_t bounds;
+    bounds.rm_so = 0;
+    bounds.rm_eo = len;
+    return regexec(&glob->re, string, 0, &bounds, REG_STARTEND);
+#else
+    // the string may not be terminated, so we need a copy
+    char *copy = NULL;
+    if (string[len] != '\0') {
+        copy = ec_glob_alloc(&glob->allocator, len + 1);
+        if (copy == NULL) return REG_ESPACE;
+        memcpy(copy, string, len);
+        copy[len] = '\0';
+    }
+    int status = regexec(&glob->re, copy == NULL ? string : copy, 0, NULL, 0);
+    if (copy != NULL) {
+        ec_glob_dealloc(&glob->allocator, copy, len + 1);
+    }
+    return status;
+#endif
+}
+
+static void ec_glob_regex_free(struct ec_glob_s *glob) {
+#ifdef EC_GLOB_USE_PCRE2
+    pcre2_code_free(glob->re);
+#else
+    regfree(&glob->re);
+#endif
+}
+
+/*
+ * The size of a compiled regular expression is not exposed by the regex
+ * library, so we assume a fixed cost per token. PCRE2 reports its own.
+ */
+static size_t ec_glob_regex_memsize(const struct ec_glob_s *glob) {
+#ifdef EC_GLOB_USE_PCRE2
+    size_t code = 0, jit = 0;
+    pcre2_pattern_info(glob->re, PCRE2_INFO_SIZE, &code);
+    pcre2_pattern_info(glob->re, PCRE2_INFO_JITSIZE, &jit);
+    return code + jit;
+#else
+    return (glob->prog.tok_count + 1) * 64;
+#endif
+}
+
+static int ec_glob_nfa_build(struct ec_glob_nfa *nfa,
+                             const struct ec_glob_prog *prog,
+                             const struct ec_glob_allocator *allocator);
+static void ec_glob_nfa_free(struct ec_glob_nfa *nfa);
+static int ec_glob_pike_run(const struct ec_glob_s *glob,
+                            const struct ec_glob_nfa *nfa,
+                            const char *string, size_t len,
+                            size_t *slots, unsigned slot_count);
+
+/*
+ * The native engine matches the tokens directly against the string.
+ * Wildcards, alternatives and num ranges are choice points, whose attempts
+ * are tried one after another and backtracked on failure. The choice points
+ * are kept on a stack of a fixed depth instead of recursing. Failed
+ * (token, position) pairs are remembered in a bitmap, which bounds the work
+ * to a polynomial. The engine never allocates: when the bitmap for the
+ * pattern and string or the choice points do not fit on the stack, the Pike
+ * VM matches instead.
+ */
+struct ec_glob_native_ctx {
+    const struct ec_glob_prog *prog;
+    const char *string;
+    unsigned len;
+    unsigned char *memo;
+};
+
+// a choice point and its current attempt at token t and position pos
+struct ec_glob_native_frame {
+    unsigned char type;
+    _Bool negative;
+    // the OPEN or ALT token of the alternative, or the index of a num range
+    unsigned arg;
+    unsigned t;
+    unsigned pos;
+    long num;
+};
+
+static _Bool ec_glob_native_failed(const struct ec_glob_native_ctx *ctx,
+                                   unsigned t, unsigned pos) {
+    if (ctx->memo == NULL) return 0;
+    size_t bit = (size_t) t * (ctx->len + 1) + pos;
+    return ctx->memo[bit >> 3] & (1u << (bit & 7));
+}
+
+/*
+ * Moves a choice point to its next attempt which did not fail before,
+ * or with advance unset, to its first one. Returns zero when there is none.
+ */
+static _Bool ec_glob_native_next(const struct ec_glob_native_ctx *ctx,
+                                 struct ec_glob_native_frame *f,
+                                 _Bool advance) {
+    const struct ec_glob_tok *toks = ctx->prog->toks;
+    const char *s = ctx->string;
+    const unsigned len = ctx->len;
+
+    switch (f->type) {
+        case EC_GLOB_TOK_STAR:
+        case EC_GLOB_TOK_GLOBSTAR:
+            for (;;) {
+                if (advance) {
+                    if (f->pos >= len || (f->type == EC_GLOB_TOK_STAR
+                                          && s[f->pos] == '/')) return 0;
+                    f->pos++;
+                }
+                advance = 1;
+                // skip positions where a literal cannot match anyway
+                if ((toks[f->t].type != EC_GLOB_TOK_CHAR || (f->pos < len
+                     && (unsigned char) s[f->pos] == toks[f->t].chr))
+                    && !ec_glob_native_failed(ctx, f->t, f->pos)) return 1;
+            }
+        case EC_GLOB_TOK_OPEN:
+            for (;;) {
+                if (advance) {
+                    f->arg = toks[f->arg].arg;
+                    if (toks[f->arg].type != EC_GLOB_TOK_ALT) return 0;
+                }
+                advance = 1;
+                f->t = f->arg + 1;
+                if (!ec_glob_native_failed(ctx, f->t, f->pos)) return 1;
+            }
+        default: {
+            // every length of the digit sequence of a num range
+            const struct numpair_s *range = &ctx->prog->numranges[f->arg];
+            while (f->pos < len && s[f->pos] >= '0' && s[f->pos] <= '9') {
+                int digit = s[f->pos++] - '0';
+                if (f->negative) {
+                    if (f->num < (LONG_MIN + digit) / 10) return 0;
+                    f->num = f->num * 10 - digit;
+                } else {
+                    if (f->num > (LONG_MAX - digit) / 10) return 0;
+                    f->num = f->num * 10 + digit;
+                }
+                if (range->min <= f->num && f->num <= range->max
+                    && !ec_glob_native_failed(ctx, f->t, f->pos)) return 1;
+            }
+            return 0;
+        }
+    }
+}
+
+/*
+ * Returns one on a match, zero if the string does not match, or -1 if there
+ * are more choice points than fit on the stack.
+ */
+static int ec_glob_native_run(const struct ec_glob_native_ctx *ctx) {
+    const struct ec_glob_tok *toks = ctx->prog->toks;
+    const unsigned count = ctx->prog->tok_count;
+    const char *s = ctx->string;
+    const unsigned len = ctx->len;
+    struct ec_glob_native_frame frames[EC_GLOB_NATIVE_DEPTH];
+    unsigned top = 0;
+    unsigned t = 0, pos = 0;
+
+    for (;;) {
+        _Bool failed = 0;
+        while (!failed && t < count) {
+            const struct ec_glob_tok *tok = &toks[t];
+            struct ec_glob_native_frame choice = {
+                    tok->type, 0, 0, t + 1, pos, 0
+            };
+            switch (tok->type) {
+                case EC_GLOB_TOK_CHAR:
+                    failed = pos >= len || (unsigned char) s[pos] != tok->chr;
+                    pos++;
+                    t++;
+                    continue;
+                case EC_GLOB_TOK_ANY:
+                    failed = pos >= len;
+                    pos++;
+                    t++;
+                    continue;
+                case EC_GLOB_TOK_CLASS:
+                    failed = pos >= len || !ec_glob_class_test(
+                            &ctx->prog->classes[tok->arg], s[pos]);
+                    pos++;
+                    t++;
+                    continue;
+                case EC_GLOB_TOK_ALT:
+                    // end of an alternative, continue after the choice
+                    t = tok->close + 1;
+                    continue;
+                case EC_GLOB_TOK_CLOSE:
+                    t++;
+                    continue;
+                case EC_GLOB_TOK_STAR:
+                case EC_GLOB_TOK_GLOBSTAR:
+                    // a trailing wildcard only needs to check for slashes
+                    if (t + 1 == count) {
+                        if (tok->type == EC_GLOB_TOK_GLOBSTAR
+                            || memchr(s + pos, '/', len - pos) == NULL) {
+                            return 1;
+                        }
+                        failed = 1;
+                        continue;
+                    }
+                    break;
+                case EC_GLOB_TOK_OPEN:
+                    // try each alternative
+                    choice.arg = t;
+                    break;
+                case EC_GLOB_TOK_NUMRANGE:
+                    choice.arg = tok->arg;
+                    if (pos < len && (s[pos] == '-' || s[pos] == '+')) {
+                        choice.negative = s[pos] == '-';
+                        choice.pos++;
+                    }
+                    break;
+            }
+            if (top == EC_GLOB_NATIVE_DEPTH) return -1;
+            if (ec_glob_native_next(ctx, &choice, 0)) {
+                frames[top++] = choice;
+                t = choice.t;
+                pos = choice.pos;
+            } else {
+                failed = 1;
+            }
+        }
+        if (!failed && pos == len) return 1;
+
+        // the attempt of the innermost choice point failed
+        for (;;) {
+            if (top == 0) return 0;
+            struct ec_glob_native_frame *f = &frames[top - 1];
+            if (ctx->memo != NULL) {
+                size_t bit = (size_t) f->t * (ctx->len + 1) + f->pos;
+                ctx->memo[bit >> 3] |= 1u << (bit & 7);
+            }
+            if (ec_glob_native_next(ctx, f, 1)) {
+                t = f->t;
+                pos = f->pos;
+                break;
+            }
+            top--;
+        }
+    }
+}
+
+static int ec_glob_native_match(const struct ec_glob_s *glob,
+                                const char *string, size_t len) {
+    struct ec_glob_native_ctx ctx = {
+            &glob->prog, string, len, NULL
+    };
+
+    // a single backtracking point never needs the memo
+    unsigned char memo[EC_GLOB_NATIVE_MEMO_SIZE];
+    int result = -1;
+    if (glob->prog.backtrack_count <= 1) {
+        result = ec_glob_native_run(&ctx);
+    } else if ((size_t) (glob->prog.tok_count + 1) * (len + 1)
+               <= 8 * sizeof(memo)) {
+        memset(memo, 0, sizeof(memo));
+        ctx.memo = memo;
+        result = ec_glob_native_run(&ctx);
+    }
+    if (result >= 0) return result ? 0 : 1;
+
+    // the Pike VM needs an NFA, but neither a memo nor a stack
+    struct ec_glob_nfa nfa;
+    if (ec_glob_nfa_build(&nfa, &glob->prog, &glob->allocator) != 0) {
+        return REG_ESPACE;
+    }
+    int status = ec_glob_pike_run(glob, &nfa, string, len, NULL, 0);
+    ec_glob_nfa_free(&nfa);
+    return status;
+}
+
+static unsigned ec_glob_nfa_add(struct ec_glob_nfa *nfa, unsigned char type,
+                                unsigned out, unsigned out1) {
+    if (nfa->count == nfa->capacity) {
+        unsigned newcap = nfa->capacity < 16 ? 16 : nfa->capacity * 2;
+        size_t oldsize = nfa->capacity * sizeof(struct ec_glob_nfa_state);
+        size_t newsize = newcap * sizeof(struct ec_glob_nfa_state);
+        struct ec_glob_nfa_state *newmem = nfa->states == NULL
+                ? ec_glob_alloc(nfa->allocator, newsize)
+                : ec_glob_realloc(nfa->allocator, nfa->states,
+                                  oldsize, newsize);
+        if (newmem == NULL) {
+            // report the error later and continue with the MATCH state
+            nfa->oom = 1;
+            return 0;
+        }
+        nfa->states = newmem;
+        nfa->capacity = newcap;
+    }
+    unsigned idx = nfa->count++;
+    nfa->states[idx].type = type;
+    nfa->states[idx].lo = 0;
+    nfa->states[idx].hi = 0;
+    nfa->states[idx].out = out;
+    nfa->states[idx].out1 = out1;
+    return idx;
+}
+
+static unsigned ec_glob_nfa_range(struct ec_glob_nfa *nfa, unsigned char lo,
+                                  unsigned char hi, unsigned out) {
+    unsigned idx = ec_glob_nfa_add(nfa, EC_GLOB_NFA_RANGE, out, 0);
+    if (idx > 0) {
+        nfa->states[idx].lo = lo;
+        nfa->states[idx].hi = hi;
+    }
+    return idx;
+}
+
+static unsigned ec_glob_nfa_loop(struct ec_glob_nfa *nfa, unsigned char type,
+                                 unsigned out) {
+    unsigned split = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT, 0, out);
+    unsigned any = ec_glob_nfa_add(nfa, type, split, 0);
+    if (split > 0) {
+        nfa->states[split].out = any;
+    }
+    return split;
+}
+
+static inline _Bool ec_glob_nfa_accepts(const struct ec_glob_nfa *nfa,
+                                        const struct ec_glob_nfa_state *s,
+                                        unsigned char c) {
+    switch (s->type) {
+        case EC_GLOB_NFA_RANGE:
+            return s->lo <= c && c <= s->hi;
+        case EC_GLOB_NFA_CLASS:
+            return ec_glob_class_test(&nfa->classes[s->out1], c) != 0;
+        case EC_GLOB_NFA_ANY:
+            return 1;
+        case EC_GLOB_NFA_NOSLASH:
+            return c != '/';
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Splits the decimal numbers from lo to hi into sequences of digit ranges,
+ * e.g. 3 to 120 becomes [3-9], [1-9][0-9], 1[0-1][0-9], 12[0].
+ * Both numbers must have the same count of digits.
+ */
+struct ec_glob_nfa_numrange_ctx {
+    struct ec_glob_nfa *nfa;
+    unsigned out;
+    unsigned result;
+    unsigned digits;
+};
+
+static void ec_glob_nfa_numrange_digits(void *data, const unsigned char *lo,
+                                        const unsigned char *hi,
+                                        unsigned len) {
+    struct ec_glob_nfa_numrange_ctx *ctx = data;
+    unsigned k = ctx->out;
+    for (unsigned i = len ; i > 0 ; i--) {
+        k = ec_glob_nfa_range(ctx->nfa, lo[i-1], hi[i-1], k);
+    }
+    ctx->digits = ctx->digits == 0 ? k
+            : ec_glob_nfa_add(ctx->nfa, EC_GLOB_NFA_SPLIT, k, ctx->digits);
+}
+
+static void ec_glob_nfa_numrange_sign(void *data, int sign,
+                                      unsigned long lo, unsigned long hi) {
+    struct ec_glob_nfa_numrange_ctx *ctx = data;
+    struct ec_glob_nfa *nfa = ctx->nfa;
+    ctx->digits = 0;
+    if (sign == 0) {
+        ctx->digits = ec_glob_nfa_range(nfa, '0', '0', ctx->out);
+    } else {
+        ec_glob_numrange_expand(lo, hi, ec_glob_nfa_numrange_digits, ctx);
+    }
+
+    // leading zeros
+    unsigned zeros = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT, 0, ctx->digits);
+    unsigned zero = ec_glob_nfa_range(nfa, '0', '0', zeros);
+    if (zeros > 0) {
+        nfa->states[zeros].out = zero;
+    }
+
+    // the sign
+    unsigned k;
+    if (sign < 0) {
+        k = ec_glob_nfa_range(nfa, '-', '-', zeros);
+    } else {
+        k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT,
+                            ec_glob_nfa_range(nfa, '+', '+', zeros), zeros);
+        if (sign == 0) {
+            k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT,
+                                ec_glob_nfa_range(nfa, '-', '-', zeros), k);
+        }
+    }
+
+    ctx->result = ctx->result == (unsigned) -1 ? k
+            : ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT, k, ctx->result);
+}
+
+/*
+ * Constructs the NFA for the tokens from begin to end (exclusive)
+ * backwards, so that every fragment can directly point to its successor.
+ */
+static unsigned ec_glob_nfa_build_seq(struct ec_glob_nfa *nfa,
+                                      const struct ec_glob_prog *prog,
+                                      unsigned begin, unsigned end,
+                                      unsigned k) {
+    const struct ec_glob_tok *toks = prog->toks;
+    unsigned t = end;
+    while (t > begin) {
+        const struct ec_glob_tok *tok = &toks[--t];
+        switch (tok->type) {
+            case EC_GLOB_TOK_CHAR:
+                k = ec_glob_nfa_range(nfa, tok->chr, tok->chr, k);
+                break;
+            case EC_GLOB_TOK_ANY:
+                k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_ANY, k, 0);
+                break;
+            case EC_GLOB_TOK_CLASS:
+                k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_CLASS, k,
+                                    nfa->class_base + tok->arg);
+                break;
+            case EC_GLOB_TOK_STAR:
+                k = ec_glob_nfa_loop(nfa, EC_GLOB_NFA_NOSLASH, k);
+                break;
+            case EC_GLOB_TOK_GLOBSTAR:
+                k = ec_glob_nfa_loop(nfa, EC_GLOB_NFA_ANY, k);
+                break;
+            case EC_GLOB_TOK_NUMRANGE: {
+                if (nfa->captures) {
+                    k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SAVE, k,
+                                        2 * tok->arg + 1);
+                }
+                struct ec_glob_nfa_numrange_ctx ctx = {
+                        nfa, k, (unsigned) -1, 0
+                };
+                ec_glob_numrange_signed(&prog->numranges[tok->arg],
+                                        ec_glob_nfa_numrange_sign, &ctx);
+                if (ctx.result == (unsigned) -1) {
+                    // empty range, nothing can match
+                    k = ec_glob_nfa_range(nfa, 1, 0, k);
+                } else {
+                    k = ctx.result;
+                }
+                if (nfa->captures) {
+                    k = ec_glob_nfa_add(nfa, EC_GLOB_NFA_SAVE, k,
+                                        2 * tok->arg);
+                }
+                break;
+            }
+            case EC_GLOB_TOK_CLOSE: {
+                // construct every alternative with the same successor
+                unsigned open = tok->arg;
+                unsigned alt = open;
+                unsigned result = (unsigned) -1;
+                while (toks[alt].type != EC_GLOB_TOK_CLOSE) {
+                    unsigned next = toks[alt].arg;
+                    unsigned start = ec_glob_nfa_build_seq(
+                            nfa, prog, alt + 1, next, k);
+                    result = result == (unsigned) -1 ? start
+                            : ec_glob_nfa_add(nfa, EC_GLOB_NFA_SPLIT,
+                                              start, result);
+                    alt = next;
+                }
+                k = result;
+                t = open;
+                break;
+            }
+            default:
+                // OPEN and ALT are handled by CLOSE
+                break;
+        }
+    }
+    return k;
+}
+
+static void ec_glob_nfa_init(struct ec_glob_nfa *nfa,
+                             const struct ec_glob_allocator *allocator) {
+    nfa->allocator = allocator;
+    nfa->states = NULL;
+    nfa->classes = NULL;
+    nfa->count = 0;
+    nfa->capacity = 0;
+    nfa->start = 0;
+    nfa->class_base = 0;
+    nfa->oom = 0;
+    nfa->mapped = 0;
+    nfa->captures = 0;
+}
+
+static void ec_glob_nfa_free(struct ec_glob_nfa *nfa) {
+    if (nfa->states != NULL && !nfa->mapped) {
+        ec_glob_dealloc(nfa->allocator, nfa->states,
+                        nfa->capacity * sizeof(struct ec_glob_nfa_state));
+        nfa->states = NULL;
+    }
+}
+
+/*
+ * Adds the MATCH state for the pattern with the given index and constructs
+ * the states for its tokens. Returns the start state of the pattern.
+ */
+static unsigned ec_glob_nfa_add_prog(struct ec_glob_nfa *nfa,
+                                     const struct ec_glob_prog *prog,
+                                     unsigned index) {
+    unsigned match = ec_glob_nfa_add(nfa, EC_GLOB_NFA_MATCH, 0, index);
+    return ec_glob_nfa_build_seq(nfa, prog, 0, prog->tok_count, match);
+}
+
+/*
+ * Constructs the NFA for a tokenized pattern, optionally with the SAVE
+ * states of the num ranges.
+ * Returns zero on success or REG_ESPACE when memory allocation failed.
+ */
+static int ec_glob_nfa_construct(struct ec_glob_nfa *nfa,
+                                 const struct ec_glob_prog *prog,
+                                 const struct ec_glob_allocator *allocator,
+                                 _Bool captures) {
+    ec_glob_nfa_init(nfa, allocator);
+    nfa->captures = captures;
+    nfa->classes = prog->classes;
+    nfa->start = ec_glob_nfa_add_prog(nfa, prog, 0);
+    if (nfa->oom) {
+        ec_glob_nfa_free(nfa);
+        return REG_ESPACE;
+    }
+    return 0;
+}
+
+static int ec_glob_nfa_build(struct ec_glob_nfa *nfa,
+                             const struct ec_glob_prog *prog,
+                             const struct ec_glob_allocator *allocator) {
+    return ec_glob_nfa_construct(nfa, prog, allocator, 0);
+}
+
+/*
+ * The lazy DFA engine computes the DFA states from the NFA while matching.
+ * The states are cached in chunks of memory until the configured budget is
+ * exhausted, in which case the whole cache is flushed and rebuilt on demand.
+ * Every byte of the string is either a single table lookup or the
+ * computation of one new state, which is linear in the size of the NFA.
+ *
+ * The cached transitions of a shared DFA are followed without the lock,
+ * which is only taken to compute a new state. A flush of the cache counts
+ * up the flushes before the memory of the states is reused, so a thread
+ * checks the counter before following a transition it read, and matches
+ * with the lock when the cache was flushed meanwhile.
+ */
+struct ec_glob_dfa_state {
+    struct ec_glob_dfa_state *hnext;
+    unsigned hash;
+    unsigned count;
+    // not a _Bool, since it may be read from a reused state without the lock
+    unsigned char accept;
+    // the number of the state in a precompiled set, if it has one
+    unsigned id;
+    // transitions for each byte class, followed by the NFA states
+    _Atomic(struct ec_glob_dfa_state *) next[];
+};
+
+struct ec_glob_dfa_chunk {
+    struct ec_glob_dfa_chunk *prev;
+    size_t used;
+    size_t size;
+};
+
+#define EC_GLOB_DFA_BUCKETS 64
+#define EC_GLOB_DFA_CHUNK_SIZE 2048
+
+struct ec_glob_dfa {
+    const struct ec_glob_nfa *nfa;
+    pthread_mutex_t lock;
+    _Atomic(struct ec_glob_dfa_state *) start;
+    // a power of two of buckets, which only grow for precompiled sets
+    struct ec_glob_dfa_state **buckets;
+    unsigned bucket_count;
+    struct ec_glob_dfa_state *inline_buckets[EC_GLOB_DFA_BUCKETS];
+    struct ec_glob_dfa_chunk *chunk;
+    // chunks of a flushed cache, which are reused before allocating more
+    struct ec_glob_dfa_chunk *spare;
+    // spare chunks which were too small, kept until the DFA is destroyed
+    // because threads without the lock may still read states in them
+    struct ec_glob_dfa_chunk *retired;
+    size_t budget;
+    size_t allocated;
+    atomic_uint flushes;
+    unsigned class_count;
+    unsigned char bytemap[256];
+    // scratch memory for computing a new state
+    unsigned *set;
+    unsigned *stack;
+    unsigned *mark;
+    unsigned generation;
+};
+
+static unsigned *ec_glob_dfa_state_nfa(const struct ec_glob_dfa *dfa,
+                                       const struct ec_glob_dfa_state *s) {
+    return (unsigned *) (s->next + dfa->class_count);
+}
+
+/*
+ * Partitions the bytes into classes which cannot be distinguished by
+ * any state of the NFA, so that the DFA needs less transitions.
+ * Returns the number of classes.
+ */
+static unsigned ec_glob_nfa_bytemap(const struct ec_glob_nfa *nfa,
+                                    unsigned char *map) {
+    // ranges only distinguish the bytes at their boundaries
+    unsigned char boundary[257] = {0};
+    for (unsigned i = 0 ; i < nfa->count ; i++) {
+        const struct ec_glob_nfa_state *s = &nfa->states[i];
+        if (s->type == EC_GLOB_NFA_RANGE && s->lo <= s->hi) {
+            boundary[s->lo] = boundary[s->hi + 1] = 1;
+        } else if (s->type == EC_GLOB_NFA_NOSLASH) {
+            boundary['/'] = boundary['/' + 1] = 1;
+        }
+    }
+    unsigned count = 0;
+    for (unsigned c = 0 ; c < 256 ; c++) {
+        if (c > 0 && boundary[c]) count++;
+        map[c] = (unsigned char) count;
+    }
+    count++;
+
+    // split the classes further into members and non-members of each class
+    for (unsigned i = 0 ; i < nfa->count && count < 256 ; i++) {
+        const struct ec_glob_nfa_state *s = &nfa->states[i];
+        if (s->type != EC_GLOB_NFA_CLASS) continue;
+        unsigned short renumber[256][2];
+        memset(renumber, 0xff, count * sizeof(renumber[0]));
+        unsigned newcount = 0;
+        for (unsigned c = 0 ; c < 256 ; c++) {
+            unsigned in = ec_glob_nfa_accepts(nfa, s, c) ? 1 : 0;
+            if (renumber[map[c]][in] == 0xffff) {
+                renumber[map[c]][in] = newcount++;
+            }
+            map[c] = (unsigned char) renumber[map[c]][in];
+        }
+        count = newcount;
+    }
+    return count;
+}
+
+static void ec_glob_dfa_release_chunks(struct ec_glob_dfa *dfa,
+                                       struct ec_glob_dfa_chunk *chunk) {
+    while (chunk != NULL) {
+        struct ec_glob_dfa_chunk *prev = chunk->prev;
+        dfa->allocated -= chunk->size;
+        ec_glob_dealloc(dfa->nfa->allocator, chunk,
+                        sizeof(struct ec_glob_dfa_chunk) + chunk->size);
+        chunk = prev;
+    }
+}
+
+static struct ec_glob_dfa_chunk *ec_glob_dfa_chunk(struct ec_glob_dfa *dfa,
+                                                   size_t size) {
+    struct ec_glob_dfa_chunk **spare = &dfa->spare;
+    while (*spare != NULL && (*spare)->size < size) {
+        spare = &(*spare)->prev;
+    }
+    struct ec_glob_dfa_chunk *chunk = *spare;
+    if (chunk != NULL) {
+        *spare = chunk->prev;
+        return chunk;
+    }
+    size_t chunksize = EC_GLOB_DFA_CHUNK_SIZE;
+    if (chunksize < size) chunksize = size;
+    if (dfa->allocated + chunksize > dfa->budget) {
+        // the spare chunks are too small for this state, so give them up
+        while (dfa->spare != NULL) {
+            chunk = dfa->spare;
+            dfa->spare = chunk->prev;
+            dfa->allocated -= chunk->size;
+            chunk->prev = dfa->retired;
+            dfa->retired = chunk;
+        }
+        if (dfa->allocated + chunksize > dfa->budget) return NULL;
+    }
+    chunk = ec_glob_alloc(dfa->nfa->allocator,
+                          sizeof(struct ec_glob_dfa_chunk) + chunksize);
+    if (chunk == NULL) return NULL;
+    chunk->size = chunksize;
+    dfa->allocated += chunksize;
+    return chunk;
+}
+
+static void *ec_glob_dfa_alloc(struct ec_glob_dfa *dfa, size_t size) {
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    struct ec_glob_dfa_chunk *chunk = dfa->chunk;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        chunk = ec_glob_dfa_chunk(dfa, size);
+        if (chunk == NULL) return NULL;
+        chunk->prev = dfa->chunk;
+        chunk->used = 0;
+        dfa->chunk = chunk;
+    }
+    void *mem = (char *) (chunk + 1) + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+/*
+ * Drops all cached states. The chunks are kept for the new states.
+ */
+static void ec_glob_dfa_flush(struct ec_glob_dfa *dfa) {
+    // count the flush before any state can be reused
+    atomic_fetch_add_explicit(&dfa->flushes, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    while (dfa->chunk != NULL) {
+        struct ec_glob_dfa_chunk *prev = dfa->chunk->prev;
+        dfa->chunk->prev = dfa->spare;
+        dfa->spare = dfa->chunk;
+        dfa->chunk = prev;
+    }
+    dfa->start = NULL;
+    memset(dfa->buckets, 0, dfa->bucket_count * sizeof(dfa->buckets[0]));
+}
+
+/*
+ * Adds the epsilon closure of an NFA state to the scratch set.
+ */
+static void ec_glob_dfa_closure(struct ec_glob_dfa *dfa, unsigned *count,
+                                unsigned state) {
+    const struct ec_glob_nfa *nfa = dfa->nfa;
+    unsigned top = 0;
+    dfa->stack[top++] = state;
+    while (top > 0) {
+        unsigned s = dfa->stack[--top];
+        if (dfa->mark[s] == dfa->generation) continue;
+        dfa->mark[s] = dfa->generation;
+        if (nfa->states[s].type == EC_GLOB_NFA_SPLIT) {
+            dfa->stack[top++] = nfa->states[s].out1;
+            dfa->stack[top++] = nfa->states[s].out;
+        } else {
+            dfa->set[(*count)++] = s;
+        }
+    }
+}
+
+static void ec_glob_dfa_next_generation(struct ec_glob_dfa *dfa) {
+    if (++dfa->generation == 0) {
+        memset(dfa->mark, 0, dfa->nfa->count * sizeof(unsigned));
+        dfa->generation = 1;
+    }
+}
+
+/*
+ * Looks up the state for the NFA states in the scratch set
+ * or creates it, when it is not yet cached.
+ */
+static struct ec_glob_dfa_state *ec_glob_dfa_lookup(struct ec_glob_dfa *dfa,
+                                                    unsigned count) {
+    // sort the set, so that equal sets are recognized
+    unsigned *set = dfa->set;
+    for (unsigned i = 1 ; i < count ; i++) {
+        unsigned v = set[i], j = i;
+        while (j > 0 && set[j-1] > v) {
+            set[j] = set[j-1];
+            j--;
+        }
+        set[j] = v;
+    }
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0 ; i < count ; i++) {
+        hash = (hash ^ set[i]) * 16777619u;
+    }
+
+    struct ec_glob_dfa_state **bucket =
+            &dfa->buckets[hash & (dfa->bucket_count - 1)];
+    for (struct ec_glob_dfa_state *s = *bucket ; s != NULL ; s = s->hnext) {
+        if (s->hash == hash && s->count == count && 0 == memcmp(
+                ec_glob_dfa_state_nfa(dfa, s), set, count * sizeof(unsigned))) {
+            return s;
+        }
+    }
+
+    size_t size = sizeof(struct ec_glob_dfa_state)
+            + dfa->class_count * sizeof(struct ec_glob_dfa_state *)
+            + count * sizeof(unsigned);
+    struct ec_glob_dfa_state *s = ec_glob_dfa_alloc(dfa, size);
+    if (s == NULL) {
+        // flush the cache and try again
+        ec_glob_dfa_flush(dfa);
+        bucket = &dfa->buckets[hash & (dfa->bucket_count - 1)];
+        s = ec_glob_dfa_alloc(dfa, size);
+        if (s == NULL) return NULL;
+    }
+    s->hash = hash;
+    s->count = count;
+    s->accept = 0;
+    s->id = (unsigned) -1;
+    for (unsigned i = 0 ; i < count ; i++) {
+        s->accept |= dfa->nfa->states[set[i]].type == EC_GLOB_NFA_MATCH;
+    }
+    for (unsigned i = 0 ; i < dfa->class_count ; i++) {
+        atomic_init(&s->next[i], NULL);
+    }
+    memcpy(ec_glob_dfa_state_nfa(dfa, s), set, count * sizeof(unsigned));
+    s->hnext = *bucket;
+    *bucket = s;
+    return s;
+}
+
+static struct ec_glob_dfa_state *ec_glob_dfa_start(struct ec_glob_dfa *dfa) {
+    unsigned count = 0;
+    ec_glob_dfa_next_generation(dfa);
+    ec_glob_dfa_closure(dfa, &count, dfa->nfa->start);
+    return dfa->start = ec_glob_dfa_lookup(dfa, count);
+}
+
+static struct ec_glob_dfa_state *ec_glob_dfa_step(struct ec_glob_dfa *dfa,
+        struct ec_glob_dfa_state *state, unsigned char c) {
+    const struct ec_glob_nfa *nfa = dfa->nfa;
+    const unsigned *states = ec_glob_dfa_state_nfa(dfa, state);
+    unsigned count = 0;
+    ec_glob_dfa_next_generation(dfa);
+    for (unsigned i = 0 ; i < state->count ; i++) {
+        const struct ec_glob_nfa_state *s = &nfa->states[states[i]];
+        if (ec_glob_nfa_accepts(nfa, s, c)) {
+            ec_glob_dfa_closure(dfa, &count, s->out);
+        }
+    }
+    unsigned flushes = dfa->flushes;
+    struct ec_glob_dfa_state *next = ec_glob_dfa_lookup(dfa, count);
+    // the old state is gone when the cache was flushed
+    if (next != NULL && flushes == dfa->flushes) {
+        // publish the state to the threads which match without the lock
+        atomic_store_explicit(&state->next[dfa->bytemap[c]], next,
+                              memory_order_release);
+    }
+    return next;
+}
+
+static struct ec_glob_dfa *ec_glob_dfa_create(const struct ec_glob_nfa *nfa,
+                                              size_t budget) {
+    unsigned n = nfa->count;
+    struct ec_glob_dfa *dfa = ec_glob_alloc(nfa->allocator,
+            sizeof(struct ec_glob_dfa) + 4 * n * sizeof(unsigned));
+    if (dfa == NULL) return NULL;
+    dfa->nfa = nfa;
+    pthread_mutex_init(&dfa->lock, NULL);
+    dfa->start = NULL;
+    dfa->buckets = dfa->inline_buckets;
+    dfa->bucket_count = EC_GLOB_DFA_BUCKETS;
+    memset(dfa->buckets, 0, sizeof(dfa->inline_buckets));
+    dfa->chunk = NULL;
+    dfa->spare = NULL;
+    dfa->retired = NULL;
+    dfa->budget = budget;
+    dfa->allocated = 0;
+    atomic_init(&dfa->flushes, 0);
+    // the stack may contain every state twice
+    dfa->set = (unsigned *) (dfa + 1);
+    dfa->stack = dfa->set + n;
+    dfa->mark = dfa->stack + 2 * n;
+    memset(dfa->mark, 0, n * sizeof(unsigned));
+    dfa->generation = 0;
+    dfa->class_count = ec_glob_nfa_bytemap(nfa, dfa->bytemap);
+    return dfa;
+}
+
+/*
+ * Redistributes the cached states to the given power of two of buckets.
+ * Returns zero on success or REG_ESPACE when memory is exhausted.
+ */
+static int ec_glob_dfa_rehash(struct ec_glob_dfa *dfa, unsigned count) {
+    struct ec_glob_dfa_state **buckets = ec_glob_alloc(dfa->nfa->allocator,
+            count * sizeof(buckets[0]));
+    if (buckets == NULL) return REG_ESPACE;
+    memset(buckets, 0, count * sizeof(buckets[0]));
+    for (unsigned i = 0 ; i < dfa->bucket_count ; i++) {
+        struct ec_glob_dfa_state *s = dfa->buckets[i];
+        while (s != NULL) {
+            struct ec_glob_dfa_state *hnext = s->hnext;
+            s->hnext = buckets[s->hash & (count - 1)];
+            buckets[s->hash & (count - 1)] = s;
+            s = hnext;
+        }
+    }
+    if (dfa->buckets != dfa->inline_buckets) {
+        ec_glob_dealloc(dfa->nfa->allocator, dfa->buckets,
+                        dfa->bucket_count * sizeof(buckets[0]));
+    }
+    dfa->buckets = buckets;
+    dfa->bucket_count = count;
+    return 0;
+}
+
+static void ec_glob_dfa_destroy(struct ec_glob_dfa *dfa) {
+    if (dfa->buckets != dfa->inline_buckets) {
+        ec_glob_dealloc(dfa->nfa->allocator, dfa->buckets,
+                        dfa->bucket_count * sizeof(dfa->buckets[0]));
+    }
+    ec_glob_dfa_release_chunks(dfa, dfa->chunk);
+    ec_glob_dfa_release_chunks(dfa, dfa->spare);
+    ec_glob_dfa_release_chunks(dfa, dfa->retired);
+    pthread_mutex_destroy(&dfa->lock);
+    ec_glob_dealloc(dfa->nfa->allocator, dfa, sizeof(struct ec_glob_dfa)
+            + 4 * dfa->nfa->count * sizeof(unsigned));
+}
+
+/*
+ * Feeds the string to the DFA beginning with the given state and returns
+ * the final state, or NULL when a state could not be allocated.
+ * The caller must hold the lock.
+ */
+static struct ec_glob_dfa_state *ec_glob_dfa_feed(
+        struct ec_glob_dfa *dfa, struct ec_glob_dfa_state *state,
+        const char *string, size_t len) {
+    const unsigned char *s = (const unsigned char *) string;
+    const unsigned char *end = s + len;
+    // stop early, when we reached the dead state
+    while (state != NULL && state->count > 0 && s != end) {
+        struct ec_glob_dfa_state *next = atomic_load_explicit(
+                &state->next[dfa->bytemap[*s]], memory_order_relaxed);
+        if (next == NULL) {
+            next = ec_glob_dfa_step(dfa, state, *s);
+        }
+        state = next;
+        s++;
+    }
+    return state;
+}
+
+/*
+ * Feeds the string to the DFA and returns the final state,
+ * or NULL when the state could not be allocated.
+ * The caller must hold the lock.
+ */
+static struct ec_glob_dfa_state *ec_glob_dfa_run(struct ec_glob_dfa *dfa,
+                                                 const char *string,
+                                                 size_t len) {
+    struct ec_glob_dfa_state *state = dfa->start;
+    if (state == NULL) {
+        state = ec_glob_dfa_start(dfa);
+    }
+    return ec_glob_dfa_feed(dfa, state, string, len);
+}
+
+/*
+ * Returns whether the cache was not flushed since the given number of
+ * flushes, so that the states read meanwhile were not reused.
+ */
+static _Bool ec_glob_dfa_current(struct ec_glob_dfa *dfa, unsigned flushes) {
+    atomic_thread_fence(memory_order_acquire);
+    return flushes == atomic_load_explicit(&dfa->flushes, memory_order_relaxed);
+}
+
+/*
+ * Feeds the string to a shared DFA without the lock, which is only taken
+ * to compute a missing state. Stores the final state, or NULL when a state
+ * could not be allocated, and the number of flushes while it is valid.
+ * Returns nonzero when the cache was flushed meanwhile, so that the string
+ * has to be fed again with the lock.
+ */
+static int ec_glob_dfa_run_shared(struct ec_glob_dfa *dfa,
+                                  const char *string, size_t len,
+                                  struct ec_glob_dfa_state **result,
+                                  unsigned *flushes) {
+    const unsigned char *s = (const unsigned char *) string;
+    const unsigned char *end = s + len;
+    *result = NULL;
+    *flushes = atomic_load_explicit(&dfa->flushes, memory_order_acquire);
+    struct ec_glob_dfa_state *state =
+            atomic_load_explicit(&dfa->start, memory_order_acquire);
+    for (;;) {
+        struct ec_glob_dfa_state *next = NULL;
+        if (state != NULL) {
+            // a reused state must not be followed
+            if (!ec_glob_dfa_current(dfa, *flushes)) return 1;
+            // stop early, when we reached the dead state
+            if (state->count == 0 || s == end) break;
+            next = atomic_load_explicit(&state->next[dfa->bytemap[*s]],
+                                        memory_order_acquire);
+        }
+        if (next == NULL) {
+            pthread_mutex_lock(&dfa->lock);
+            _Bool flushed = *flushes != atomic_load_explicit(
+                    &dfa->flushes, memory_order_relaxed);
+            if (!flushed) {
+                next = state == NULL ? ec_glob_dfa_run(dfa, "", 0)
+                        : ec_glob_dfa_feed(dfa, state, (const char *) s, 1);
+                // computing the state may have flushed the cache
+                *flushes = atomic_load_explicit(&dfa->flushes,
+                                                memory_order_relaxed);
+            }
+            pthread_mutex_unlock(&dfa->lock);
+            if (flushed) return 1;
+            if (next == NULL) return 0;
+        }
+        if (state != NULL) s++;
+        state = next;
+    }
+    *result = state;
+    return 0;
+}
+
+static int ec_glob_dfa_compile(struct ec_glob_s *glob) {
+    int status = ec_glob_nfa_build(&glob->nfa, &glob->prog,
+                                   &glob->allocator);
+    if (status != 0) return status;
+
+    glob->dfa = ec_glob_dfa_create(&glob->nfa, EC_GLOB_DFA_CACHE_SIZE);
+    if (glob->dfa == NULL) {
+        ec_glob_nfa_free(&glob->nfa);
+        return REG_ESPACE;
+    }
+    return 0;
+}
+
+static int ec_glob_dfa_match(const struct ec_glob_s *glob,
+                             const char *string, size_t len) {
+    struct ec_glob_dfa *dfa = glob->dfa;
+    struct ec_glob_dfa_state *state;
+    unsigned flushes;
+    int status = 1;
+
+    _Bool flushed = ec_glob_dfa_run_shared(dfa, string, len,
+                                           &state, &flushes) != 0;
+    if (state != NULL) {
+        status = !state->accept;
+        flushed = !ec_glob_dfa_current(dfa, flushes);
+    }
+    if (flushed) {
+        pthread_mutex_lock(&dfa->lock);
+        state = ec_glob_dfa_run(dfa, string, len);
+        status = state == NULL || !state->accept;
+        pthread_mutex_unlock(&dfa->lock);
+    }
+
+    // a state which does not fit into the cache, or no memory for it,
+    // so the Pike VM answers from the same NFA instead
+    if (state == NULL) {
+        status = ec_glob_pike_run(glob, &glob->nfa, string, len, NULL, 0);
+    }
+    return status;
+}
+
+static void ec_glob_dfa_free(struct ec_glob_s *glob) {
+    ec_glob_dfa_destroy(glob->dfa);
+    ec_glob_nfa_free(&glob->nfa);
+}
+
+static size_t ec_glob_dfa_memsize(const struct ec_glob_s *glob) {
+    return glob->nfa.capacity * sizeof(struct ec_glob_nfa_state)
+            + sizeof(struct ec_glob_dfa) + glob->dfa->budget
+            + 4 * glob->nfa.count * sizeof(unsigned);
+}
+
+/*
+ * The bit-parallel engine simulates the Glushkov automaton of a pattern,
+ * which has a state for every position of the pattern, i.e. for every NFA
+ * state which reads a character. A set of positions is a bit string of a
+ * few words. After a byte, the positions which read it are the active
+ * positions masked with the positions accepting the byte, and they
+ * activate their successors. Most positions are followed by the next one,
+ * which is a shift, or by themselves, which is a mask. A star may also be
+ * skipped, which activates the position after a run of stars with a single
+ * addition, so that only the positions before alternatives need a table
+ * lookup. Patterns with more positions are matched by the DFA instead.
+ */
+#ifndef EC_GLOB_BITAP_MAX_POSITIONS
+#define EC_GLOB_BITAP_MAX_POSITIONS 256
+#endif
+
+#define EC_GLOB_BITAP_MAX_WORDS ((EC_GLOB_BITAP_MAX_POSITIONS + 63) / 64)
+
+struct ec_glob_bitap {
+    size_t size;
+    // the number of 64-bit words of a set of positions
+    unsigned words;
+    unsigned class_count;
+    // the pattern matches the empty string
+    _Bool nullable;
+    unsigned char bytemap[256];
+    // the first positions, the positions followed by the next one,
+    // followed by themselves, followed by others, ending the pattern,
+    // and the stars which may be skipped to the next position,
+    // then the positions accepting each class of bytes,
+    // then the other successors of every position
+    uint64_t bits[];
+};
+
+#define ec_glob_bitap_first(b) ((b)->bits)
+#define ec_glob_bitap_shift(b) ((b)->bits + (b)->words)
+#define ec_glob_bitap_loop(b) ((b)->bits + 2 * (b)->words)
+#define ec_glob_bitap_jump(b) ((b)->bits + 3 * (b)->words)
+#define ec_glob_bitap_last(b) ((b)->bits + 4 * (b)->words)
+#define ec_glob_bitap_skip(b) ((b)->bits + 5 * (b)->words)
+#define ec_glob_bitap_masks(b) ((b)->bits + 6 * (b)->words)
+#define ec_glob_bitap_follow(b) \
+    ((b)->bits + (6 + (b)->class_count) * (b)->words)
+
+#define ec_glob_bitap_test(set, p) (((set)[(p) / 64] >> ((p) % 64)) & 1)
+#define ec_glob_bitap_set(set, p) \
+    ((set)[(p) / 64] |= (uint64_t) 1 << ((p) % 64))
+
+struct ec_glob_bitap_ctx {
+    const struct ec_glob_nfa *nfa;
+    // the position of every NFA state
+    unsigned *pos;
+    unsigned *stack;
+    unsigned *mark;
+    unsigned generation;
+    // the loops of the stars which may be skipped
+    unsigned char *skip;
+};
+
+// whether the set contains nothing but the position
+static _Bool ec_glob_bitap_only(const uint64_t *set, unsigned words,
+                                unsigned p) {
+    for (unsigned w = 0 ; w < words ; w++) {
+        uint64_t bit = w == p / 64 ? (uint64_t) 1 << (p % 64) : 0;
+        if (set[w] != bit) return 0;
+    }
+    return 1;
+}
+
+static _Bool ec_glob_bitap_empty(const uint64_t *set, unsigned words) {
+    for (unsigned w = 0 ; w < words ; w++) {
+        if (set[w] != 0) return 0;
+    }
+    return 1;
+}
+
+static _Bool ec_glob_bitap_position(const struct ec_glob_nfa_state *s) {
+    return s->type != EC_GLOB_NFA_SPLIT && s->type != EC_GLOB_NFA_MATCH;
+}
+
+/*
+ * Adds the positions reachable from an NFA state without reading a
+ * character to the set. With reduce, the closure stops at the stars which
+ * may be skipped, which is done while matching. Returns whether the MATCH
+ * state is reachable.
+ */
+static _Bool ec_glob_bitap_closure(struct ec_glob_bitap_ctx *ctx,
+                                   unsigned state, _Bool reduce,
+                                   uint64_t *set) {
+    const struct ec_glob_nfa *nfa = ctx->nfa;
+    unsigned generation = ++ctx->generation;
+    _Bool match = 0;
+    unsigned top = 0;
+    ctx->stack[top++] = state;
+    while (top > 0) {
+        unsigned s = ctx->stack[--top];
+        if (ctx->mark[s] == generation) continue;
+        ctx->mark[s] = generation;
+        const struct ec_glob_nfa_state *st = &nfa->states[s];
+        if (st->type == EC_GLOB_NFA_SPLIT) {
+            if (!reduce || !ctx->skip[s]) {
+                ctx->stack[top++] = st->out1;
+            }
+            ctx->stack[top++] = st->out;
+        } else if (st->type == EC_GLOB_NFA_MATCH) {
+            match = 1;
+        } else {
+            ec_glob_bitap_set(set, ctx->pos[s]);
+        }
+    }
+    return match;
+}
+
+/*
+ * Constructs the tables of the bit-parallel engine from the NFA.
+ * Returns zero on success or REG_ESPACE when memory allocation failed.
+ * When the pattern has too many positions, the result is set to NULL.
+ */
+static int ec_glob_bitap_build(struct ec_glob_bitap **result,
+                               const struct ec_glob_nfa *nfa,
+                               const struct ec_glob_allocator *allocator) {
+    *result = NULL;
+    unsigned n = nfa->count;
+    unsigned positions = 0;
+    for (unsigned i = 0 ; i < n ; i++) {
+        positions += ec_glob_bitap_position(&nfa->states[i]);
+    }
+    if (positions > EC_GLOB_BITAP_MAX_POSITIONS) return 0;
+
+    // the stack may contain every state twice
+    size_t scratch = 4 * n * sizeof(unsigned) + n;
+    unsigned *mem = ec_glob_alloc(allocator, scratch);
+    if (mem == NULL) return REG_ESPACE;
+    struct ec_glob_bitap_ctx ctx = {
+            nfa, mem, mem + n, mem + 3 * n, 0,
+            (unsigned char *) (mem + 4 * n)
+    };
+    memset(ctx.mark, 0, n * sizeof(unsigned));
+    memset(ctx.skip, 0, n);
+
+    // the NFA is constructed backwards, so that the positions in the order
+    // of the pattern are mostly followed by the next one
+    unsigned p = 0;
+    for (unsigned i = n ; i > 0 ; i--) {
+        if (ec_glob_bitap_position(&nfa->states[i - 1])) ctx.pos[i - 1] = p++;
+    }
+
+    unsigned char bytemap[256];
+    unsigned class_count = ec_glob_nfa_bytemap(nfa, bytemap);
+    unsigned words = positions == 0 ? 1 : (positions + 63) / 64;
+    size_t size = sizeof(struct ec_glob_bitap)
+            + (6 + class_count + positions) * words * sizeof(uint64_t);
+    struct ec_glob_bitap *b = ec_glob_alloc(allocator, size);
+    if (b == NULL) {
+        ec_glob_dealloc(allocator, mem, scratch);
+        return REG_ESPACE;
+    }
+    memset(b, 0, size);
+    b->size = size;
+    b->words = words;
+    b->class_count = class_count;
+    memcpy(b->bytemap, bytemap, sizeof(bytemap));
+    b->nullable = ec_glob_bitap_closure(&ctx, nfa->start, 0,
+                                        ec_glob_bitap_first(b));
+
+    // a star may be skipped with an addition, when it is left only to the
+    // next position; the stars after it are known already, as the states
+    // are visited backwards through the pattern
+    uint64_t set[EC_GLOB_BITAP_MAX_WORDS];
+    for (unsigned i = 0 ; i < n ; i++) {
+        const struct ec_glob_nfa_state *s = &nfa->states[i];
+        unsigned split = s->out;
+        if ((s->type != EC_GLOB_NFA_ANY && s->type != EC_GLOB_NFA_NOSLASH)
+            || nfa->states[split].type != EC_GLOB_NFA_SPLIT
+            || nfa->states[split].out != i) continue;
+        p = ctx.pos[i];
+        memset(set, 0, words * sizeof(uint64_t));
+        if (p + 1 < positions
+            && !ec_glob_bitap_closure(&ctx, nfa->states[split].out1, 1, set)
+            && ec_glob_bitap_only(set, words, p + 1)) {
+            ctx.skip[split] = 1;
+            ec_glob_bitap_set(ec_glob_bitap_skip(b), p);
+        }
+    }
+
+    // the bytes of a class are indistinguishable, so one member suffices
+    unsigned char members[256];
+    for (unsigned c = 256 ; c > 0 ; c--) {
+        members[bytemap[c - 1]] = (unsigned char) (c - 1);
+    }
+    uint64_t *masks = ec_glob_bitap_masks(b);
+    for (unsigned i = 0 ; i < n ; i++) {
+        const struct ec_glob_nfa_state *s = &nfa->states[i];
+        if (!ec_glob_bitap_position(s)) continue;
+        p = ctx.pos[i];
+        if (ec_glob_bitap_closure(&ctx, s->out, 0, set)) {
+            ec_glob_bitap_set(ec_glob_bitap_last(b), p);
+        }
+        uint64_t *follow = ec_glob_bitap_follow(b) + p * words;
+        ec_glob_bitap_closure(&ctx, s->out, 1, follow);
+        if (ec_glob_bitap_test(follow, p)) {
+            ec_glob_bitap_set(ec_glob_bitap_loop(b), p);
+            follow[p / 64] &= ~((uint64_t) 1 << (p % 64));
+        }
+
+        // the successors are either just the next position, or looked up
+        if (p + 1 < positions && ec_glob_bitap_only(follow, words, p + 1)) {
+            ec_glob_bitap_set(ec_glob_bitap_shift(b), p);
+            memset(follow, 0, words * sizeof(uint64_t));
+        } else if (!ec_glob_bitap_empty(follow, words)) {
+            ec_glob_bitap_set(ec_glob_bitap_jump(b), p);
+        }
+
+        for (unsigned k = 0 ; k < class_count ; k++) {
+            if (ec_glob_nfa_accepts(nfa, s, members[k])) {
+                ec_glob_bitap_set(masks + k * words, p);
+            }
+        }
+    }
+    ec_glob_dealloc(allocator, mem, scratch);
+    *result = b;
+    return 0;
+}
+
+static int ec_glob_bitap_match1(const struct ec_glob_bitap *b,
+                                const unsigned char *s, size_t len) {
+    const uint64_t *masks = ec_glob_bitap_masks(b);
+    const uint64_t *follow = ec_glob_bitap_follow(b);
+    // the successors are masked after the shift, and those which are
+    // skipped are computed next to the others to shorten the dependencies
+    uint64_t shifted = *ec_glob_bitap_shift(b) << 1;
+    uint64_t loop = *ec_glob_bitap_loop(b);
+    uint64_t jump = *ec_glob_bitap_jump(b);
+    uint64_t skip = *ec_glob_bitap_skip(b);
+    uint64_t shifted_skip = shifted & skip;
+    uint64_t loop_skip = loop & skip;
+    uint64_t active = *ec_glob_bitap_first(b);
+    uint64_t read = 0;
+    for (size_t i = 0 ; i < len ; i++) {
+        read = active & masks[b->bytemap[s[i]]];
+        if (read == 0) return 1;
+        uint64_t next = read << 1;
+        active = (next & shifted) | (read & loop);
+        uint64_t skipped = (next & shifted_skip) | (read & loop_skip);
+        for (uint64_t x = read & jump ; x != 0 ; x &= x - 1) {
+            uint64_t f = follow[__builtin_ctzll(x)];
+            active |= f;
+            skipped |= f & skip;
+        }
+        // the carry runs through the skipped stars to the next position
+        active |= (skipped + skip) ^ skip;
+    }
+    return (read & *ec_glob_bitap_last(b)) != 0 ? 0 : 1;
+}
+
+static int ec_glob_bitap_matchn(const struct ec_glob_bitap *b,
+                                const unsigned char *s, size_t len) {
+    unsigned words = b->words;
+    const uint64_t *masks = ec_glob_bitap_masks(b);
+    const uint64_t *follow = ec_glob_bitap_follow(b);
+    const uint64_t *shift = ec_glob_bitap_shift(b);
+    const uint64_t *loop = ec_glob_bitap_loop(b);
+    const uint64_t *jump = ec_glob_bitap_jump(b);
+    const uint64_t *skip = ec_glob_bitap_skip(b);
+    uint64_t active[EC_GLOB_BITAP_MAX_WORDS];
+    uint64_t read[EC_GLOB_BITAP_MAX_WORDS];
+    memcpy(active, ec_glob_bitap_first(b), words * sizeof(uint64_t));
+    for (size_t i = 0 ; i < len ; i++) {
+        const uint64_t *mask = masks + b->bytemap[s[i]] * words;
+        uint64_t any = 0;
+        for (unsigned w = 0 ; w < words ; w++) {
+            read[w] = active[w] & mask[w];
+            any |= read[w];
+        }
+        if (any == 0) return 1;
+        uint64_t carry = 0;
+        for (unsigned w = 0 ; w < words ; w++) {
+            uint64_t shifted = read[w] & shift[w];
+            active[w] = (shifted << 1) | carry | (read[w] & loop[w]);
+            carry = shifted >> 63;
+        }
+        for (unsigned w = 0 ; w < words ; w++) {
+            for (uint64_t x = read[w] & jump[w] ; x != 0 ; x &= x - 1) {
+                const uint64_t *f = follow
+                        + (w * 64 + __builtin_ctzll(x)) * words;
+                for (unsigned v = 0 ; v < words ; v++) {
+                    active[v] |= f[v];
+                }
+            }
+        }
+        carry = 0;
+        for (unsigned w = 0 ; w < words ; w++) {
+            uint64_t x = active[w] & skip[w];
+            uint64_t sum = x + skip[w];
+            uint64_t total = sum + carry;
+            carry = (sum < x) | (total < sum);
+            active[w] |= total ^ skip[w];
+        }
+    }
+    const uint64_t *last = ec_glob_bitap_last(b);
+    for (unsigned w = 0 ; w < words ; w++) {
+        if ((read[w] & last[w]) != 0) return 0;
+    }
+    return 1;
+}
+
+static int ec_glob_bitap_match(const struct ec_glob_s *glob,
+                               const char *string, size_t len) {
+    const struct ec_glob_bitap *b = glob->bitap;
+    if (len == 0) return b->nullable ? 0 : 1;
+    const unsigned char *s = (const unsigned char *) string;
+    return b->words == 1 ? ec_glob_bitap_match1(b, s, len)
+            : ec_glob_bitap_matchn(b, s, len);
+}
+
+/*
+ * Batches of strings are matched by the bit-parallel engine in lanes, so
+ * that the sets of positions of several strings advance together with SIMD
+ * instructions. This pays off, because the steps of a single string depend
+ * on each other, while the lanes are independent.
+ */
+#ifndef EC_GLOB_USE_SIMD
+#if defined(__x86_64__) && defined(__GNUC__)
+#define EC_GLOB_USE_SIMD 1
+#else
+#define EC_GLOB_USE_SIMD 0
+#endif
+#endif
+
+// a multiple of the four lanes of the widest vectors
+#ifndef EC_GLOB_BATCH_LANES
+#define EC_GLOB_BATCH_LANES 16
+#endif
+
+#if EC_GLOB_BATCH_LANES % 4 != 0
+#error "EC_GLOB_BATCH_LANES must be a multiple of 4"
+#endif
+
+// the number of bytes of each lane transposed at once
+#ifndef EC_GLOB_BATCH_CHUNK
+#define EC_GLOB_BATCH_CHUNK 8
+#endif
+
+/*
+ * The strings in lanes. The masks of their next bytes are transposed into
+ * columns, so that each step loads the masks of all lanes at once, and the
+ * final positions are stored in the column of the last byte of each string,
+ * so that the strings are accepted without checking their lengths. A lane
+ * whose string ended or failed is refilled after the chunk, which leaves
+ * less of the chunks unused than waiting for the longest string.
+ */
+struct ec_glob_lanes {
+    uint64_t active[EC_GLOB_BATCH_LANES];
+    uint64_t matched[EC_GLOB_BATCH_LANES];
+    uint64_t masks[EC_GLOB_BATCH_CHUNK][EC_GLOB_BATCH_LANES];
+    uint64_t ends[EC_GLOB_BATCH_CHUNK][EC_GLOB_BATCH_LANES];
+    const unsigned char *string[EC_GLOB_BATCH_LANES];
+    size_t left[EC_GLOB_BATCH_LANES];
+    size_t index[EC_GLOB_BATCH_LANES];
+};
+
+// the jumps of all lanes after the successors were computed
+static void ec_glob_lanes_jump(const struct ec_glob_bitap *b,
+                               const uint64_t *read, uint64_t *active,
+                               uint64_t *skipped) {
+    const uint64_t *follow = ec_glob_bitap_follow(b);
+    uint64_t jump = *ec_glob_bitap_jump(b);
+    uint64_t skip = *ec_glob_bitap_skip(b);
+    for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+        for (uint64_t x = read[l] & jump ; x != 0 ; x &= x - 1) {
+            uint64_t f = follow[__builtin_ctzll(x)];
+            active[l] |= f;
+            skipped[l] |= f & skip;
+        }
+    }
+}
+
+// advances all lanes over the transposed chunk
+static void ec_glob_lanes_run(struct ec_glob_lanes *lanes,
+                              const struct ec_glob_bitap *b) {
+    uint64_t shifted = *ec_glob_bitap_shift(b) << 1;
+    uint64_t loop = *ec_glob_bitap_loop(b);
+    uint64_t jump = *ec_glob_bitap_jump(b);
+    uint64_t skip = *ec_glob_bitap_skip(b);
+    uint64_t read[EC_GLOB_BATCH_LANES];
+    uint64_t skipped[EC_GLOB_BATCH_LANES];
+    for (unsigned n = 0 ; n < EC_GLOB_BATCH_CHUNK ; n++) {
+        for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+            read[l] = lanes->active[l] & lanes->masks[n][l];
+            lanes->matched[l] |= read[l] & lanes->ends[n][l];
+            lanes->active[l] = ((read[l] << 1) & shifted) | (read[l] & loop);
+            skipped[l] = lanes->active[l] & skip;
+        }
+        if (jump != 0) {
+            ec_glob_lanes_jump(b, read, lanes->active, skipped);
+        }
+        for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+            lanes->active[l] |= (skipped[l] + skip) ^ skip;
+        }
+    }
+}
+
+#if EC_GLOB_USE_SIMD
+__attribute__((target("sse2")))
+static void ec_glob_lanes_run_sse2(struct ec_glob_lanes *lanes,
+                                   const struct ec_glob_bitap *b) {
+    enum { vectors = EC_GLOB_BATCH_LANES / 2 };
+    uint64_t jump = *ec_glob_bitap_jump(b);
+    __m128i shifted = _mm_set1_epi64x((long long)
+                                      (*ec_glob_bitap_shift(b) << 1));
+    __m128i loop = _mm_set1_epi64x((long long) *ec_glob_bitap_loop(b));
+    __m128i skip = _mm_set1_epi64x((long long) *ec_glob_bitap_skip(b));
+    __m128i active[vectors];
+    __m128i matched[vectors];
+    for (unsigned v = 0 ; v < vectors ; v++) {
+        active[v] = _mm_loadu_si128((const __m128i *) lanes->active + v);
+        matched[v] = _mm_loadu_si128((const __m128i *) lanes->matched + v);
+    }
+    for (unsigned n = 0 ; n < EC_GLOB_BATCH_CHUNK ; n++) {
+        const __m128i *masks = (const __m128i *) lanes->masks[n];
+        const __m128i *ends = (const __m128i *) lanes->ends[n];
+        __m128i read[vectors];
+        __m128i skipped[vectors];
+        for (unsigned v = 0 ; v < vectors ; v++) {
+            read[v] = _mm_and_si128(active[v], _mm_loadu_si128(masks + v));
+            matched[v] = _mm_or_si128(matched[v], _mm_and_si128(
+                    read[v], _mm_loadu_si128(ends + v)));
+            active[v] = _mm_or_si128(
+                    _mm_and_si128(_mm_slli_epi64(read[v], 1), shifted),
+                    _mm_and_si128(read[v], loop));
+            skipped[v] = _mm_and_si128(active[v], skip);
+        }
+        if (jump != 0) {
+            uint64_t spill[3][EC_GLOB_BATCH_LANES];
+            for (unsigned v = 0 ; v < vectors ; v++) {
+                _mm_storeu_si128((__m128i *) spill[0] + v, read[v]);
+                _mm_storeu_si128((__m128i *) spill[1] + v, active[v]);
+                _mm_storeu_si128((__m128i *) spill[2] + v, skipped[v]);
+            }
+            ec_glob_lanes_jump(b, spill[0], spill[1], spill[2]);
+            for (unsigned v = 0 ; v < vectors ; v++) {
+                active[v] = _mm_loadu_si128((const __m128i *) spill[1] + v);
+                skipped[v] = _mm_loadu_si128((const __m128i *) spill[2] + v);
+            }
+        }
+        for (unsigned v = 0 ; v < vectors ; v++) {
+            active[v] = _mm_or_si128(active[v], _mm_xor_si128(
+                    _mm_add_epi64(skipped[v], skip), skip));
+        }
+    }
+    for (unsigned v = 0 ; v < vectors ; v++) {
+        _mm_storeu_si128((__m128i *) lanes->active + v, active[v]);
+        _mm_storeu_si128((__m128i *) lanes->matched + v, matched[v]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void ec_glob_lanes_run_avx2(struct ec_glob_lanes *lanes,
+                                   const struct ec_glob_bitap *b) {
+    enum { vectors = EC_GLOB_BATCH_LANES / 4 };
+    uint64_t jump = *ec_glob_bitap_jump(b);
+    __m256i shifted = _mm256_set1_epi64x((long long)
+                                         (*ec_glob_bitap_shift(b) << 1));
+    __m256i loop = _mm256_set1_epi64x((long long) *ec_glob_bitap_loop(b));
+    __m256i skip = _mm256_set1_epi64x((long long) *ec_glob_bitap_skip(b));
+    __m256i active[vectors];
+    __m256i matched[vectors];
+    for (unsigned v = 0 ; v < vectors ; v++) {
+        active[v] = _mm256_loadu_si256((const __m256i *) lanes->active + v);
+        matched[v] = _mm256_loadu_si256(
+                (const __m256i *) lanes->matched + v);
+    }
+    for (unsigned n = 0 ; n < EC_GLOB_BATCH_CHUNK ; n++) {
+        const __m256i *masks = (const __m256i *) lanes->masks[n];
+        const __m256i *ends = (const __m256i *) lanes->ends[n];
+        __m256i read[vectors];
+        __m256i skipped[vectors];
+        for (unsigned v = 0 ; v < vectors ; v++) {
+            read[v] = _mm256_and_si256(active[v],
+                                       _mm256_loadu_si256(masks + v));
+            matched[v] = _mm256_or_si256(matched[v], _mm256_and_si256(
+                    read[v], _mm256_loadu_si256(ends + v)));
+            active[v] = _mm256_or_si256(
+                    _mm256_and_si256(_mm256_slli_epi64(read[v], 1), shifted),
+                    _mm256_and_si256(read[v], loop));
+            skipped[v] = _mm256_and_si256(active[v], skip);
+        }
+        if (jump != 0) {
+            uint64_t spill[3][EC_GLOB_BATCH_LANES];
+            for (unsigned v = 0 ; v < vectors ; v++) {
+                _mm256_storeu_si256((__m256i *) spill[0] + v, read[v]);
+                _mm256_storeu_si256((__m256i *) spill[1] + v, active[v]);
+                _mm256_storeu_si256((__m256i *) spill[2] + v, skipped[v]);
+            }
+            ec_glob_lanes_jump(b, spill[0], spill[1], spill[2]);
+            for (unsigned v = 0 ; v < vectors ; v++) {
+                active[v] = _mm256_loadu_si256(
+                        (const __m256i *) spill[1] + v);
+                skipped[v] = _mm256_loadu_si256(
+                        (const __m256i *) spill[2] + v);
+            }
+        }
+        for (unsigned v = 0 ; v < vectors ; v++) {
+            active[v] = _mm256_or_si256(active[v], _mm256_xor_si256(
+                    _mm256_add_epi64(skipped[v], skip), skip));
+        }
+    }
+    for (unsigned v = 0 ; v < vectors ; v++) {
+        _mm256_storeu_si256((__m256i *) lanes->active + v, active[v]);
+        _mm256_storeu_si256((__m256i *) lanes->matched + v, matched[v]);
+    }
+}
+#endif
+
+typedef void ec_glob_lanes_run_fn(struct ec_glob_lanes *lanes,
+                                  const struct ec_glob_bitap *b);
+
+static ec_glob_lanes_run_fn *ec_glob_lanes_select(void) {
+#if EC_GLOB_USE_SIMD
+    if (__builtin_cpu_supports("avx2")) return ec_glob_lanes_run_avx2;
+    if (__builtin_cpu_supports("sse2")) return ec_glob_lanes_run_sse2;
+#endif
+    return ec_glob_lanes_run;
+}
+
+/*
+ * Transposes the next bytes of the lanes into the chunk, with the masks
+ * indexed by the bytes themselves. The empty lanes get no masks, so that
+ * they stay empty.
+ */
+static void ec_glob_lanes_transpose(struct ec_glob_lanes *lanes,
+                                    const uint64_t *masks, uint64_t last) {
+    for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+        size_t left = lanes->left[l];
+        const unsigned char *s = lanes->string[l];
+        if (left >= EC_GLOB_BATCH_CHUNK) {
+            for (unsigned n = 0 ; n < EC_GLOB_BATCH_CHUNK ; n++) {
+                lanes->masks[n][l] = masks[s[n]];
+                lanes->ends[n][l] = 0;
+            }
+        } else {
+            for (unsigned n = 0 ; n < EC_GLOB_BATCH_CHUNK ; n++) {
+                lanes->masks[n][l] = n < left ? masks[s[n]] : 0;
+                lanes->ends[n][l] = 0;
+            }
+        }
+        if (left != 0 && left <= EC_GLOB_BATCH_CHUNK) {
+            lanes->ends[left - 1][l] = last;
+        }
+    }
+}
+
+/*
+ * Matches a batch with a bit-parallel automaton of a single word, which
+ * need not be the engine of the pattern.
+ */
+static void ec_glob_bitap_batch(const struct ec_glob_s *glob,
+                                const struct ec_glob_bitap *b,
+                                const char *blob, const size_t *offsets,
+                                size_t count, unsigned char *matches) {
+    uint64_t first = *ec_glob_bitap_first(b);
+    uint64_t last = *ec_glob_bitap_last(b);
+    ec_glob_lanes_run_fn *run = ec_glob_lanes_select();
+    struct ec_glob_lanes lanes;
+
+    // the masks of the bytes without the indirection through the classes
+    uint64_t masks[256];
+    for (unsigned c = 0 ; c < 256 ; c++) {
+        masks[c] = ec_glob_bitap_masks(b)[b->bytemap[c]];
+    }
+
+    memset(matches, 0, (count + 7) / 8);
+    for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+        lanes.string[l] = (const unsigned char *) blob;
+        lanes.left[l] = 0;
+        lanes.index[l] = count;
+    }
+    size_t i = 0;
+    for (;;) {
+        // the lanes whose strings are done take the next strings which pass
+        // the prefilter
+        _Bool busy = 0;
+        for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+            if (lanes.left[l] != 0 && lanes.active[l] != 0) {
+                busy = 1;
+                continue;
+            }
+            if (lanes.index[l] != count && lanes.matched[l] != 0) {
+                matches[lanes.index[l] / 8] |= 1u << (lanes.index[l] % 8);
+            }
+            lanes.index[l] = count;
+            lanes.left[l] = 0;
+            lanes.active[l] = 0;
+            lanes.matched[l] = 0;
+            for ( ; i < count ; i++) {
+                const char *string = blob + offsets[i];
+                size_t len = offsets[i + 1] - offsets[i];
+                if (!ec_glob_prefilter_test(&glob->filter, string, len)) {
+                    continue;
+                }
+                if (len == 0) {
+                    matches[i / 8] |= (unsigned char) (b->nullable << (i % 8));
+                    continue;
+                }
+                lanes.string[l] = (const unsigned char *) string;
+                lanes.left[l] = len;
+                lanes.index[l] = i++;
+                lanes.active[l] = first;
+                busy = 1;
+                break;
+            }
+        }
+        if (!busy) break;
+
+        ec_glob_lanes_transpose(&lanes, masks, last);
+        run(&lanes, b);
+        for (unsigned l = 0 ; l < EC_GLOB_BATCH_LANES ; l++) {
+            size_t step = lanes.left[l] < EC_GLOB_BATCH_CHUNK
+                    ? lanes.left[l] : EC_GLOB_BATCH_CHUNK;
+            lanes.string[l] += step;
+            lanes.left[l] -= step;
+        }
+    }
+}
+
+/*
+ * Builds the automaton which matches the batches of a compiled pattern in
+ * lanes, unless the pattern is matched by the bit-parallel engine or as a
+ * shape anyway, or it does not fit into a single word.
+ * Returns zero on success or REG_ESPACE when memory allocation failed.
+ */
+static int ec_glob_lanes_build(struct ec_glob_s *glob) {
+    glob->lanes = NULL;
+    if (glob->engine == ec_glob_engine_bitap
+        || glob->engine == ec_glob_engine_shape) return 0;
+    struct ec_glob_nfa nfa;
+    int status = ec_glob_nfa_build(&nfa, &glob->prog, &glob->allocator);
+    if (status != 0) return status;
+    status = ec_glob_bitap_build(&glob->lanes, &nfa, &glob->allocator);
+    ec_glob_nfa_free(&nfa);
+    if (glob->lanes != NULL && glob->lanes->words != 1) {
+        ec_glob_dealloc(&glob->allocator, glob->lanes, glob->lanes->size);
+        glob->lanes = NULL;
+    }
+    return status;
+}
+
+static int ec_glob_bitap_compile(struct ec_glob_s *glob) {
+    int status = ec_glob_nfa_build(&glob->nfa, &glob->prog,
+                                   &glob->allocator);
+    if (status != 0) return status;
+    status = ec_glob_bitap_build(&glob->bitap, &glob->nfa, &glob->allocator);
+    if (status != 0 || glob->bitap != NULL) {
+        ec_glob_nfa_free(&glob->nfa);
+        return status;
+    }
+
+    // too many positions for the bit-parallel engine
+    glob->engine = ec_glob_engine_dfa;
+    glob->dfa = ec_glob_dfa_create(&glob->nfa, EC_GLOB_DFA_CACHE_SIZE);
+    if (glob->dfa == NULL) {
+        ec_glob_nfa_free(&glob->nfa);
+        return REG_ESPACE;
+    }
+    return 0;
+}
+
+static void ec_glob_bitap_free(struct ec_glob_s *glob) {
+    ec_glob_dealloc(&glob->allocator, glob->bitap, glob->bitap->size);
+}
+
+static size_t ec_glob_bitap_memsize(const struct ec_glob_s *glob) {
+    return glob->bitap->size;
+}
+
+/*
+ * The Pike VM engine simulates the NFA with at most one thread per state,
+ * kept in the order of their priority, so every byte costs at most one
+ * step of every state, regardless of how many stars and alternatives the
+ * pattern has. Its NFA brackets every num range with SAVE states, and the
+ * threads carry the positions where they passed them, so a match reports
+ * the span of every {num1..num2} group. The numbers are matched by the
+ * exact digit automata of the ranges, so the thread which survives in a
+ * state never has a number out of range where a dropped one had it in.
+ */
+#ifndef EC_GLOB_PIKE_SCRATCH_SIZE
+#define EC_GLOB_PIKE_SCRATCH_SIZE 4096
+#endif
+
+// an NFA state to visit, or with state -1 the old value of a slot
+struct ec_glob_pike_entry {
+    unsigned state;
+    unsigned slot;
+    size_t value;
+};
+
+struct ec_glob_pike_list {
+    unsigned count;
+    unsigned *states;
+    // the slots of every thread
+    size_t *slots;
+};
+
+struct ec_glob_pike_ctx {
+    const struct ec_glob_nfa *nfa;
+    unsigned slot_count;
+    // the position after which each state was added last
+    size_t *mark;
+    struct ec_glob_pike_entry *stack;
+    // the slots of the thread being added
+    size_t *slots;
+};
+
+static size_t ec_glob_pike_scratch_size(unsigned count, unsigned slots) {
+    return ((size_t) count * (1 + 2 * slots) + slots) * sizeof(size_t)
+            + (2 * (size_t) count + 1) * sizeof(struct ec_glob_pike_entry)
+            + 2 * (size_t) count * sizeof(unsigned);
+}
+
+/*
+ * Adds the threads for the states reached from the given one without
+ * reading a byte, in the order of their priority. The slots are changed
+ * while following a SAVE state and restored afterwards.
+ */
+static void ec_glob_pike_add(const struct ec_glob_pike_ctx *ctx,
+                             struct ec_glob_pike_list *list,
+                             unsigned state, size_t pos) {
+    const struct ec_glob_nfa_state *states = ctx->nfa->states;
+    struct ec_glob_pike_entry *stack = ctx->stack;
+    unsigned top = 0;
+    stack[top++] = (struct ec_glob_pike_entry) {state, 0, 0};
+    while (top > 0) {
+        struct ec_glob_pike_entry e = stack[--top];
+        if (e.state == (unsigned) -1) {
+            ctx->slots[e.slot] = e.value;
+            continue;
+        }
+        if (ctx->mark[e.state] == pos + 1) continue;
+        ctx->mark[e.state] = pos + 1;
+        const struct ec_glob_nfa_state *s = &states[e.state];
+        switch (s->type) {
+            case EC_GLOB_NFA_SPLIT:
+                stack[top++] = (struct ec_glob_pike_entry) {s->out1, 0, 0};
+                stack[top++] = (struct ec_glob_pike_entry) {s->out, 0, 0};
+                break;
+            case EC_GLOB_NFA_SAVE:
+                if (s->out1 < ctx->slot_count) {
+                    stack[top++] = (struct ec_glob_pike_entry) {
+                            (unsigned) -1, s->out1, ctx->slots[s->out1]
+                    };
+                    ctx->slots[s->out1] = pos;
+                }
+                stack[top++] = (struct ec_glob_pike_entry) {s->out, 0, 0};
+                break;
+            default: {
+                unsigned t = list->count++;
+                list->states[t] = e.state;
+                memcpy(list->slots + (size_t) t * ctx->slot_count,
+                       ctx->slots, ctx->slot_count * sizeof(size_t));
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Runs the Pike VM, and on a match stores the spans of the num ranges in
+ * the slots, unless there are none. Returns zero on a match, one if the
+ * string does not match, or REG_ESPACE if there is no memory left.
+ */
+static int ec_glob_pike_run(const struct ec_glob_s *glob,
+                            const struct ec_glob_nfa *nfa,
+                            const char *string, size_t len,
+                            size_t *slots, unsigned slot_count) {
+    size_t scratch[EC_GLOB_PIKE_SCRATCH_SIZE / sizeof(size_t)];
+    size_t size = ec_glob_pike_scratch_size(nfa->count, slot_count);
+    size_t *mem = size <= sizeof(scratch) ? scratch
+            : ec_glob_alloc(&glob->allocator, size);
+    if (mem == NULL) return REG_ESPACE;
+
+    unsigned count = nfa->count;
+    struct ec_glob_pike_ctx ctx;
+    struct ec_glob_pike_list lists[2];
+    ctx.nfa = nfa;
+    ctx.slot_count = slot_count;
+    ctx.mark = mem;
+    lists[0].slots = ctx.mark + count;
+    lists[1].slots = lists[0].slots + (size_t) count * slot_count;
+    ctx.slots = lists[1].slots + (size_t) count * slot_count;
+    ctx.stack = (struct ec_glob_pike_entry *) (ctx.slots + slot_count);
+    lists[0].states = (unsigned *) (ctx.stack + 2 * count + 1);
+    lists[1].states = lists[0].states + count;
+    memset(ctx.mark, 0, count * sizeof(size_t));
+
+    // the spans of the num ranges which are not part of the match
+    for (unsigned i = 0 ; i < slot_count ; i++) {
+        ctx.slots[i] = (size_t) -1;
+    }
+    struct ec_glob_pike_list *clist = &lists[0], *nlist = &lists[1];
+    clist->count = 0;
+    ec_glob_pike_add(&ctx, clist, nfa->start, 0);
+    const unsigned char *s = (const unsigned char *) string;
+    for (size_t pos = 0 ; pos < len && clist->count > 0 ; pos++) {
+        nlist->count = 0;
+        for (unsigned t = 0 ; t < clist->count ; t++) {
+            const struct ec_glob_nfa_state *state =
+                    &nfa->states[clist->states[t]];
+            if (!ec_glob_nfa_accepts(nfa, state, s[pos])) continue;
+            memcpy(ctx.slots, clist->slots + (size_t) t * slot_count,
+                   slot_count * sizeof(size_t));
+            ec_glob_pike_add(&ctx, nlist, state->out, pos + 1);
+        }
+        struct ec_glob_pike_list *swap = clist;
+        clist = nlist;
+        nlist = swap;
+    }
+
+    // the thread of the highest priority in the MATCH state wins
+    int status = 1;
+    for (unsigned t = 0 ; t < clist->count ; t++) {
+        if (nfa->states[clist->states[t]].type == EC_GLOB_NFA_MATCH) {
+            if (slot_count > 0) {
+                memcpy(slots, clist->slots + (size_t) t * slot_count,
+                       slot_count * sizeof(size_t));
+            }
+            status = 0;
+            break;
+        }
+    }
+
+    if (mem != scratch) {
+        ec_glob_dealloc(&glob->allocator, mem, size);
+    }
+    return status;
+}
+
+static int ec_glob_pike_compile(struct ec_glob_s *glob) {
+    return ec_glob_nfa_construct(&glob->nfa, &glob->prog, &glob->allocator,
+                                 1);
+}
+
+static int ec_glob_pike_match(const struct ec_glob_s *glob,
+                              const char *string, size_t len) {
+    return ec_glob_pike_run(glob, &glob->nfa, string, len, NULL, 0);
+}
+
+static void ec_glob_pike_free(struct ec_glob_s *glob) {
+    ec_glob_nfa_free(&glob->nfa);
+}
+
+static size_t ec_glob_pike_memsize(const struct ec_glob_s *glob) {
+    return glob->nfa.capacity * sizeof(struct ec_glob_nfa_state);
+}
+
+/*
+ * The engines are registered in a table indexed by their enum value, so
+ * that all of them are available in every build. Each entry compiles an
+ * analyzed pattern, matches a string which passed the prefilter, releases
+ * the engine and estimates the memory used beyond the tokens. Engines
+ * without a compile, free or memsize function need none.
+ */
+struct ec_glob_backend {
+    const char *name;
+    int (*compile)(struct ec_glob_s *glob);
+    int (*exec)(const struct ec_glob_s *glob, const char *string, size_t len);
+    void (*free)(struct ec_glob_s *glob);
+    size_t (*memsize)(const struct ec_glob_s *glob);
+};
+
+static const struct ec_glob_backend ec_glob_backends[] = {
+        [ec_glob_engine_regex] = {
+                "regex", ec_glob_regex_compile, ec_glob_regex_match,
+                ec_glob_regex_free, ec_glob_regex_memsize
+        },
+        [ec_glob_engine_native] = {
+                "native", NULL, ec_glob_native_match, NULL, NULL
+        },
+        [ec_glob_engine_dfa] = {
+                "dfa", ec_glob_dfa_compile, ec_glob_dfa_match,
+                ec_glob_dfa_free, ec_glob_dfa_memsize
+        },
+        [ec_glob_engine_bitap] = {
+                "bitap", ec_glob_bitap_compile, ec_glob_bitap_match,
+                ec_glob_bitap_free, ec_glob_bitap_memsize
+        },
+        [ec_glob_engine_pike] = {
+                "pike", ec_glob_pike_compile, ec_glob_pike_match,
+                ec_glob_pike_free, ec_glob_pike_memsize
+        },
+        [ec_glob_engine_shape] = {
+                "shape", NULL, ec_glob_shape_match, NULL, NULL
+        },
+        [ec_glob_engine_auto] = {
+                "auto", NULL, NULL, NULL, NULL
+        },
+};
+
+static const unsigned ec_glob_backend_count =
+        sizeof(ec_glob_backends) / sizeof(ec_glob_backends[0]);
+
+/*
+ * Rough costs in nanoseconds per match of a typical path, measured with
+ * the benchmark. The native engine needs no compilation and wins as long
+ * as it hardly backtracks, while the DFA pays for the lock and for
+ * building the NFA up front, but then matches in a single pass.
+ */
+#ifndef EC_GLOB_COST_NATIVE
+#define EC_GLOB_COST_NATIVE 10
+#endif
+
+#ifndef EC_GLOB_COST_NATIVE_BACKTRACK
+#define EC_GLOB_COST_NATIVE_BACKTRACK 15
+#endif
+
+#ifndef EC_GLOB_COST_NATIVE_NUMRANGE
+#define EC_GLOB_COST_NATIVE_NUMRANGE 100
+#endif
+
+#ifndef EC_GLOB_COST_DFA
+#define EC_GLOB_COST_DFA 25
+#endif
+
+#ifndef EC_GLOB_COST_DFA_COMPILE
+#define EC_GLOB_COST_DFA_COMPILE 100
+#endif
+
+#ifndef EC_GLOB_COST_DFA_TOKEN
+#define EC_GLOB_COST_DFA_TOKEN 10
+#endif
+
+#ifndef EC_GLOB_COST_DFA_NUMRANGE
+#define EC_GLOB_COST_DFA_NUMRANGE 1000
+#endif
+
+/*
+ * Chooses the engine for a pattern without a shape. A pattern which is
+ * matched only once pays the whole compilation of the DFA for that match.
+ * The POSIX regex engine is slower than both on every pattern of the
+ * benchmark, so it is only used when it is requested.
+ *
+ * The native engine may backtrack at more than one point only when its
+ * memo fits on the stack for the string, because it would otherwise build
+ * an NFA for the Pike VM on every match. The DFA takes linear time instead.
+ */
+static enum ec_glob_engine ec_glob_choose_engine(const struct ec_glob_s *glob) {
+    const struct ec_glob_prog *prog = &glob->prog;
+    if (prog->backtrack_count > 1 && (glob->reused
+        || (size_t) (prog->tok_count + 1) * (glob->len + 1)
+           > 8 * EC_GLOB_NATIVE_MEMO_SIZE)) {
+        return ec_glob_engine_dfa;
+    }
+    unsigned long native = EC_GLOB_COST_NATIVE
+            + prog->numrange_count * EC_GLOB_COST_NATIVE_NUMRANGE;
+    if (prog->backtrack_count > 1) {
+        native += (prog->backtrack_count - 1)
+                * (unsigned long) EC_GLOB_COST_NATIVE_BACKTRACK;
+    }
+    unsigned long dfa = EC_GLOB_COST_DFA;
+    if (!glob->reused) {
+        dfa += EC_GLOB_COST_DFA_COMPILE
+                + prog->tok_count * (unsigned long) EC_GLOB_COST_DFA_TOKEN
+                + prog->numrange_count
+                    * (unsigned long) EC_GLOB_COST_DFA_NUMRANGE;
+    }
+    return native < dfa ? ec_glob_engine_native : ec_glob_engine_dfa;
+}
+
+// the specialized matcher for common shapes, the cost model for the rest
+static enum ec_glob_engine ec_glob_auto_engine(const struct ec_glob_s *glob) {
+    return glob->shape != ec_glob_shape_none
+            ? ec_glob_engine_shape : ec_glob_choose_engine(glob);
+}
+
+// compiles the analyzed pattern with the given engine
+static int ec_glob_engine_compile(struct ec_glob_s *glob,
+                                  enum ec_glob_engine engine) {
+    if (engine == ec_glob_engine_auto) {
+        engine = ec_glob_auto_engine(glob);
+    } else if (engine == ec_glob_engine_shape
+               && glob->shape == ec_glob_shape_none) {
+        return REG_BADPAT;
+    }
+    glob->engine = engine;
+    const struct ec_glob_backend *backend = &ec_glob_backends[engine];
+    return backend->compile == NULL ? 0 : backend->compile(glob);
+}
+
+// the engine of the build, unless the pattern has a common shape
+static enum ec_glob_engine ec_glob_default_engine(const struct ec_glob_s *glob) {
+    return glob->shape == ec_glob_shape_none
+            ? EC_GLOB_DEFAULT_ENGINE : ec_glob_engine_auto;
+}
+
+/*
+ * Tokenizes the pattern into the given memory and compiles it
+ * with the given engine, or the default engine when it is NULL.
+ */
+static int ec_glob_compile_into(struct ec_glob_s *glob, void *mem,
+                                const char *pattern, unsigned inputlen,
+                                const enum ec_glob_engine *engine) {
+    ec_glob_prog_init(&glob->prog, mem);
+    int status = ec_glob_parse(&glob->prog, pattern, inputlen);
+    if (status != 0) return status;
+    ec_glob_optimize(&glob->prog, &glob->allocator);
+    ec_glob_analyze(glob);
+    return ec_glob_engine_compile(glob, engine == NULL
+            ? ec_glob_default_engine(glob) : *engine);
+}
+
+static int ec_glob_match(const struct ec_glob_s *glob,
+                         const char *string, size_t len) {
+    if (glob->engine != ec_glob_engine_shape
+        && !ec_glob_prefilter_test(&glob->filter, string, len)) return 1;
+    return ec_glob_backends[glob->engine].exec(glob, string, len);
+}
+
+static void ec_glob_release(struct ec_glob_s *glob) {
+    if (glob->lanes != NULL) {
+        ec_glob_dealloc(&glob->allocator, glob->lanes, glob->lanes->size);
+    }
+    const struct ec_glob_backend *backend = &ec_glob_backends[glob->engine];
+    if (backend->free != NULL) {
+        backend->free(glob);
+    }
+}
+
+static int ec_glob_compile_engine(ec_glob_t **glob, const char *pattern,
+                                  const struct ec_glob_allocator *allocator,
+                                  const enum ec_glob_engine *engine) {
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    unsigned inputlen = strlen(pattern);
+    struct ec_glob_prog sizes;
+    size_t size = sizeof(struct ec_glob_s)
+            + ec_glob_prog_size(pattern, inputlen, &sizes);
+    struct ec_glob_s *g = ec_glob_alloc(allocator, size);
+    if (g == NULL) {
+        *glob = NULL;
+        return REG_ESPACE;
+    }
+    g->prog = sizes;
+    g->allocator = *allocator;
+    g->size = size;
+    g->reused = 1;
+    int status = ec_glob_compile_into(g, g + 1, pattern, inputlen,
+                                      engine);
+    if (status == 0) {
+        // compiled patterns may be matched in batches
+        status = ec_glob_lanes_build(g);
+        if (status != 0) {
+            g->lanes = NULL;
+            ec_glob_release(g);
+        }
+    }
+    if (status == 0) {
+        *glob = g;
+    } else {
+        ec_glob_dealloc(allocator, g, size);
+        *glob = NULL;
+    }
+    return status;
+}
+
+int ec_glob_compile_with(ec_glob_t **glob, const char *pattern,
+                         const struct ec_glob_allocator *allocator) {
+    return ec_glob_compile_engine(glob, pattern, allocator, NULL);
+}
+
+int ec_glob_compile_using(ec_glob_t **glob, const char *pattern,
+                          const char *engine) {
+    if (engine == NULL) {
+        return ec_glob_compile_engine(glob, pattern, NULL, NULL);
+    }
+    for (unsigned i = 0 ; i < ec_glob_backend_count ; i++) {
+        if (strcmp(ec_glob_backends[i].name, engine) == 0) {
+            enum ec_glob_engine e = i;
+            return ec_glob_compile_engine(glob, pattern, NULL, &e);
+        }
+    }
+    *glob = NULL;
+    return REG_BADPAT;
+}
+
+const char *ec_glob_engine_name(const ec_glob_t *glob) {
+    return ec_glob_backends[glob->engine].name;
+}
+
+int ec_glob_compile(ec_glob_t **glob, const char *pattern) {
+    return ec_glob_compile_with(glob, pattern, NULL);
+}
+
+int ec_glob_exec(const ec_glob_t *glob, const char *string) {
+    return ec_glob_match(glob, string, strlen(string));
+}
+
+int ec_glob_exec_ranges(const ec_glob_t *glob, const char *string,
+                        size_t *spans, unsigned count) {
+    size_t len = strlen(string);
+    if (glob->engine != ec_glob_engine_shape
+        && !ec_glob_prefilter_test(&glob->filter, string, len)) return 1;
+    if (count > glob->prog.numrange_count) {
+        count = glob->prog.numrange_count;
+    }
+    if (glob->engine == ec_glob_engine_pike) {
+        return ec_glob_pike_run(glob, &glob->nfa, string, len,
+                                spans, 2 * count);
+    }
+
+    // the NFA of the other engines has no SAVE states
+    struct ec_glob_nfa nfa;
+    if (ec_glob_nfa_construct(&nfa, &glob->prog, &glob->allocator, 1) != 0) {
+        return REG_ESPACE;
+    }
+    int status = ec_glob_pike_run(glob, &nfa, string, len, spans, 2 * count);
+    ec_glob_nfa_free(&nfa);
+    return status;
+}
+
+int ec_glob_exec_batch(const ec_glob_t *glob, const char *blob,
+                       const size_t *offsets, size_t count,
+                       unsigned char *matches) {
+    if (glob->engine == ec_glob_engine_bitap && glob->bitap->words == 1) {
+        ec_glob_bitap_batch(glob, glob->bitap, blob, offsets, count, matches);
+        return 0;
+    }
+
+    if (glob->lanes != NULL) {
+        ec_glob_bitap_batch(glob, glob->lanes, blob, offsets, count, matches);
+        return 0;
+    }
+
+    int status = 0;
+    unsigned char bits = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+        const char *path = blob + offsets[i];
+        size_t len = offsets[i + 1] - offsets[i];
+        status = ec_glob_match(glob, path, len);
+        if (status == REG_ESPACE) break;
+        _Bool match = status == 0;
+        status = 0;
+        // collect eight results before writing them to the bitmap
+        bits |= match << (i % 8);
+        if (i % 8 == 7) {
+            matches[i / 8] = bits;
+            bits = 0;
+        }
+    }
+    if (status == 0 && count % 8 != 0) {
+        matches[count / 8] = bits;
+    }
+    return status;
+}
+
+int ec_glob_match_batch(const char *pattern, const char *blob,
+                        const size_t *offsets, size_t count,
+                        unsigned char *matches) {
+    ec_glob_t *glob;
+    int status = ec_glob_compile(&glob, pattern);
+    if (status == 0) {
+        status = ec_glob_exec_batch(glob, blob, offsets, count, matches);
+        ec_glob_free(glob);
+    }
+    return status;
+}
+
+void ec_glob_free(ec_glob_t *glob) {
+    if (glob == NULL) return;
+    ec_glob_release(glob);
+    // the allocator lives in the memory we are going to free
+    struct ec_glob_allocator allocator = glob->allocator;
+    ec_glob_dealloc(&allocator, glob, glob->size);
+}
+
+// estimates the memory used by a compiled pattern
+static size_t ec_glob_memsize(const struct ec_glob_s *glob) {
+    const struct ec_glob_prog *prog = &glob->prog;
+    size_t size = sizeof(struct ec_glob_s)
+            + prog->numrange_count * sizeof(struct numpair_s)
+            + prog->tok_count * sizeof(struct ec_glob_tok)
+            + prog->class_count * sizeof(struct ec_glob_class);
+    const struct ec_glob_backend *backend = &ec_glob_backends[glob->engine];
+    if (backend->memsize != NULL) {
+        size += backend->memsize(glob);
+    }
+    if (glob->lanes != NULL) {
+        size += glob->lanes->size;
+    }
+    return size;
+}
+
+void ec_glob_query(const ec_glob_t *glob, struct ec_glob_stats *stats) {
+    stats->tokens = glob->prog.tok_count;
+    stats->backtracks = glob->prog.backtrack_count;
+    stats->bytes = ec_glob_memsize(glob);
+}
+
+/*
+ * The pattern cache of ec_glob() is split into shards which are selected by
+ * the hash of the pattern, so that threads matching different patterns
+ * rarely compete for the same lock.
+ * Every shard keeps its entries in a hash table and in a list ordered by
+ * the time of the last use, so that the least recently used entry can be
+ * evicted when a limit is exceeded.
+ */
+#define EC_GLOB_CACHE_BUCKETS 64
+
+struct ec_glob_cache_entry {
+    struct ec_glob_cache_entry *hnext;
+    struct ec_glob_cache_entry *prev;
+    struct ec_glob_cache_entry *next;
+    ec_glob_t *glob;
+    size_t size;
+    unsigned hash;
+    // the cache holds one reference as long as the entry is listed
+    unsigned refs;
+    char pattern[];
+};
+
+struct ec_glob_cache_shard {
+    pthread_mutex_t lock;
+    struct ec_glob_cache_entry *buckets[EC_GLOB_CACHE_BUCKETS];
+    struct ec_glob_cache_entry *head;
+    struct ec_glob_cache_entry *tail;
+    unsigned count;
+    unsigned max_entries;
+    size_t bytes;
+    size_t max_bytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+static struct ec_glob_cache_shard ec_glob_cache[EC_GLOB_CACHE_SHARDS];
+static pthread_once_t ec_glob_cache_once = PTHREAD_ONCE_INIT;
+static atomic_bool ec_glob_cache_enabled = EC_GLOB_CACHE_ENTRIES > 0;
+
+static void ec_glob_cache_limits(struct ec_glob_cache_shard *shard,
+                                 unsigned max_entries, size_t max_bytes) {
+    // the limits are distributed evenly among the shards
+    shard->max_entries = (max_entries + EC_GLOB_CACHE_SHARDS - 1)
+            / EC_GLOB_CACHE_SHARDS;
+    shard->max_bytes = (max_bytes + EC_GLOB_CACHE_SHARDS - 1)
+            / EC_GLOB_CACHE_SHARDS;
+}
+
+static void ec_glob_cache_init(void) {
+    for (unsigned i = 0 ; i < EC_GLOB_CACHE_SHARDS ; i++) {
+        struct ec_glob_cache_shard *shard = &ec_glob_cache[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        ec_glob_cache_limits(shard, EC_GLOB_CACHE_ENTRIES,
+                             EC_GLOB_CACHE_BYTES);
+    }
+}
+
+static unsigned ec_glob_cache_hash(const char *pattern, size_t *len) {
+    unsigned hash = 2166136261u;
+    const char *p = pattern;
+    while (*p != '\0') {
+        hash = (hash ^ (unsigned char) *p) * 16777619u;
+        p++;
+    }
+    *len = p - pattern;
+    return hash;
+}
+
+/*
+ * Drops one reference to the entry.
+ * Returns the entry, when it is no longer used and must be freed after
+ * releasing the lock, or NULL otherwise.
+ */
+static struct ec_glob_cache_entry *ec_glob_cache_unref(
+        struct ec_glob_cache_entry *entry) {
+    return --entry->refs == 0 ? entry : NULL;
+}
+
+static void ec_glob_cache_destroy(struct ec_glob_cache_entry *entry) {
+    while (entry != NULL) {
+        struct ec_glob_cache_entry *next = entry->hnext;
+        ec_glob_free(entry->glob);
+        free(entry);
+        entry = next;
+    }
+}
+
+/*
+ * Removes the entry from the shard and returns it, when it can be freed.
+ * The caller must hold the lock.
+ */
+static struct ec_glob_cache_entry *ec_glob_cache_unlink(
+        struct ec_glob_cache_shard *shard, struct ec_glob_cache_entry *entry) {
+    struct ec_glob_cache_entry **bucket =
+            &shard->buckets[entry->hash % EC_GLOB_CACHE_BUCKETS];
+    while (*bucket != entry) {
+        bucket = &(*bucket)->hnext;
+    }
+    *bucket = entry->hnext;
+    entry->hnext = NULL;
+
+    if (entry->prev == NULL) {
+        shard->head = entry->next;
+    } else {
+        entry->prev->next = entry->next;
+    }
+    if (entry->next == NULL) {
+        shard->tail = entry->prev;
+    } else {
+        entry->next->prev = entry->prev;
+    }
+    shard->count--;
+    shard->bytes -= entry->size;
+    return ec_glob_cache_unref(entry);
+}
+
+/*
+ * Evicts the least recently used entries until the shard can take an entry
+ * of the given size and returns a list of entries which shall be freed.
+ * The caller must hold the lock.
+ */
+static struct ec_glob_cache_entry *ec_glob_cache_evict(
+        struct ec_glob_cache_shard *shard, size_t size) {
+    struct ec_glob_cache_entry *garbage = NULL;
+    while (shard->tail != NULL && (shard->count + (size > 0) > shard->max_entries
+            || shard->bytes + size > shard->max_bytes)) {
+        struct ec_glob_cache_entry *entry =
+                ec_glob_cache_unlink(shard, shard->tail);
+        shard->evictions++;
+        if (entry != NULL) {
+            entry->hnext = garbage;
+            garbage = entry;
+        }
+    }
+    return garbage;
+}
+
+static void ec_glob_cache_touch(struct ec_glob_cache_shard *shard,
+                                struct ec_glob_cache_entry *entry) {
+    if (shard->head == entry) return;
+    entry->prev->next = entry->next;
+    if (entry->next == NULL) {
+        shard->tail = entry->prev;
+    } else {
+        entry->next->prev = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = shard->head;
+    shard->head->prev = entry;
+    shard->head = entry;
+}
+
+static int ec_glob_cached(const char *pattern, const char *string) {
+    pthread_once(&ec_glob_cache_once, ec_glob_cache_init);
+
+    size_t len;
+    unsigned hash = ec_glob_cache_hash(pattern, &len);
+    struct ec_glob_cache_shard *shard =
+            &ec_glob_cache[hash % EC_GLOB_CACHE_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    struct ec_glob_cache_entry *entry =
+            shard->buckets[hash % EC_GLOB_CACHE_BUCKETS];
+    while (entry != NULL && (entry->hash != hash
+            || memcmp(entry->pattern, pattern, len + 1) != 0)) {
+        entry = entry->hnext;
+    }
+    if (entry != NULL) {
+        shard->hits++;
+        entry->refs++;
+        ec_glob_cache_touch(shard, entry);
+        pthread_mutex_unlock(&shard->lock);
+
+        int status = ec_glob_exec(entry->glob, string);
+
+        pthread_mutex_lock(&shard->lock);
+        entry = ec_glob_cache_unref(entry);
+        pthread_mutex_unlock(&shard->lock);
+        ec_glob_cache_destroy(entry);
+        return status;
+    }
+    shard->misses++;
+    pthread_mutex_unlock(&shard->lock);
+
+    // compile without holding the lock
+    ec_glob_t *glob;
+    int status = ec_glob_compile(&glob, pattern);
+    if (status != 0) return status;
+    status = ec_glob_exec(glob, string);
+
+    entry = malloc(sizeof(struct ec_glob_cache_entry) + len + 1);
+    if (entry == NULL) {
+        ec_glob_free(glob);
+        return status;
+    }
+    entry->glob = glob;
+    entry->size = sizeof(struct ec_glob_cache_entry) + len + 1
+            + ec_glob_memsize(glob);
+    entry->hash = hash;
+    entry->refs = 1;
+    memcpy(entry->pattern, pattern, len + 1);
+
+    pthread_mutex_lock(&shard->lock);
+    struct ec_glob_cache_entry *garbage = NULL;
+    struct ec_glob_cache_entry *other =
+            shard->buckets[hash % EC_GLOB_CACHE_BUCKETS];
+    while (other != NULL && (other->hash != hash
+            || memcmp(other->pattern, pattern, len + 1) != 0)) {
+        other = other->hnext;
+    }
+    if (other != NULL || entry->size > shard->max_bytes
+            || shard->max_entries == 0) {
+        // another thread was faster, or the entry does not fit at all
+        entry->hnext = NULL;
+        garbage = entry;
+    } else {
+        garbage = ec_glob_cache_evict(shard, entry->size);
+        struct ec_glob_cache_entry **bucket =
+                &shard->buckets[hash % EC_GLOB_CACHE_BUCKETS];
+        entry->hnext = *bucket;
+        *bucket = entry;
+        entry->prev = NULL;
+        entry->next = shard->head;
+        if (shard->head == NULL) {
+            shard->tail = entry;
+        } else {
+            shard->head->prev = entry;
+        }
+        shard->head = entry;
+        shard->count++;
+        shard->bytes += entry->size;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    ec_glob_cache_destroy(garbage);
+
+    return status;
+}
+
+int ec_glob_cache_configure(unsigned max_entries, size_t max_bytes) {
+    pthread_once(&ec_glob_cache_once, ec_glob_cache_init);
+    atomic_store(&ec_glob_cache_enabled, max_entries > 0 && max_bytes > 0);
+    for (unsigned i = 0 ; i < EC_GLOB_CACHE_SHARDS ; i++) {
+        struct ec_glob_cache_shard *shard = &ec_glob_cache[i];
+        pthread_mutex_lock(&shard->lock);
+        ec_glob_cache_limits(shard, max_entries, max_bytes);
+        struct ec_glob_cache_entry *garbage = ec_glob_cache_evict(shard, 0);
+        pthread_mutex_unlock(&shard->lock);
+        ec_glob_cache_destroy(garbage);
+    }
+    return 0;
+}
+
+void ec_glob_cache_clear(void) {
+    pthread_once(&ec_glob_cache_once, ec_glob_cache_init);
+    for (unsigned i = 0 ; i < EC_GLOB_CACHE_SHARDS ; i++) {
+        struct ec_glob_cache_shard *shard = &ec_glob_cache[i];
+        struct ec_glob_cache_entry *garbage = NULL;
+        pthread_mutex_lock(&shard->lock);
+        while (shard->tail != NULL) {
+            struct ec_glob_cache_entry *entry =
+                    ec_glob_cache_unlink(shard, shard->tail);
+            if (entry != NULL) {
+                entry->hnext = garbage;
+                garbage = entry;
+            }
+        }
+        shard->hits = shard->misses = shard->evictions = 0;
+        pthread_mutex_unlock(&shard->lock);
+        ec_glob_cache_destroy(garbage);
+    }
+}
+
+void ec_glob_cache_query(struct ec_glob_cache_stats *stats) {
+    pthread_once(&ec_glob_cache_once, ec_glob_cache_init);
+    memset(stats, 0, sizeof(struct ec_glob_cache_stats));
+    for (unsigned i = 0 ; i < EC_GLOB_CACHE_SHARDS ; i++) {
+        struct ec_glob_cache_shard *shard = &ec_glob_cache[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->count;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+int ec_glob_with(const char *pattern, const char *string,
+                 const struct ec_glob_allocator *allocator) {
+    struct ec_glob_s glob;
+    glob.allocator = allocator == NULL ? ec_glob_std_allocator : *allocator;
+    glob.reused = 0;
+    glob.len = strlen(string);
+    glob.lanes = NULL;
+    long stack[EC_GLOB_STACK_PROG_SIZE / sizeof(long)];
+    void *mem = stack;
+
+    unsigned inputlen = strlen(pattern);
+    size_t progsize = ec_glob_prog_size(pattern, inputlen, &glob.prog);
+    if (progsize > sizeof(stack)) {
+        mem = ec_glob_alloc(&glob.allocator, progsize);
+        if (mem == NULL) return REG_ESPACE;
+    }
+
+    ec_glob_prog_init(&glob.prog, mem);
+    int status = ec_glob_parse(&glob.prog, pattern, inputlen);
+    if (status == 0) {
+        ec_glob_optimize(&glob.prog, &glob.allocator);
+        // most strings are rejected before the engine needs to be compiled
+        ec_glob_analyze(&glob);
+        if (glob.shape == ec_glob_shape_none
+            && !ec_glob_prefilter_test(&glob.filter, string, glob.len)) {
+            status = 1;
+        } else {
+            status = ec_glob_engine_compile(&glob,
+                                            ec_glob_default_engine(&glob));
+            if (status == 0) {
+                status = ec_glob_match(&glob, string, glob.len);
+                ec_glob_release(&glob);
+            }
+        }
+    }
+
+    if (mem != stack) {
+        ec_glob_dealloc(&glob.allocator, mem, progsize);
+    }
+    return status;
+}
+
+int ec_glob(const char *pattern, const char *string) {
+    if (atomic_load_explicit(&ec_glob_cache_enabled, memory_order_relaxed)) {
+        return ec_glob_cached(pattern, string);
+    }
+    return ec_glob_with(pattern, string, NULL);
+}
+
+/*
+ * A precompiled set is the complete DFA of the combined NFA, which is the
+ * product automaton of all patterns, minimized with Hopcroft's algorithm.
+ * Every state is labeled with the bitmap of the patterns which match the
+ * strings ending in it, so that a single scan of the string answers all
+ * patterns without taking a lock or computing a state.
+ */
+struct ec_glob_set_table {
+    size_t size;
+    // the number of states before and after the minimization
+    unsigned subset_count;
+    unsigned state_count;
+    unsigned class_count;
+    unsigned label_count;
+    unsigned start;
+    // the state which never reaches a match, or -1
+    unsigned dead;
+    unsigned char bytemap[256];
+    // the next state for every state and class of bytes
+    uint16_t *next;
+    // the label of every state
+    uint16_t *labels;
+    // the bitmap of every label, beginning with the empty one
+    unsigned char *bitmaps;
+};
+
+/*
+ * A pattern set combines the NFAs of all patterns into one automaton.
+ * The lazy DFA then evaluates all patterns with a single scan of the
+ * string and the MATCH states in the final state tell which patterns
+ * matched.
+ */
+struct ec_glob_set_s {
+    struct ec_glob_nfa nfa;
+    struct ec_glob_class *classes;
+    unsigned class_count;
+    struct ec_glob_dfa *dfa;
+    // the minimized DFA, if the set was precompiled
+    struct ec_glob_set_table *table;
+    unsigned count;
+    struct ec_glob_allocator allocator;
+};
+
+int ec_glob_set_compile_with(ec_glob_set_t **set,
+                             const char * const *patterns, unsigned count,
+                             const struct ec_glob_allocator *allocator) {
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    *set = NULL;
+    struct ec_glob_set_s *s = ec_glob_alloc(allocator,
+                                            sizeof(struct ec_glob_set_s));
+    if (s == NULL) return REG_ESPACE;
+    s->count = count;
+    s->classes = NULL;
+    s->class_count = 0;
+    s->dfa = NULL;
+    s->table = NULL;
+    s->allocator = *allocator;
+    ec_glob_nfa_init(&s->nfa, &s->allocator);
+
+    int status = 0;
+    size_t memsize = 0;
+    long *mem = NULL;
+    unsigned start = (unsigned) -1;
+    for (unsigned i = 0 ; i < count && status == 0 ; i++) {
+        struct ec_glob_prog prog;
+        unsigned inputlen = strlen(patterns[i]);
+        size_t progsize = ec_glob_prog_size(patterns[i], inputlen, &prog);
+        if (progsize > memsize) {
+            if (mem != NULL) ec_glob_dealloc(allocator, mem, memsize);
+            mem = ec_glob_alloc(allocator, progsize);
+            memsize = progsize;
+            if (mem == NULL) {
+                status = REG_ESPACE;
+                break;
+            }
+        }
+        ec_glob_prog_init(&prog, mem);
+        // like ec_glob(), an invalid pattern never matches
+        if (ec_glob_parse(&prog, patterns[i], inputlen) != 0) continue;
+        ec_glob_optimize(&prog, allocator);
+
+        if (prog.class_count > 0) {
+            size_t oldsize = s->class_count * sizeof(struct ec_glob_class);
+            size_t newsize = oldsize
+                    + prog.class_count * sizeof(struct ec_glob_class);
+            struct ec_glob_class *classes = s->classes == NULL
+                    ? ec_glob_alloc(allocator, newsize)
+                    : ec_glob_realloc(allocator, s->classes, oldsize, newsize);
+            if (classes == NULL) {
+                status = REG_ESPACE;
+                break;
+            }
+            memcpy(classes + s->class_count, prog.classes,
+                   prog.class_count * sizeof(struct ec_glob_class));
+            s->classes = classes;
+        }
+        s->nfa.class_base = s->class_count;
+        s->class_count += prog.class_count;
+
+        // the first pattern must always own the MATCH state at index zero
+        if (i == 0) {
+            s->nfa.start = ec_glob_nfa_add_prog(&s->nfa, &prog, 0);
+            start = s->nfa.start;
+        } else {
+            unsigned k = ec_glob_nfa_add_prog(&s->nfa, &prog, i);
+            start = start == (unsigned) -1 ? k
+                    : ec_glob_nfa_add(&s->nfa, EC_GLOB_NFA_SPLIT, k, start);
+        }
+    }
+    if (mem != NULL) {
+        ec_glob_dealloc(allocator, mem, memsize);
+    }
+
+    if (status == 0 && start == (unsigned) -1) {
+        // no valid pattern at all, so create a state which never matches
+        ec_glob_nfa_add(&s->nfa, EC_GLOB_NFA_MATCH, 0, (unsigned) -1);
+        start = ec_glob_nfa_range(&s->nfa, 1, 0, 0);
+    }
+    s->nfa.start = start;
+    s->nfa.classes = s->classes;
+    if (status == 0 && s->nfa.oom) {
+        status = REG_ESPACE;
+    }
+    if (status == 0) {
+        s->dfa = ec_glob_dfa_create(&s->nfa, EC_GLOB_SET_CACHE_SIZE);
+        if (s->dfa == NULL) status = REG_ESPACE;
+    }
+
+    if (status == 0) {
+        *set = s;
+    } else {
+        ec_glob_set_free(s);
+    }
+    return status;
+}
+
+int ec_glob_set_compile(ec_glob_set_t **set, const char * const *patterns,
+                        unsigned count) {
+    return ec_glob_set_compile_with(set, patterns, count, NULL);
+}
+
+/*
+ * Sets the bits of the patterns with a MATCH state among the NFA states
+ * and returns their number. The bitmap must be cleared by the caller.
+ */
+static int ec_glob_set_collect(const struct ec_glob_set_s *set,
+                               const unsigned *states, unsigned count,
+                               unsigned char *matches) {
+    int found = 0;
+    for (unsigned i = 0 ; i < count ; i++) {
+        // the states of a reused DFA state are garbage
+        if (states[i] >= set->nfa.count) continue;
+        const struct ec_glob_nfa_state *s = &set->nfa.states[states[i]];
+        if (s->type == EC_GLOB_NFA_MATCH && s->out1 != (unsigned) -1) {
+            matches[s->out1 / 8] |= 1u << (s->out1 % 8);
+            found++;
+        }
+    }
+    return found;
+}
+
+static int ec_glob_set_matches(const struct ec_glob_set_s *set,
+                               const struct ec_glob_dfa *dfa,
+                               const struct ec_glob_dfa_state *state,
+                               unsigned char *matches) {
+    if (!state->accept) return 0;
+    return ec_glob_set_collect(set, ec_glob_dfa_state_nfa(dfa, state),
+                               state->count, matches);
+}
+
+/*
+ * The scratch memory of the minimization. The blocks of the partition
+ * are ranges of the states in elems, with the states of the pending split
+ * at the start of the range.
+ */
+struct ec_glob_set_block {
+    unsigned first;
+    unsigned end;
+    unsigned marked;
+};
+
+struct ec_glob_set_minimizer {
+    unsigned state_count;
+    unsigned class_count;
+    // the transitions of the states of the subset construction
+    unsigned *next;
+    // the predecessors of every state by class, and where they start
+    unsigned *prev;
+    unsigned *prev_start;
+    unsigned *elems;
+    unsigned *loc;
+    unsigned *block_of;
+    struct ec_glob_set_block *blocks;
+    unsigned block_count;
+    unsigned *work;
+    unsigned char *pending;
+    unsigned work_count;
+    unsigned *splitter;
+    unsigned *touched;
+};
+
+static void ec_glob_set_push_block(struct ec_glob_set_minimizer *m,
+                                   unsigned b) {
+    m->pending[b] = 1;
+    m->work[m->work_count++] = b;
+}
+
+/*
+ * Refines the partition, which must initially separate the states by
+ * their labels, until no block has transitions into two blocks for the
+ * same class of bytes. Every time a block is split, only the smaller
+ * half has to be used as a splitter, unless the block is still pending.
+ */
+static void ec_glob_set_minimize(struct ec_glob_set_minimizer *m) {
+    unsigned n = m->state_count;
+    while (m->work_count > 0) {
+        unsigned b = m->work[--m->work_count];
+        m->pending[b] = 0;
+        unsigned first = m->blocks[b].first;
+        unsigned len = m->blocks[b].end - first;
+        memcpy(m->splitter, m->elems + first, len * sizeof(unsigned));
+        for (unsigned c = 0 ; c < m->class_count ; c++) {
+            // mark the states with a transition into the splitter
+            unsigned touched = 0;
+            for (unsigned i = 0 ; i < len ; i++) {
+                size_t key = (size_t) c * n + m->splitter[i];
+                for (unsigned k = m->prev_start[key] ;
+                     k < m->prev_start[key + 1] ; k++) {
+                    unsigned p = m->prev[k];
+                    struct ec_glob_set_block *x = &m->blocks[m->block_of[p]];
+                    unsigned mark = x->first + x->marked;
+                    if (m->loc[p] < mark) continue;
+                    unsigned other = m->elems[mark];
+                    m->elems[m->loc[p]] = other;
+                    m->loc[other] = m->loc[p];
+                    m->elems[mark] = p;
+                    m->loc[p] = mark;
+                    if (x->marked++ == 0) {
+                        m->touched[touched++] = m->block_of[p];
+                    }
+                }
+            }
+
+            // split the blocks which were only partly marked
+            for (unsigned i = 0 ; i < touched ; i++) {
+                unsigned t = m->touched[i];
+                struct ec_glob_set_block *x = &m->blocks[t];
+                unsigned marked = x->marked;
+                x->marked = 0;
+                if (marked == x->end - x->first) continue;
+                unsigned nb = m->block_count++;
+                struct ec_glob_set_block *y = &m->blocks[nb];
+                y->first = x->first;
+                y->end = x->first + marked;
+                y->marked = 0;
+                x->first += marked;
+                for (unsigned k = y->first ; k < y->end ; k++) {
+                    m->block_of[m->elems[k]] = nb;
+                }
+                if (m->pending[t] || marked <= x->end - x->first) {
+                    ec_glob_set_push_block(m, nb);
+                } else {
+                    ec_glob_set_push_block(m, t);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Looks up the bitmap in the labels or adds it.
+ * The hash table has a power of two of slots, more than labels.
+ */
+static unsigned ec_glob_set_label(unsigned char *bitmaps, unsigned bytes,
+                                  unsigned *count, unsigned *table,
+                                  unsigned mask, const unsigned char *bitmap) {
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0 ; i < bytes ; i++) {
+        hash = (hash ^ bitmap[i]) * 16777619u;
+    }
+    for (unsigned h = hash & mask ; ; h = (h + 1) & mask) {
+        if (table[h] == 0) {
+            memcpy(bitmaps + (size_t) *count * bytes, bitmap, bytes);
+            table[h] = ++*count;
+            return *count - 1;
+        }
+        unsigned label = table[h] - 1;
+        if (0 == memcmp(bitmaps + (size_t) label * bytes, bitmap, bytes)) {
+            return label;
+        }
+    }
+}
+
+// the states of the subset construction in the order of their discovery
+struct ec_glob_set_explored {
+    struct ec_glob_dfa_state **states;
+    unsigned count;
+    unsigned capacity;
+    // there are more states than the budget
+    _Bool exceeded;
+};
+
+/*
+ * Explores all states of the DFA, until they exceed the budget, and
+ * numbers them, so that the start state has the number zero.
+ * Returns zero on success or REG_ESPACE when memory is exhausted.
+ */
+static int ec_glob_set_explore(struct ec_glob_dfa *dfa,
+                               struct ec_glob_set_explored *e,
+                               unsigned max_states) {
+    const struct ec_glob_allocator *allocator = dfa->nfa->allocator;
+    unsigned char rep[256];
+    for (unsigned c = 256 ; c-- > 0 ; ) {
+        rep[dfa->bytemap[c]] = (unsigned char) c;
+    }
+    e->count = 0;
+    e->capacity = 64;
+    e->exceeded = 0;
+    e->states = ec_glob_alloc(allocator,
+            e->capacity * sizeof(struct ec_glob_dfa_state *));
+    if (e->states == NULL) return REG_ESPACE;
+    struct ec_glob_dfa_state *next = ec_glob_dfa_start(dfa);
+    if (next == NULL) return REG_ESPACE;
+    next->id = e->count;
+    e->states[e->count++] = next;
+    for (unsigned i = 0 ; i < e->count ; i++) {
+        struct ec_glob_dfa_state *state = e->states[i];
+        for (unsigned c = 0 ; c < dfa->class_count ; c++) {
+            next = state->next[c];
+            if (next == NULL) {
+                next = ec_glob_dfa_step(dfa, state, rep[c]);
+                if (next == NULL) return REG_ESPACE;
+            }
+            if (next->id != (unsigned) -1) continue;
+            if (e->count == max_states) {
+                e->exceeded = 1;
+                return 0;
+            }
+            if (e->count == 2 * dfa->bucket_count
+                && ec_glob_dfa_rehash(dfa, 8 * dfa->bucket_count) != 0) {
+                return REG_ESPACE;
+            }
+            if (e->count == e->capacity) {
+                size_t size = e->capacity * sizeof(struct ec_glob_dfa_state *);
+                struct ec_glob_dfa_state **grown = ec_glob_realloc(allocator,
+                        e->states, size, 2 * size);
+                if (grown == NULL) return REG_ESPACE;
+                e->states = grown;
+                e->capacity *= 2;
+            }
+            next->id = e->count;
+            e->states[e->count++] = next;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Builds the minimized DFA from the explored states of the subset
+ * construction. Returns NULL when memory is exhausted.
+ */
+static struct ec_glob_set_table *ec_glob_set_table_build(
+        const struct ec_glob_set_s *set, const struct ec_glob_dfa *dfa,
+        struct ec_glob_dfa_state **states, unsigned n) {
+    const struct ec_glob_allocator *allocator = &set->allocator;
+    unsigned classes = dfa->class_count;
+    unsigned bytes = (set->count + 7) / 8;
+    unsigned buckets = 1;
+    while (buckets <= 2 * n) buckets *= 2;
+
+    // all scratch memory in one allocation
+    size_t transitions = (size_t) n * classes;
+    size_t scratch = (3 * transitions + 1 + 8 * (size_t) n + buckets)
+            * sizeof(unsigned)
+            + n * sizeof(struct ec_glob_set_block)
+            + (size_t) (n + 1) * bytes + bytes + n;
+    unsigned *mem = ec_glob_alloc(allocator, scratch);
+    if (mem == NULL) return NULL;
+    struct ec_glob_set_minimizer m;
+    m.state_count = n;
+    m.class_count = classes;
+    m.next = mem;
+    m.prev = m.next + transitions;
+    m.prev_start = m.prev + transitions;
+    m.elems = m.prev_start + transitions + 1;
+    m.loc = m.elems + n;
+    m.block_of = m.loc + n;
+    m.work = m.block_of + n;
+    m.splitter = m.work + n;
+    m.touched = m.splitter + n;
+    unsigned *label_of = m.touched + n;
+    unsigned *label_size = label_of + n;
+    unsigned *table = label_size + n;
+    m.blocks = (struct ec_glob_set_block *) (table + buckets);
+    unsigned char *bitmaps = (unsigned char *) (m.blocks + n);
+    unsigned char *bitmap = bitmaps + (size_t) (n + 1) * bytes;
+    m.pending = bitmap + bytes;
+
+    // the transitions and their inverse
+    memset(m.prev_start, 0, (transitions + 1) * sizeof(unsigned));
+    for (unsigned i = 0 ; i < n ; i++) {
+        for (unsigned c = 0 ; c < classes ; c++) {
+            unsigned t = states[i]->next[c]->id;
+            m.next[(size_t) i * classes + c] = t;
+            m.prev_start[(size_t) c * n + t + 1]++;
+        }
+    }
+    for (size_t k = 0 ; k < transitions ; k++) {
+        m.prev_start[k + 1] += m.prev_start[k];
+    }
+    for (unsigned i = 0 ; i < n ; i++) {
+        for (unsigned c = 0 ; c < classes ; c++) {
+            size_t key = (size_t) c * n + m.next[(size_t) i * classes + c];
+            m.prev[m.prev_start[key]++] = i;
+        }
+    }
+    // filling shifted every start to the next one
+    memmove(m.prev_start + 1, m.prev_start, transitions * sizeof(unsigned));
+    m.prev_start[0] = 0;
+
+    // the labels, the empty one first
+    unsigned label_count = 0;
+    memset(table, 0, buckets * sizeof(unsigned));
+    memset(bitmap, 0, bytes);
+    ec_glob_set_label(bitmaps, bytes, &label_count, table, buckets - 1, bitmap);
+    for (unsigned i = 0 ; i < n ; i++) {
+        memset(bitmap, 0, bytes);
+        if (states[i]->accept) {
+            ec_glob_set_matches(set, dfa, states[i], bitmap);
+        }
+        label_of[i] = ec_glob_set_label(bitmaps, bytes, &label_count, table,
+                                        buckets - 1, bitmap);
+    }
+
+    // the initial partition has a block for every label
+    memset(label_size, 0, label_count * sizeof(unsigned));
+    for (unsigned i = 0 ; i < n ; i++) {
+        label_size[label_of[i]]++;
+    }
+    m.block_count = 0;
+    m.work_count = 0;
+    unsigned first = 0;
+    for (unsigned l = 0 ; l < label_count ; l++) {
+        unsigned size = label_size[l];
+        // from now on the block of the label
+        label_size[l] = m.block_count;
+        if (size == 0) continue;
+        struct ec_glob_set_block *b = &m.blocks[m.block_count];
+        b->first = b->end = first;
+        b->marked = 0;
+        first += size;
+        ec_glob_set_push_block(&m, m.block_count++);
+    }
+    for (unsigned i = 0 ; i < n ; i++) {
+        unsigned b = label_size[label_of[i]];
+        m.block_of[i] = b;
+        m.loc[i] = m.blocks[b].end++;
+        m.elems[m.loc[i]] = i;
+    }
+    ec_glob_set_minimize(&m);
+
+    unsigned count = m.block_count;
+    size_t size = sizeof(struct ec_glob_set_table)
+            + ((size_t) count * classes + count) * sizeof(uint16_t)
+            + (size_t) label_count * bytes;
+    struct ec_glob_set_table *t = ec_glob_alloc(allocator, size);
+    if (t != NULL) {
+        t->size = size;
+        t->subset_count = n;
+        t->state_count = count;
+        t->class_count = classes;
+        t->label_count = label_count;
+        t->start = m.block_of[0];
+        t->dead = (unsigned) -1;
+        memcpy(t->bytemap, dfa->bytemap, sizeof(t->bytemap));
+        t->next = (uint16_t *) (t + 1);
+        t->labels = t->next + (size_t) count * classes;
+        t->bitmaps = (unsigned char *) (t->labels + count);
+        memcpy(t->bitmaps, bitmaps, (size_t) label_count * bytes);
+        for (unsigned b = 0 ; b < count ; b++) {
+            unsigned rep = m.elems[m.blocks[b].first];
+            _Bool dead = label_of[rep] == 0;
+            for (unsigned c = 0 ; c < classes ; c++) {
+                unsigned next = m.block_of[m.next[(size_t) rep * classes + c]];
+                t->next[(size_t) b * classes + c] = (uint16_t) next;
+                dead = dead && next == b;
+            }
+            t->labels[b] = (uint16_t) label_of[rep];
+            if (dead) t->dead = b;
+        }
+    }
+    ec_glob_dealloc(allocator, mem, scratch);
+    return t;
+}
+
+int ec_glob_set_precompile(ec_glob_set_t *set, unsigned max_states) {
+    if (max_states == 0) max_states = EC_GLOB_SET_MAX_STATES;
+    // the states and labels are numbered with 16 bits
+    if (max_states > UINT16_MAX) max_states = UINT16_MAX;
+    if (set->table != NULL) {
+        ec_glob_dealloc(&set->allocator, set->table, set->table->size);
+        set->table = NULL;
+    }
+
+    // the budget of states limits the memory instead of the cache
+    struct ec_glob_dfa *dfa = ec_glob_dfa_create(&set->nfa, SIZE_MAX);
+    if (dfa == NULL) return REG_ESPACE;
+    struct ec_glob_set_explored explored;
+    int status = ec_glob_set_explore(dfa, &explored, max_states);
+    if (status == 0 && !explored.exceeded) {
+        set->table = ec_glob_set_table_build(set, dfa, explored.states,
+                                             explored.count);
+        if (set->table == NULL) status = REG_ESPACE;
+    }
+    if (explored.states != NULL) {
+        ec_glob_dealloc(&set->allocator, explored.states,
+                explored.capacity * sizeof(struct ec_glob_dfa_state *));
+    }
+    ec_glob_dfa_destroy(dfa);
+    return status;
+}
+
+void ec_glob_set_query(const ec_glob_set_t *set,
+                       struct ec_glob_set_stats *stats) {
+    const struct ec_glob_set_table *t = set->table;
+    stats->subset_states = t == NULL ? 0 : t->subset_count;
+    stats->states = t == NULL ? 0 : t->state_count;
+    stats->labels = t == NULL ? 0 : t->label_count;
+    stats->classes = t == NULL ? 0 : t->class_count;
+    stats->bytes = t == NULL ? 0 : t->size;
+}
+
+// one lookup per byte of the string, which stops at the dead state
+static int ec_glob_set_table_exec(const struct ec_glob_set_table *t,
+                                  unsigned count, const char *string,
+                                  unsigned char *matches) {
+    const unsigned char *s = (const unsigned char *) string;
+    unsigned state = t->start;
+    while (*s != '\0' && state != t->dead) {
+        state = t->next[state * t->class_count + t->bytemap[*s++]];
+    }
+    unsigned bytes = (count + 7) / 8;
+    unsigned label = t->labels[state];
+    if (label == 0) return 0;
+    memcpy(matches, t->bitmaps + (size_t) label * bytes, bytes);
+    int found = 0;
+    for (unsigned i = 0 ; i < bytes ; i++) {
+        found += __builtin_popcount(matches[i]);
+    }
+    return found;
+}
+
+int ec_glob_set_exec(const ec_glob_set_t *set, const char *string,
+                     unsigned char *matches) {
+    struct ec_glob_dfa *dfa = set->dfa;
+    int found = 0;
+
+    memset(matches, 0, (set->count + 7) / 8);
+    if (set->table != NULL) {
+        return ec_glob_set_table_exec(set->table, set->count, string, matches);
+    }
+
+    size_t len = strlen(string);
+    struct ec_glob_dfa_state *state;
+    unsigned flushes;
+    _Bool flushed = ec_glob_dfa_run_shared(dfa, string, len,
+                                           &state, &flushes) != 0;
+    if (state != NULL) {
+        // the NFA states are only read up to the count of a current state
+        _Bool accept = state->accept;
+        unsigned count = state->count;
+        flushed = !ec_glob_dfa_current(dfa, flushes);
+        if (accept && !flushed) {
+            found = ec_glob_set_collect(set, ec_glob_dfa_state_nfa(dfa, state),
+                                        count, matches);
+            flushed = !ec_glob_dfa_current(dfa, flushes);
+        }
+    }
+    if (flushed) {
+        // the state may have been reused, so match again with the lock
+        memset(matches, 0, (set->count + 7) / 8);
+        pthread_mutex_lock(&dfa->lock);
+        state = ec_glob_dfa_run(dfa, string, len);
+        if (state != NULL) {
+            found = ec_glob_set_matches(set, dfa, state, matches);
+        }
+        pthread_mutex_unlock(&dfa->lock);
+    }
+    if (state == NULL) {
+        found = -1;
+    }
+    return found;
+}
+
+void ec_glob_set_free(ec_glob_set_t *set) {
+    if (set == NULL) return;
+    if (set->dfa != NULL) {
+        ec_glob_dfa_destroy(set->dfa);
+    }
+    ec_glob_nfa_free(&set->nfa);
+    struct ec_glob_allocator allocator = set->allocator;
+    if (set->table != NULL) {
+        ec_glob_dealloc(&allocator, set->table, set->table->size);
+    }
+    if (set->classes != NULL) {
+        ec_glob_dealloc(&allocator, set->classes,
+                        set->class_count * sizeof(struct ec_glob_class));
+    }
+    ec_glob_dealloc(&allocator, set, sizeof(struct ec_glob_set_s));
+}
+
+/*
+ * The arena state lives at the start of its memory region. Allocations
+ * bump the offset of the free memory with compare-and-swap, so that
+ * concurrent matching of the patterns in one arena needs no lock.
+ * Only the most recent allocation can be resized in place or given back.
+ */
+struct ec_glob_arena_s {
+    char *mem;
+    size_t size;
+    atomic_size_t used;
+};
+
+#define ec_glob_arena_align(n) \
+    (((n) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+static void *ec_glob_arena_alloc(size_t size, void *ctx) {
+    struct ec_glob_arena_s *arena = ctx;
+    size = ec_glob_arena_align(size);
+    size_t used = atomic_load_explicit(&arena->used, memory_order_relaxed);
+    do {
+        if (size > arena->size - used) return NULL;
+    } while (!atomic_compare_exchange_weak(&arena->used, &used, used + size));
+    return arena->mem + used;
+}
+
+static void *ec_glob_arena_realloc(void *ptr, size_t oldsize, size_t newsize,
+                                   void *ctx) {
+    struct ec_glob_arena_s *arena = ctx;
+    size_t offset = (char *) ptr - arena->mem;
+    size_t end = offset + ec_glob_arena_align(oldsize);
+    size_t newend = offset + ec_glob_arena_align(newsize);
+    // try to resize the most recent allocation in place
+    if (newend <= arena->size && atomic_compare_exchange_strong(
+            &arena->used, &end, newend)) {
+        return ptr;
+    }
+    void *mem = ec_glob_arena_alloc(newsize, ctx);
+    if (mem != NULL) {
+        memcpy(mem, ptr, oldsize < newsize ? oldsize : newsize);
+    }
+    return mem;
+}
+
+static void ec_glob_arena_free(void *ptr, size_t size, void *ctx) {
+    struct ec_glob_arena_s *arena = ctx;
+    size_t offset = (char *) ptr - arena->mem;
+    size_t end = offset + ec_glob_arena_align(size);
+    // only the most recent allocation can be given back
+    atomic_compare_exchange_strong(&arena->used, &end, offset);
+}
+
+ec_glob_arena_t *ec_glob_arena_init(void *mem, size_t size) {
+    size_t skip = ec_glob_arena_align((size_t) mem) - (size_t) mem;
+    size_t header = ec_glob_arena_align(sizeof(struct ec_glob_arena_s));
+    if (size < skip + header) return NULL;
+    struct ec_glob_arena_s *arena = (void *) ((char *) mem + skip);
+    arena->mem = (char *) arena + header;
+    arena->size = size - skip - header;
+    atomic_init(&arena->used, 0);
+    return arena;
+}
+
+void ec_glob_arena_allocator(ec_glob_arena_t *arena,
+                             struct ec_glob_allocator *allocator) {
+    allocator->alloc = ec_glob_arena_alloc;
+    allocator->realloc = ec_glob_arena_realloc;
+    allocator->free = ec_glob_arena_free;
+    allocator->ctx = arena;
+}
+
+size_t ec_glob_arena_used(const ec_glob_arena_t *arena) {
+    return atomic_load((atomic_size_t *) &arena->used);
+}
+
+void ec_glob_arena_reset(ec_glob_arena_t *arena) {
+    atomic_store(&arena->used, 0);
+}
+
+/*
+ * The directory walkers match the paths with a private lazy DFA, so that
+ * the shared compiled pattern is never locked. Before a directory is
+ * opened, its path and a slash are fed to the DFA. When this ends in the
+ * dead state, no path below the directory can match and it is skipped.
+ * The entries continue from the state of their directory, so every byte
+ * of a path is fed only once.
+ *
+ * The sequential walker reads a directory completely onto an explicit
+ * stack before it descends into the first subdirectory, so the depth of
+ * the tree is neither limited by the C stack nor by the number of open
+ * files: at most EC_GLOB_WALK_OPEN_DIRS directories on the stack are kept
+ * open, and a closed one is opened again from the root when another of
+ * its subdirectories is read.
+ */
+
+// read directories with the raw system call instead of readdir()
+#ifndef EC_GLOB_USE_GETDENTS
+#ifdef SYS_getdents64
+#define EC_GLOB_USE_GETDENTS 1
+#else
+#define EC_GLOB_USE_GETDENTS 0
+#endif
+#endif
+
+#ifndef EC_GLOB_WALK_BUFFER_SIZE
+#define EC_GLOB_WALK_BUFFER_SIZE 32768
+#endif
+
+typedef int (*ec_glob_entry_fn)(void *ctx, int fd, const char *name,
+                                unsigned char type);
+
+/*
+ * Calls the function for the entries of a directory except for . and ..
+ * until it returns non-zero, and closes the file descriptor unless it
+ * shall be kept. The buffer must have EC_GLOB_WALK_BUFFER_SIZE bytes.
+ */
+static int ec_glob_readdir(int fd, _Bool keep, char *buf, ec_glob_entry_fn fn,
+                           void *ctx) {
+    int status = 0;
+#if EC_GLOB_USE_GETDENTS
+    struct ec_glob_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+    long n;
+    while (status == 0 && (n = syscall(SYS_getdents64, fd, buf,
+            EC_GLOB_WALK_BUFFER_SIZE)) > 0) {
+        for (long off = 0 ; off < n && status == 0 ; ) {
+            struct ec_glob_dirent64 *d = (void *) (buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0'
+                || (name[1] == '.' && name[2] == '\0'))) continue;
+            status = fn(ctx, fd, name, d->d_type);
+        }
+    }
+    if (!keep) close(fd);
+#else
+    (void) buf;
+    // the stream closes its own file descriptor
+    if (keep && (fd = dup(fd)) < 0) return 0;
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return 0;
+    }
+    struct dirent *d;
+    while (status == 0 && (d = readdir(dir)) != NULL) {
+        const char *name = d->d_name;
+        if (name[0] == '.' && (name[1] == '\0'
+            || (name[1] == '.' && name[2] == '\0'))) continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+        status = fn(ctx, dirfd(dir), name, d->d_type);
+#else
+        status = fn(ctx, dirfd(dir), name, DT_UNKNOWN);
+#endif
+    }
+    closedir(dir);
+#endif
+    return status;
+}
+
+// determines the type of an entry, when the file system did not report it
+static unsigned char ec_glob_entry_type(int fd, const char *name,
+                                        unsigned char type) {
+    if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return type;
+        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+    }
+    return type;
+}
+
+static int ec_glob_open_subdir(int fd, const char *name) {
+    return openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+/*
+ * Opens a directory by its relative path with a trailing slash, starting
+ * at the root and without following a symbolic link on the way.
+ */
+static int ec_glob_open_path(int rootfd, const char *path, size_t len) {
+    char name[NAME_MAX + 1];
+    int fd = openat(rootfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (size_t begin = 0 ; fd >= 0 && begin < len ; ) {
+        const char *slash = memchr(path + begin, '/', len - begin);
+        size_t namelen = slash - (path + begin);
+        memcpy(name, path + begin, namelen);
+        name[namelen] = '\0';
+        int subfd = ec_glob_open_subdir(fd, name);
+        close(fd);
+        fd = subfd;
+        begin += namelen + 1;
+    }
+    return fd;
+}
+
+// the number of directories which are kept open by a walker
+#ifndef EC_GLOB_WALK_OPEN_DIRS
+#define EC_GLOB_WALK_OPEN_DIRS 256
+#endif
+
+// a directory on the stack of the sequential walker
+struct ec_glob_walk_frame {
+    // the open directory, or -1 when it was closed to bound the open files
+    int fd;
+    size_t dirlen;
+    struct ec_glob_dfa_state *state;
+    unsigned flushes;
+    // the entries which were read, and the next one to match
+    size_t next;
+    size_t end;
+};
+
+struct ec_glob_walk_ctx {
+    struct ec_glob_dfa *dfa;
+    // the set, or NULL when walking with a single pattern
+    const struct ec_glob_set_s *set;
+    unsigned char *matches;
+    ec_glob_walk_fn callback;
+    void *data;
+    const struct ec_glob_allocator *allocator;
+    // the relative path of the current entry
+    char *path;
+    size_t capacity;
+    // the directories from the root to the current one
+    struct ec_glob_walk_frame *frames;
+    size_t depth;
+    size_t frame_capacity;
+    // the directories below this one on the stack are closed
+    size_t closed;
+    unsigned open;
+    // the entries of the directories on the stack, each a type and a name
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+    char *buf;
+    int status;
+};
+
+/*
+ * Grows a buffer of the walker, so that it has more than len bytes.
+ */
+static _Bool ec_glob_walk_grow(struct ec_glob_walk_ctx *ctx, char **mem,
+                               size_t *capacity, size_t len) {
+    if (len < *capacity) return 1;
+    size_t newcap = *capacity * 2;
+    while (newcap <= len) newcap *= 2;
+    char *newmem = ec_glob_realloc(ctx->allocator, *mem, *capacity, newcap);
+    if (newmem == NULL) {
+        ctx->status = -1;
+        errno = ENOMEM;
+        return 0;
+    }
+    *mem = newmem;
+    *capacity = newcap;
+    return 1;
+}
+
+// appends an entry of the directory which is read to the stack
+static int ec_glob_walk_collect(void *data, int fd, const char *name,
+                                unsigned char type) {
+    struct ec_glob_walk_ctx *ctx = data;
+    size_t len = strlen(name) + 1;
+    if (!ec_glob_walk_grow(ctx, &ctx->names, &ctx->names_capacity,
+                           ctx->names_len + len + 1)) {
+        return ctx->status;
+    }
+    // the directory may be closed when the entry is matched
+    ctx->names[ctx->names_len] = (char) ec_glob_entry_type(fd, name, type);
+    memcpy(ctx->names + ctx->names_len + 1, name, len);
+    ctx->names_len += len + 1;
+    return 0;
+}
+
+/*
+ * Reads the entries of a directory onto the stack, whose relative path
+ * (including the trailing slash) is in the path buffer.
+ * The state must be the current DFA state for the path.
+ */
+static void ec_glob_walk_push(struct ec_glob_walk_ctx *ctx, int fd,
+                              size_t dirlen,
+                              struct ec_glob_dfa_state *state) {
+    if (ctx->depth == ctx->frame_capacity) {
+        size_t size = ctx->frame_capacity * sizeof(struct ec_glob_walk_frame);
+        struct ec_glob_walk_frame *frames = ec_glob_realloc(ctx->allocator,
+                ctx->frames, size, 2 * size);
+        if (frames == NULL) {
+            close(fd);
+            ctx->status = -1;
+            errno = ENOMEM;
+            return;
+        }
+        ctx->frames = frames;
+        ctx->frame_capacity *= 2;
+    }
+    struct ec_glob_walk_frame *frame = &ctx->frames[ctx->depth++];
+    frame->fd = fd;
+    frame->dirlen = dirlen;
+    frame->state = state;
+    frame->flushes = ctx->dfa->flushes;
+    frame->next = ctx->names_len;
+    ec_glob_readdir(fd, 1, ctx->buf, ec_glob_walk_collect, ctx);
+    frame->end = ctx->names_len;
+    if (ctx->depth > 1) ctx->open++;
+}
+
+// removes the current directory from the stack
+static void ec_glob_walk_pop(struct ec_glob_walk_ctx *ctx) {
+    struct ec_glob_walk_frame *frame = &ctx->frames[--ctx->depth];
+    if (frame->fd >= 0) {
+        close(frame->fd);
+        if (ctx->depth > 0) ctx->open--;
+    }
+    ctx->names_len = frame->next;
+}
+
+/*
+ * Opens a subdirectory of the current directory. Beyond
+ * EC_GLOB_WALK_OPEN_DIRS open directories, the directory closest to the
+ * root is closed, since it is needed again last. The current directory
+ * is opened again from the root, when it was closed.
+ */
+static int ec_glob_walk_open(struct ec_glob_walk_ctx *ctx, const char *name) {
+    size_t top = ctx->depth - 1;
+    struct ec_glob_walk_frame *frame = &ctx->frames[top];
+    if (frame->fd < 0) {
+        frame->fd = ec_glob_open_path(ctx->frames[0].fd, ctx->path,
+                                      frame->dirlen);
+        if (frame->fd < 0) return -1;
+        ctx->open++;
+        // the directories below were closed before this one
+        ctx->closed = top - 1;
+    }
+    if (ctx->open >= EC_GLOB_WALK_OPEN_DIRS && ctx->closed + 1 < top) {
+        struct ec_glob_walk_frame *oldest = &ctx->frames[++ctx->closed];
+        close(oldest->fd);
+        oldest->fd = -1;
+        ctx->open--;
+    }
+    return ec_glob_open_subdir(frame->fd, name);
+}
+
+/*
+ * Matches the entries of the directories on the stack and descends into
+ * the subdirectories, in the order in which they were read.
+ */
+static void ec_glob_walk_run(struct ec_glob_walk_ctx *ctx) {
+    struct ec_glob_dfa *dfa = ctx->dfa;
+    while (ctx->depth > 0 && ctx->status == 0) {
+        struct ec_glob_walk_frame *frame = &ctx->frames[ctx->depth - 1];
+        if (frame->next == frame->end) {
+            ec_glob_walk_pop(ctx);
+            continue;
+        }
+        unsigned char type = (unsigned char) ctx->names[frame->next];
+        const char *name = ctx->names + frame->next + 1;
+        size_t namelen = strlen(name);
+        frame->next += namelen + 2;
+
+        if (frame->flushes != dfa->flushes) {
+            // the state of the directory is gone, so compute it again
+            frame->state = ec_glob_dfa_run(dfa, ctx->path, frame->dirlen);
+            frame->flushes = dfa->flushes;
+            if (frame->state == NULL) goto oom;
+        }
+        struct ec_glob_dfa_state *state = ec_glob_dfa_feed(dfa, frame->state,
+                                                           name, namelen);
+        if (state == NULL) goto oom;
+
+        size_t dirlen = frame->dirlen;
+        if (!ec_glob_walk_grow(ctx, &ctx->path, &ctx->capacity,
+                               dirlen + namelen + 1)) {
+            return;
+        }
+        memcpy(ctx->path + dirlen, name, namelen + 1);
+
+        if (type == DT_DIR) {
+            state = ec_glob_dfa_feed(dfa, state, "/", 1);
+            if (state == NULL) goto oom;
+            // prune the subtree, when nothing below can match
+            if (state->count == 0) continue;
+            int fd = ec_glob_walk_open(ctx, ctx->path + dirlen);
+            if (fd < 0) continue;
+            ctx->path[dirlen + namelen] = '/';
+            ec_glob_walk_push(ctx, fd, dirlen + namelen + 1, state);
+        } else if (state->accept) {
+            if (ctx->set != NULL) {
+                memset(ctx->matches, 0, (ctx->set->count + 7) / 8);
+                ec_glob_set_matches(ctx->set, dfa, state, ctx->matches);
+            }
+            ctx->status = ctx->callback(ctx->path, ctx->matches, ctx->data);
+        }
+    }
+    return;
+
+oom:
+    ctx->status = -1;
+    errno = ENOMEM;
+}
+
+static int ec_glob_walk_root(struct ec_glob_walk_ctx *ctx, const char *root) {
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ctx->capacity = 256;
+    ctx->path = ec_glob_alloc(ctx->allocator, ctx->capacity);
+    ctx->frame_capacity = 16;
+    ctx->frames = ec_glob_alloc(ctx->allocator,
+            ctx->frame_capacity * sizeof(struct ec_glob_walk_frame));
+    ctx->names_capacity = 4096;
+    ctx->names = ec_glob_alloc(ctx->allocator, ctx->names_capacity);
+    ctx->buf = ec_glob_alloc(ctx->allocator, EC_GLOB_WALK_BUFFER_SIZE);
+    ctx->depth = 0;
+    ctx->closed = 0;
+    ctx->open = 0;
+    ctx->names_len = 0;
+    ctx->status = 0;
+    struct ec_glob_dfa_state *state = ec_glob_dfa_run(ctx->dfa, "", 0);
+    if (ctx->path == NULL || ctx->frames == NULL || ctx->names == NULL
+        || ctx->buf == NULL || state == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        ctx->status = -1;
+    } else {
+        ctx->path[0] = '\0';
+        ec_glob_walk_push(ctx, fd, 0, state);
+        ec_glob_walk_run(ctx);
+    }
+    // close the directories, when the walk was stopped
+    while (ctx->depth > 0) {
+        ec_glob_walk_pop(ctx);
+    }
+    if (ctx->buf != NULL) {
+        ec_glob_dealloc(ctx->allocator, ctx->buf, EC_GLOB_WALK_BUFFER_SIZE);
+    }
+    if (ctx->names != NULL) {
+        ec_glob_dealloc(ctx->allocator, ctx->names, ctx->names_capacity);
+    }
+    if (ctx->frames != NULL) {
+        ec_glob_dealloc(ctx->allocator, ctx->frames,
+                ctx->frame_capacity * sizeof(struct ec_glob_walk_frame));
+    }
+    if (ctx->path != NULL) {
+        ec_glob_dealloc(ctx->allocator, ctx->path, ctx->capacity);
+    }
+    return ctx->status;
+}
+
+int ec_glob_walk(const char *root, const ec_glob_t *glob,
+                 ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_nfa nfa;
+    if (ec_glob_nfa_build(&nfa, &glob->prog, &glob->allocator) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    struct ec_glob_walk_ctx ctx;
+    ctx.dfa = ec_glob_dfa_create(&nfa, EC_GLOB_DFA_CACHE_SIZE);
+    if (ctx.dfa == NULL) {
+        ec_glob_nfa_free(&nfa);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx.set = NULL;
+    ctx.matches = NULL;
+    ctx.callback = callback;
+    ctx.data = data;
+    ctx.allocator = &glob->allocator;
+    int status = ec_glob_walk_root(&ctx, root);
+    ec_glob_dfa_destroy(ctx.dfa);
+    ec_glob_nfa_free(&nfa);
+    return status;
+}
+
+int ec_glob_set_walk(const char *root, const ec_glob_set_t *set,
+                     ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_walk_ctx ctx;
+    ctx.allocator = &set->allocator;
+    ctx.matches = ec_glob_alloc(ctx.allocator, (set->count + 7) / 8 + 1);
+    if (ctx.matches == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx.dfa = ec_glob_dfa_create(&set->nfa, EC_GLOB_SET_CACHE_SIZE);
+    if (ctx.dfa == NULL) {
+        ec_glob_dealloc(ctx.allocator, ctx.matches, (set->count + 7) / 8 + 1);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx.set = set;
+    ctx.callback = callback;
+    ctx.data = data;
+    int status = ec_glob_walk_root(&ctx, root);
+    ec_glob_dfa_destroy(ctx.dfa);
+    ec_glob_dealloc(ctx.allocator, ctx.matches, (set->count + 7) / 8 + 1);
+    return status;
+}
+
+/*
+ * The parallel walkers distribute the directories over worker threads.
+ * Every worker owns a work-stealing deque of directories (Chase and Lev)
+ * and a private lazy DFA over the shared NFA, so that matching needs no
+ * locks. Idle workers steal the oldest directories of the others.
+ *
+ * The matching paths are appended to lists with a single producer, from
+ * which the calling thread invokes the callback while the walk is still
+ * in progress: one list per worker, or one list per directory when the
+ * order of the sequential walk shall be kept. In the latter case, the
+ * list of a directory also contains its subdirectories at the position
+ * where the sequential walker would have descended into them.
+ *
+ * Like the sequential walker, the workers open a subdirectory relative to
+ * its parent when they find it, so that symbolic links are never followed
+ * and the length of a path is not limited by PATH_MAX. The queued
+ * directories keep their file descriptors open up to a limit, beyond which
+ * they are opened one component after another when they are read.
+ */
+
+#ifndef EC_GLOB_WALK_CHUNK_SIZE
+#define EC_GLOB_WALK_CHUNK_SIZE 65536
+#endif
+
+#ifndef EC_GLOB_DEQUE_SIZE
+#define EC_GLOB_DEQUE_SIZE 64
+#endif
+
+struct ec_glob_pwalk_dir;
+
+struct ec_glob_pwalk_item {
+    _Atomic(struct ec_glob_pwalk_item *) next;
+    // the subdirectory at this position, or NULL for a matching path
+    struct ec_glob_pwalk_dir *dir;
+    unsigned char *matches;
+    char path[];
+};
+
+struct ec_glob_pwalk_list {
+    _Atomic(struct ec_glob_pwalk_item *) first;
+    // only accessed by the producer
+    struct ec_glob_pwalk_item *last;
+    // set after the last item was appended
+    atomic_bool closed;
+};
+
+struct ec_glob_pwalk_dir {
+    struct ec_glob_pwalk_list items;
+    // the open directory, or -1 when it must be opened by its path
+    int fd;
+    size_t len;
+    // the relative path with a trailing slash (empty for the root)
+    char path[];
+};
+
+struct ec_glob_pwalk_chunk {
+    struct ec_glob_pwalk_chunk *prev;
+    size_t used;
+    size_t size;
+};
+
+struct ec_glob_deque_array {
+    // the replaced arrays, which thieves may still read until the end
+    struct ec_glob_deque_array *prev;
+    long size;
+    _Atomic(struct ec_glob_pwalk_dir *) slots[];
+};
+
+struct ec_glob_deque {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(struct ec_glob_deque_array *) array;
+};
+
+struct ec_glob_pwalk;
+
+struct ec_glob_pwalk_worker {
+    struct ec_glob_pwalk *walk;
+    struct ec_glob_deque deque;
+    struct ec_glob_dfa *dfa;
+    // the matching paths in unordered mode
+    struct ec_glob_pwalk_list results;
+    // the memory for directories and items
+    struct ec_glob_pwalk_chunk *chunk;
+    char *buf;
+    unsigned seed;
+    pthread_t thread;
+};
+
+// the directory which is currently read by a worker
+struct ec_glob_pwalk_dirctx {
+    struct ec_glob_pwalk_worker *worker;
+    struct ec_glob_pwalk_dir *dir;
+    struct ec_glob_dfa_state *state;
+    unsigned flushes;
+};
+
+struct ec_glob_pwalk {
+    const struct ec_glob_nfa *nfa;
+    const struct ec_glob_set_s *set;
+    size_t budget;
+    const struct ec_glob_allocator *allocator;
+    int rootfd;
+    _Bool ordered;
+    unsigned count;
+    struct ec_glob_pwalk_worker *workers;
+    // directories which are queued or being read
+    atomic_long pending;
+    // queued directories with an open file descriptor
+    atomic_uint open_dirs;
+    atomic_uint running;
+    atomic_bool stop;
+    // the first error of a worker
+    atomic_int error;
+};
+
+static int ec_glob_deque_init(struct ec_glob_deque *q,
+                              const struct ec_glob_allocator *allocator) {
+    struct ec_glob_deque_array *a = ec_glob_alloc(allocator,
+            sizeof(struct ec_glob_deque_array)
+            + EC_GLOB_DEQUE_SIZE * sizeof(a->slots[0]));
+    if (a == NULL) return -1;
+    a->prev = NULL;
+    a->size = EC_GLOB_DEQUE_SIZE;
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->array, a);
+    return 0;
+}
+
+static void ec_glob_deque_destroy(struct ec_glob_deque *q,
+                                  const struct ec_glob_allocator *allocator) {
+    struct ec_glob_deque_array *a = atomic_load(&q->array);
+    while (a != NULL) {
+        struct ec_glob_deque_array *prev = a->prev;
+        ec_glob_dealloc(allocator, a, sizeof(struct ec_glob_deque_array)
+                + a->size * sizeof(a->slots[0]));
+        a = prev;
+    }
+}
+
+// only called by the owner
+static int ec_glob_deque_push(struct ec_glob_deque *q,
+                              const struct ec_glob_allocator *allocator,
+                              struct ec_glob_pwalk_dir *dir) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    struct ec_glob_deque_array *a =
+            atomic_load_explicit(&q->array, memory_order_relaxed);
+    if (b - t > a->size - 1) {
+        struct ec_glob_deque_array *g = ec_glob_alloc(allocator,
+                sizeof(struct ec_glob_deque_array)
+                + 2 * a->size * sizeof(a->slots[0]));
+        if (g == NULL) return -1;
+        g->prev = a;
+        g->size = 2 * a->size;
+        for (long i = t ; i < b ; i++) {
+            atomic_store_explicit(&g->slots[i & (g->size - 1)],
+                    atomic_load_explicit(&a->slots[i & (a->size - 1)],
+                                         memory_order_relaxed),
+                    memory_order_relaxed);
+        }
+        atomic_store_explicit(&q->array, g, memory_order_release);
+        a = g;
+    }
+    atomic_store_explicit(&a->slots[b & (a->size - 1)], dir,
+                          memory_order_relaxed);
+    // publishes the directory to the thieves
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+    return 0;
+}
+
+// only called by the owner, takes the newest directory
+static struct ec_glob_pwalk_dir *ec_glob_deque_take(struct ec_glob_deque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    struct ec_glob_deque_array *a =
+            atomic_load_explicit(&q->array, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    struct ec_glob_pwalk_dir *dir = NULL;
+    if (t <= b) {
+        dir = atomic_load_explicit(&a->slots[b & (a->size - 1)],
+                                   memory_order_relaxed);
+        if (t == b) {
+            // the last directory, which a thief might take concurrently
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                dir = NULL;
+            }
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return dir;
+}
+
+// called by other workers, takes the oldest directory
+static struct ec_glob_pwalk_dir *ec_glob_deque_steal(struct ec_glob_deque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    struct ec_glob_deque_array *a =
+            atomic_load_explicit(&q->array, memory_order_acquire);
+    struct ec_glob_pwalk_dir *dir = atomic_load_explicit(
+            &a->slots[t & (a->size - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        // another thread was faster
+        return NULL;
+    }
+    return dir;
+}
+
+static void ec_glob_pwalk_list_init(struct ec_glob_pwalk_list *list) {
+    atomic_init(&list->first, NULL);
+    list->last = NULL;
+    atomic_init(&list->closed, 0);
+}
+
+static void ec_glob_pwalk_list_append(struct ec_glob_pwalk_list *list,
+                                      struct ec_glob_pwalk_item *item) {
+    atomic_init(&item->next, NULL);
+    if (list->last == NULL) {
+        atomic_store_explicit(&list->first, item, memory_order_release);
+    } else {
+        atomic_store_explicit(&list->last->next, item, memory_order_release);
+    }
+    list->last = item;
+}
+
+static struct ec_glob_pwalk_item *ec_glob_pwalk_list_next(
+        struct ec_glob_pwalk_list *list, struct ec_glob_pwalk_item *item) {
+    return atomic_load_explicit(item == NULL ? &list->first : &item->next,
+                                memory_order_acquire);
+}
+
+static void *ec_glob_pwalk_alloc(struct ec_glob_pwalk_worker *w,
+                                 size_t size) {
+    size = ec_glob_arena_align(size);
+    struct ec_glob_pwalk_chunk *chunk = w->chunk;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        size_t chunksize = EC_GLOB_WALK_CHUNK_SIZE;
+        if (chunksize < size) chunksize = size;
+        chunk = ec_glob_alloc(w->walk->allocator,
+                ec_glob_arena_align(sizeof(struct ec_glob_pwalk_chunk))
+                + chunksize);
+        if (chunk == NULL) return NULL;
+        chunk->prev = w->chunk;
+        chunk->used = 0;
+        chunk->size = chunksize;
+        w->chunk = chunk;
+    }
+    void *mem = (char *) chunk
+            + ec_glob_arena_align(sizeof(struct ec_glob_pwalk_chunk))
+            + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+static void ec_glob_pwalk_fail(struct ec_glob_pwalk *walk, int error) {
+    int expected = 0;
+    atomic_compare_exchange_strong(&walk->error, &expected, error);
+    atomic_store(&walk->stop, 1);
+}
+
+// closes the file descriptor of a queued directory, if it has one
+static void ec_glob_pwalk_close(struct ec_glob_pwalk *walk, int fd) {
+    if (fd < 0) return;
+    close(fd);
+    atomic_fetch_sub(&walk->open_dirs, 1);
+}
+
+static int ec_glob_pwalk_entry(void *data, int fd, const char *name,
+                               unsigned char type) {
+    struct ec_glob_pwalk_dirctx *ctx = data;
+    struct ec_glob_pwalk_worker *w = ctx->worker;
+    struct ec_glob_pwalk *walk = w->walk;
+    struct ec_glob_pwalk_dir *dir = ctx->dir;
+    struct ec_glob_dfa *dfa = w->dfa;
+    if (atomic_load_explicit(&walk->stop, memory_order_relaxed)) return 1;
+
+    if (ctx->flushes != dfa->flushes) {
+        ctx->state = ec_glob_dfa_run(dfa, dir->path, dir->len);
+        ctx->flushes = dfa->flushes;
+        if (ctx->state == NULL) goto oom;
+    }
+    size_t namelen = strlen(name);
+    struct ec_glob_dfa_state *state = ec_glob_dfa_feed(dfa, ctx->state,
+                                                       name, namelen);
+    if (state == NULL) goto oom;
+
+    type = ec_glob_entry_type(fd, name, type);
+    if (type == DT_DIR) {
+        state = ec_glob_dfa_feed(dfa, state, "/", 1);
+        if (state == NULL) goto oom;
+        // prune the subtree, when nothing below can match
+        if (state->count == 0) return 0;
+
+        // open it now, unless too many queued directories are open
+        int subfd = -1;
+        if (atomic_fetch_add(&walk->open_dirs, 1) < EC_GLOB_WALK_OPEN_DIRS) {
+            subfd = ec_glob_open_subdir(fd, name);
+            // skip it like the sequential walker, unless only the file
+            // descriptors ran out
+            if (subfd < 0 && errno != EMFILE && errno != ENFILE) {
+                atomic_fetch_sub(&walk->open_dirs, 1);
+                return 0;
+            }
+        }
+        if (subfd < 0) {
+            atomic_fetch_sub(&walk->open_dirs, 1);
+        }
+
+        size_t len = dir->len + namelen + 1;
+        struct ec_glob_pwalk_dir *sub = ec_glob_pwalk_alloc(w,
+                sizeof(struct ec_glob_pwalk_dir) + len + 1);
+        if (sub == NULL) {
+            ec_glob_pwalk_close(walk, subfd);
+            goto oom;
+        }
+        ec_glob_pwalk_list_init(&sub->items);
+        sub->fd = subfd;
+        sub->len = len;
+        memcpy(sub->path, dir->path, dir->len);
+        memcpy(sub->path + dir->len, name, namelen);
+        sub->path[len - 1] = '/';
+        sub->path[len] = '\0';
+        if (walk->ordered) {
+            struct ec_glob_pwalk_item *item = ec_glob_pwalk_alloc(w,
+                    sizeof(struct ec_glob_pwalk_item));
+            if (item == NULL) goto oom;
+            item->dir = sub;
+            ec_glob_pwalk_list_append(&dir->items, item);
+        }
+        atomic_fetch_add(&walk->pending, 1);
+        if (ec_glob_deque_push(&w->deque, walk->allocator, sub) != 0) {
+            atomic_fetch_sub(&walk->pending, 1);
+            ec_glob_pwalk_close(walk, subfd);
+            goto oom;
+        }
+    } else if (state->accept) {
+        size_t len = dir->len + namelen;
+        size_t bytes = walk->set == NULL ? 0 : (walk->set->count + 7) / 8;
+        struct ec_glob_pwalk_item *item = ec_glob_pwalk_alloc(w,
+                sizeof(struct ec_glob_pwalk_item) + len + 1 + bytes);
+        if (item == NULL) goto oom;
+        item->dir = NULL;
+        memcpy(item->path, dir->path, dir->len);
+        memcpy(item->path + dir->len, name, namelen + 1);
+        item->matches = NULL;
+        if (walk->set != NULL) {
+            item->matches = (unsigned char *) item->path + len + 1;
+            memset(item->matches, 0, bytes);
+            ec_glob_set_matches(walk->set, dfa, state, item->matches);
+        }
+        ec_glob_pwalk_list_append(
+                walk->ordered ? &dir->items : &w->results, item);
+    }
+    return 0;
+
+oom:
+    ec_glob_pwalk_fail(walk, ENOMEM);
+    return 1;
+}
+
+static void ec_glob_pwalk_dir(struct ec_glob_pwalk_worker *w,
+                              struct ec_glob_pwalk_dir *dir) {
+    struct ec_glob_pwalk *walk = w->walk;
+    int fd = dir->fd;
+    if (fd >= 0) {
+        // reading the directory closes it
+        atomic_fetch_sub(&walk->open_dirs, 1);
+    } else {
+        fd = ec_glob_open_path(walk->rootfd, dir->path, dir->len);
+    }
+    if (fd >= 0) {
+        struct ec_glob_pwalk_dirctx ctx = {
+                w, dir, ec_glob_dfa_run(w->dfa, dir->path, dir->len),
+                w->dfa->flushes
+        };
+        if (ctx.state == NULL) {
+            close(fd);
+            ec_glob_pwalk_fail(walk, ENOMEM);
+        } else {
+            ec_glob_readdir(fd, 0, w->buf, ec_glob_pwalk_entry, &ctx);
+        }
+    }
+    atomic_store_explicit(&dir->items.closed, 1, memory_order_release);
+}
+
+static void *ec_glob_pwalk_run(void *data) {
+    struct ec_glob_pwalk_worker *w = data;
+    struct ec_glob_pwalk *walk = w->walk;
+    while (!atomic_load_explicit(&walk->stop, memory_order_relaxed)) {
+        struct ec_glob_pwalk_dir *dir = ec_glob_deque_take(&w->deque);
+        // try to steal from the others, beginning with a random worker
+        w->seed = w->seed * 1103515245 + 12345;
+        unsigned victim = (w->seed >> 16) % walk->count;
+        for (unsigned i = 0 ; dir == NULL && i < walk->count ; i++) {
+            struct ec_glob_pwalk_worker *other =
+                    &walk->workers[(victim + i) % walk->count];
+            if (other != w) dir = ec_glob_deque_steal(&other->deque);
+        }
+        if (dir == NULL) {
+            if (atomic_load(&walk->pending) == 0) break;
+            sched_yield();
+            continue;
+        }
+        ec_glob_pwalk_dir(w, dir);
+        atomic_fetch_sub(&walk->pending, 1);
+    }
+    atomic_store_explicit(&w->results.closed, 1, memory_order_release);
+    atomic_fetch_sub(&walk->running, 1);
+    return NULL;
+}
+
+/*
+ * Waits for the next item of a list, which is NULL when the list is
+ * complete or the walk was stopped.
+ */
+static struct ec_glob_pwalk_item *ec_glob_pwalk_wait(
+        struct ec_glob_pwalk *walk, struct ec_glob_pwalk_list *list,
+        struct ec_glob_pwalk_item *item) {
+    for (;;) {
+        // check the flag first, so that no item appended before is missed
+        _Bool closed = atomic_load_explicit(&list->closed,
+                                            memory_order_acquire);
+        struct ec_glob_pwalk_item *next = ec_glob_pwalk_list_next(list, item);
+        if (next != NULL || closed) return next;
+        if (atomic_load(&walk->stop)) return NULL;
+        sched_yield();
+    }
+}
+
+static int ec_glob_pwalk_emit_ordered(struct ec_glob_pwalk *walk,
+                                      struct ec_glob_pwalk_dir *dir,
+                                      ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_pwalk_item *item = NULL;
+    while ((item = ec_glob_pwalk_wait(walk, &dir->items, item)) != NULL) {
+        int status = item->dir == NULL
+                ? callback(item->path, item->matches, data)
+                : ec_glob_pwalk_emit_ordered(walk, item->dir, callback, data);
+        if (status != 0) return status;
+    }
+    return 0;
+}
+
+static int ec_glob_pwalk_emit(struct ec_glob_pwalk *walk,
+                              ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_pwalk_item *cursors[walk->count];
+    memset(cursors, 0, sizeof(cursors));
+    for (;;) {
+        // when all workers are done, the next round will see all items
+        _Bool done = atomic_load(&walk->running) == 0;
+        _Bool progress = 0;
+        for (unsigned i = 0 ; i < walk->count ; i++) {
+            struct ec_glob_pwalk_list *list = &walk->workers[i].results;
+            struct ec_glob_pwalk_item *item;
+            while ((item = ec_glob_pwalk_list_next(list, cursors[i]))
+                   != NULL) {
+                cursors[i] = item;
+                progress = 1;
+                int status = callback(item->path, item->matches, data);
+                if (status != 0) return status;
+            }
+        }
+        if (atomic_load(&walk->stop) || (done && !progress)) return 0;
+        if (!progress) sched_yield();
+    }
+}
+
+static int ec_glob_pwalk_start(struct ec_glob_pwalk *walk, const char *root,
+                               const struct ec_glob_walk_options *options,
+                               ec_glob_walk_fn callback, void *data) {
+    unsigned count = options == NULL ? 0 : options->threads;
+    if (count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (unsigned) cpus : 1;
+    }
+    walk->ordered = options != NULL && options->ordered;
+    walk->count = count;
+    atomic_init(&walk->pending, 1);
+    atomic_init(&walk->open_dirs, 0);
+    atomic_init(&walk->running, 0);
+    atomic_init(&walk->stop, 0);
+    atomic_init(&walk->error, 0);
+
+    walk->rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk->rootfd < 0) return -1;
+    walk->workers = ec_glob_alloc(walk->allocator,
+            count * sizeof(struct ec_glob_pwalk_worker));
+    if (walk->workers == NULL) {
+        close(walk->rootfd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // prepare all workers before any thread can steal from them
+    unsigned ready = 0;
+    for ( ; ready < count ; ready++) {
+        struct ec_glob_pwalk_worker *w = &walk->workers[ready];
+        w->walk = walk;
+        w->chunk = NULL;
+        w->seed = ready;
+        ec_glob_pwalk_list_init(&w->results);
+        w->buf = ec_glob_alloc(walk->allocator, EC_GLOB_WALK_BUFFER_SIZE);
+        if (w->buf == NULL) break;
+        w->dfa = ec_glob_dfa_create(walk->nfa, walk->budget);
+        if (w->dfa == NULL) {
+            ec_glob_dealloc(walk->allocator, w->buf,
+                            EC_GLOB_WALK_BUFFER_SIZE);
+            break;
+        }
+        if (ec_glob_deque_init(&w->deque, walk->allocator) != 0) {
+            ec_glob_dfa_destroy(w->dfa);
+            ec_glob_dealloc(walk->allocator, w->buf,
+                            EC_GLOB_WALK_BUFFER_SIZE);
+            break;
+        }
+    }
+
+    int status = 0;
+    struct ec_glob_pwalk_dir *rootdir = NULL;
+    if (ready < count) {
+        ec_glob_pwalk_fail(walk, ENOMEM);
+    } else {
+        rootdir = ec_glob_pwalk_alloc(&walk->workers[0],
+                sizeof(struct ec_glob_pwalk_dir) + 1);
+        if (rootdir == NULL) {
+            ec_glob_pwalk_fail(walk, ENOMEM);
+        } else {
+            ec_glob_pwalk_list_init(&rootdir->items);
+            rootdir->fd = -1;
+            rootdir->len = 0;
+            rootdir->path[0] = '\0';
+            if (ec_glob_deque_push(&walk->workers[0].deque,
+                                   walk->allocator, rootdir) != 0) {
+                ec_glob_pwalk_fail(walk, ENOMEM);
+            }
+        }
+    }
+
+    unsigned started = 0;
+    if (!atomic_load(&walk->stop)) {
+        atomic_store(&walk->running, count);
+        for ( ; started < count ; started++) {
+            struct ec_glob_pwalk_worker *w = &walk->workers[started];
+            if (pthread_create(&w->thread, NULL, ec_glob_pwalk_run, w)) {
+                // the remaining workers will never run
+                atomic_fetch_sub(&walk->running, count - started);
+                ec_glob_pwalk_fail(walk, EAGAIN);
+                break;
+            }
+        }
+        status = walk->ordered
+                ? ec_glob_pwalk_emit_ordered(walk, rootdir, callback, data)
+                : ec_glob_pwalk_emit(walk, callback, data);
+        atomic_store(&walk->stop, 1);
+    }
+
+    for (unsigned i = 0 ; i < started ; i++) {
+        pthread_join(walk->workers[i].thread, NULL);
+    }
+    for (unsigned i = 0 ; i < ready ; i++) {
+        struct ec_glob_pwalk_worker *w = &walk->workers[i];
+        // the directories which were not read when the walk stopped
+        struct ec_glob_pwalk_dir *dir;
+        while ((dir = ec_glob_deque_take(&w->deque)) != NULL) {
+            ec_glob_pwalk_close(walk, dir->fd);
+        }
+        while (w->chunk != NULL) {
+            struct ec_glob_pwalk_chunk *prev = w->chunk->prev;
+            ec_glob_dealloc(walk->allocator, w->chunk,
+                    ec_glob_arena_align(sizeof(struct ec_glob_pwalk_chunk))
+                    + w->chunk->size);
+            w->chunk = prev;
+        }
+        ec_glob_deque_destroy(&w->deque, walk->allocator);
+        ec_glob_dfa_destroy(w->dfa);
+        ec_glob_dealloc(walk->allocator, w->buf, EC_GLOB_WALK_BUFFER_SIZE);
+    }
+    ec_glob_dealloc(walk->allocator, walk->workers,
+                    count * sizeof(struct ec_glob_pwalk_worker));
+    close(walk->rootfd);
+
+    int error = atomic_load(&walk->error);
+    if (status == 0 && error != 0) {
+        errno = error;
+        status = -1;
+    }
+    return status;
+}
+
+int ec_glob_walk_parallel(const char *root, const ec_glob_t *glob,
+                          const struct ec_glob_walk_options *options,
+                          ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_nfa nfa;
+    if (ec_glob_nfa_build(&nfa, &glob->prog, &glob->allocator) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    struct ec_glob_pwalk walk;
+    walk.nfa = &nfa;
+    walk.set = NULL;
+    walk.budget = EC_GLOB_DFA_CACHE_SIZE;
+    walk.allocator = &glob->allocator;
+    int status = ec_glob_pwalk_start(&walk, root, options, callback, data);
+    ec_glob_nfa_free(&nfa);
+    return status;
+}
+
+int ec_glob_set_walk_parallel(const char *root, const ec_glob_set_t *set,
+                              const struct ec_glob_walk_options *options,
+                              ec_glob_walk_fn callback, void *data) {
+    struct ec_glob_pwalk walk;
+    walk.nfa = &set->nfa;
+    walk.set = set;
+    walk.budget = EC_GLOB_SET_CACHE_SIZE;
+    walk.allocator = &set->allocator;
+    return ec_glob_pwalk_start(&walk, root, options, callback, data);
+}
+
+/*
+ * The resolver finds the EditorConfig properties of a file.
+ *
+ * Every directory which has been asked for is kept in a hash table,
+ * together with its parsed configuration file (if any) and a pointer to
+ * the closest parent directory with a configuration file. The sections of
+ * a configuration file are compiled into one set, so that resolving the
+ * properties of a file takes one set match per configuration file on the
+ * way to the root, once the directories are known.
+ */
+
+// larger configuration files are ignored
+#ifndef EC_GLOB_CONFIG_MAX_SIZE
+#define EC_GLOB_CONFIG_MAX_SIZE (1024 * 1024)
+#endif
+
+struct ec_glob_config {
+    ec_glob_set_t *set;
+    // the index of the first pair of every section and the end of the last
+    unsigned *sections;
+    unsigned section_count;
+    unsigned section_capacity;
+    // name and value of every pair, pointing into text
+    const char **pairs;
+    unsigned pair_count;
+    unsigned pair_capacity;
+    char *text;
+    size_t size;
+    _Bool root;
+};
+
+struct ec_glob_resolver_dir {
+    struct ec_glob_resolver_dir *hnext;
+    // the closest parent with a configuration file which applies
+    struct ec_glob_resolver_dir *up;
+    struct ec_glob_config *config;
+    unsigned hash;
+    size_t len;
+    // the path without trailing slash (empty for the root directory)
+    char path[];
+};
+
+struct ec_glob_resolver_s {
+    pthread_rwlock_t lock;
+    struct ec_glob_resolver_dir **buckets;
+    unsigned bucket_count;
+    unsigned count;
+    struct ec_glob_allocator allocator;
+    size_t filename_len;
+    char filename[];
+};
+
+// the properties whose values are case insensitive
+static const char *ec_glob_config_lowercase[] = {
+        "end_of_line", "indent_style", "indent_size", "insert_final_newline",
+        "trim_trailing_whitespace", "charset"
+};
+
+static char *ec_glob_config_trim(char *s, char *end) {
+    while (s < end && isspace((unsigned char) *s)) s++;
+    while (end > s && isspace((unsigned char) end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+static void ec_glob_config_lower(char *s) {
+    for ( ; *s != '\0' ; s++) *s = (char) tolower((unsigned char) *s);
+}
+
+static void ec_glob_config_free(const struct ec_glob_allocator *allocator,
+                                struct ec_glob_config *config) {
+    ec_glob_set_free(config->set);
+    ec_glob_dealloc(allocator, config->pairs,
+                    config->pair_capacity * 2 * sizeof(const char *));
+    ec_glob_dealloc(allocator, config->sections,
+                    config->section_capacity * sizeof(unsigned));
+    ec_glob_dealloc(allocator, config->text, config->size + 1);
+    ec_glob_dealloc(allocator, config, sizeof(struct ec_glob_config));
+}
+
+static _Bool ec_glob_config_add_section(
+        const struct ec_glob_allocator *allocator,
+        struct ec_glob_config *config) {
+    // one more for the end of the last section
+    if (config->section_count + 1 >= config->section_capacity) {
+        unsigned capacity = 2 * config->section_capacity + 8;
+        unsigned *sections = ec_glob_realloc(allocator, config->sections,
+                config->section_capacity * sizeof(unsigned),
+                capacity * sizeof(unsigned));
+        if (sections == NULL) return 0;
+        config->sections = sections;
+        config->section_capacity = capacity;
+    }
+    config->sections[config->section_count++] = config->pair_count;
+    return 1;
+}
+
+static _Bool ec_glob_config_add_pair(const struct ec_glob_allocator *allocator,
+                                     struct ec_glob_config *config,
+                                     const char *name, const char *value) {
+    if (config->pair_count == config->pair_capacity) {
+        unsigned capacity = 2 * config->pair_capacity + 8;
+        const char **pairs = ec_glob_realloc(allocator, config->pairs,
+                config->pair_capacity * 2 * sizeof(const char *),
+                capacity * 2 * sizeof(const char *));
+        if (pairs == NULL) return 0;
+        config->pairs = pairs;
+        config->pair_capacity = capacity;
+    }
+    config->pairs[2 * config->pair_count] = name;
+    config->pairs[2 * config->pair_count + 1] = value;
+    config->pair_count++;
+    return 1;
+}
+
+/*
+ * Parses the text of a configuration file in place.
+ * Every section starts with a pair whose name is the line of the section
+ * header and whose value is NULL, followed by the pairs of the section.
+ */
+static int ec_glob_config_parse(const struct ec_glob_allocator *allocator,
+                                struct ec_glob_config *config) {
+    char *line = config->text;
+    char *textend = config->text + config->size;
+    while (line < textend) {
+        char *end = memchr(line, '\n', textend - line);
+        if (end == NULL) end = textend;
+        char *next = end + 1;
+        line = ec_glob_config_trim(line, end);
+
+        if (*line == '\0' || *line == '#' || *line == ';') {
+            // empty line or comment
+        } else if (*line == '[') {
+            // the name is everything up to the last bracket
+            char *close = strrchr(line, ']');
+            if (close != NULL) {
+                *close = '\0';
+                // the section starts with a pair holding its name
+                if (!ec_glob_config_add_section(allocator, config)) return -1;
+                if (!ec_glob_config_add_pair(allocator, config, line, NULL)) {
+                    return -1;
+                }
+            }
+        } else {
+            char *eq = strchr(line, '=');
+            if (eq != NULL) {
+                char *name = ec_glob_config_trim(line, eq);
+                char *value = ec_glob_config_trim(eq + 1,
+                                                  eq + 1 + strlen(eq + 1));
+                ec_glob_config_lower(name);
+                for (unsigned i = 0 ; i < sizeof(ec_glob_config_lowercase)
+                        / sizeof(ec_glob_config_lowercase[0]) ; i++) {
+                    if (strcmp(name, ec_glob_config_lowercase[i]) == 0) {
+                        ec_glob_config_lower(value);
+                    }
+                }
+                if (config->section_count > 0) {
+                    if (!ec_glob_config_add_pair(allocator, config,
+                                                 name, value)) {
+                        return -1;
+                    }
+                } else if (strcmp(name, "root") == 0) {
+                    // only the preamble can declare the root
+                    ec_glob_config_lower(value);
+                    config->root = strcmp(value, "true") == 0;
+                }
+            }
+        }
+        line = next;
+    }
+    if (config->section_count > 0) {
+        config->sections[config->section_count] = config->pair_count;
+    }
+    return 0;
+}
+
+/*
+ * Compiles the sections of a parsed configuration file into one set.
+ *
+ * A section name without a slash matches files in any subdirectory,
+ * otherwise it is anchored to the directory of the configuration file.
+ * The path of a file is later matched relative to that directory with a
+ * leading slash, so the name of the directory never needs to be escaped.
+ */
+static int ec_glob_config_compile(const struct ec_glob_allocator *allocator,
+                                  struct ec_glob_config *config) {
+    unsigned count = config->section_count;
+    if (count == 0) return 0;
+    char **patterns = ec_glob_alloc(allocator, count * sizeof(char *));
+    if (patterns == NULL) return -1;
+
+    unsigned i = 0;
+    for ( ; i < count ; i++) {
+        const char *name = config->pairs[2 * config->sections[i]] + 1;
+        _Bool anchored = strchr(name, '/') != NULL;
+        if (*name == '/') name++;
+        size_t len = strlen(name);
+        const char *prefix = anchored ? "/" : "/**/";
+        size_t prefixlen = strlen(prefix);
+        patterns[i] = ec_glob_alloc(allocator, prefixlen + len + 1);
+        if (patterns[i] == NULL) break;
+        memcpy(patterns[i], prefix, prefixlen);
+        memcpy(patterns[i] + prefixlen, name, len + 1);
+    }
+    int status = i < count || ec_glob_set_compile_with(&config->set,
+            (const char * const *) patterns, count, allocator) != 0;
+    while (i-- > 0) {
+        ec_glob_dealloc(allocator, patterns[i], strlen(patterns[i]) + 1);
+    }
+    ec_glob_dealloc(allocator, patterns, count * sizeof(char *));
+    return status ? -1 : 0;
+}
+
+/*
+ * Reads the configuration file of a directory.
+ * Returns NULL with error set to zero, when there is none.
+ */
+static struct ec_glob_config *ec_glob_config_read(
+        const struct ec_glob_resolver_s *resolver, const char *dir,
+        size_t len, int *error) {
+    const struct ec_glob_allocator *allocator = &resolver->allocator;
+    *error = 0;
+    size_t namesize = len + 1 + resolver->filename_len + 1;
+    char *name = ec_glob_alloc(allocator, namesize);
+    if (name == NULL) {
+        *error = ENOMEM;
+        return NULL;
+    }
+    memcpy(name, dir, len);
+    name[len] = '/';
+    memcpy(name + len + 1, resolver->filename, resolver->filename_len + 1);
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    ec_glob_dealloc(allocator, name, namesize);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    struct ec_glob_config *config = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size <= EC_GLOB_CONFIG_MAX_SIZE) {
+        config = ec_glob_alloc(allocator, sizeof(struct ec_glob_config));
+        if (config != NULL) {
+            memset(config, 0, sizeof(struct ec_glob_config));
+            config->size = st.st_size;
+            config->text = ec_glob_alloc(allocator, config->size + 1);
+            if (config->text == NULL) {
+                ec_glob_dealloc(allocator, config,
+                                sizeof(struct ec_glob_config));
+                config = NULL;
+            }
+        }
+        if (config == NULL) {
+            *error = ENOMEM;
+        } else {
+            // the file may have been truncated meanwhile
+            size_t size = 0;
+            ssize_t n;
+            while (size < config->size && (n = read(fd, config->text + size,
+                                                    config->size - size)) > 0) {
+                size += n;
+            }
+            memset(config->text + size, 0, config->size + 1 - size);
+            if (ec_glob_config_parse(allocator, config) != 0
+                || ec_glob_config_compile(allocator, config) != 0) {
+                ec_glob_config_free(allocator, config);
+                config = NULL;
+                *error = ENOMEM;
+            }
+        }
+    }
+    close(fd);
+    return config;
+}
+
+static unsigned ec_glob_resolver_hash(const char *path, size_t len) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0 ; i < len ; i++) {
+        hash = (hash ^ (unsigned char) path[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static struct ec_glob_resolver_dir *ec_glob_resolver_lookup(
+        const struct ec_glob_resolver_s *resolver, const char *path,
+        size_t len, unsigned hash) {
+    struct ec_glob_resolver_dir *dir =
+            resolver->buckets[hash & (resolver->bucket_count - 1)];
+    while (dir != NULL && (dir->hash != hash || dir->len != len
+                           || memcmp(dir->path, path, len) != 0)) {
+        dir = dir->hnext;
+    }
+    return dir;
+}
+
+static _Bool ec_glob_resolver_insert(struct ec_glob_resolver_s *resolver,
+                                     struct ec_glob_resolver_dir *dir) {
+    if (resolver->count >= resolver->bucket_count) {
+        unsigned count = 2 * resolver->bucket_count;
+        struct ec_glob_resolver_dir **buckets = ec_glob_alloc(
+                &resolver->allocator, count * sizeof(buckets[0]));
+        if (buckets == NULL) return 0;
+        memset(buckets, 0, count * sizeof(buckets[0]));
+        for (unsigned i = 0 ; i < resolver->bucket_count ; i++) {
+            struct ec_glob_resolver_dir *d = resolver->buckets[i];
+            while (d != NULL) {
+                struct ec_glob_resolver_dir *next = d->hnext;
+                d->hnext = buckets[d->hash & (count - 1)];
+                buckets[d->hash & (count - 1)] = d;
+                d = next;
+            }
+        }
+        ec_glob_dealloc(&resolver->allocator, resolver->buckets,
+                        resolver->bucket_count * sizeof(buckets[0]));
+        resolver->buckets = buckets;
+        resolver->bucket_count = count;
+    }
+    unsigned b = dir->hash & (resolver->bucket_count - 1);
+    dir->hnext = resolver->buckets[b];
+    resolver->buckets[b] = dir;
+    resolver->count++;
+    return 1;
+}
+
+/*
+ * Finds a directory or reads its configuration file and those of its
+ * parents. Must be called with the write lock held.
+ */
+static struct ec_glob_resolver_dir *ec_glob_resolver_dir(
+        struct ec_glob_resolver_s *resolver, const char *path, size_t len) {
+    unsigned hash = ec_glob_resolver_hash(path, len);
+    struct ec_glob_resolver_dir *dir =
+            ec_glob_resolver_lookup(resolver, path, len, hash);
+    if (dir != NULL) return dir;
+
+    int error;
+    struct ec_glob_config *config = ec_glob_config_read(resolver, path, len,
+                                                        &error);
+    if (error != 0) return NULL;
+    struct ec_glob_resolver_dir *up = NULL;
+    if (len > 0 && (config == NULL || !config->root)) {
+        const char *slash = path + len;
+        while (*--slash != '/');
+        struct ec_glob_resolver_dir *parent =
+                ec_glob_resolver_dir(resolver, path, slash - path);
+        if (parent == NULL) {
+            if (config != NULL) ec_glob_config_free(&resolver->allocator,
+                                                    config);
+            return NULL;
+        }
+        up = parent->config != NULL ? parent : parent->up;
+    }
+
+    dir = ec_glob_alloc(&resolver->allocator,
+                        sizeof(struct ec_glob_resolver_dir) + len + 1);
+    if (dir != NULL) {
+        dir->up = up;
+        dir->config = config;
+        dir->hash = hash;
+        dir->len = len;
+        memcpy(dir->path, path, len);
+        dir->path[len] = '\0';
+        if (ec_glob_resolver_insert(resolver, dir)) return dir;
+        ec_glob_dealloc(&resolver->allocator, dir,
+                        sizeof(struct ec_glob_resolver_dir) + len + 1);
+    }
+    if (config != NULL) ec_glob_config_free(&resolver->allocator, config);
+    return NULL;
+}
+
+// the resolved properties as pairs of names and values
+struct ec_glob_resolved {
+    const char **pairs;
+    unsigned count;
+    unsigned char *matches;
+};
+
+static const char **ec_glob_resolved_find(struct ec_glob_resolved *resolved,
+                                          const char *name) {
+    for (unsigned i = 0 ; i < resolved->count ; i++) {
+        if (strcmp(resolved->pairs[2 * i], name) == 0) {
+            return &resolved->pairs[2 * i + 1];
+        }
+    }
+    return NULL;
+}
+
+static void ec_glob_resolved_set(struct ec_glob_resolved *resolved,
+                                 const char *name, const char *value) {
+    const char **found = ec_glob_resolved_find(resolved, name);
+    if (found != NULL) {
+        *found = value;
+    } else {
+        resolved->pairs[2 * resolved->count] = name;
+        resolved->pairs[2 * resolved->count + 1] = value;
+        resolved->count++;
+    }
+}
+
+// applies the configuration files from the root down to the directory
+static int ec_glob_resolved_apply(struct ec_glob_resolved *resolved,
+                                  const struct ec_glob_resolver_dir *dir,
+                                  const char *path) {
+    if (dir->up != NULL
+        && ec_glob_resolved_apply(resolved, dir->up, path) != 0) {
+        return -1;
+    }
+    const struct ec_glob_config *config = dir->config;
+    if (config->set == NULL) return 0;
+    int found = ec_glob_set_exec(config->set, path + dir->len,
+                                 resolved->matches);
+    if (found < 0) return -1;
+    for (unsigned s = 0 ; found > 0 && s < config->section_count ; s++) {
+        if ((resolved->matches[s / 8] >> (s % 8)) & 1) {
+            // skip the name of the section
+            for (unsigned p = config->sections[s] + 1 ;
+                 p < config->sections[s + 1] ; p++) {
+                ec_glob_resolved_set(resolved, config->pairs[2 * p],
+                                     config->pairs[2 * p + 1]);
+            }
+            found--;
+        }
+    }
+    return 0;
+}
+
+static int ec_glob_resolver_emit(const struct ec_glob_resolver_s *resolver,
+                                 const struct ec_glob_resolver_dir *dir,
+                                 const char *path,
+                                 ec_glob_property_fn callback, void *data) {
+    const struct ec_glob_resolver_dir *first =
+            dir->config != NULL ? dir : dir->up;
+    // room for every pair and the two derived properties
+    unsigned pairs = 2, sections = 0;
+    for (const struct ec_glob_resolver_dir *d = first ; d != NULL ;
+         d = d->up) {
+        pairs += d->config->pair_count;
+        if (sections < d->config->section_count) {
+            sections = d->config->section_count;
+        }
+    }
+    size_t size = pairs * 2 * sizeof(const char *) + (sections + 7) / 8;
+    struct ec_glob_resolved resolved;
+    resolved.pairs = ec_glob_alloc(&resolver->allocator, size);
+    if (resolved.pairs == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    resolved.count = 0;
+    resolved.matches = (unsigned char *) (resolved.pairs + 2 * pairs);
+
+    int status = 0;
+    if (first != NULL && ec_glob_resolved_apply(&resolved, first, path)) {
+        errno = ENOMEM;
+        status = -1;
+    } else {
+        // the defaults which the specification derives from other values
+        const char **style = ec_glob_resolved_find(&resolved, "indent_style");
+        const char **indent = ec_glob_resolved_find(&resolved, "indent_size");
+        const char **tab = ec_glob_resolved_find(&resolved, "tab_width");
+        if (style != NULL && indent == NULL && strcmp(*style, "tab") == 0) {
+            ec_glob_resolved_set(&resolved, "indent_size", "tab");
+            indent = ec_glob_resolved_find(&resolved, "indent_size");
+        }
+        if (indent != NULL && tab == NULL && strcmp(*indent, "tab") != 0) {
+            ec_glob_resolved_set(&resolved, "tab_width", *indent);
+        }
+        if (indent != NULL && tab != NULL && strcmp(*indent, "tab") == 0) {
+            *indent = *tab;
+        }
+        for (unsigned i = 0 ; i < resolved.count && status == 0 ; i++) {
+            status = callback(resolved.pairs[2 * i],
+                              resolved.pairs[2 * i + 1], data);
+        }
+    }
+    ec_glob_dealloc(&resolver->allocator, resolved.pairs, size);
+    return status;
+}
+
+int ec_glob_resolver_create(ec_glob_resolver_t **resolver,
+                            const char *filename,
+                            const struct ec_glob_allocator *allocator) {
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    if (filename == NULL) filename = ".editorconfig";
+    size_t len = strlen(filename);
+    struct ec_glob_resolver_s *r = ec_glob_alloc(allocator,
+            sizeof(struct ec_glob_resolver_s) + len + 1);
+    *resolver = r;
+    if (r == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    r->allocator = *allocator;
+    r->bucket_count = 64;
+    r->count = 0;
+    r->buckets = ec_glob_alloc(allocator,
+                               r->bucket_count * sizeof(r->buckets[0]));
+    if (r->buckets == NULL) {
+        ec_glob_dealloc(allocator, r,
+                        sizeof(struct ec_glob_resolver_s) + len + 1);
+        *resolver = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(r->buckets, 0, r->bucket_count * sizeof(r->buckets[0]));
+    r->filename_len = len;
+    memcpy(r->filename, filename, len + 1);
+    pthread_rwlock_init(&r->lock, NULL);
+    return 0;
+}
+
+int ec_glob_resolve(ec_glob_resolver_t *resolver, const char *path,
+                    ec_glob_property_fn callback, void *data) {
+    if (path[0] != '/') {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t len = strrchr(path, '/') - path;
+
+    pthread_rwlock_rdlock(&resolver->lock);
+    struct ec_glob_resolver_dir *dir = ec_glob_resolver_lookup(resolver,
+            path, len, ec_glob_resolver_hash(path, len));
+    if (dir == NULL) {
+        // the first file of this directory, read the configuration files
+        pthread_rwlock_unlock(&resolver->lock);
+        pthread_rwlock_wrlock(&resolver->lock);
+        dir = ec_glob_resolver_dir(resolver, path, len);
+        if (dir == NULL) {
+            pthread_rwlock_unlock(&resolver->lock);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    int status = ec_glob_resolver_emit(resolver, dir, path, callback, data);
+    pthread_rwlock_unlock(&resolver->lock);
+    return status;
+}
+
+static void ec_glob_resolver_drop(struct ec_glob_resolver_s *resolver) {
+    for (unsigned i = 0 ; i < resolver->bucket_count ; i++) {
+        struct ec_glob_resolver_dir *dir = resolver->buckets[i];
+        while (dir != NULL) {
+            struct ec_glob_resolver_dir *next = dir->hnext;
+            if (dir->config != NULL) {
+                ec_glob_config_free(&resolver->allocator, dir->config);
+            }
+            ec_glob_dealloc(&resolver->allocator, dir,
+                            sizeof(struct ec_glob_resolver_dir) + dir->len + 1);
+            dir = next;
+        }
+        resolver->buckets[i] = NULL;
+    }
+    resolver->count = 0;
+}
+
+void ec_glob_resolver_clear(ec_glob_resolver_t *resolver) {
+    pthread_rwlock_wrlock(&resolver->lock);
+    ec_glob_resolver_drop(resolver);
+    pthread_rwlock_unlock(&resolver->lock);
+}
+
+void ec_glob_resolver_free(ec_glob_resolver_t *resolver) {
+    if (resolver == NULL) return;
+    ec_glob_resolver_drop(resolver);
+    pthread_rwlock_destroy(&resolver->lock);
+    ec_glob_dealloc(&resolver->allocator, resolver->buckets,
+                    resolver->bucket_count * sizeof(resolver->buckets[0]));
+    struct ec_glob_allocator allocator = resolver->allocator;
+    ec_glob_dealloc(&allocator, resolver, sizeof(struct ec_glob_resolver_s)
+                    + resolver->filename_len + 1);
+}
+
+/*
+ * The database stores compiled patterns and sets in the layout in which
+ * the engines use them, so that a mapped file is used in place. The arrays
+ * of every entry are referenced by their offset from the start of the file,
+ * and a loaded pattern only needs a small handle which points into the
+ * mapping. The layout word changes with the sizes of the stored structures,
+ * so that a file written by an incompatible build is rejected.
+ */
+#define EC_GLOB_DB_MAGIC "ECGLOBDB"
+#define EC_GLOB_DB_VERSION 1
+
+struct ec_glob_db_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    // the size of the whole file
+    uint64_t size;
+    // of everything after the header
+    uint64_t checksum;
+    uint32_t glob_count;
+    uint32_t set_count;
+    // followed by the offsets of the globs and the sets
+};
+
+struct ec_glob_db_glob {
+    uint64_t toks;
+    uint64_t classes;
+    uint64_t numranges;
+    uint64_t states;
+    uint32_t tok_count;
+    uint32_t class_count;
+    uint32_t numrange_count;
+    uint32_t backtrack_count;
+    // the NFA, unless the pattern has a shape
+    uint32_t state_count;
+    uint32_t start;
+    uint32_t shape;
+    uint32_t reserved;
+    struct ec_glob_prefilter filter;
+};
+
+struct ec_glob_db_set {
+    uint64_t classes;
+    uint64_t states;
+    uint32_t count;
+    uint32_t class_count;
+    uint32_t state_count;
+    uint32_t start;
+};
+
+struct ec_glob_db_s {
+    const char *base;
+    size_t size;
+    const struct ec_glob_db_header *header;
+    const uint64_t *entries;
+    // of the handle and of the loaded patterns and sets
+    struct ec_glob_allocator allocator;
+};
+
+static uint32_t ec_glob_db_layout(void) {
+    const uint32_t sizes[] = {
+            EC_GLOB_DB_VERSION,
+            // detects the byte order
+            0x01020304,
+            sizeof(long),
+            sizeof(struct ec_glob_tok),
+            sizeof(struct ec_glob_class),
+            sizeof(struct numpair_s),
+            sizeof(struct ec_glob_nfa_state),
+            sizeof(struct ec_glob_prefilter),
+    };
+    uint32_t hash = 2166136261u;
+    const unsigned char *p = (const unsigned char *) sizes;
+    for (size_t i = 0 ; i < sizeof(sizes) ; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// FNV-1a over 64-bit words, which is fast enough to check large files
+static uint64_t ec_glob_db_checksum(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for ( ; i + 8 <= size ; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for ( ; i < size ; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct ec_glob_db_writer {
+    char *buf;
+    size_t size;
+    size_t capacity;
+    const struct ec_glob_allocator *allocator;
+};
+
+/*
+ * Appends data (or zeros) at the next aligned offset and returns the
+ * offset, or zero if memory is exhausted. Only the header is at offset zero.
+ */
+static uint64_t ec_glob_db_put(struct ec_glob_db_writer *w,
+                               const void *data, size_t size) {
+    size_t offset = (w->size + 7) & ~(size_t) 7;
+    if (offset + size > w->capacity) {
+        size_t capacity = 2 * w->capacity + size + 4096;
+        char *buf = w->buf == NULL
+                ? ec_glob_alloc(w->allocator, capacity)
+                : ec_glob_realloc(w->allocator, w->buf, w->capacity, capacity);
+        if (buf == NULL) return 0;
+        w->buf = buf;
+        w->capacity = capacity;
+    }
+    memset(w->buf + w->size, 0, offset - w->size);
+    if (data != NULL) {
+        memcpy(w->buf + offset, data, size);
+    } else {
+        memset(w->buf + offset, 0, size);
+    }
+    w->size = offset + size;
+    return offset;
+}
+
+// puts an array, where an empty array needs no space
+#define ec_glob_db_put_array(w, array, count, offset) \
+    ((count) == 0 || ((offset) = ec_glob_db_put(w, array, \
+                                                (count) * sizeof(*(array)))))
+
+static _Bool ec_glob_db_put_glob(struct ec_glob_db_writer *w, uint64_t entry,
+                                 const struct ec_glob_s *glob) {
+    struct ec_glob_db_glob rec;
+    memset(&rec, 0, sizeof(rec));
+    const struct ec_glob_prog *prog = &glob->prog;
+    rec.tok_count = prog->tok_count;
+    rec.class_count = prog->class_count;
+    rec.numrange_count = prog->numrange_count;
+    rec.backtrack_count = prog->backtrack_count;
+    rec.shape = glob->shape;
+    rec.filter = glob->filter;
+    if (!ec_glob_db_put_array(w, prog->toks, prog->tok_count, rec.toks)
+        || !ec_glob_db_put_array(w, prog->classes, prog->class_count,
+                                 rec.classes)
+        || !ec_glob_db_put_array(w, prog->numranges, prog->numrange_count,
+                                 rec.numranges)) {
+        return 0;
+    }
+
+    // the NFA is stored as well, so that a DFA build needs not construct it
+    if (glob->shape == ec_glob_shape_none) {
+        struct ec_glob_nfa nfa = glob->nfa;
+        _Bool built = glob->engine != ec_glob_engine_dfa;
+        if (built && ec_glob_nfa_build(&nfa, prog, &glob->allocator) != 0) {
+            return 0;
+        }
+        rec.state_count = nfa.count;
+        rec.start = nfa.start;
+        _Bool ok = ec_glob_db_put_array(w, nfa.states, nfa.count,
+                                        rec.states);
+        if (built) ec_glob_nfa_free(&nfa);
+        if (!ok) return 0;
+    }
+
+    uint64_t offset = ec_glob_db_put(w, &rec, sizeof(rec));
+    if (offset == 0) return 0;
+    memcpy(w->buf + entry, &offset, sizeof(offset));
+    return 1;
+}
+
+static _Bool ec_glob_db_put_set(struct ec_glob_db_writer *w, uint64_t entry,
+                                const struct ec_glob_set_s *set) {
+    struct ec_glob_db_set rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.count = set->count;
+    rec.class_count = set->class_count;
+    rec.state_count = set->nfa.count;
+    rec.start = set->nfa.start;
+    if (!ec_glob_db_put_array(w, set->nfa.classes, set->class_count,
+                              rec.classes)
+        || !ec_glob_db_put_array(w, set->nfa.states, set->nfa.count,
+                                 rec.states)) {
+        return 0;
+    }
+    uint64_t offset = ec_glob_db_put(w, &rec, sizeof(rec));
+    if (offset == 0) return 0;
+    memcpy(w->buf + entry, &offset, sizeof(offset));
+    return 1;
+}
+
+int ec_glob_db_save_with(const char *path, const ec_glob_t * const *globs,
+                         unsigned glob_count, const ec_glob_set_t * const *sets,
+                         unsigned set_count,
+                         const struct ec_glob_allocator *allocator) {
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    struct ec_glob_db_writer w = {NULL, 0, 0, allocator};
+    size_t entries = sizeof(struct ec_glob_db_header);
+    ec_glob_db_put(&w, NULL, entries
+            + (glob_count + set_count) * sizeof(uint64_t));
+    _Bool ok = w.buf != NULL;
+    for (unsigned i = 0 ; ok && i < glob_count ; i++) {
+        ok = ec_glob_db_put_glob(&w, entries + i * sizeof(uint64_t),
+                                 globs[i]);
+    }
+    for (unsigned i = 0 ; ok && i < set_count ; i++) {
+        ok = ec_glob_db_put_set(&w, entries
+                + (glob_count + i) * sizeof(uint64_t), sets[i]);
+    }
+    if (!ok) {
+        if (w.buf != NULL) ec_glob_dealloc(allocator, w.buf, w.capacity);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct ec_glob_db_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EC_GLOB_DB_MAGIC, sizeof(header.magic));
+    header.version = EC_GLOB_DB_VERSION;
+    header.layout = ec_glob_db_layout();
+    header.size = w.size;
+    header.checksum = ec_glob_db_checksum(w.buf + sizeof(header),
+                                          w.size - sizeof(header));
+    header.glob_count = glob_count;
+    header.set_count = set_count;
+    memcpy(w.buf, &header, sizeof(header));
+
+    // replace an existing database atomically
+    size_t len = strlen(path);
+    char *tmp = ec_glob_alloc(allocator, len + 5);
+    if (tmp == NULL) {
+        ec_glob_dealloc(allocator, w.buf, w.capacity);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+    int status = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        size_t written = 0;
+        ssize_t n;
+        while (written < w.size
+               && (n = write(fd, w.buf + written, w.size - written)) > 0) {
+            written += n;
+        }
+        if (close(fd) == 0 && written == w.size && rename(tmp, path) == 0) {
+            status = 0;
+        } else {
+            int error = errno;
+            unlink(tmp);
+            errno = error;
+        }
+    }
+    ec_glob_dealloc(allocator, tmp, len + 5);
+    ec_glob_dealloc(allocator, w.buf, w.capacity);
+    return status;
+}
+
+int ec_glob_db_save(const char *path, const ec_glob_t * const *globs,
+                    unsigned glob_count, const ec_glob_set_t * const *sets,
+                    unsigned set_count) {
+    return ec_glob_db_save_with(path, globs, glob_count, sets, set_count,
+                                NULL);
+}
+
+int ec_glob_db_open_with(ec_glob_db_t **db, const char *path,
+                         const struct ec_glob_allocator *allocator) {
+    *db = NULL;
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    if (size < sizeof(struct ec_glob_db_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const struct ec_glob_db_header *header = map;
+    size_t entries = (size_t) header->glob_count + header->set_count;
+    if (memcmp(header->magic, EC_GLOB_DB_MAGIC, sizeof(header->magic)) != 0
+        || header->version != EC_GLOB_DB_VERSION
+        || header->layout != ec_glob_db_layout()
+        || header->size != size
+        || entries > (size - sizeof(*header)) / sizeof(uint64_t)
+        || header->checksum != ec_glob_db_checksum(
+                (const char *) map + sizeof(*header), size - sizeof(*header))) {
+        munmap(map, size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct ec_glob_db_s *d = ec_glob_alloc(allocator,
+                                           sizeof(struct ec_glob_db_s));
+    if (d == NULL) {
+        munmap(map, size);
+        errno = ENOMEM;
+        return -1;
+    }
+    d->base = map;
+    d->size = size;
+    d->header = header;
+    d->entries = (const uint64_t *) (header + 1);
+    d->allocator = *allocator;
+    *db = d;
+    return 0;
+}
+
+int ec_glob_db_open(ec_glob_db_t **db, const char *path) {
+    return ec_glob_db_open_with(db, path, NULL);
+}
+
+unsigned ec_glob_db_glob_count(const ec_glob_db_t *db) {
+    return db->header->glob_count;
+}
+
+unsigned ec_glob_db_set_count(const ec_glob_db_t *db) {
+    return db->header->set_count;
+}
+
+// checks that an array of the entry lies within the file
+static _Bool ec_glob_db_valid(const ec_glob_db_t *db, uint64_t offset,
+                              uint64_t count, size_t size) {
+    return count == 0 || (offset % 8 == 0 && offset <= db->size
+                          && count <= (db->size - offset) / size);
+}
+
+static const void *ec_glob_db_entry(const ec_glob_db_t *db, unsigned index,
+                                    size_t size) {
+    uint64_t offset = db->entries[index];
+    return offset > 0 && ec_glob_db_valid(db, offset, 1, size)
+            ? db->base + offset : NULL;
+}
+
+/*
+ * Checks that the tokens only refer to classes, num ranges and tokens of the
+ * pattern, and that the alternatives are linked like the parser links them.
+ */
+static _Bool ec_glob_db_valid_toks(const struct ec_glob_prog *prog) {
+    // like the parser, choices nest no deeper than that, and for each
+    // choice we need its OPEN and the last OPEN or ALT token
+    unsigned open[32], last[32];
+    unsigned depth = 0;
+    const struct ec_glob_tok *toks = prog->toks;
+    for (unsigned t = 0 ; t < prog->tok_count ; t++) {
+        const struct ec_glob_tok *tok = &toks[t];
+        switch (tok->type) {
+            case EC_GLOB_TOK_CHAR:
+            case EC_GLOB_TOK_ANY:
+            case EC_GLOB_TOK_STAR:
+            case EC_GLOB_TOK_GLOBSTAR:
+                break;
+            case EC_GLOB_TOK_CLASS:
+                if (tok->arg >= prog->class_count) return 0;
+                break;
+            case EC_GLOB_TOK_NUMRANGE:
+                if (tok->arg >= prog->numrange_count) return 0;
+                break;
+            case EC_GLOB_TOK_OPEN:
+                if (depth == sizeof(open) / sizeof(open[0])) return 0;
+                open[depth] = t;
+                last[depth++] = t;
+                break;
+            case EC_GLOB_TOK_ALT:
+            case EC_GLOB_TOK_CLOSE:
+                // the previous OPEN or ALT must link to this token
+                if (depth == 0 || toks[last[depth - 1]].arg != t) return 0;
+                if (tok->type == EC_GLOB_TOK_ALT) {
+                    if (tok->close != toks[open[depth - 1]].close) return 0;
+                    last[depth - 1] = t;
+                } else {
+                    depth--;
+                    if (tok->arg != open[depth]
+                        || toks[open[depth]].close != t) return 0;
+                }
+                break;
+            default:
+                return 0;
+        }
+    }
+    return depth == 0;
+}
+
+/*
+ * Checks that the NFA states only refer to states, classes and patterns
+ * of the entry.
+ */
+static _Bool ec_glob_db_valid_states(const struct ec_glob_nfa_state *states,
+                                    unsigned count, unsigned start,
+                                    unsigned class_count,
+                                    unsigned pattern_count) {
+    if (start >= count) return 0;
+    for (unsigned i = 0 ; i < count ; i++) {
+        const struct ec_glob_nfa_state *state = &states[i];
+        switch (state->type) {
+            case EC_GLOB_NFA_RANGE:
+            case EC_GLOB_NFA_ANY:
+            case EC_GLOB_NFA_NOSLASH:
+            case EC_GLOB_NFA_SAVE:
+                if (state->out >= count) return 0;
+                break;
+            case EC_GLOB_NFA_CLASS:
+                if (state->out >= count || state->out1 >= class_count) return 0;
+                break;
+            case EC_GLOB_NFA_SPLIT:
+                if (state->out >= count || state->out1 >= count) return 0;
+                break;
+            case EC_GLOB_NFA_MATCH:
+                // the match state of a set without any valid pattern
+                if (state->out1 == (unsigned) -1) break;
+                if (state->out1 >= pattern_count) return 0;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static _Bool ec_glob_db_valid_literals(const struct ec_glob_literals *lits) {
+    if (lits->count > EC_GLOB_PREFILTER_COUNT) return 0;
+    for (unsigned i = 0 ; i < lits->count ; i++) {
+        if (lits->len[i] > EC_GLOB_PREFILTER_LEN) return 0;
+    }
+    return 1;
+}
+
+int ec_glob_db_glob(const ec_glob_db_t *db, unsigned index,
+                    ec_glob_t **glob) {
+    *glob = NULL;
+    const struct ec_glob_db_glob *rec = index < db->header->glob_count
+            ? ec_glob_db_entry(db, index, sizeof(*rec)) : NULL;
+    if (rec == NULL
+        || !ec_glob_db_valid(db, rec->toks, rec->tok_count,
+                             sizeof(struct ec_glob_tok))
+        || !ec_glob_db_valid(db, rec->classes, rec->class_count,
+                             sizeof(struct ec_glob_class))
+        || !ec_glob_db_valid(db, rec->numranges, rec->numrange_count,
+                             sizeof(struct numpair_s))
+        || !ec_glob_db_valid(db, rec->states, rec->state_count,
+                             sizeof(struct ec_glob_nfa_state))
+        || rec->shape > ec_glob_shape_suffix
+        || (rec->shape == ec_glob_shape_none && rec->state_count == 0)
+        || (rec->state_count > 0 && !ec_glob_db_valid_states(
+                (const struct ec_glob_nfa_state *) (db->base + rec->states),
+                rec->state_count, rec->start, rec->class_count, 1))
+        || !ec_glob_db_valid_literals(&rec->filter.prefix)
+        || !ec_glob_db_valid_literals(&rec->filter.suffix)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct ec_glob_s *g = ec_glob_alloc(&db->allocator,
+                                        sizeof(struct ec_glob_s));
+    if (g == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(g, 0, sizeof(struct ec_glob_s));
+    g->reused = 1;
+    g->allocator = db->allocator;
+    g->size = sizeof(struct ec_glob_s);
+    g->prog.toks = (struct ec_glob_tok *) (db->base + rec->toks);
+    g->prog.classes = (struct ec_glob_class *) (db->base + rec->classes);
+    g->prog.numranges = (struct numpair_s *) (db->base + rec->numranges);
+    g->prog.tok_count = rec->tok_count;
+    g->prog.class_count = rec->class_count;
+    g->prog.numrange_count = rec->numrange_count;
+    g->prog.backtrack_count = rec->backtrack_count;
+    g->filter = rec->filter;
+    g->shape = rec->shape;
+    if (!ec_glob_db_valid_toks(&g->prog)) {
+        ec_glob_dealloc(&g->allocator, g, g->size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // a regex cannot be stored, so those builds use the native engine
+    enum ec_glob_engine engine = ec_glob_default_engine(g);
+    if (engine == ec_glob_engine_auto) {
+        engine = ec_glob_auto_engine(g);
+    }
+    if (engine == ec_glob_engine_shape) {
+        g->engine = ec_glob_engine_shape;
+    } else if (engine == ec_glob_engine_pike) {
+        // the stored NFA has no SAVE states
+        g->engine = ec_glob_engine_pike;
+        if (ec_glob_pike_compile(g) != 0) {
+            ec_glob_dealloc(&g->allocator, g, g->size);
+            errno = ENOMEM;
+            return -1;
+        }
+    } else if (engine == ec_glob_engine_dfa
+               || engine == ec_glob_engine_bitap) {
+        ec_glob_nfa_init(&g->nfa, &g->allocator);
+        g->nfa.states = (struct ec_glob_nfa_state *) (db->base + rec->states);
+        g->nfa.count = g->nfa.capacity = rec->state_count;
+        g->nfa.start = rec->start;
+        g->nfa.classes = g->prog.classes;
+        g->nfa.mapped = 1;
+        int status = 0;
+        if (engine == ec_glob_engine_bitap) {
+            status = ec_glob_bitap_build(&g->bitap, &g->nfa, &g->allocator);
+        }
+        // patterns with too many positions use the DFA
+        if (status == 0 && g->bitap != NULL) {
+            g->engine = ec_glob_engine_bitap;
+        } else if (status == 0) {
+            g->engine = ec_glob_engine_dfa;
+            g->dfa = ec_glob_dfa_create(&g->nfa, EC_GLOB_DFA_CACHE_SIZE);
+        }
+        if (status != 0 || (g->bitap == NULL && g->dfa == NULL)) {
+            ec_glob_dealloc(&g->allocator, g, g->size);
+            errno = ENOMEM;
+            return -1;
+        }
+    } else {
+        g->engine = ec_glob_engine_native;
+    }
+    if (ec_glob_lanes_build(g) != 0) {
+        g->lanes = NULL;
+        ec_glob_release(g);
+        ec_glob_dealloc(&g->allocator, g, g->size);
+        errno = ENOMEM;
+        return -1;
+    }
+    *glob = g;
+    return 0;
+}
+
+int ec_glob_db_set(const ec_glob_db_t *db, unsigned index,
+                   ec_glob_set_t **set) {
+    *set = NULL;
+    const struct ec_glob_db_set *rec = index < db->header->set_count
+            ? ec_glob_db_entry(db, db->header->glob_count + index,
+                               sizeof(*rec)) : NULL;
+    if (rec == NULL
+        || !ec_glob_db_valid(db, rec->classes, rec->class_count,
+                             sizeof(struct ec_glob_class))
+        || !ec_glob_db_valid(db, rec->states, rec->state_count,
+                             sizeof(struct ec_glob_nfa_state))
+        || rec->state_count == 0
+        || !ec_glob_db_valid_states(
+                (const struct ec_glob_nfa_state *) (db->base + rec->states),
+                rec->state_count, rec->start, rec->class_count, rec->count)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct ec_glob_set_s *s = ec_glob_alloc(&db->allocator,
+                                            sizeof(struct ec_glob_set_s));
+    if (s == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    s->allocator = db->allocator;
+    s->count = rec->count;
+    // the classes are not owned by the set
+    s->classes = NULL;
+    s->class_count = rec->class_count;
+    s->table = NULL;
+    ec_glob_nfa_init(&s->nfa, &s->allocator);
+    s->nfa.states = (struct ec_glob_nfa_state *) (db->base + rec->states);
+    s->nfa.count = s->nfa.capacity = rec->state_count;
+    s->nfa.start = rec->start;
+    s->nfa.classes = (const struct ec_glob_class *) (db->base + rec->classes);
+    s->nfa.mapped = 1;
+    s->dfa = ec_glob_dfa_create(&s->nfa, EC_GLOB_SET_CACHE_SIZE);
+    if (s->dfa == NULL) {
+        ec_glob_set_free(s);
+        errno = ENOMEM;
+        return -1;
+    }
+    *set = s;
+    return 0;
+}
+
+void ec_glob_db_close(ec_glob_db_t *db) {
+    if (db == NULL) return;
+    munmap((void *) db->base, db->size);
+    struct ec_glob_allocator allocator = db->allocator;
+    ec_glob_dealloc(&allocator, db, sizeof(struct ec_glob_db_s));
+}
+
+/*
+ * A resumable match state holds the NFA states reached by the components
+ * fed so far plus the following slash. The NFA states, unlike the DFA
+ * state, survive a flush of the DFA cache and can simply be copied.
+ * The DFA of a pattern compiled with the DFA engine is shared with the
+ * pattern, for all other engines the first state builds an automaton,
+ * which is shared with its clones.
+ */
+struct ec_glob_automaton {
+    struct ec_glob_nfa nfa;
+    struct ec_glob_dfa *dfa;
+    atomic_uint refs;
+};
+
+struct ec_glob_state_s {
+    const struct ec_glob_s *glob;
+    struct ec_glob_dfa *dfa;
+    // the owner of the DFA, or NULL when it belongs to the pattern
+    struct ec_glob_automaton *automaton;
+    // the DFA state for the NFA states, unless the cache was flushed since
+    struct ec_glob_dfa_state *cached;
+    unsigned flushes;
+    _Bool accept;
+    unsigned count;
+    unsigned states[];
+};
+
+static struct ec_glob_automaton *ec_glob_automaton_create(
+        const struct ec_glob_s *glob) {
+    struct ec_glob_automaton *automaton = ec_glob_alloc(&glob->allocator,
+            sizeof(struct ec_glob_automaton));
+    if (automaton == NULL) return NULL;
+    if (ec_glob_nfa_build(&automaton->nfa, &glob->prog,
+                          &glob->allocator) == 0) {
+        automaton->dfa = ec_glob_dfa_create(&automaton->nfa,
+                                            EC_GLOB_DFA_CACHE_SIZE);
+        if (automaton->dfa != NULL) {
+            atomic_init(&automaton->refs, 1);
+            return automaton;
+        }
+        ec_glob_nfa_free(&automaton->nfa);
+    }
+    ec_glob_dealloc(&glob->allocator, automaton,
+                    sizeof(struct ec_glob_automaton));
+    return NULL;
+}
+
+static void ec_glob_automaton_release(const struct ec_glob_s *glob,
+                                      struct ec_glob_automaton *automaton) {
+    if (automaton == NULL
+        || atomic_fetch_sub_explicit(&automaton->refs, 1,
+                                     memory_order_acq_rel) != 1) return;
+    ec_glob_dfa_destroy(automaton->dfa);
+    ec_glob_nfa_free(&automaton->nfa);
+    ec_glob_dealloc(&glob->allocator, automaton,
+                    sizeof(struct ec_glob_automaton));
+}
+
+static size_t ec_glob_state_size(const struct ec_glob_dfa *dfa) {
+    return sizeof(struct ec_glob_state_s)
+            + dfa->nfa->count * sizeof(unsigned);
+}
+
+// remembers the DFA state to resume from - the caller must hold the lock
+static void ec_glob_state_store(struct ec_glob_state_s *state,
+                                struct ec_glob_dfa_state *s) {
+    state->cached = s;
+    state->flushes = state->dfa->flushes;
+    state->count = s->count;
+    memcpy(state->states, ec_glob_dfa_state_nfa(state->dfa, s),
+           s->count * sizeof(unsigned));
+}
+
+int ec_glob_state_init(ec_glob_state_t **state, const ec_glob_t *glob) {
+    *state = NULL;
+    struct ec_glob_automaton *automaton = NULL;
+    struct ec_glob_dfa *dfa = glob->dfa;
+    if (glob->engine != ec_glob_engine_dfa) {
+        automaton = ec_glob_automaton_create(glob);
+        if (automaton == NULL) return REG_ESPACE;
+        dfa = automaton->dfa;
+    }
+
+    struct ec_glob_state_s *s = ec_glob_alloc(&glob->allocator,
+                                              ec_glob_state_size(dfa));
+    if (s == NULL) {
+        ec_glob_automaton_release(glob, automaton);
+        return REG_ESPACE;
+    }
+    s->glob = glob;
+    s->dfa = dfa;
+    s->automaton = automaton;
+    pthread_mutex_lock(&dfa->lock);
+    struct ec_glob_dfa_state *start = dfa->start == NULL
+            ? ec_glob_dfa_start(dfa) : dfa->start;
+    if (start != NULL) {
+        s->accept = start->accept;
+        ec_glob_state_store(s, start);
+    }
+    pthread_mutex_unlock(&dfa->lock);
+    if (start == NULL) {
+        ec_glob_state_free(s);
+        return REG_ESPACE;
+    }
+    *state = s;
+    return 0;
+}
+
+int ec_glob_state_feed(ec_glob_state_t *state, const char *component) {
+    struct ec_glob_dfa *dfa = state->dfa;
+    pthread_mutex_lock(&dfa->lock);
+    struct ec_glob_dfa_state *s = state->cached;
+    if (s == NULL || state->flushes != dfa->flushes) {
+        memcpy(dfa->set, state->states, state->count * sizeof(unsigned));
+        s = ec_glob_dfa_lookup(dfa, state->count);
+    }
+    s = ec_glob_dfa_feed(dfa, s, component, strlen(component));
+    _Bool accept = s != NULL && s->accept;
+    if (s != NULL) {
+        s = ec_glob_dfa_feed(dfa, s, "/", 1);
+    }
+    // a state which cannot be built leaves the state as it was
+    if (s != NULL) {
+        state->accept = accept;
+        ec_glob_state_store(state, s);
+    }
+    pthread_mutex_unlock(&dfa->lock);
+    return s == NULL ? REG_ESPACE : state->accept ? 0 : 1;
+}
+
+int ec_glob_state_dead(const ec_glob_state_t *state) {
+    return state->count == 0;
+}
+
+int ec_glob_state_clone(ec_glob_state_t **clone,
+                        const ec_glob_state_t *state) {
+    size_t size = ec_glob_state_size(state->dfa);
+    struct ec_glob_state_s *s = ec_glob_alloc(&state->glob->allocator, size);
+    *clone = s;
+    if (s == NULL) return REG_ESPACE;
+    memcpy(s, state, size);
+    if (s->automaton != NULL) {
+        atomic_fetch_add_explicit(&s->automaton->refs, 1,
+                                  memory_order_relaxed);
+    }
+    return 0;
+}
+
+void ec_glob_state_free(ec_glob_state_t *state) {
+    if (state == NULL) return;
+    const struct ec_glob_s *glob = state->glob;
+    // the DFA may be released with the automaton
+    size_t size = ec_glob_state_size(state->dfa);
+    ec_glob_automaton_release(glob, state->automaton);
+    ec_glob_dealloc(&glob->allocator, state, size);
+}
+
+/*
+ * A path index keeps the paths sorted and front coded: every entry stores
+ * the length of the prefix it shares with the previous entry and the length
+ * of the rest as variable length integers, followed by the rest of the path.
+ * The matcher keeps the DFA state for every prefix of the current path, so
+ * each entry resumes after the shared prefix, and skips all following
+ * entries which share a prefix that leads to the dead state.
+ */
+struct ec_glob_pathindex_s {
+    size_t count;
+    // the position of each entry in the list of paths
+    size_t *ids;
+    unsigned char *text;
+    size_t textlen;
+    size_t max_len;
+    size_t size;
+    struct ec_glob_allocator allocator;
+};
+
+struct ec_glob_pathindex_entry {
+    const char *path;
+    size_t id;
+};
+
+static int ec_glob_pathindex_compare(const void *a, const void *b) {
+    const struct ec_glob_pathindex_entry *x = a, *y = b;
+    int c = strcmp(x->path, y->path);
+    return c != 0 ? c : (x->id > y->id) - (x->id < y->id);
+}
+
+static size_t ec_glob_pathindex_shared(const char *prev, const char *path) {
+    size_t shared = 0;
+    while (prev[shared] != '\0' && prev[shared] == path[shared]) shared++;
+    return shared;
+}
+
+static size_t ec_glob_varint_size(size_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static unsigned char *ec_glob_varint_put(unsigned char *p, size_t value) {
+    while (value >= 0x80) {
+        *p++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char) value;
+    return p;
+}
+
+static const unsigned char *ec_glob_varint_get(const unsigned char *p,
+                                               size_t *value) {
+    size_t v = 0;
+    unsigned shift = 0;
+    while (*p & 0x80) {
+        v |= (size_t) (*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *value = v | (size_t) *p++ << shift;
+    return p;
+}
+
+int ec_glob_pathindex_create_with(ec_glob_pathindex_t **index,
+                                  const char * const *paths, size_t count,
+                                  const struct ec_glob_allocator *allocator) {
+    *index = NULL;
+    if (allocator == NULL) allocator = &ec_glob_std_allocator;
+    size_t sortsize = count * sizeof(struct ec_glob_pathindex_entry);
+    struct ec_glob_pathindex_entry *sorted = ec_glob_alloc(allocator,
+                                                           sortsize + 1);
+    if (sorted == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0 ; i < count ; i++) {
+        sorted[i].path = paths[i];
+        sorted[i].id = i;
+    }
+    qsort(sorted, count, sizeof(struct ec_glob_pathindex_entry),
+          ec_glob_pathindex_compare);
+
+    // the shared prefixes are computed twice, to allocate only once
+    size_t textlen = 0;
+    size_t max_len = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+        const char *path = sorted[i].path;
+        size_t len = strlen(path);
+        size_t shared = i == 0 ? 0
+                : ec_glob_pathindex_shared(sorted[i - 1].path, path);
+        textlen += ec_glob_varint_size(shared)
+                + ec_glob_varint_size(len - shared) + len - shared;
+        if (len > max_len) max_len = len;
+    }
+
+    size_t size = sizeof(struct ec_glob_pathindex_s)
+            + count * sizeof(size_t) + textlen;
+    struct ec_glob_pathindex_s *ix = ec_glob_alloc(allocator, size);
+    if (ix == NULL) {
+        ec_glob_dealloc(allocator, sorted, sortsize + 1);
+        errno = ENOMEM;
+        return -1;
+    }
+    ix->count = count;
+    ix->ids = (size_t *) (ix + 1);
+    ix->text = (unsigned char *) (ix->ids + count);
+    ix->textlen = textlen;
+    ix->max_len = max_len;
+    ix->size = size;
+    ix->allocator = *allocator;
+    unsigned char *p = ix->text;
+    for (size_t i = 0 ; i < count ; i++) {
+        const char *path = sorted[i].path;
+        size_t shared = i == 0 ? 0
+                : ec_glob_pathindex_shared(sorted[i - 1].path, path);
+        size_t len = strlen(path + shared);
+        ix->ids[i] = sorted[i].id;
+        p = ec_glob_varint_put(p, shared);
+        p = ec_glob_varint_put(p, len);
+        memcpy(p, path + shared, len);
+        p += len;
+    }
+    ec_glob_dealloc(allocator, sorted, sortsize + 1);
+    *index = ix;
+    return 0;
+}
+
+int ec_glob_pathindex_create(ec_glob_pathindex_t **index,
+                             const char * const *paths, size_t count) {
+    return ec_glob_pathindex_create_with(index, paths, count, NULL);
+}
+
+size_t ec_glob_pathindex_size(const ec_glob_pathindex_t *index) {
+    return index->size;
+}
+
+void ec_glob_pathindex_free(ec_glob_pathindex_t *index) {
+    if (index == NULL) return;
+    struct ec_glob_allocator allocator = index->allocator;
+    ec_glob_dealloc(&allocator, index, index->size);
+}
+
+/*
+ * Runs the DFA over all entries of the index.
+ * The DFA belongs to the caller, so that no lock is needed.
+ */
+static int ec_glob_pathindex_run(const struct ec_glob_pathindex_s *index,
+                                 struct ec_glob_dfa *dfa,
+                                 const struct ec_glob_set_s *set,
+                                 unsigned char *matches,
+                                 ec_glob_pathindex_fn callback, void *data) {
+    const struct ec_glob_allocator *allocator = &index->allocator;
+    size_t depth = index->max_len + 1;
+    // the state after each prefix of the current path, and the path itself
+    size_t scratch = depth * sizeof(struct ec_glob_dfa_state *) + depth;
+    struct ec_glob_dfa_state **states = ec_glob_alloc(allocator, scratch);
+    if (states == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    unsigned char *path = (unsigned char *) (states + depth);
+
+    int status = 0;
+    // the states of shorter prefixes are gone after a flush of the cache
+    size_t valid = 0;
+    states[0] = NULL;
+    const unsigned char *p = index->text;
+    for (size_t i = 0 ; i < index->count && status == 0 ; i++) {
+        size_t k, len;
+        p = ec_glob_varint_get(p, &k);
+        p = ec_glob_varint_get(p, &len);
+        size_t end = k + len;
+        memcpy(path + k, p, len);
+        p += len;
+        if (k < valid || states[0] == NULL) {
+            states[0] = dfa->start == NULL ? ec_glob_dfa_start(dfa)
+                                           : dfa->start;
+            if (states[0] == NULL) goto oom;
+            valid = 0;
+            k = 0;
+        }
+
+        struct ec_glob_dfa_state *state = states[k];
+        for ( ; k < end && state->count > 0 ; k++) {
+            struct ec_glob_dfa_state *next =
+                    state->next[dfa->bytemap[path[k]]];
+            if (next == NULL) {
+                unsigned flushes = dfa->flushes;
+                next = ec_glob_dfa_step(dfa, state, path[k]);
+                if (next == NULL) goto oom;
+                if (flushes != dfa->flushes) valid = k + 1;
+            }
+            states[k + 1] = state = next;
+        }
+
+        if (state->count == 0) {
+            // no entry sharing this prefix can match
+            while (i + 1 < index->count) {
+                size_t shared;
+                const unsigned char *q = ec_glob_varint_get(p, &shared);
+                if (shared < k) break;
+                p = ec_glob_varint_get(q, &len) + len;
+                i++;
+            }
+        } else if (state->accept) {
+            if (set != NULL) {
+                memset(matches, 0, (set->count + 7) / 8);
+                ec_glob_set_matches(set, dfa, state, matches);
+            }
+            status = callback(index->ids[i], matches, data);
+        }
+    }
+    ec_glob_dealloc(allocator, states, scratch);
+    return status;
+
+oom:
+    ec_glob_dealloc(allocator, states, scratch);
+    errno = ENOMEM;
+    return -1;
+}
+
+/*
+ * Matches a pattern against every entry of the index with its own engine.
+ * Without a literal prefix there is little to prune, and the common shapes,
+ * the suffix prefilter or a native engine, which hardly backtracks, reject
+ * a path faster than the DFA steps through the rest of every entry.
+ */
+static int ec_glob_pathindex_scan(const struct ec_glob_pathindex_s *index,
+                                  const struct ec_glob_s *glob,
+                                  ec_glob_pathindex_fn callback, void *data) {
+    const struct ec_glob_allocator *allocator = &index->allocator;
+    char *path = ec_glob_alloc(allocator, index->max_len + 1);
+    if (path == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int status = 0;
+    const unsigned char *p = index->text;
+    for (size_t i = 0 ; i < index->count && status == 0 ; i++) {
+        size_t shared, len;
+        p = ec_glob_varint_get(p, &shared);
+        p = ec_glob_varint_get(p, &len);
+        memcpy(path + shared, p, len);
+        p += len;
+        int ret = ec_glob_match(glob, path, shared + len);
+        if (ret == 0) {
+            status = callback(index->ids[i], NULL, data);
+        } else if (ret != 1) {
+            errno = ENOMEM;
+            status = -1;
+        }
+    }
+    ec_glob_dealloc(allocator, path, index->max_len + 1);
+    return status;
+}
+
+int ec_glob_pathindex_match(const ec_glob_pathindex_t *index,
+                            const ec_glob_t *glob,
+                            ec_glob_pathindex_fn callback, void *data) {
+    if (glob->engine == ec_glob_engine_shape
+        || (glob->filter.prefix.count == 0
+            && (glob->engine != ec_glob_engine_dfa
+                || glob->filter.suffix.count != 0))) {
+        return ec_glob_pathindex_scan(index, glob, callback, data);
+    }
+    struct ec_glob_automaton *automaton = ec_glob_automaton_create(glob);
+    if (automaton == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int status = ec_glob_pathindex_run(index, automaton->dfa, NULL, NULL,
+                                       callback, data);
+    ec_glob_automaton_release(glob, automaton);
+    return status;
+}
+
+int ec_glob_pathindex_set_match(const ec_glob_pathindex_t *index,
+                                const ec_glob_set_t *set,
+                                ec_glob_pathindex_fn callback, void *data) {
+    size_t bytes = (set->count + 7) / 8 + 1;
+    unsigned char *matches = ec_glob_alloc(&set->allocator, bytes);
+    if (matches == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    struct ec_glob_dfa *dfa = ec_glob_dfa_create(&set->nfa,
+                                                 EC_GLOB_SET_CACHE_SIZE);
+    int status = -1;
+    if (dfa == NULL) {
+        errno = ENOMEM;
+    } else {
+        status = ec_glob_pathindex_run(index, dfa, set, matches,
+                                       callback, data);
+        ec_glob_dfa_destroy(dfa);
+    }
+    ec_glob_dealloc(&set->allocator, matches, bytes);
     return status;
 }
@@ -29,10 +29,948 @@
 #ifndef EC_GLOB_H
 #define EC_GLOB_H
 
+#include <stddef.h>
+
+/*
+ * When EC_GLOB_PREFIX is defined, all exported functions are prefixed with
+ * its value, so that differently configured builds can be linked into the
+ * same program.
+ */
+#ifdef EC_GLOB_PREFIX
+#define EC_GLOB_CONCAT_(prefix, name) prefix##name
+#define EC_GLOB_CONCAT(prefix, name) EC_GLOB_CONCAT_(prefix, name)
+#define ec_glob EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob)
+#define ec_glob_compile EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_compile)
+#define ec_glob_exec EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_exec)
+#define ec_glob_free EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_free)
+#define ec_glob_exec_ranges EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_exec_ranges)
+#define ec_glob_exec_batch EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_exec_batch)
+#define ec_glob_match_batch EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_match_batch)
+#define ec_glob_set_compile EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_compile)
+#define ec_glob_set_exec EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_exec)
+#define ec_glob_set_free EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_free)
+#define ec_glob_set_precompile EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_precompile)
+#define ec_glob_set_query EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_query)
+#define ec_glob_cache_configure EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_cache_configure)
+#define ec_glob_cache_clear EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_cache_clear)
+#define ec_glob_cache_query EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_cache_query)
+#define ec_glob_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_with)
+#define ec_glob_compile_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_compile_with)
+#define ec_glob_compile_using EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_compile_using)
+#define ec_glob_engine_name EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_engine_name)
+#define ec_glob_query EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_query)
+#define ec_glob_set_compile_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_compile_with)
+#define ec_glob_arena_init EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_arena_init)
+#define ec_glob_arena_allocator EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_arena_allocator)
+#define ec_glob_arena_used EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_arena_used)
+#define ec_glob_arena_reset EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_arena_reset)
+#define ec_glob_walk EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_walk)
+#define ec_glob_set_walk EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_walk)
+#define ec_glob_walk_parallel EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_walk_parallel)
+#define ec_glob_set_walk_parallel EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_set_walk_parallel)
+#define ec_glob_resolver_create EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_resolver_create)
+#define ec_glob_resolve EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_resolve)
+#define ec_glob_resolver_clear EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_resolver_clear)
+#define ec_glob_resolver_free EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_resolver_free)
+#define ec_glob_db_save EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_save)
+#define ec_glob_db_save_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_save_with)
+#define ec_glob_db_open EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_open)
+#define ec_glob_db_open_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_open_with)
+#define ec_glob_db_glob_count EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_glob_count)
+#define ec_glob_db_set_count EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_set_count)
+#define ec_glob_db_glob EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_glob)
+#define ec_glob_db_set EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_set)
+#define ec_glob_db_close EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_db_close)
+#define ec_glob_state_init EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_state_init)
+#define ec_glob_state_feed EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_state_feed)
+#define ec_glob_state_dead EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_state_dead)
+#define ec_glob_state_clone EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_state_clone)
+#define ec_glob_state_free EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_state_free)
+#define ec_glob_pathindex_create EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_create)
+#define ec_glob_pathindex_create_with EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_create_with)
+#define ec_glob_pathindex_size EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_size)
+#define ec_glob_pathindex_free EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_free)
+#define ec_glob_pathindex_match EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_match)
+#define ec_glob_pathindex_set_match EC_GLOB_CONCAT(EC_GLOB_PREFIX, ec_glob_pathindex_set_match)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
+
+/**
+ * Opaque type for a compiled glob pattern.
+ */
+typedef struct ec_glob_s ec_glob_t;
+
+/**
+ * Matches a string against an EditorConfig glob pattern.
+ *
+ * @param pattern the glob pattern
+ * @param string the string to match
+ * @return zero if the string matches, non-zero otherwise
+ */
 int ec_glob(const char * pattern, const char * string);
+
+/**
+ * Compiles a glob pattern for repeated matching with ec_glob_exec().
+ *
+ * @param glob a pointer where the compiled pattern shall be stored
+ * @param pattern the glob pattern
+ * @return zero on success, non-zero otherwise
+ * (in which case @p glob is set to @c NULL)
+ */
+int ec_glob_compile(ec_glob_t ** glob, const char * pattern);
+
+/**
+ * Matches a string against a compiled glob pattern.
+ *
+ * The compiled pattern is not modified, so it is safe to share it
+ * between threads.
+ *
+ * @param glob the compiled pattern
+ * @param string the string to match
+ * @return zero if the string matches, non-zero otherwise
+ */
+int ec_glob_exec(const ec_glob_t * glob, const char * string);
+
+/**
+ * Matches a string against a compiled glob pattern and reports the spans
+ * of its <code>{num1..num2}</code> groups.
+ *
+ * The span of the group with index @c i (counted from the left of the
+ * pattern) starts at @c spans[2*i] and ends before @c spans[2*i+1]. Both
+ * are <code>(size_t) -1</code> for a group which is not part of the match,
+ * like one within another alternative. When the string matches in several
+ * ways, the spans are those of one of them. The spans are recorded by the
+ * Pike VM, which builds its automaton on every call unless the pattern was
+ * compiled with the "pike" engine.
+ *
+ * @param glob the compiled pattern
+ * @param string the string to match
+ * @param spans room for two positions per group, which is only written
+ * when the string matches
+ * @param count the number of groups to report, any further groups are
+ * ignored
+ * @return zero if the string matches, non-zero otherwise
+ */
+int ec_glob_exec_ranges(const ec_glob_t * glob, const char * string,
+                        size_t * spans, unsigned count);
+
+/**
+ * Matches a compiled pattern against a packed array of strings.
+ *
+ * The strings are stored back to back in @p blob and need not be
+ * terminated. The string with index @c i starts at @c offsets[i] and ends
+ * before @c offsets[i+1], so @p offsets must contain @p count + 1 elements.
+ * The bit @c i%8 of byte @c i/8 in @p matches is set, when the string with
+ * index @c i matches, and cleared otherwise.
+ *
+ * @param glob the compiled pattern
+ * @param blob the packed strings
+ * @param offsets the offsets of the strings within the blob
+ * @param count the number of strings
+ * @param matches a bitset with room for at least one bit per string
+ * @return zero on success, non-zero otherwise
+ */
+int ec_glob_exec_batch(const ec_glob_t * glob, const char * blob,
+                       const size_t * offsets, size_t count,
+                       unsigned char * matches);
+
+/**
+ * Matches a pattern against a packed array of strings.
+ *
+ * The pattern is compiled only once.
+ * See ec_glob_exec_batch() for the layout of the arguments.
+ *
+ * @param pattern the glob pattern
+ * @param blob the packed strings
+ * @param offsets the offsets of the strings within the blob
+ * @param count the number of strings
+ * @param matches a bitset with room for at least one bit per string
+ * @return zero on success, non-zero if the pattern could not be compiled
+ */
+int ec_glob_match_batch(const char * pattern, const char * blob,
+                        const size_t * offsets, size_t count,
+                        unsigned char * matches);
+
+/**
+ * Releases the memory of a compiled pattern.
+ *
+ * @param glob the compiled pattern (may be @c NULL)
+ */
+void ec_glob_free(ec_glob_t * glob);
+
+/**
+ * Compiles a glob pattern with the named engine.
+ *
+ * The engines are "regex", "native", "dfa", "bitap", "pike" and "shape",
+ * where "shape" only accepts patterns of a common shape like
+ * <code>*.c</code>.
+ * With "auto" the engine is chosen for the pattern by a cost model,
+ * even in builds which select an engine, and with @c NULL the engine is
+ * chosen like with ec_glob_compile().
+ *
+ * @param glob a pointer where the compiled pattern shall be stored
+ * @param pattern the glob pattern
+ * @param engine the name of the engine or @c NULL
+ * @return zero on success, non-zero otherwise, including unknown engines
+ * (in which case @p glob is set to @c NULL)
+ */
+int ec_glob_compile_using(ec_glob_t ** glob, const char * pattern,
+                          const char * engine);
+
+/**
+ * Returns the name of the engine which matches a compiled pattern.
+ *
+ * @param glob the compiled pattern
+ * @return the name of the engine, as accepted by ec_glob_compile_using()
+ */
+const char * ec_glob_engine_name(const ec_glob_t * glob);
+
+/**
+ * Statistics of a compiled pattern.
+ */
+struct ec_glob_stats {
+    /** Number of tokens after the pattern was optimized. */
+    unsigned tokens;
+    /** Number of tokens where the matching may need to backtrack. */
+    unsigned backtracks;
+    /** Estimated memory used by the pattern and its engine. */
+    size_t bytes;
+};
+
+/**
+ * Retrieves the statistics of a compiled pattern.
+ *
+ * Before a pattern is compiled, choices are factored and flattened,
+ * duplicate alternatives are removed and runs of stars are merged,
+ * so that <code>{*.yaml,*.yml}</code> is matched like
+ * <code>*.y{a,}ml</code>. Patterns with num ranges are left unchanged.
+ *
+ * @param glob the compiled pattern
+ * @param stats the structure to fill
+ */
+void ec_glob_query(const ec_glob_t * glob, struct ec_glob_stats * stats);
+
+/**
+ * Opaque type for a set of compiled glob patterns.
+ */
+typedef struct ec_glob_set_s ec_glob_set_t;
+
+/**
+ * Compiles an ordered list of glob patterns into a single automaton.
+ *
+ * Patterns which cannot be compiled never match, like with ec_glob().
+ *
+ * @param set a pointer where the compiled set shall be stored
+ * @param patterns the glob patterns
+ * @param count the number of patterns
+ * @return zero on success, non-zero otherwise
+ * (in which case @p set is set to @c NULL)
+ */
+int ec_glob_set_compile(ec_glob_set_t ** set,
+                        const char * const * patterns, unsigned count);
+
+/**
+ * Matches a string against all patterns of a set with a single scan.
+ *
+ * The bit @c i%8 of byte @c i/8 in @p matches is set, when the pattern
+ * with index @c i matches the string.
+ *
+ * @param set the compiled set
+ * @param string the string to match
+ * @param matches a bitset with room for at least one bit per pattern
+ * @return the number of matching patterns, or a negative value on error
+ */
+int ec_glob_set_exec(const ec_glob_set_t * set, const char * string,
+                     unsigned char * matches);
+
+/**
+ * Releases the memory of a compiled set.
+ *
+ * @param set the compiled set (may be @c NULL)
+ */
+void ec_glob_set_free(ec_glob_set_t * set);
+
+/**
+ * Precompiles a set into a single minimized DFA.
+ *
+ * All states of the automaton are computed ahead of time and every state
+ * is labeled with the patterns matching there, so that ec_glob_set_exec()
+ * needs a single table lookup per byte and no lock. When the automaton
+ * has more states than the budget, it is not built, and the set is still
+ * matched by computing the states lazily.
+ *
+ * The set must not be used by other threads during this call.
+ *
+ * @param set the compiled set
+ * @param max_states the maximum number of states before the minimization,
+ * or zero for the default (at most 65535)
+ * @return zero on success, also when the budget was exceeded,
+ * non-zero when memory is exhausted
+ */
+int ec_glob_set_precompile(ec_glob_set_t * set, unsigned max_states);
+
+/**
+ * Statistics of a precompiled set, which are all zero when the set is
+ * matched lazily.
+ */
+struct ec_glob_set_stats {
+    /** Number of states of the DFA before the minimization. */
+    unsigned subset_states;
+    /** Number of states of the minimized DFA. */
+    unsigned states;
+    /** Number of distinct sets of matching patterns among the states. */
+    unsigned labels;
+    /** Number of classes of bytes the states distinguish. */
+    unsigned classes;
+    /** Memory used by the minimized DFA. */
+    size_t bytes;
+};
+
+/**
+ * Retrieves the statistics of a precompiled set.
+ *
+ * @param set the compiled set
+ * @param stats the structure to fill
+ */
+void ec_glob_set_query(const ec_glob_set_t * set,
+                       struct ec_glob_set_stats * stats);
+
+/**
+ * Statistics of the pattern cache used by ec_glob().
+ */
+struct ec_glob_cache_stats {
+    /** Number of calls which found their pattern in the cache. */
+    unsigned long hits;
+    /** Number of calls which had to compile their pattern. */
+    unsigned long misses;
+    /** Number of entries removed to satisfy the limits. */
+    unsigned long evictions;
+    /** Number of patterns currently cached. */
+    unsigned entries;
+    /** Estimated memory used by the cached patterns. */
+    size_t bytes;
+};
+
+/**
+ * Configures the pattern cache used by ec_glob().
+ *
+ * The cache is disabled by default. When enabled, ec_glob() keeps the
+ * compiled patterns and reuses them on subsequent calls with the same
+ * pattern. When a limit is exceeded, the least recently used patterns
+ * are evicted. The limits are distributed among the lock shards of the
+ * cache, so they are approximate.
+ *
+ * This function is thread-safe.
+ *
+ * @param max_entries the maximum number of cached patterns
+ * (zero disables the cache and releases all cached patterns)
+ * @param max_bytes the maximum estimated memory of the cached patterns
+ * @return zero on success, non-zero otherwise
+ */
+int ec_glob_cache_configure(unsigned max_entries, size_t max_bytes);
+
+/**
+ * Releases all cached patterns and resets the counters.
+ */
+void ec_glob_cache_clear(void);
+
+/**
+ * Retrieves the statistics of the pattern cache.
+ *
+ * @param stats the structure to fill
+ */
+void ec_glob_cache_query(struct ec_glob_cache_stats * stats);
+
+/**
+ * Memory allocator for compiled patterns and for the memory they need
+ * while matching.
+ *
+ * The sizes of previous allocations are passed back to @c realloc and
+ * @c free, so that simple allocators like arenas need no bookkeeping.
+ * Returning @c NULL reports exhausted memory, which the functions using
+ * the allocator report as an error instead of aborting the program.
+ *
+ * The regex engine allocates its compiled expressions internally
+ * with malloc(), which cannot be redirected.
+ */
+struct ec_glob_allocator {
+    /** Allocates memory, or returns @c NULL. */
+    void *(*alloc)(size_t size, void * ctx);
+    /** Resizes memory, or returns @c NULL (leaving @p ptr untouched). */
+    void *(*realloc)(void * ptr, size_t oldsize, size_t newsize, void * ctx);
+    /** Releases memory. */
+    void (*free)(void * ptr, size_t size, void * ctx);
+    /** Passed to every function of the allocator. */
+    void * ctx;
+};
+
+/**
+ * Like ec_glob(), but allocates the memory needed for the pattern with the
+ * given allocator. The pattern cache is not used.
+ *
+ * @param pattern the glob pattern
+ * @param string the string to match
+ * @param allocator the allocator (@c NULL for the standard library)
+ * @return zero if the string matches, non-zero otherwise
+ */
+int ec_glob_with(const char * pattern, const char * string,
+                 const struct ec_glob_allocator * allocator);
+
+/**
+ * Like ec_glob_compile(), but allocates all memory of the compiled pattern
+ * with the given allocator, including the memory needed by ec_glob_exec().
+ *
+ * The allocator is copied, its context must stay valid until the pattern
+ * is released with ec_glob_free().
+ *
+ * @param glob a pointer where the compiled pattern shall be stored
+ * @param pattern the glob pattern
+ * @param allocator the allocator (@c NULL for the standard library)
+ * @return zero on success, non-zero otherwise
+ * (in which case @p glob is set to @c NULL)
+ */
+int ec_glob_compile_with(ec_glob_t ** glob, const char * pattern,
+                         const struct ec_glob_allocator * allocator);
+
+/**
+ * Like ec_glob_set_compile(), but allocates all memory of the set
+ * with the given allocator, including the memory needed by
+ * ec_glob_set_exec().
+ *
+ * @param set a pointer where the compiled set shall be stored
+ * @param patterns the glob patterns
+ * @param count the number of patterns
+ * @param allocator the allocator (@c NULL for the standard library)
+ * @return zero on success, non-zero otherwise
+ * (in which case @p set is set to @c NULL)
+ */
+int ec_glob_set_compile_with(ec_glob_set_t ** set,
+                             const char * const * patterns, unsigned count,
+                             const struct ec_glob_allocator * allocator);
+
+/**
+ * Opaque type for a bump allocator on a contiguous region of memory.
+ */
+typedef struct ec_glob_arena_s ec_glob_arena_t;
+
+/**
+ * Creates an arena in the given memory region.
+ *
+ * The arena hands out the memory in order and only reclaims the most
+ * recent allocation when it is freed. Everything else is released at once
+ * with ec_glob_arena_reset(). Allocations are thread-safe, so the patterns
+ * compiled into the arena can be matched concurrently.
+ *
+ * @param mem the memory region (the arena keeps its state at the start)
+ * @param size the size of the memory region
+ * @return the arena, or @c NULL if the region is too small
+ */
+ec_glob_arena_t *ec_glob_arena_init(void * mem, size_t size);
+
+/**
+ * Fills an allocator which allocates from the arena.
+ *
+ * @param arena the arena
+ * @param allocator the allocator to fill
+ */
+void ec_glob_arena_allocator(ec_glob_arena_t * arena,
+                             struct ec_glob_allocator * allocator);
+
+/**
+ * Returns the number of bytes allocated from the arena.
+ *
+ * @param arena the arena
+ * @return the number of bytes in use
+ */
+size_t ec_glob_arena_used(const ec_glob_arena_t * arena);
+
+/**
+ * Releases all memory of the arena at once.
+ *
+ * Patterns and sets compiled into the arena must not be used afterwards.
+ * They should still be released with ec_glob_free() or ec_glob_set_free()
+ * before, which is cheap with an arena and releases what the regex engine
+ * and the locks may hold outside of the arena.
+ *
+ * @param arena the arena
+ */
+void ec_glob_arena_reset(ec_glob_arena_t * arena);
+
+/**
+ * Function called by the directory walkers for every matching entry.
+ *
+ * @param path the path of the entry relative to the root directory
+ * @param matches the bitset of the matching patterns, like with
+ * ec_glob_set_exec() (@c NULL for ec_glob_walk())
+ * @param data the pointer passed to the walker
+ * @return zero to continue the walk, non-zero to stop it
+ */
+typedef int (*ec_glob_walk_fn)(const char * path,
+                               const unsigned char * matches, void * data);
+
+/**
+ * Walks the directory tree below @p root and calls @p callback for every
+ * entry, which is not a directory and whose relative path matches the
+ * compiled pattern.
+ *
+ * Directories are only read, when a path below them can still match the
+ * pattern. For example, a pattern starting with @c src/ never reads other
+ * directories than @c src and @c *.c never reads any subdirectory,
+ * because it cannot match a slash. Symbolic links are
+ * reported like files and never followed. Subdirectories which cannot
+ * be opened are skipped.
+ *
+ * @param root the directory to walk
+ * @param glob the compiled pattern
+ * @param callback the function to call for every matching entry
+ * @param data passed to @p callback
+ * @return zero on success, the non-zero value of @p callback if it stopped
+ * the walk, or -1 if @p root cannot be read or memory is exhausted
+ * (in which case @c errno is set)
+ */
+int ec_glob_walk(const char * root, const ec_glob_t * glob,
+                 ec_glob_walk_fn callback, void * data);
+
+/**
+ * Like ec_glob_walk(), but for a set of patterns.
+ *
+ * A directory is read, when a path below it can match any of the patterns.
+ * The callback is invoked for entries which match at least one pattern.
+ *
+ * @param root the directory to walk
+ * @param set the compiled set
+ * @param callback the function to call for every matching entry
+ * @param data passed to @p callback
+ * @return zero on success, the non-zero value of @p callback if it stopped
+ * the walk, or -1 if @p root cannot be read or memory is exhausted
+ * (in which case @c errno is set)
+ */
+int ec_glob_set_walk(const char * root, const ec_glob_set_t * set,
+                     ec_glob_walk_fn callback, void * data);
+
+/**
+ * Options of the parallel directory walkers.
+ */
+struct ec_glob_walk_options {
+    /** The number of worker threads, 0 for one per online processor. */
+    unsigned threads;
+    /**
+     * Whether the entries shall be reported in the same order as by the
+     * sequential walker. Otherwise, they are reported as soon as they are
+     * found, in an order which differs from run to run.
+     */
+    int ordered;
+};
+
+/**
+ * Like ec_glob_walk(), but reads the directories with several threads.
+ *
+ * The worker threads share the compiled pattern and take the directories
+ * from each other, when they run out of work. The callback is always
+ * invoked on the calling thread, while the workers are still reading.
+ * If the pattern was compiled with a custom allocator, it must be
+ * thread-safe.
+ *
+ * @param root the directory to walk
+ * @param glob the compiled pattern
+ * @param options the options, or @c NULL for the defaults
+ * @param callback the function to call for every matching entry
+ * @param data passed to @p callback
+ * @return zero on success, the non-zero value of @p callback if it stopped
+ * the walk, or -1 if @p root cannot be read, memory is exhausted or no
+ * thread can be created (in which case @c errno is set)
+ */
+int ec_glob_walk_parallel(const char * root, const ec_glob_t * glob,
+                          const struct ec_glob_walk_options * options,
+                          ec_glob_walk_fn callback, void * data);
+
+/**
+ * Like ec_glob_walk_parallel(), but for a set of patterns.
+ *
+ * @param root the directory to walk
+ * @param set the compiled set
+ * @param options the options, or @c NULL for the defaults
+ * @param callback the function to call for every matching entry
+ * @param data passed to @p callback
+ * @return zero on success, the non-zero value of @p callback if it stopped
+ * the walk, or -1 if @p root cannot be read, memory is exhausted or no
+ * thread can be created (in which case @c errno is set)
+ */
+int ec_glob_set_walk_parallel(const char * root, const ec_glob_set_t * set,
+                              const struct ec_glob_walk_options * options,
+                              ec_glob_walk_fn callback, void * data);
+
+/**
+ * Opaque type for a resolver of EditorConfig properties.
+ */
+typedef struct ec_glob_resolver_s ec_glob_resolver_t;
+
+/**
+ * Function called by ec_glob_resolve() for every property of a file.
+ *
+ * @param name the lower case name of the property
+ * @param value the value of the property (lower case for the properties
+ * defined by the specification)
+ * @param data the pointer passed to ec_glob_resolve()
+ * @return zero to continue, non-zero to stop
+ */
+typedef int (*ec_glob_property_fn)(const char * name, const char * value,
+                                   void * data);
+
+/**
+ * Creates a resolver for the EditorConfig properties of files.
+ *
+ * The resolver remembers the configuration files of every directory it has
+ * seen, with their sections compiled into one pattern set per file. Changes
+ * of the files are only noticed after ec_glob_resolver_clear().
+ *
+ * @param resolver a pointer where the resolver shall be stored
+ * @param filename the name of the configuration files
+ * (@c NULL for @c .editorconfig)
+ * @param allocator the allocator for the resolver and its patterns
+ * (@c NULL for the standard library), which must be thread-safe if the
+ * resolver is used by several threads
+ * @return zero on success, or -1 if memory is exhausted
+ * (in which case @p resolver is set to @c NULL and @c errno is set)
+ */
+int ec_glob_resolver_create(ec_glob_resolver_t ** resolver,
+                            const char * filename,
+                            const struct ec_glob_allocator * allocator);
+
+/**
+ * Resolves the EditorConfig properties of a file.
+ *
+ * The configuration files are read from the directory of the file up to
+ * the root directory or the first file declaring @c root=true. Later
+ * sections override earlier ones, and closer files override those of
+ * parent directories. The defaults of @c indent_size and @c tab_width are
+ * derived as required by the specification.
+ *
+ * Only the first call for a directory reads files. This function is
+ * thread-safe, but @p callback must not call the resolver.
+ *
+ * @param resolver the resolver
+ * @param path the absolute path of the file
+ * @param callback the function to call for every property
+ * @param data passed to @p callback
+ * @return zero on success, the non-zero value of @p callback if it stopped,
+ * or -1 if @p path is not absolute or memory is exhausted
+ * (in which case @c errno is set)
+ */
+int ec_glob_resolve(ec_glob_resolver_t * resolver, const char * path,
+                    ec_glob_property_fn callback, void * data);
+
+/**
+ * Forgets all configuration files, so that they are read again.
+ *
+ * @param resolver the resolver
+ */
+void ec_glob_resolver_clear(ec_glob_resolver_t * resolver);
+
+/**
+ * Releases a resolver and all configuration files it has read.
+ *
+ * @param resolver the resolver (may be @c NULL)
+ */
+void ec_glob_resolver_free(ec_glob_resolver_t * resolver);
+
+/**
+ * Opaque type for a mapped database of compiled patterns.
+ */
+typedef struct ec_glob_db_s ec_glob_db_t;
+
+/**
+ * Writes compiled patterns and sets to a database file.
+ *
+ * The file stores the patterns in the form in which the engines use them,
+ * with offsets instead of pointers, so that ec_glob_db_open() can map it
+ * without parsing. It can only be opened by builds with the same layout of
+ * the compiled patterns on the same architecture. An existing file is
+ * replaced atomically.
+ *
+ * @param path the path of the database file
+ * @param globs the compiled patterns, retrieved by their index with
+ * ec_glob_db_glob()
+ * @param glob_count the number of patterns
+ * @param sets the compiled sets, retrieved by their index with
+ * ec_glob_db_set()
+ * @param set_count the number of sets
+ * @return zero on success, or -1 if the file cannot be written or memory
+ * is exhausted (in which case @c errno is set)
+ */
+int ec_glob_db_save(const char * path, const ec_glob_t * const * globs,
+                    unsigned glob_count, const ec_glob_set_t * const * sets,
+                    unsigned set_count);
+
+/**
+ * Like ec_glob_db_save(), but allocates the memory needed for writing the
+ * file with the given allocator.
+ *
+ * @param path the path of the database file
+ * @param globs the compiled patterns
+ * @param glob_count the number of patterns
+ * @param sets the compiled sets
+ * @param set_count the number of sets
+ * @param allocator the allocator (@c NULL for the standard library)
+ * @return zero on success, or -1 if the file cannot be written or memory
+ * is exhausted (in which case @c errno is set)
+ */
+int ec_glob_db_save_with(const char * path, const ec_glob_t * const * globs,
+                         unsigned glob_count,
+                         const ec_glob_set_t * const * sets,
+                         unsigned set_count,
+                         const struct ec_glob_allocator * allocator);
+
+/**
+ * Maps a database file written by ec_glob_db_save().
+ *
+ * The header is checked for the version, the layout, and a checksum of
+ * the contents. The entries are checked when they are loaded, so that a
+ * damaged file is rejected instead of being read out of bounds.
+ *
+ * @param db a pointer where the database shall be stored
+ * @param path the path of the database file
+ * @return zero on success, or -1 if the file cannot be mapped or is not a
+ * compatible database (in which case @c errno is set, to @c EINVAL for the
+ * latter, and @p db is set to @c NULL)
+ */
+int ec_glob_db_open(ec_glob_db_t ** db, const char * path);
+
+/**
+ * Like ec_glob_db_open(), but allocates the database and every pattern and
+ * set loaded from it with the given allocator.
+ *
+ * The allocator is copied, its context must stay valid until the database
+ * is closed with ec_glob_db_close().
+ *
+ * @param db a pointer where the database shall be stored
+ * @param path the path of the database file
+ * @param allocator the allocator (@c NULL for the standard library)
+ * @return zero on success, or -1 if the file cannot be mapped or is not a
+ * compatible database (in which case @c errno is set, to @c EINVAL for the
+ * latter, and @p db is set to @c NULL)
+ */
+int ec_glob_db_open_with(ec_glob_db_t ** db, const char * path,
+                         const struct ec_glob_allocator * allocator);
+
+/**
+ * Returns the number of compiled patterns in a database.
+ *
+ * @param db the database
+ * @return the number of patterns
+ */
+unsigned ec_glob_db_glob_count(const ec_glob_db_t * db);
+
+/**
+ * Returns the number of compiled sets in a database.
+ *
+ * @param db the database
+ * @return the number of sets
+ */
+unsigned ec_glob_db_set_count(const ec_glob_db_t * db);
+
+/**
+ * Loads a compiled pattern from a database.
+ *
+ * The pattern uses the mapped data in place and must be released with
+ * ec_glob_free() before the database is closed. Patterns which were
+ * compiled to a regular expression are matched by the native engine.
+ *
+ * @param db the database
+ * @param index the index of the pattern
+ * @param glob a pointer where the pattern shall be stored
+ * @return zero on success, or -1 if the index or the entry is invalid or
+ * memory is exhausted (in which case @c errno is set and @p glob is set to
+ * @c NULL)
+ */
+int ec_glob_db_glob(const ec_glob_db_t * db, unsigned index,
+                    ec_glob_t ** glob);
+
+/**
+ * Loads a compiled set from a database.
+ *
+ * The set uses the mapped data in place and must be released with
+ * ec_glob_set_free() before the database is closed.
+ *
+ * @param db the database
+ * @param index the index of the set
+ * @param set a pointer where the set shall be stored
+ * @return zero on success, or -1 if the index or the entry is invalid or
+ * memory is exhausted (in which case @c errno is set and @p set is set to
+ * @c NULL)
+ */
+int ec_glob_db_set(const ec_glob_db_t * db, unsigned index,
+                   ec_glob_set_t ** set);
+
+/**
+ * Unmaps a database.
+ *
+ * @param db the database (may be @c NULL)
+ */
+void ec_glob_db_close(ec_glob_db_t * db);
+
+/**
+ * Opaque type for the state of matching a path component by component.
+ */
+typedef struct ec_glob_state_s ec_glob_state_t;
+
+/**
+ * Creates a state for matching a path against a compiled pattern one
+ * component at a time.
+ *
+ * A walker can feed the components of a directory once, clone the state
+ * for every entry and only feed the name of the entry. The pattern must
+ * not be freed before all of its states.
+ *
+ * @param state a pointer where the state shall be stored
+ * @param glob the compiled pattern
+ * @return zero on success, non-zero otherwise
+ * (in which case @p state is set to @c NULL)
+ */
+int ec_glob_state_init(ec_glob_state_t ** state, const ec_glob_t * glob);
+
+/**
+ * Appends a component to the path of the state.
+ *
+ * Components are joined with a slash, so an empty first component stands
+ * for the leading slash of an absolute path.
+ *
+ * @param state the state
+ * @param component the path component
+ * @return zero if the path fed so far matches, non-zero otherwise, where
+ * @c REG_ESPACE means that the component could not be fed for lack of
+ * memory and the state is unchanged
+ */
+int ec_glob_state_feed(ec_glob_state_t * state, const char * component);
+
+/**
+ * Checks whether a path below the path of the state can still match.
+ *
+ * @param state the state
+ * @return non-zero if no path below the path fed so far can match
+ */
+int ec_glob_state_dead(const ec_glob_state_t * state);
+
+/**
+ * Copies a state, so that different components can be fed to both.
+ *
+ * @param clone a pointer where the copy shall be stored
+ * @param state the state to copy
+ * @return zero on success, non-zero otherwise
+ * (in which case @p clone is set to @c NULL)
+ */
+int ec_glob_state_clone(ec_glob_state_t ** clone,
+                        const ec_glob_state_t * state);
+
+/**
+ * Releases a state.
+ *
+ * @param state the state (may be @c NULL)
+ */
+void ec_glob_state_free(ec_glob_state_t * state);
+
+/**
+ * Opaque type for an index of paths.
+ */
+typedef struct ec_glob_pathindex_s ec_glob_pathindex_t;
+
+/**
+ * Function called by the path index matchers for every matching path.
+ *
+ * @param id the position of the path in the list the index was created from
+ * @param matches for the set matcher, the bitset of matching patterns like
+ * with ec_glob_set_exec() (@c NULL for ec_glob_pathindex_match())
+ * @param data the pointer passed to the matcher
+ * @return zero to continue, non-zero to stop matching
+ */
+typedef int (*ec_glob_pathindex_fn)(size_t id,
+                                    const unsigned char * matches,
+                                    void * data);
+
+/**
+ * Creates an index of paths for matching many patterns against them.
+ *
+ * The paths are sorted and stored with their common prefixes only once.
+ * The index does not refer to the paths after it was created.
+ *
+ * @param index a pointer where the index shall be stored
+ * @param paths the paths
+ * @param count the number of paths
+ * @return zero on success, -1 with @c errno set otherwise
+ * (in which case @p index is set to @c NULL)
+ */
+int ec_glob_pathindex_create(ec_glob_pathindex_t ** index,
+                             const char * const * paths, size_t count);
+
+/**
+ * Like ec_glob_pathindex_create(), but takes all memory of the index,
+ * including the scratch memory of its matchers, from the allocator.
+ *
+ * @param index a pointer where the index shall be stored
+ * @param paths the paths
+ * @param count the number of paths
+ * @param allocator the allocator, or @c NULL for the standard allocator
+ * @return zero on success, -1 with @c errno set otherwise
+ * (in which case @p index is set to @c NULL)
+ */
+int ec_glob_pathindex_create_with(ec_glob_pathindex_t ** index,
+                                  const char * const * paths, size_t count,
+                                  const struct ec_glob_allocator * allocator);
+
+/**
+ * Returns the memory used by an index in bytes.
+ *
+ * @param index the index
+ * @return the size of the index
+ */
+size_t ec_glob_pathindex_size(const ec_glob_pathindex_t * index);
+
+/**
+ * Releases an index.
+ *
+ * @param index the index (may be @c NULL)
+ */
+void ec_glob_pathindex_free(ec_glob_pathindex_t * index);
+
+/**
+ * Calls the callback with the id of every path in the index which matches
+ * the compiled pattern, in the sorted order of the paths.
+ *
+ * Every prefix shared by several paths is matched only once, and all paths
+ * below a prefix which no longer can match are skipped. Patterns without a
+ * literal prefix, which hardly prune, are matched path by path with their
+ * engine instead.
+ *
+ * @param index the index
+ * @param glob the compiled pattern
+ * @param callback the function called for every matching path
+ * @param data a pointer passed to the callback
+ * @return zero on success, the non-zero result of the callback which stopped
+ * matching, or -1 with @c errno set when memory is exhausted
+ */
+int ec_glob_pathindex_match(const ec_glob_pathindex_t * index,
+                            const ec_glob_t * glob,
+                            ec_glob_pathindex_fn callback, void * data);
+
+/**
+ * Like ec_glob_pathindex_match(), but for a set of patterns.
+ *
+ * The callback is called for every path matched by any of the patterns.
+ *
+ * @param index the index
+ * @param set the compiled set
+ * @param callback the function called for every matching path
+ * @param data a pointer passed to the callback
+ * @return zero on success, the non-zero result of the callback which stopped
+ * matching, or -1 with @c errno set when memory is exhausted
+ */
+int ec_glob_pathindex_set_match(const ec_glob_pathindex_t * index,
+                                const ec_glob_set_t * set,
+                                ec_glob_pathindex_fn callback, void * data);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -30,12 +30,55 @@
 
 #include "test.h"
 
+#include <time.h>
+
 // https://github.com/editorconfig/editorconfig-core-c/issues/101
 #define TEST_EXCLUDE_EDITORCONFIG_CORE_C_BUG_101
 
 // https://github.com/editorconfig/editorconfig-core-c/issues/102
 #define TEST_EXCLUDE_EDITORCONFIG_CORE_C_BUG_102
 
+#ifdef TEST_COMPILED
+// run the same test cases through the compile-once API
+static int ec_glob_compiled(const char *pattern, const char *str) {
+    ec_glob_t *glob;
+    int status = ec_glob_compile(&glob, pattern);
+    if (status == 0) {
+        status = ec_glob_exec(glob, str);
+        // a second run must yield the same result
+        if (status != ec_glob_exec(glob, str)) status = -1;
+        // and so must the Pike VM, with or without the spans
+        size_t spans[8];
+        if ((status == 0) != (ec_glob_exec_ranges(glob, str, spans, 4) == 0)) {
+            status = -1;
+        }
+        ec_glob_free(glob);
+        if (status != -1 && ec_glob_compile_using(&glob, pattern, "pike") == 0) {
+            if ((status == 0) != (ec_glob_exec(glob, str) == 0)) status = -1;
+            ec_glob_free(glob);
+        }
+    }
+    return status;
+}
+#define ec_glob ec_glob_compiled
+#endif
+
+#ifdef TEST_SHAPES
+// compare every result with the regex backend without specializations
+int regex_ec_glob(const char *pattern, const char *str);
+static unsigned shape_mismatches;
+static int ec_glob_verified(const char *pattern, const char *str) {
+    int status = ec_glob(pattern, str);
+    if ((status == 0) != (regex_ec_glob(pattern, str) == 0)) {
+        fprintf(stderr, "Mismatch for pattern %s and string %s\n",
+                pattern, str);
+        shape_mismatches++;
+    }
+    return status;
+}
+#define ec_glob ec_glob_verified
+#endif
+
 #define assert_ec_glob_true(str) CX_TEST_ASSERT(0 == ec_glob(pattern, str))
 #define assert_ec_glob_false(str) CX_TEST_ASSERT(0 != ec_glob(pattern, str))
 
@@ -205,6 +248,51 @@ CX_TEST(test_num_range_in_file_extension) {
     }
 }
 
+CX_TEST(test_many_num_ranges) {
+    // more num ranges than any fixed number of capture groups
+    char pattern[40 * 7];
+    char match[40 * 3], mismatch[40 * 3];
+    for (unsigned i = 0 ; i < 40 ; i++) {
+        memcpy(pattern + 7 * i, "{0..2}.", 7);
+        memcpy(match + 3 * i, i % 2 ? "+1." : "02.", 3);
+        memcpy(mismatch + 3 * i, i == 39 ? "03." : "-0.", 3);
+    }
+    pattern[40 * 7 - 1] = match[40 * 3 - 1] = mismatch[40 * 3 - 1] = '\0';
+    CX_TEST_DO {
+        assert_ec_glob_true(match);
+        assert_ec_glob_false(mismatch);
+    }
+}
+
+#ifndef TEST_REFERENCE
+CX_TEST(test_num_range_digit_prefix) {
+    const char *pattern = "{1..3}*";
+    CX_TEST_DO {
+        // unlike the reference implementation, the remaining digits
+        // of the number are left to the wildcard
+        assert_ec_glob_true("2");
+        assert_ec_glob_true("12");
+        assert_ec_glob_true("+3x");
+
+        assert_ec_glob_false("42");
+        assert_ec_glob_false("-12");
+
+        pattern = "a{10..20}{0,1}";
+        assert_ec_glob_true("a150");
+        assert_ec_glob_true("a201");
+
+        assert_ec_glob_false("a15");
+        assert_ec_glob_false("a152");
+
+        // followed by a non-digit, the whole number must be in the range
+        pattern = "*.{1..3}.txt";
+        assert_ec_glob_true("x.3.txt");
+
+        assert_ec_glob_false("x.12.txt");
+    }
+}
+#endif
+
 CX_TEST(test_escaped_slash_in_brackets) {
     const char *pattern = "ab[e\\/]cd.i";
     CX_TEST_DO {
@@ -233,6 +321,19 @@ CX_TEST(test_auto_escape_bracket_and_minus_in_brackets) {
     }
 }
 
+CX_TEST(test_empty_range_in_brackets) {
+    const char *pattern = "[b-*]a*";
+    CX_TEST_DO {
+        // a reversed range leaves the class without members
+        assert_ec_glob_false("");
+        assert_ec_glob_false("a");
+        assert_ec_glob_false("ba");
+        assert_ec_glob_false("*a");
+        assert_ec_glob_false("-a");
+        assert_ec_glob_false("[b-*]a");
+    }
+}
+
 #ifndef TEST_EXCLUDE_EDITORCONFIG_CORE_C_BUG_101
 CX_TEST(test_wildcard_in_brackets) {
     const char *pattern = "ab[e*]cd.i";
@@ -756,9 +857,1555 @@ CX_TEST(test_core_braces_16) {
     }
 }
 
+// a one-shot match must not backtrack over several wildcards
+CX_TEST(test_backtracking_time) {
+    const char *pattern = "*a*a*a*a*[bc]";
+    char string[402];
+    memset(string, 'a', 400);
+    string[400] = '\0';
+    struct timespec start, end;
+    CX_TEST_DO {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        assert_ec_glob_false(string);
+        strcpy(string + 400, "c");
+        assert_ec_glob_true(string);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        CX_TEST_ASSERT(end.tv_sec - start.tv_sec < 2);
+    }
+}
+
+// one pattern for every specialized shape
+CX_TEST(test_shapes) {
+    const char *pattern;
+    CX_TEST_DO {
+        pattern = "*";
+        assert_ec_glob_true("");
+        assert_ec_glob_true("main.c");
+        assert_ec_glob_false("src/main.c");
+        pattern = "*.{c,h}";
+        assert_ec_glob_true("main.c");
+        assert_ec_glob_true(".h");
+        assert_ec_glob_false("main.cc");
+        assert_ec_glob_false("src/main.c");
+        pattern = "**/*";
+        assert_ec_glob_true("src/");
+        assert_ec_glob_true("src/main.c");
+        assert_ec_glob_false("main.c");
+        pattern = "**/*.txt";
+        assert_ec_glob_true("a/b/c.txt");
+        assert_ec_glob_true("a/.txt");
+        assert_ec_glob_false("a.txt/b");
+        assert_ec_glob_false("a.txt");
+        pattern = "**/{package.json,.travis.yml}";
+        assert_ec_glob_true("lib/package.json");
+        assert_ec_glob_true("a/b/.travis.yml");
+        assert_ec_glob_false("package.json");
+        assert_ec_glob_false("lib/xpackage.json");
+        pattern = "{Makefile,GNUmakefile}";
+        assert_ec_glob_true("Makefile");
+        assert_ec_glob_true("GNUmakefile");
+        assert_ec_glob_false("Makefile.am");
+        assert_ec_glob_false("src/Makefile");
+        pattern = "{src,lib}/**";
+        assert_ec_glob_true("src/");
+        assert_ec_glob_true("lib/a/b.c");
+        assert_ec_glob_false("src");
+        assert_ec_glob_false("test/src/a.c");
+    }
+}
+
+#ifdef TEST_COMPILED
+// checks that the pattern is optimized into as many tokens as the other
+static _Bool same_tokens(const char *pattern, const char *optimized) {
+    ec_glob_t *a, *b;
+    struct ec_glob_stats x, y;
+    if (ec_glob_compile(&a, pattern) != 0) return 0;
+    if (ec_glob_compile(&b, optimized) != 0) {
+        ec_glob_free(a);
+        return 0;
+    }
+    ec_glob_query(a, &x);
+    ec_glob_query(b, &y);
+    ec_glob_free(a);
+    ec_glob_free(b);
+    return x.tokens == y.tokens && x.backtracks == y.backtracks;
+}
+#endif
+
+// patterns the optimizer rewrites
+CX_TEST(test_optimizer) {
+    const char *pattern;
+    CX_TEST_DO {
+        pattern = "{*.yaml,*.yml}";
+        assert_ec_glob_true("a.yaml");
+        assert_ec_glob_true(".yml");
+        assert_ec_glob_false("a.yl");
+        assert_ec_glob_false("a.yamlml");
+        assert_ec_glob_false("a/b.yml");
+        pattern = "**/**/*.c";
+        assert_ec_glob_true("a/b.c");
+        assert_ec_glob_true("a/b/c/d.c");
+        assert_ec_glob_false("b.c");
+        assert_ec_glob_false("a/b.h");
+        pattern = "{a,{b,{c}}}";
+        assert_ec_glob_true("a");
+        assert_ec_glob_true("b");
+        assert_ec_glob_true("{c}");
+        assert_ec_glob_false("c");
+        pattern = "{a,a,b}";
+        assert_ec_glob_true("a");
+        assert_ec_glob_true("b");
+        assert_ec_glob_false("aa");
+        pattern = "{a*,a*}{,x}";
+        assert_ec_glob_true("a");
+        assert_ec_glob_true("abx");
+        assert_ec_glob_false("b");
+        pattern = "*{*.c,*.h}";
+        assert_ec_glob_true("a.c");
+        assert_ec_glob_true(".h");
+        assert_ec_glob_false("a/b.h");
+        pattern = "{**/x,*/x,x}";
+        assert_ec_glob_true("x");
+        assert_ec_glob_true("a/x");
+        assert_ec_glob_true("a/b/x");
+        assert_ec_glob_false("ax");
+        pattern = "{src/*.js,src/*.jsx,src/*.ts,test/*.ts}";
+        assert_ec_glob_true("src/a.jsx");
+        assert_ec_glob_true("src/a.ts");
+        assert_ec_glob_true("test/a.ts");
+        assert_ec_glob_false("test/a.js");
+        assert_ec_glob_false("src/a.j");
+        pattern = "{ab{c,d},ab{e,c}}";
+        assert_ec_glob_true("abc");
+        assert_ec_glob_true("abe");
+        assert_ec_glob_false("ab");
+        pattern = "{a,}{,}";
+        assert_ec_glob_true("a");
+        assert_ec_glob_true("");
+#ifdef TEST_COMPILED
+        CX_TEST_ASSERT(same_tokens("{*.yaml,*.yml}", "*.y{a,}ml"));
+        CX_TEST_ASSERT(same_tokens("**/**/*.c", "**/*.c"));
+        CX_TEST_ASSERT(same_tokens("**/**/**", "**/*"));
+        CX_TEST_ASSERT(same_tokens("***.c", "**.c"));
+        CX_TEST_ASSERT(same_tokens("{a,{b,{c}}}", "{a,b,\\{c\\}}"));
+        CX_TEST_ASSERT(same_tokens("{a,a,b}", "{a,b}"));
+        CX_TEST_ASSERT(same_tokens("{a,{a,a}}", "a"));
+        CX_TEST_ASSERT(same_tokens("{ab{c,d},ab{e,c}}", "ab{c,d,e}"));
+        CX_TEST_ASSERT(same_tokens("{*.abcd,*.abce,f}", "{*.abc{d,e},f}"));
+        // plain strings are matched as set, and num ranges keep their spans
+        CX_TEST_ASSERT(same_tokens("{abcd,abce,f}", "{abcd,abce,f}"));
+        CX_TEST_ASSERT(same_tokens("{{1..3},{1..3}}", "{{1..3},{1..3}}"));
+
+        // the simplified pattern has a common shape
+        ec_glob_t *glob;
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "**/**/*.c", "shape"));
+        CX_TEST_ASSERT(0 == ec_glob_exec(glob, "src/main.c"));
+        ec_glob_free(glob);
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "{*.yaml,*.yml}",
+                                                  "shape"));
+        ec_glob_free(glob);
+#endif
+    }
+}
+
+#ifdef TEST_COMPILED
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+
+static const char *set_patterns[] = {
+        "*",
+        "*.{c,h}",
+        "**/*.{c,h}",
+        "src/**",
+        "Makefile",
+        "{,9",
+        "**/*.orig.{0..9}",
+        "[!a-m]*.txt",
+};
+static const unsigned set_count = sizeof(set_patterns) / sizeof(set_patterns[0]);
+
+// the result of the set must agree with the individual patterns
+CX_TEST_SUBROUTINE(verify_ec_glob_set, ec_glob_set_t *set, const char *str) {
+    unsigned char matches[(sizeof(set_patterns) / sizeof(set_patterns[0]) + 7) / 8];
+    int count = ec_glob_set_exec(set, str, matches);
+    int expected = 0;
+    for (unsigned i = 0 ; i < set_count ; i++) {
+        _Bool match = 0 == ec_glob(set_patterns[i], str);
+        expected += match;
+        CX_TEST_ASSERT(match == ((matches[i / 8] >> (i % 8)) & 1));
+    }
+    CX_TEST_ASSERT(count == expected);
+}
+
+CX_TEST(test_set) {
+    ec_glob_set_t *set;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, set_patterns, set_count));
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "main.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "src/main.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "src/lib/util.h");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "Makefile");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "src/Makefile");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "{,9");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "a/b.orig.7");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "a/b.orig.10");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "notes.txt");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "docs/notes.txt");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "");
+        ec_glob_set_free(set);
+    }
+}
+
+// the minimized DFA must agree with the lazy one, also within a budget
+CX_TEST(test_set_precompile) {
+    static const char *names[] = {
+            "main.c", "util.h", "Makefile", "{,9", "b.orig.7", "b.orig.10",
+            "notes.txt", "zap.txt", ".c", "",
+    };
+    static const char *dirs[] = { "", "src/", "src/lib/", "docs/", "a/src/" };
+    ec_glob_set_t *set;
+    struct ec_glob_set_stats stats;
+    char path[64];
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, set_patterns, set_count));
+        ec_glob_set_query(set, &stats);
+        CX_TEST_ASSERT(stats.states == 0 && stats.bytes == 0);
+        CX_TEST_ASSERT(0 == ec_glob_set_precompile(set, 0));
+        ec_glob_set_query(set, &stats);
+        CX_TEST_ASSERT(stats.states > 1);
+        CX_TEST_ASSERT(stats.states <= stats.subset_states);
+        CX_TEST_ASSERT(stats.labels > 1 && stats.labels <= stats.states);
+        CX_TEST_ASSERT(stats.bytes > stats.states * stats.classes);
+        for (unsigned budget = 0 ; budget < 2 ; budget++) {
+            for (unsigned d = 0 ; d < sizeof(dirs) / sizeof(dirs[0]) ; d++) {
+                for (unsigned i = 0 ; i < sizeof(names) / sizeof(names[0]) ;
+                     i++) {
+                    strcpy(path, dirs[d]);
+                    strcat(path, names[i]);
+                    CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, path);
+                }
+            }
+            // too many states fall back to the lazy DFA
+            CX_TEST_ASSERT(0 == ec_glob_set_precompile(set, 3));
+            ec_glob_set_query(set, &stats);
+            CX_TEST_ASSERT(stats.states == 0 && stats.bytes == 0);
+        }
+        ec_glob_set_free(set);
+
+        // the minimization merges the states of equivalent patterns
+        static const char *same[] = { "*.c", "*.[c]", "{*.c,*.c}" };
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, same, 3));
+        CX_TEST_ASSERT(0 == ec_glob_set_precompile(set, 0));
+        ec_glob_set_query(set, &stats);
+        CX_TEST_ASSERT(stats.labels == 2);
+        CX_TEST_ASSERT(stats.states == 4);
+        unsigned char matches[1];
+        CX_TEST_ASSERT(3 == ec_glob_set_exec(set, "main.c", matches));
+        CX_TEST_ASSERT(matches[0] == 7);
+        CX_TEST_ASSERT(0 == ec_glob_set_exec(set, "src/main.c", matches));
+        CX_TEST_ASSERT(matches[0] == 0);
+        ec_glob_set_free(set);
+    }
+}
+
+// the paths are packed without separators, so that none is terminated
+CX_TEST_SUBROUTINE(verify_ec_glob_batch, const char *pattern) {
+    static const char *strs[] = {
+            "main.c", "src/main.c", "src/lib/util.h", "Makefile", "", "a.c",
+            "src/Makefile", "x.orig.7", "notes.txt", "test.c.orig.11", "c",
+    };
+    const size_t count = sizeof(strs) / sizeof(strs[0]);
+    char blob[256];
+    size_t offsets[sizeof(strs) / sizeof(strs[0]) + 1];
+    offsets[0] = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+        size_t len = strlen(strs[i]);
+        memcpy(blob + offsets[i], strs[i], len);
+        offsets[i + 1] = offsets[i] + len;
+    }
+    unsigned char matches[2] = {0xFF, 0xFF};
+    CX_TEST_ASSERT(0 == ec_glob_match_batch(pattern, blob, offsets, count,
+                                            matches));
+    for (size_t i = 0 ; i < count ; i++) {
+        _Bool match = 0 == ec_glob(pattern, strs[i]);
+        CX_TEST_ASSERT(match == ((matches[i / 8] >> (i % 8)) & 1));
+    }
+    // bits beyond the last string are cleared
+    CX_TEST_ASSERT(0 == (matches[1] >> (count % 8)));
+}
+
+CX_TEST(test_batch) {
+    CX_TEST_DO {
+        for (unsigned i = 0 ; i < set_count ; i++) {
+            CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, set_patterns[i]);
+        }
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, "*.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, "**.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, "*.orig.{0..10}");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, "**/*.{c,h}");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch, "?");
+    }
+}
+
+// enough paths of different lengths to refill the lanes of the batches
+CX_TEST_SUBROUTINE(verify_ec_glob_batch_lanes, const char *pattern) {
+    static const char *names[] = {
+            "main.c", "Makefile", "", "util.h", "x.orig.7", "c", "notes.txt",
+    };
+    enum { count = 200 };
+    static char blob[count * 96];
+    size_t offsets[count + 1];
+    char path[96];
+    offsets[0] = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+        path[0] = '\0';
+        for (size_t d = 0 ; d < i % 19 ; d++) {
+            strcat(path, d % 3 ? "lib/" : "src/");
+        }
+        strcat(path, names[i % 7]);
+        size_t len = strlen(path);
+        memcpy(blob + offsets[i], path, len);
+        offsets[i + 1] = offsets[i] + len;
+    }
+    unsigned char matches[count / 8];
+    CX_TEST_ASSERT(0 == ec_glob_match_batch(pattern, blob, offsets, count,
+                                            matches));
+    for (size_t i = 0 ; i < count ; i++) {
+        memcpy(path, blob + offsets[i], offsets[i + 1] - offsets[i]);
+        path[offsets[i + 1] - offsets[i]] = '\0';
+        _Bool match = 0 == ec_glob(pattern, path);
+        CX_TEST_ASSERT(match == ((matches[i / 8] >> (i % 8)) & 1));
+    }
+
+    // the lanes are used whichever engine matches single paths
+    static const char *engines[] = {
+            "regex", "native", "dfa", "bitap", "pike", "auto"
+    };
+    for (unsigned e = 0 ; e < sizeof(engines) / sizeof(engines[0]) ; e++) {
+        ec_glob_t *glob;
+        unsigned char others[count / 8];
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, pattern, engines[e]));
+        CX_TEST_ASSERT(0 == ec_glob_exec_batch(glob, blob, offsets, count,
+                                               others));
+        CX_TEST_ASSERT(0 == memcmp(matches, others, count / 8));
+        ec_glob_free(glob);
+    }
+}
+
+CX_TEST(test_batch_lanes) {
+    CX_TEST_DO {
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "**/*.{c,h}");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "src/**/*.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "*/{lib,src}/*");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "**Makefile");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "**/*.orig.{0..9}");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes, "{,**/}");
+        // too many positions for the lanes
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_batch_lanes,
+                "{src,lib}/**/{main.c,util.h,notes.txt,Makefile,x.orig.{0..9},"
+                "README.md,CHANGELOG.txt,configure.ac}");
+    }
+}
+
+// an allocator with a limit, which checks that all memory is given back
+struct test_allocator {
+    size_t limit;
+    size_t used;
+    unsigned live;
+};
+
+static void *test_alloc(size_t size, void *ctx) {
+    struct test_allocator *a = ctx;
+    if (a->used + size > a->limit) return NULL;
+    void *mem = malloc(size);
+    if (mem != NULL) {
+        a->used += size;
+        a->live++;
+    }
+    return mem;
+}
+
+static void *test_realloc(void *ptr, size_t oldsize, size_t newsize,
+                          void *ctx) {
+    struct test_allocator *a = ctx;
+    if (a->used - oldsize + newsize > a->limit) return NULL;
+    void *mem = realloc(ptr, newsize);
+    if (mem != NULL) {
+        a->used = a->used - oldsize + newsize;
+    }
+    return mem;
+}
+
+static void test_free(void *ptr, size_t size, void *ctx) {
+    struct test_allocator *a = ctx;
+    a->used -= size;
+    a->live--;
+    free(ptr);
+}
+
+CX_TEST(test_allocator) {
+    struct test_allocator a;
+    struct ec_glob_allocator allocator = {
+            test_alloc, test_realloc, test_free, &a
+    };
+    // long enough to need heap memory for every engine
+    const char *pattern = "**/{alpha,beta,gamma,delta}/*.{c,h,cpp,hpp}.{1..99}";
+    CX_TEST_DO {
+        // every failed allocation is reported and nothing is leaked
+        int status = 1;
+        ec_glob_set_t *set = NULL;
+        for (a.limit = 0 ; status != 0 ; a.limit += 64) {
+            a.used = a.live = 0;
+            status = ec_glob_set_compile_with(&set, set_patterns, set_count,
+                                              &allocator);
+            CX_TEST_ASSERT(status == 0 || (set == NULL && a.live == 0));
+        }
+        // matching may need more memory
+        a.limit = (size_t) -1;
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "src/main.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "a/b.orig.7");
+        ec_glob_set_free(set);
+        CX_TEST_ASSERT(a.live == 0 && a.used == 0);
+
+        ec_glob_t *glob = NULL;
+        status = 1;
+        for (a.limit = 0 ; status != 0 ; a.limit += 64) {
+            a.used = a.live = 0;
+            status = ec_glob_compile_with(&glob, pattern, &allocator);
+            CX_TEST_ASSERT(status == 0 || (glob == NULL && a.live == 0));
+        }
+        a.limit = (size_t) -1;
+        CX_TEST_ASSERT(0 == ec_glob_exec(glob, "src/beta/util.hpp.42"));
+        CX_TEST_ASSERT(0 != ec_glob_exec(glob, "src/beta/util.hpp.100"));
+        ec_glob_free(glob);
+        CX_TEST_ASSERT(a.live == 0 && a.used == 0);
+
+        CX_TEST_ASSERT(0 == ec_glob_with(pattern, "src/alpha/x.c.1",
+                                         &allocator));
+        CX_TEST_ASSERT(0 != ec_glob_with(pattern, "src/alpha/x.c.0",
+                                         &allocator));
+        CX_TEST_ASSERT(a.live == 0 && a.used == 0);
+    }
+}
+
+CX_TEST(test_arena) {
+    static long region[4096];
+    ec_glob_arena_t *arena = ec_glob_arena_init(region, sizeof(region));
+    struct ec_glob_allocator allocator;
+    ec_glob_arena_allocator(arena, &allocator);
+    ec_glob_set_t *set;
+    ec_glob_t *glob;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(NULL == ec_glob_arena_init(region, 8));
+        CX_TEST_ASSERT(0 == ec_glob_set_compile_with(&set, set_patterns,
+                                                     set_count, &allocator));
+        CX_TEST_ASSERT(ec_glob_arena_used(arena) > 0);
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "main.c");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "src/lib/util.h");
+        CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, "notes.txt");
+        ec_glob_set_free(set);
+
+        // batches allocate nothing after the compilation
+        char blob[32 * 16];
+        size_t offsets[33] = { 0 };
+        unsigned char matches[4];
+        for (unsigned i = 0 ; i < 32 ; i++) {
+            offsets[i + 1] = offsets[i]
+                    + sprintf(blob + offsets[i], "dir/file%u.c", i);
+        }
+        CX_TEST_ASSERT(0 == ec_glob_compile_with(&glob, "dir/file{1..20}.c",
+                                                 &allocator));
+        size_t used = ec_glob_arena_used(arena);
+        for (unsigned i = 0 ; i < 100 ; i++) {
+            CX_TEST_ASSERT(0 == ec_glob_exec_batch(glob, blob, offsets, 32,
+                                                   matches));
+        }
+        CX_TEST_ASSERT(used == ec_glob_arena_used(arena));
+        CX_TEST_ASSERT(matches[0] == 0xFE && matches[1] == 0xFF
+                       && matches[2] == 0x1F && matches[3] == 0);
+        ec_glob_free(glob);
+        ec_glob_arena_reset(arena);
+        CX_TEST_ASSERT(0 == ec_glob_arena_used(arena));
+
+        // running out of arena memory is reported as an error
+        arena = ec_glob_arena_init(region, 256);
+        ec_glob_arena_allocator(arena, &allocator);
+        CX_TEST_ASSERT(0 != ec_glob_set_compile_with(&set, set_patterns,
+                                                     set_count, &allocator));
+        CX_TEST_ASSERT(NULL == set);
+    }
+}
+
+static int count_walked(const char *path, const unsigned char *matches,
+                        void *data) {
+    (void) path;
+    unsigned *count = data;
+    count[0]++;
+    for (unsigned i = 0 ; matches != NULL && i < 8 ; i++) {
+        count[1] += (matches[0] >> i) & 1;
+    }
+    return 0;
+}
+
+static int stop_walk(const char *path, const unsigned char *matches,
+                     void *data) {
+    (void) path;
+    (void) matches;
+    (void) data;
+    return 42;
+}
+
+static int collect_walked(const char *path, const unsigned char *matches,
+                          void *data) {
+    (void) matches;
+    char *paths = data;
+    size_t len = strlen(paths);
+    snprintf(paths + len, 256 - len, "%s;", path);
+    return 0;
+}
+
+CX_TEST(test_walk) {
+    static const char *dirs[] = {"src", "src/lib", "docs"};
+    static const char *files[] = {"src/a.c", "src/lib/b.c", "docs/c.md", "d.c"};
+    char root[] = "/tmp/ec_glob_walk_XXXXXX";
+    char path[64];
+    CX_TEST_DO {
+        CX_TEST_ASSERT(NULL != mkdtemp(root));
+        for (unsigned i = 0 ; i < 3 ; i++) {
+            snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+            CX_TEST_ASSERT(0 == mkdir(path, 0700));
+        }
+        for (unsigned i = 0 ; i < 4 ; i++) {
+            snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+            FILE *f = fopen(path, "w");
+            CX_TEST_ASSERT(f != NULL);
+            fclose(f);
+        }
+
+        ec_glob_t *glob;
+        unsigned count[2] = {0, 0};
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "src/**/*.c"));
+        CX_TEST_ASSERT(0 == ec_glob_walk(root, glob, count_walked, count));
+        CX_TEST_ASSERT(count[0] == 2);
+        CX_TEST_ASSERT(42 == ec_glob_walk(root, glob, stop_walk, NULL));
+        ec_glob_free(glob);
+
+        count[0] = 0;
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "**.c"));
+        CX_TEST_ASSERT(0 == ec_glob_walk(root, glob, count_walked, count));
+        CX_TEST_ASSERT(count[0] == 3);
+        ec_glob_free(glob);
+
+        ec_glob_set_t *set;
+        const char *patterns[] = {"*.c", "**.c", "docs/*"};
+        count[0] = 0;
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, patterns, 3));
+        CX_TEST_ASSERT(0 == ec_glob_set_walk(root, set, count_walked, count));
+        // d.c matches two patterns, the others only one
+        CX_TEST_ASSERT(count[0] == 4 && count[1] == 5);
+        CX_TEST_ASSERT(-1 == ec_glob_set_walk("/nonexistent/ec_glob", set,
+                                              count_walked, count));
+
+        // the parallel walkers report the same entries
+        struct ec_glob_walk_options options = {3, 0};
+        count[0] = count[1] = 0;
+        CX_TEST_ASSERT(0 == ec_glob_set_walk_parallel(root, set, &options,
+                                                      count_walked, count));
+        CX_TEST_ASSERT(count[0] == 4 && count[1] == 5);
+        CX_TEST_ASSERT(42 == ec_glob_set_walk_parallel(root, set, &options,
+                                                       stop_walk, NULL));
+        CX_TEST_ASSERT(-1 == ec_glob_set_walk_parallel("/nonexistent/ec_glob",
+                set, NULL, count_walked, count));
+
+        // and in the same order, if requested
+        char expected[256] = "", actual[256] = "";
+        options.ordered = 1;
+        CX_TEST_ASSERT(0 == ec_glob_set_walk(root, set, collect_walked,
+                                             expected));
+        CX_TEST_ASSERT(0 == ec_glob_set_walk_parallel(root, set, &options,
+                                                      collect_walked, actual));
+        CX_TEST_ASSERT(0 == strcmp(expected, actual));
+        CX_TEST_ASSERT(42 == ec_glob_set_walk_parallel(root, set, &options,
+                                                       stop_walk, NULL));
+        ec_glob_set_free(set);
+
+        count[0] = 0;
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "src/**/*.c"));
+        CX_TEST_ASSERT(0 == ec_glob_walk_parallel(root, glob, NULL,
+                                                  count_walked, count));
+        CX_TEST_ASSERT(count[0] == 2);
+        ec_glob_free(glob);
+
+        for (unsigned i = 4 ; i-- > 0 ;) {
+            snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+            remove(path);
+        }
+        for (unsigned i = 3 ; i-- > 0 ;) {
+            snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+            remove(path);
+        }
+        remove(root);
+    }
+}
+
+CX_TEST(test_walk_deep) {
+    char root[] = "/tmp/ec_glob_walk_XXXXXX";
+    char name[61];
+    memset(name, 'd', 60);
+    name[60] = '\0';
+    int fds[81];
+    CX_TEST_DO {
+        // a file whose path is longer than PATH_MAX
+        CX_TEST_ASSERT(NULL != mkdtemp(root));
+        fds[0] = open(root, O_RDONLY | O_DIRECTORY);
+        CX_TEST_ASSERT(fds[0] >= 0);
+        for (unsigned i = 0 ; i < 80 ; i++) {
+            CX_TEST_ASSERT(0 == mkdirat(fds[i], name, 0700));
+            fds[i + 1] = openat(fds[i], name, O_RDONLY | O_DIRECTORY);
+            CX_TEST_ASSERT(fds[i + 1] >= 0);
+        }
+        int fd = openat(fds[80], "deep.c", O_WRONLY | O_CREAT, 0600);
+        CX_TEST_ASSERT(fd >= 0);
+        close(fd);
+
+        ec_glob_t *glob;
+        unsigned count[2] = {0, 0};
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "**.c"));
+        CX_TEST_ASSERT(0 == ec_glob_walk(root, glob, count_walked, count));
+        CX_TEST_ASSERT(count[0] == 1);
+        struct ec_glob_walk_options options = {2, 0};
+        for (options.ordered = 0 ; options.ordered < 2 ; options.ordered++) {
+            count[0] = 0;
+            CX_TEST_ASSERT(0 == ec_glob_walk_parallel(root, glob, &options,
+                                                      count_walked, count));
+            CX_TEST_ASSERT(count[0] == 1);
+        }
+        ec_glob_free(glob);
+
+        unlinkat(fds[80], "deep.c", 0);
+        close(fds[80]);
+        for (unsigned i = 80 ; i-- > 0 ;) {
+            unlinkat(fds[i], name, AT_REMOVEDIR);
+            close(fds[i]);
+        }
+        remove(root);
+    }
+}
+
+// a tree with more levels than the walker may keep open
+CX_TEST(test_walk_stack) {
+    char root[] = "/tmp/ec_glob_walk_XXXXXX";
+    static char path[2048];
+    const unsigned depth = 600;
+    struct rlimit limit, lowered;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(NULL != mkdtemp(root));
+        size_t rootlen = strlen(root), len = rootlen;
+        memcpy(path, root, len + 1);
+        // every level has a file next to the subdirectory, which must be
+        // read after returning from the subdirectory in half of the cases
+        for (unsigned i = 0 ; i < depth ; i++, len += 2) {
+            memcpy(path + len, "/e", 3);
+            CX_TEST_ASSERT(0 == mkdir(path, 0700));
+            memcpy(path + len, "/e/x.c", 7);
+            int fd = open(path, O_WRONLY | O_CREAT, 0600);
+            CX_TEST_ASSERT(fd >= 0);
+            close(fd);
+            memcpy(path + len, "/d", 3);
+            CX_TEST_ASSERT(0 == mkdir(path, 0700));
+        }
+
+        ec_glob_t *glob;
+        unsigned count[2] = {0, 0};
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "**.c"));
+        CX_TEST_ASSERT(0 == getrlimit(RLIMIT_NOFILE, &limit));
+        lowered = limit;
+        if (lowered.rlim_cur > 300) lowered.rlim_cur = 300;
+        CX_TEST_ASSERT(0 == setrlimit(RLIMIT_NOFILE, &lowered));
+        int status = ec_glob_walk(root, glob, count_walked, count);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        CX_TEST_ASSERT(status == 0);
+        CX_TEST_ASSERT(count[0] == depth);
+        ec_glob_free(glob);
+
+        for (unsigned i = depth + 1 ; i-- > 0 ; ) {
+            len = rootlen + 2 * i;
+            if (i < depth) {
+                memcpy(path + len, "/e/x.c", 7);
+                unlink(path);
+                memcpy(path + len, "/e", 3);
+                rmdir(path);
+            }
+            path[len] = '\0';
+            rmdir(path);
+        }
+    }
+}
+
+static int collect_property(const char *name, const char *value,
+                            void *data) {
+    char *props = data;
+    size_t len = strlen(props);
+    snprintf(props + len, 256 - len, "%s=%s;", name, value);
+    return 0;
+}
+
+static int stop_property(const char *name, const char *value, void *data) {
+    (void) name;
+    (void) value;
+    (void) data;
+    return 42;
+}
+
+static void write_file(const char *root, const char *name, const char *text) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *f = fopen(path, "w");
+    if (f != NULL) {
+        fputs(text, f);
+        fclose(f);
+    }
+}
+
+CX_TEST(test_resolver) {
+    char root[] = "/tmp/ec_glob_resolve_XXXXXX";
+    char path[64];
+    char props[256];
+    ec_glob_resolver_t *resolver;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(NULL != mkdtemp(root));
+        snprintf(path, sizeof(path), "%s/src", root);
+        CX_TEST_ASSERT(0 == mkdir(path, 0700));
+        write_file(root, ".editorconfig",
+                "; preamble\n"
+                "root = TRUE\n"
+                "[*]\n"
+                "indent_style = space\n"
+                "indent_size = 4\n"
+                "\n"
+                "[*.{c,h}]\r\n"
+                "  Indent_Style = TAB\r\n"
+                "[Makefile]\n"
+                "indent_style = tab\n"
+                "# anchored to this directory\n"
+                "[/docs/*.md]\n"
+                "trim_trailing_whitespace = true\n");
+        write_file(root, "src/.editorconfig",
+                "[*.c]\n"
+                "indent_size = 2\n"
+                "custom = Value\n");
+
+        CX_TEST_ASSERT(0 == ec_glob_resolver_create(&resolver, NULL, NULL));
+        props[0] = '\0';
+        snprintf(path, sizeof(path), "%s/src/a.c", root);
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strcmp(props, "indent_style=tab;indent_size=2;"
+                                          "custom=Value;tab_width=2;"));
+        props[0] = '\0';
+        snprintf(path, sizeof(path), "%s/src/lib/b.h", root);
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strcmp(props, "indent_style=tab;indent_size=4;"
+                                          "tab_width=4;"));
+        props[0] = '\0';
+        snprintf(path, sizeof(path), "%s/docs/x.md", root);
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strcmp(props, "indent_style=space;indent_size=4;"
+                "trim_trailing_whitespace=true;tab_width=4;"));
+        props[0] = '\0';
+        snprintf(path, sizeof(path), "%s/src/docs/x.md", root);
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strcmp(props, "indent_style=space;"
+                                          "indent_size=4;tab_width=4;"));
+
+        // the directories are remembered until the resolver is cleared
+        write_file(root, "src/.editorconfig", "[*.c]\nindent_size = 8\n");
+        props[0] = '\0';
+        snprintf(path, sizeof(path), "%s/src/a.c", root);
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strncmp(props, "indent_style=tab;indent_size=2;",
+                                    31));
+        ec_glob_resolver_clear(resolver);
+        props[0] = '\0';
+        CX_TEST_ASSERT(0 == ec_glob_resolve(resolver, path,
+                                            collect_property, props));
+        CX_TEST_ASSERT(0 == strcmp(props, "indent_style=tab;indent_size=8;"
+                                          "tab_width=8;"));
+
+        CX_TEST_ASSERT(42 == ec_glob_resolve(resolver, path, stop_property,
+                                             NULL));
+        CX_TEST_ASSERT(-1 == ec_glob_resolve(resolver, "src/a.c",
+                                             collect_property, props));
+        ec_glob_resolver_free(resolver);
+
+        snprintf(path, sizeof(path), "%s/src/.editorconfig", root);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/src", root);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/.editorconfig", root);
+        remove(path);
+        remove(root);
+    }
+}
+
+// like the database, FNV-1a over 64-bit words after the header
+static uint64_t db_checksum(const unsigned char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for ( ; i + 8 <= size ; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for ( ; i < size ; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// overwrites every word of the file with an index beyond every array,
+// which is small enough for the bitmap of the set in case it is the count
+CX_TEST_SUBROUTINE(verify_db_damaged, const char *path,
+                   const char * const *strs, unsigned count) {
+    enum { header = 40, checksum = 24 };
+    static unsigned char data[65536], copy[65536];
+    FILE *f = fopen(path, "r");
+    CX_TEST_ASSERT(f != NULL);
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    CX_TEST_ASSERT(size > header && size < sizeof(data));
+    unsigned rejected = 0;
+    for (size_t offset = header ; offset + 4 <= size ; offset += 4) {
+        memcpy(copy, data, size);
+        uint32_t index = 0xFFF0;
+        memcpy(copy + offset, &index, sizeof(index));
+        uint64_t hash = db_checksum(copy + header, size - header);
+        memcpy(copy + checksum, &hash, sizeof(hash));
+        f = fopen(path, "w");
+        CX_TEST_ASSERT(f != NULL);
+        CX_TEST_ASSERT(size == fwrite(copy, 1, size, f));
+        fclose(f);
+
+        ec_glob_db_t *db;
+        CX_TEST_ASSERT(0 == ec_glob_db_open(&db, path));
+        for (unsigned i = 0 ; i < ec_glob_db_glob_count(db) ; i++) {
+            ec_glob_t *glob;
+            if (ec_glob_db_glob(db, i, &glob) != 0) {
+                rejected++;
+                continue;
+            }
+            for (unsigned k = 0 ; k < count ; k++) {
+                ec_glob_exec(glob, strs[k]);
+            }
+            ec_glob_free(glob);
+        }
+        ec_glob_set_t *set;
+        if (ec_glob_db_set(db, 0, &set) == 0) {
+            static unsigned char matches[0x10000 / 8];
+            for (unsigned k = 0 ; k < count ; k++) {
+                ec_glob_set_exec(set, strs[k], matches);
+            }
+            ec_glob_set_free(set);
+        } else {
+            rejected++;
+        }
+        ec_glob_db_close(db);
+    }
+    CX_TEST_ASSERT(rejected > 0);
+}
+
+CX_TEST(test_db) {
+    static const char *strs[] = {
+            "main.c", "src/main.c", "src/lib/util.h", "Makefile", "{,9",
+            "a/b.orig.7", "a/b.orig.10", "docs/notes.txt", "",
+    };
+    char path[] = "/tmp/ec_glob_db_XXXXXX";
+    ec_glob_t *globs[sizeof(set_patterns) / sizeof(set_patterns[0])];
+    ec_glob_set_t *set;
+    ec_glob_db_t *db;
+    CX_TEST_DO {
+        int fd = mkstemp(path);
+        CX_TEST_ASSERT(fd >= 0);
+        close(fd);
+        for (unsigned i = 0 ; i < set_count ; i++) {
+            CX_TEST_ASSERT(0 == ec_glob_compile(&globs[i], set_patterns[i]));
+        }
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, set_patterns, set_count));
+        CX_TEST_ASSERT(0 == ec_glob_db_save(path,
+                (const ec_glob_t * const *) globs, set_count,
+                (const ec_glob_set_t * const *) &set, 1));
+        for (unsigned i = 0 ; i < set_count ; i++) {
+            ec_glob_free(globs[i]);
+        }
+        ec_glob_set_free(set);
+
+        CX_TEST_ASSERT(0 == ec_glob_db_open(&db, path));
+        CX_TEST_ASSERT(set_count == ec_glob_db_glob_count(db));
+        CX_TEST_ASSERT(1 == ec_glob_db_set_count(db));
+        for (unsigned i = 0 ; i < set_count ; i++) {
+            ec_glob_t *glob;
+            CX_TEST_ASSERT(0 == ec_glob_db_glob(db, i, &glob));
+            for (unsigned k = 0 ; k < sizeof(strs) / sizeof(strs[0]) ; k++) {
+                CX_TEST_ASSERT(ec_glob(set_patterns[i], strs[k])
+                               == ec_glob_exec(glob, strs[k]));
+            }
+            ec_glob_free(glob);
+        }
+        CX_TEST_ASSERT(0 == ec_glob_db_set(db, 0, &set));
+        for (unsigned k = 0 ; k < sizeof(strs) / sizeof(strs[0]) ; k++) {
+            CX_TEST_CALL_SUBROUTINE(verify_ec_glob_set, set, strs[k]);
+        }
+        ec_glob_set_free(set);
+        CX_TEST_ASSERT(-1 == ec_glob_db_set(db, 1, &set));
+        CX_TEST_ASSERT(NULL == set);
+        ec_glob_db_close(db);
+
+        // a damaged file is rejected
+        FILE *f = fopen(path, "r+");
+        CX_TEST_ASSERT(f != NULL);
+        fseek(f, -1, SEEK_END);
+        int c = fgetc(f);
+        fseek(f, -1, SEEK_END);
+        fputc(c ^ 1, f);
+        fclose(f);
+        CX_TEST_ASSERT(-1 == ec_glob_db_open(&db, path));
+        CX_TEST_ASSERT(EINVAL == errno && NULL == db);
+
+        // so is every entry with an index out of bounds, even with a valid
+        // checksum, and the others are matched within the file
+        f = fopen(path, "r+");
+        CX_TEST_ASSERT(f != NULL);
+        fseek(f, -1, SEEK_END);
+        fputc(c, f);
+        fclose(f);
+        CX_TEST_CALL_SUBROUTINE(verify_db_damaged, path, strs,
+                                sizeof(strs) / sizeof(strs[0]));
+        remove(path);
+    }
+}
+
+// every engine must agree with ec_glob(), whichever was chosen
+CX_TEST(test_engines) {
+    static const char *engines[] = {
+            "regex", "native", "dfa", "bitap", "pike", "auto"
+    };
+    static const char *strs[] = {
+            "main.c", "src/main.c", "src/lib/util.h", "Makefile", "{,9",
+            "a/b.orig.7", "a/b.orig.10", "docs/notes.txt", "",
+    };
+    ec_glob_t *glob;
+    CX_TEST_DO {
+        for (unsigned e = 0 ; e < sizeof(engines) / sizeof(engines[0]) ; e++) {
+            for (unsigned i = 0 ; i < set_count ; i++) {
+                CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob,
+                        set_patterns[i], engines[e]));
+                for (unsigned k = 0 ; k < sizeof(strs) / sizeof(strs[0]) ; k++) {
+                    CX_TEST_ASSERT(ec_glob(set_patterns[i], strs[k])
+                                   == ec_glob_exec(glob, strs[k]));
+                }
+                if (e < 5) {
+                    CX_TEST_ASSERT(0 == strcmp(engines[e],
+                                               ec_glob_engine_name(glob)));
+                }
+                ec_glob_free(glob);
+            }
+        }
+
+        // the cost model
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "**/*.c", "auto"));
+        CX_TEST_ASSERT(0 == strcmp("shape", ec_glob_engine_name(glob)));
+        ec_glob_free(glob);
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "lib/**.js", "auto"));
+        CX_TEST_ASSERT(0 == strcmp("native", ec_glob_engine_name(glob)));
+        ec_glob_free(glob);
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "**/*.orig.{0..9}",
+                                                  "auto"));
+        CX_TEST_ASSERT(0 == strcmp("dfa", ec_glob_engine_name(glob)));
+        ec_glob_free(glob);
+
+        // sets of positions of several words, and the fallback to the DFA
+        char pattern[400], string[400];
+        memset(pattern, '?', 300);
+        memset(string, 'x', 300);
+        for (unsigned len = 60 ; len <= 300 ; len += 60) {
+            strcpy(pattern + len, "{*/,}*.c");
+            strcpy(string + len, "/main.c");
+            CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, pattern, "bitap"));
+            CX_TEST_ASSERT(0 == strcmp(len < 300 ? "bitap" : "dfa",
+                                       ec_glob_engine_name(glob)));
+            CX_TEST_ASSERT(0 == ec_glob_exec(glob, string));
+            strcpy(string + len, ".c");
+            CX_TEST_ASSERT(0 == ec_glob_exec(glob, string));
+            CX_TEST_ASSERT(0 != ec_glob_exec(glob, string + 1));
+            memset(pattern + len, '?', sizeof("{*/,}*.c"));
+            memset(string + len, 'x', sizeof("/main.c"));
+            ec_glob_free(glob);
+        }
+
+        // the memo of the native engine does not fit on the stack
+        char many[1002];
+        memset(many, 'a', 1000);
+        many[1000] = '\0';
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "*a*a*a*a*[bc]",
+                                                  "native"));
+        CX_TEST_ASSERT(0 != ec_glob_exec(glob, many));
+        strcpy(many + 1000, "c");
+        CX_TEST_ASSERT(0 == ec_glob_exec(glob, many));
+        ec_glob_free(glob);
+
+        // a state of the DFA which does not fit into its cache
+        char *wide = malloc(5000 * 6 + 3);
+        CX_TEST_ASSERT(wide != NULL);
+        size_t widelen = 0;
+        for (unsigned i = 0 ; i < 5000 ; i++) {
+            widelen += sprintf(wide + widelen, "%sx%u", i ? "," : "*{", i);
+        }
+        strcpy(wide + widelen, "}");
+        const char *paths = "ax5ax5000bx4999";
+        const size_t offsets[] = { 0, 3, 9, 15 };
+        unsigned char matches[1];
+        for (unsigned e = 0 ; e < 2 ; e++) {
+            CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, wide,
+                                                      e ? "auto" : "dfa"));
+            CX_TEST_ASSERT(0 == ec_glob_exec(glob, "ax5"));
+            CX_TEST_ASSERT(0 != ec_glob_exec(glob, "ax5000"));
+            CX_TEST_ASSERT(0 == ec_glob_exec_batch(glob, paths, offsets, 3,
+                                                   matches));
+            CX_TEST_ASSERT(matches[0] == 5);
+            ec_glob_free(glob);
+        }
+        CX_TEST_ASSERT(0 == ec_glob(wide, "ax5"));
+        free(wide);
+
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "*.{c,h}", "shape"));
+        CX_TEST_ASSERT(0 == strcmp("shape", ec_glob_engine_name(glob)));
+        CX_TEST_ASSERT(0 == ec_glob_exec(glob, "main.h"));
+        ec_glob_free(glob);
+        CX_TEST_ASSERT(0 != ec_glob_compile_using(&glob, "src/*.c", "shape"));
+        CX_TEST_ASSERT(glob == NULL);
+        CX_TEST_ASSERT(0 != ec_glob_compile_using(&glob, "*.c", "unknown"));
+        CX_TEST_ASSERT(glob == NULL);
+    }
+}
+
+// deep patterns run in a thread whose stack is much smaller than the default
+static void *native_deep(void *data) {
+    int *results = data;
+    enum { n = 2000 };
+    char *pattern = malloc(2 * n + 1);
+    char *string = malloc(n + 1);
+    if (pattern == NULL || string == NULL) {
+        free(pattern);
+        free(string);
+        return NULL;
+    }
+    for (unsigned i = 0 ; i < n ; i++) {
+        pattern[2 * i] = '*';
+        pattern[2 * i + 1] = 'a';
+        string[i] = 'a';
+    }
+    pattern[2 * n] = '\0';
+    string[n] = '\0';
+    ec_glob_t *glob;
+    if (ec_glob_compile_using(&glob, pattern, "native") == 0) {
+        results[0] = ec_glob_exec(glob, string);
+        results[1] = ec_glob_exec(glob, string + 1);
+        ec_glob_free(glob);
+    }
+    free(pattern);
+    free(string);
+    return NULL;
+}
+
+CX_TEST(test_native_deep) {
+    int results[2] = { -1, -1 };
+    pthread_attr_t attr;
+    pthread_t thread;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == pthread_attr_init(&attr));
+        CX_TEST_ASSERT(0 == pthread_attr_setstacksize(&attr, 64 * 1024));
+        CX_TEST_ASSERT(0 == pthread_create(&thread, &attr, native_deep,
+                                           results));
+        CX_TEST_ASSERT(0 == pthread_join(thread, NULL));
+        pthread_attr_destroy(&attr);
+        CX_TEST_ASSERT(results[0] == 0);
+        CX_TEST_ASSERT(results[1] == 1);
+    }
+}
+
+static const char * const dfa_shared_patterns[] = {
+    "*a?????????", "*b????????.c", "**/*.{c,h}"
+};
+
+struct dfa_shared {
+    const ec_glob_t *glob;
+    const ec_glob_set_t *set;
+    ec_glob_t *reference[3];
+    unsigned seed;
+    unsigned mismatches;
+};
+
+// many threads match against the same DFAs, whose caches are flushed often
+static void *dfa_shared(void *data) {
+    struct dfa_shared *ctx = data;
+    char string[24];
+    for (unsigned i = 0 ; i < 3000 ; i++) {
+        for (unsigned k = 0 ; k < sizeof(string) - 1 ; k++) {
+            ctx->seed = ctx->seed * 1103515245u + 12345u;
+            string[k] = "ab/.ch"[(ctx->seed >> 16) % 6];
+        }
+        string[8 + i % 15] = '\0';
+        if (ec_glob_exec(ctx->glob, string)
+                != ec_glob_exec(ctx->reference[0], string)) {
+            ctx->mismatches++;
+        }
+        unsigned char matches[1];
+        unsigned char expected = 0;
+        for (unsigned k = 0 ; k < 3 ; k++) {
+            if (ec_glob_exec(ctx->reference[k], string) == 0) {
+                expected |= 1u << k;
+            }
+        }
+        int found = ec_glob_set_exec(ctx->set, string, matches);
+        if (found != __builtin_popcount(expected) || matches[0] != expected) {
+            ctx->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+CX_TEST(test_dfa_shared) {
+    ec_glob_t *glob = NULL;
+    ec_glob_set_t *set = NULL;
+    struct dfa_shared ctx[4];
+    pthread_t threads[4];
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob,
+                dfa_shared_patterns[0], "dfa"));
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, dfa_shared_patterns, 3));
+        for (unsigned t = 0 ; t < 4 ; t++) {
+            ctx[t].glob = glob;
+            ctx[t].set = set;
+            for (unsigned k = 0 ; k < 3 ; k++) {
+                CX_TEST_ASSERT(0 == ec_glob_compile_using(
+                        &ctx[t].reference[k], dfa_shared_patterns[k], "pike"));
+            }
+            ctx[t].seed = t;
+            ctx[t].mismatches = 0;
+        }
+        for (unsigned t = 0 ; t < 4 ; t++) {
+            CX_TEST_ASSERT(0 == pthread_create(&threads[t], NULL,
+                                               dfa_shared, &ctx[t]));
+        }
+        for (unsigned t = 0 ; t < 4 ; t++) {
+            CX_TEST_ASSERT(0 == pthread_join(threads[t], NULL));
+            CX_TEST_ASSERT(ctx[t].mismatches == 0);
+            for (unsigned k = 0 ; k < 3 ; k++) {
+                ec_glob_free(ctx[t].reference[k]);
+            }
+        }
+        ec_glob_set_free(set);
+        ec_glob_free(glob);
+    }
+}
+
+// the spans of the num ranges, recorded by the Pike VM
+CX_TEST(test_exec_ranges) {
+    static const char *engines[] = { "pike", "native", "dfa" };
+    ec_glob_t *glob;
+    size_t spans[4];
+    CX_TEST_DO {
+        for (unsigned e = 0 ; e < sizeof(engines) / sizeof(engines[0]) ; e++) {
+            CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob,
+                    "*.{orig,{0..9}.v{10..20}}", engines[e]));
+            CX_TEST_ASSERT(0 == ec_glob_exec_ranges(glob, "a.7.v12", spans, 2));
+            CX_TEST_ASSERT(spans[0] == 2 && spans[1] == 3);
+            CX_TEST_ASSERT(spans[2] == 5 && spans[3] == 7);
+
+            // the groups outside the match, and only the requested ones
+            spans[2] = spans[3] = 42;
+            CX_TEST_ASSERT(0 == ec_glob_exec_ranges(glob, "a.orig", spans, 1));
+            CX_TEST_ASSERT(spans[0] == (size_t) -1 && spans[1] == (size_t) -1);
+            CX_TEST_ASSERT(spans[2] == 42 && spans[3] == 42);
+
+            // no match leaves the spans alone
+            spans[0] = 42;
+            CX_TEST_ASSERT(0 != ec_glob_exec_ranges(glob, "a.7.v21", spans, 2));
+            CX_TEST_ASSERT(0 != ec_glob_exec_ranges(glob, "a.c", spans, 2));
+            CX_TEST_ASSERT(spans[0] == 42);
+            CX_TEST_ASSERT(0 == ec_glob_exec_ranges(glob, "a.orig", NULL, 0));
+            ec_glob_free(glob);
+        }
+
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, "*.{3..30}",
+                                                  "auto"));
+        CX_TEST_ASSERT(0 == ec_glob_exec_ranges(glob, "x.y.12", spans, 4));
+        CX_TEST_ASSERT(spans[0] == 4 && spans[1] == 6);
+        ec_glob_free(glob);
+
+        // the time stays linear where backtracking would not
+        char string[4001];
+        memset(string, 'a', 4000);
+        string[4000] = '\0';
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob,
+                "*a*a*a*a*a*a*a*a*a*a*a*a*{0..9}", "pike"));
+        CX_TEST_ASSERT(0 != ec_glob_exec(glob, string));
+        string[3999] = '5';
+        CX_TEST_ASSERT(0 == ec_glob_exec_ranges(glob, string, spans, 1));
+        CX_TEST_ASSERT(spans[0] == 3999 && spans[1] == 4000);
+        ec_glob_free(glob);
+    }
+}
+
+// fills the pattern with as many units as fit between the head and the tail
+static void fill_pattern(char *pattern, size_t size, const char *head,
+                         const char *unit, const char *tail) {
+    size_t len = strlen(head), unitlen = strlen(unit), taillen = strlen(tail);
+    memcpy(pattern, head, len);
+    while (len + unitlen + taillen <= size) {
+        memcpy(pattern + len, unit, unitlen);
+        len += unitlen;
+    }
+    memcpy(pattern + len, tail, taillen + 1);
+}
+
+// the best of three compilations, in nanoseconds per pattern byte
+static double compile_time(const char *pattern, size_t size) {
+    double best = 0;
+    for (unsigned r = 0 ; r < 3 ; r++) {
+        struct timespec start, end;
+        ec_glob_t *glob;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int status = ec_glob_compile_using(&glob, pattern, "native");
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (status == 0) ec_glob_free(glob);
+        double t = (end.tv_sec - start.tv_sec) * 1e9
+                + (end.tv_nsec - start.tv_nsec);
+        if (r == 0 || t < best) best = t;
+    }
+    return best / size;
+}
+
+// adversarial patterns must compile in linear time: a quadratic parser
+// would spend 64 times as long per byte on the large pattern
+CX_TEST(test_complexity) {
+    static const char *patterns[][3] = {
+        { "", "[", "" },
+        { "", "[a", "" },
+        { "", "[a-z]", "" },
+        { "", "[]", "" },
+        { "", "{", "" },
+        { "", "{1", "" },
+        { "", "{1..2", "" },
+        { "", "{x,", "" },
+        { "", "\\{", "" },
+        { "", "**/", "*.c" },
+        { "", "{a,b}", "" },
+        { "", "{a,{b,c}}", "" },
+        { "{", "a,", "a}" },
+        { "{", "*ab,", "*b}" },
+        { "{", "aa*,a*,", "a}" },
+        { "", "{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{x", "" },
+    };
+    const size_t small = 16 * 1024, large = 1024 * 1024;
+    char *pattern = malloc(large + 64);
+    CX_TEST_DO {
+        CX_TEST_ASSERT(pattern != NULL);
+        for (unsigned i = 0 ; i < sizeof(patterns) / sizeof(patterns[0]) ; i++) {
+            fill_pattern(pattern, small, patterns[i][0], patterns[i][1],
+                         patterns[i][2]);
+            double per_byte = compile_time(pattern, small);
+            fill_pattern(pattern, large, patterns[i][0], patterns[i][1],
+                         patterns[i][2]);
+            CX_TEST_ASSERT(compile_time(pattern, large) < 8 * per_byte + 10);
+        }
+    }
+    free(pattern);
+}
+
+// feeding the components one by one must agree with the whole path
+CX_TEST_SUBROUTINE(verify_ec_glob_state, const char *pattern,
+                   const char *engine) {
+    static const char *dirs[][3] = {
+            { "", "", "" }, { "src", "", "" }, { "src", "lib", "" },
+            { "a", "", "" }, { "docs", "old", "" }, { "", "src", "" },
+    };
+    static const char *names[] = {
+            "main.c", "util.h", "Makefile", "b.orig.7", "b.orig.10",
+            "notes.txt", "{,9", "",
+    };
+    ec_glob_t *glob;
+    ec_glob_state_t *dirstate, *state;
+    char path[64];
+    CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, pattern, engine));
+    for (unsigned d = 0 ; d < sizeof(dirs) / sizeof(dirs[0]) ; d++) {
+        CX_TEST_ASSERT(0 == ec_glob_state_init(&dirstate, glob));
+        path[0] = '\0';
+        for (unsigned c = 0 ; c < 3 && (c == 0 || dirs[d][c][0]) ; c++) {
+            if (c > 0) strcat(path, "/");
+            strcat(path, dirs[d][c]);
+            CX_TEST_ASSERT((0 == ec_glob_state_feed(dirstate, dirs[d][c]))
+                           == (0 == ec_glob(pattern, path)));
+        }
+        strcat(path, "/");
+        size_t dirlen = strlen(path);
+        _Bool dead = ec_glob_state_dead(dirstate);
+        for (unsigned n = 0 ; n < sizeof(names) / sizeof(names[0]) ; n++) {
+            CX_TEST_ASSERT(0 == ec_glob_state_clone(&state, dirstate));
+            strcpy(path + dirlen, names[n]);
+            _Bool match = 0 == ec_glob(pattern, path);
+            CX_TEST_ASSERT(match == (0 == ec_glob_state_feed(state, names[n])));
+            // a dead state never matches below
+            CX_TEST_ASSERT(!dead || !match);
+            ec_glob_state_free(state);
+        }
+        ec_glob_state_free(dirstate);
+    }
+    ec_glob_free(glob);
+}
+
+CX_TEST(test_state) {
+    ec_glob_t *glob;
+    ec_glob_state_t *state;
+    CX_TEST_DO {
+        for (unsigned i = 0 ; i < set_count ; i++) {
+            CX_TEST_CALL_SUBROUTINE(verify_ec_glob_state,
+                                    set_patterns[i], "native");
+            CX_TEST_CALL_SUBROUTINE(verify_ec_glob_state,
+                                    set_patterns[i], "dfa");
+        }
+
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "src/**/*.c"));
+        CX_TEST_ASSERT(0 == ec_glob_state_init(&state, glob));
+        CX_TEST_ASSERT(!ec_glob_state_dead(state));
+        CX_TEST_ASSERT(0 != ec_glob_state_feed(state, "docs"));
+        CX_TEST_ASSERT(ec_glob_state_dead(state));
+        CX_TEST_ASSERT(0 != ec_glob_state_feed(state, "main.c"));
+        ec_glob_state_free(state);
+        CX_TEST_ASSERT(0 == ec_glob_state_init(&state, glob));
+        CX_TEST_ASSERT(0 != ec_glob_state_feed(state, "src"));
+        CX_TEST_ASSERT(!ec_glob_state_dead(state));
+        CX_TEST_ASSERT(0 == ec_glob_state_feed(state, "main.c"));
+        // main.c may still be a directory
+        CX_TEST_ASSERT(!ec_glob_state_dead(state));
+        ec_glob_state_free(state);
+        ec_glob_free(glob);
+
+        // a DFA state which does not fit into the cache is not a dead one
+        char *wide = malloc(5000 * 6 + 8);
+        CX_TEST_ASSERT(wide != NULL);
+        size_t widelen = sprintf(wide, "src/*{");
+        for (unsigned i = 0 ; i < 5000 ; i++) {
+            widelen += sprintf(wide + widelen, "%sx%u", i ? "," : "", i);
+        }
+        strcpy(wide + widelen, "}");
+        CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, wide, "dfa"));
+        CX_TEST_ASSERT(0 == ec_glob_state_init(&state, glob));
+        CX_TEST_ASSERT(0 != ec_glob_state_feed(state, "src"));
+        CX_TEST_ASSERT(0 != ec_glob_state_feed(state, "ax5"));
+        CX_TEST_ASSERT(!ec_glob_state_dead(state));
+        ec_glob_state_free(state);
+        ec_glob_free(glob);
+        free(wide);
+    }
+}
+
+static const char *index_paths[] = {
+        "src/main.c", "src/lib/util.h", "Makefile", "src/main.c", "",
+        "a/b.orig.7", "a/b.orig.10", "docs/notes.txt", "src", "src/Makefile",
+        "{,9", "main.c", "src/lib/util.c", "notes.txt", "a/b.orig.7/x",
+};
+#define INDEX_PATH_COUNT (sizeof(index_paths) / sizeof(index_paths[0]))
+
+struct index_result {
+    unsigned count;
+    unsigned char found[INDEX_PATH_COUNT];
+    unsigned char matches[INDEX_PATH_COUNT][1];
+};
+
+static int collect_index(size_t id, const unsigned char *matches, void *data) {
+    struct index_result *result = data;
+    result->count++;
+    result->found[id]++;
+    if (matches != NULL) result->matches[id][0] = matches[0];
+    return 0;
+}
+
+static int stop_index(size_t id, const unsigned char *matches, void *data) {
+    (void) id;
+    (void) matches;
+    (void) data;
+    return 42;
+}
+
+CX_TEST(test_pathindex) {
+    ec_glob_pathindex_t *index;
+    ec_glob_t *glob;
+    ec_glob_set_t *set;
+    struct index_result result;
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == ec_glob_pathindex_create(&index, index_paths,
+                                                     INDEX_PATH_COUNT));
+        CX_TEST_ASSERT(ec_glob_pathindex_size(index) > 0);
+        // the DFA prunes, while the other engines may scan the paths
+        for (unsigned i = 0 ; i < 2 * set_count ; i++) {
+            const char *pattern = set_patterns[i / 2];
+            memset(&result, 0, sizeof(result));
+            CX_TEST_ASSERT(0 == ec_glob_compile_using(&glob, pattern,
+                    i % 2 ? "dfa" : NULL));
+            CX_TEST_ASSERT(0 == ec_glob_pathindex_match(index, glob,
+                    collect_index, &result));
+            for (unsigned k = 0 ; k < INDEX_PATH_COUNT ; k++) {
+                CX_TEST_ASSERT(result.found[k]
+                               == (0 == ec_glob(pattern, index_paths[k])));
+            }
+            ec_glob_free(glob);
+        }
+
+        // the sample patterns fit into one byte of matches
+        CX_TEST_ASSERT(set_count <= 8);
+        memset(&result, 0, sizeof(result));
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, set_patterns, set_count));
+        CX_TEST_ASSERT(0 == ec_glob_pathindex_set_match(index, set,
+                collect_index, &result));
+        for (unsigned k = 0 ; k < INDEX_PATH_COUNT ; k++) {
+            unsigned char expected = 0;
+            for (unsigned i = 0 ; i < set_count ; i++) {
+                expected |= (0 == ec_glob(set_patterns[i],
+                                          index_paths[k])) << i;
+            }
+            CX_TEST_ASSERT(result.found[k] == (expected != 0));
+            CX_TEST_ASSERT(result.matches[k][0] == expected);
+        }
+        CX_TEST_ASSERT(42 == ec_glob_pathindex_set_match(index, set,
+                stop_index, NULL));
+        ec_glob_set_free(set);
+        ec_glob_pathindex_free(index);
+
+        // the matchers take their scratch memory from the index allocator,
+        // whether they prune with the DFA or scan the paths
+        struct test_allocator a = { (size_t) -1, 0, 0 };
+        struct ec_glob_allocator allocator = {
+                test_alloc, test_realloc, test_free, &a
+        };
+        CX_TEST_ASSERT(0 == ec_glob_pathindex_create_with(&index, index_paths,
+                INDEX_PATH_COUNT, &allocator));
+        CX_TEST_ASSERT(a.live == 1);
+        const char *patterns[] = { "src/**", "*.c" };
+        for (unsigned i = 0 ; i < 2 ; i++) {
+            CX_TEST_ASSERT(0 == ec_glob_compile(&glob, patterns[i]));
+            a.limit = a.used;
+            errno = 0;
+            CX_TEST_ASSERT(-1 == ec_glob_pathindex_match(index, glob,
+                    collect_index, &result));
+            CX_TEST_ASSERT(errno == ENOMEM);
+            a.limit = (size_t) -1;
+            memset(&result, 0, sizeof(result));
+            CX_TEST_ASSERT(0 == ec_glob_pathindex_match(index, glob,
+                    collect_index, &result));
+            for (unsigned k = 0 ; k < INDEX_PATH_COUNT ; k++) {
+                CX_TEST_ASSERT(result.found[k]
+                               == (0 == ec_glob(patterns[i], index_paths[k])));
+            }
+            CX_TEST_ASSERT(a.live == 1);
+            ec_glob_free(glob);
+        }
+        ec_glob_pathindex_free(index);
+        CX_TEST_ASSERT(a.live == 0 && a.used == 0);
+
+        CX_TEST_ASSERT(0 == ec_glob_pathindex_create(&index, NULL, 0));
+        CX_TEST_ASSERT(0 == ec_glob_compile(&glob, "**"));
+        memset(&result, 0, sizeof(result));
+        CX_TEST_ASSERT(0 == ec_glob_pathindex_match(index, glob,
+                collect_index, &result));
+        CX_TEST_ASSERT(0 == result.count);
+        ec_glob_free(glob);
+        ec_glob_pathindex_free(index);
+    }
+}
+
+CX_TEST(test_set_empty) {
+    ec_glob_set_t *set;
+    unsigned char matches[1] = {0xFF};
+    CX_TEST_DO {
+        CX_TEST_ASSERT(0 == ec_glob_set_compile(&set, NULL, 0));
+        CX_TEST_ASSERT(0 == ec_glob_set_exec(set, "test.c", matches));
+        CX_TEST_ASSERT(0 == ec_glob_set_precompile(set, 0));
+        CX_TEST_ASSERT(0 == ec_glob_set_exec(set, "test.c", matches));
+        ec_glob_set_free(set);
+    }
+}
+#endif
+
+#ifdef TEST_SHAPES
+CX_TEST(test_shapes_verified) {
+    CX_TEST_DO {
+        CX_TEST_ASSERT(shape_mismatches == 0);
+    }
+}
+#endif
+
+#ifdef TEST_CACHED
+CX_TEST(test_cache) {
+    struct ec_glob_cache_stats stats;
+    CX_TEST_DO {
+        ec_glob_cache_clear();
+        CX_TEST_ASSERT(0 == ec_glob("*.c", "test.c"));
+        CX_TEST_ASSERT(0 != ec_glob("*.c", "test.h"));
+        CX_TEST_ASSERT(0 == ec_glob("*.h", "test.h"));
+        ec_glob_cache_query(&stats);
+        CX_TEST_ASSERT(stats.hits == 1);
+        CX_TEST_ASSERT(stats.misses == 2);
+        CX_TEST_ASSERT(stats.entries == 2);
+        CX_TEST_ASSERT(stats.bytes > 0);
+
+        // invalid patterns are not cached
+        CX_TEST_ASSERT(0 != ec_glob("{,9/,00.[}!]", "test.c"));
+        ec_glob_cache_query(&stats);
+        CX_TEST_ASSERT(stats.entries == 2);
+
+        // a single entry per shard forces evictions
+        ec_glob_cache_configure(1, 1024 * 1024);
+        char pattern[16];
+        for (unsigned i = 0 ; i < 100 ; i++) {
+            snprintf(pattern, sizeof(pattern), "*.%u", i);
+            CX_TEST_ASSERT(0 == ec_glob(pattern, pattern + 1));
+        }
+        ec_glob_cache_query(&stats);
+        CX_TEST_ASSERT(stats.evictions > 0);
+        CX_TEST_ASSERT(stats.entries > 0);
+        CX_TEST_ASSERT(stats.entries < 100);
+
+        // disabling the cache releases all entries
+        ec_glob_cache_configure(0, 0);
+        CX_TEST_ASSERT(0 == ec_glob("*.c", "test.c"));
+        ec_glob_cache_query(&stats);
+        CX_TEST_ASSERT(stats.entries == 0);
+        CX_TEST_ASSERT(stats.bytes == 0);
+
+        ec_glob_cache_configure(16, 64 * 1024);
+    }
+}
+#endif
+
 
 int main(void) {
 
+#ifdef TEST_CACHED
+    // run all test cases through a small cache to also exercise evictions
+    ec_glob_cache_configure(16, 64 * 1024);
+#endif
+
     CxTestSuite *suite = cx_test_suite_new("ec_glob");
 
     cx_test_register(suite, test_match_all);
@@ -773,8 +2420,13 @@ int main(void) {
     cx_test_register(suite, test_single_nested_choice);
     cx_test_register(suite, test_escaped_comma_outside_choice);
     cx_test_register(suite, test_num_range_in_file_extension);
+    cx_test_register(suite, test_many_num_ranges);
+#ifndef TEST_REFERENCE
+    cx_test_register(suite, test_num_range_digit_prefix);
+#endif
     cx_test_register(suite, test_escaped_slash_in_brackets);
     cx_test_register(suite, test_auto_escape_bracket_and_minus_in_brackets);
+    cx_test_register(suite, test_empty_range_in_brackets);
 #ifndef TEST_EXCLUDE_EDITORCONFIG_CORE_C_BUG_101
     cx_test_register(suite, test_wildcard_in_brackets);
 #endif
@@ -815,6 +2467,37 @@ int main(void) {
     cx_test_register(suite, test_core_braces_14);
     cx_test_register(suite, test_core_braces_15);
     cx_test_register(suite, test_core_braces_16);
+    cx_test_register(suite, test_backtracking_time);
+    cx_test_register(suite, test_shapes);
+    cx_test_register(suite, test_optimizer);
+#ifdef TEST_COMPILED
+    cx_test_register(suite, test_set);
+    cx_test_register(suite, test_set_precompile);
+    cx_test_register(suite, test_set_empty);
+    cx_test_register(suite, test_batch);
+    cx_test_register(suite, test_batch_lanes);
+    cx_test_register(suite, test_allocator);
+    cx_test_register(suite, test_arena);
+    cx_test_register(suite, test_walk);
+    cx_test_register(suite, test_walk_deep);
+    cx_test_register(suite, test_walk_stack);
+    cx_test_register(suite, test_resolver);
+    cx_test_register(suite, test_db);
+    cx_test_register(suite, test_engines);
+    cx_test_register(suite, test_native_deep);
+    cx_test_register(suite, test_dfa_shared);
+    cx_test_register(suite, test_exec_ranges);
+    cx_test_register(suite, test_complexity);
+    cx_test_register(suite, test_state);
+    cx_test_register(suite, test_pathindex);
+#endif
+#ifdef TEST_CACHED
+    cx_test_register(suite, test_cache);
+#endif
+#ifdef TEST_SHAPES
+    // must run last
+    cx_test_register(suite, test_shapes_verified);
+#endif
 
     cx_test_run_stdout(suite);
     int result = suite->failure > 0;